@@ -19,16 +19,30 @@
 
 #include "stdafx.h"
 #include "Misc/Misc.h"
+#include "Misc/DxgiFormatHelper.h"
 #include "GltfHelpers.h"
 #include "Base/ShaderCompiler.h"
 #include "Misc/ThreadPool.h"
 #include "GLTFTexturesAndBuffers.h"
 #include "../common/GLTF/GltfPbrMaterial.h"
+#include "../common/GLTF/GltfMorphTargets.h"
 
 class DefineList;
 
 namespace CAULDRON_DX12
 {
+    // KHR_mesh_quantization, DX12 has no SCALED vertex formats so the integer attributes that are not normalized (quantized positions and uvs)
+    // are uploaded as they are with SINT/UINT formats and the vertex factory converts them to floats. Returns the suffix of the define that 
+    // tells the shaders, NULL for the attributes read as floats. The joints are the only integer attributes the shaders use as integers
+    //
+    static const char *GetIntegerAttributeType(const std::string &attributeName, const tfAccessorDesc &accessor)
+    {
+        if (accessor.m_componentType == 5126 || accessor.m_normalized || attributeName.compare(0, 7, "JOINTS_") == 0)
+            return NULL;
+
+        return (accessor.m_componentType == 5120 || accessor.m_componentType == 5122 || accessor.m_componentType == 5124) ? "_SINT" : "_UINT";
+    }
+
     bool GLTFTexturesAndBuffers::OnCreate(Device *pDevice, GLTFCommon *pGLTFCommon, UploadHeap* pUploadHeap, StaticBufferPool *pStaticBufferPool, DynamicBufferRing *pDynamicBufferRing)
     {
         m_pDevice = pDevice;
@@ -44,17 +58,16 @@ namespace CAULDRON_DX12
     {
         // load textures 
         //
-        if (m_pGLTFCommon->j3.find("images") != m_pGLTFCommon->j3.end())
+        if (m_pGLTFCommon->m_images.size() > 0)
         {
-            m_pTextureNodes = &m_pGLTFCommon->j3["textures"];
-            const json &images = m_pGLTFCommon->j3["images"];
+            const std::vector<tfImageDesc> &images = m_pGLTFCommon->m_images;
             const json &materials = m_pGLTFCommon->j3["materials"];
 
             m_textures.resize(images.size());
             for (int imageIndex = 0; imageIndex < images.size(); imageIndex++)
             {
                 Texture *pTex = &m_textures[imageIndex];
-                std::string filename = m_pGLTFCommon->m_path + images[imageIndex]["uri"].get<std::string>();
+                std::string filename = m_pGLTFCommon->m_path + images[imageIndex].m_uri;
 
                 ExecAsyncIfThereIsAPool(pAsyncPool, [imageIndex, pTex, this, filename, materials]()
                 {
@@ -62,7 +75,19 @@ namespace CAULDRON_DX12
                     float cutOff;
                     GetSrgbAndCutOffOfImageGivenItsUse(imageIndex, materials, &useSRGB, &cutOff);
 
-                    bool result = pTex->InitFromFile(m_pDevice, m_pUploadHeap, filename.c_str(), useSRGB, cutOff);
+                    // use the precomputed mip chain if the scene was loaded from a cooked cache
+                    //
+                    bool result;
+                    ImgLoader *pCooked = m_pGLTFCommon->CreateCookedImageLoader(imageIndex);
+                    if (pCooked)
+                    {
+                        result = pTex->InitFromLoader(m_pDevice, m_pUploadHeap, pCooked, filename.c_str(), useSRGB, cutOff);
+                        delete pCooked;
+                    }
+                    else
+                    {
+                        result = pTex->InitFromFile(m_pDevice, m_pUploadHeap, filename.c_str(), useSRGB, cutOff);
+                    }
                     assert(result != false);
                 });
             }
@@ -79,22 +104,37 @@ namespace CAULDRON_DX12
 
     void GLTFTexturesAndBuffers::LoadGeometry()
     {
-        if (m_pGLTFCommon->j3.find("meshes") != m_pGLTFCommon->j3.end())
+        if (m_pGLTFCommon->m_meshes.size() > 0)
         {
-            for (const json &mesh : m_pGLTFCommon->j3["meshes"])
+            for (const tfMesh &mesh : m_pGLTFCommon->m_meshes)
             {
-                for (const json &primitive : mesh["primitives"])
+                for (const tfPrimitives &primitive : mesh.m_pPrimitives)
                 {
                     //
                     //  Load vertex buffers
                     //
-                    for (const json &attributeId : primitive["attributes"])
+                    for (const tfAttribute &attribute : primitive.m_attributes)
                     {
+                        int attributeId = attribute.m_accessor;
+
                         tfAccessor vertexBufferAcc;
                         m_pGLTFCommon->GetBufferDetails(attributeId, &vertexBufferAcc);
 
                         D3D12_VERTEX_BUFFER_VIEW vbv;
-                        m_pStaticBufferPool->AllocVertexBuffer(vertexBufferAcc.m_count, vertexBufferAcc.m_stride, vertexBufferAcc.m_data, &vbv);
+                        if (vertexBufferAcc.IsSparse())
+                        {
+                            // the elements get padded to the size of their format, VEC3 of 8 and 16 bits are read as VEC4
+                            const tfAccessorDesc &inAccessor = m_pGLTFCommon->m_accessors[attributeId];
+                            uint32_t formatSize = (uint32_t)GetPixelByteSize(GetFormat(inAccessor.m_dimension, inAccessor.m_componentType, inAccessor.m_normalized));
+
+                            void *pData;
+                            m_pStaticBufferPool->AllocVertexBuffer(vertexBufferAcc.m_count, formatSize, &pData, &vbv);
+                            vertexBufferAcc.CopyTo(pData, formatSize);
+                        }
+                        else
+                        {
+                            m_pStaticBufferPool->AllocVertexBuffer(vertexBufferAcc.m_count, vertexBufferAcc.m_stride, vertexBufferAcc.m_data, &vbv);
+                        }
 
                         m_vertexBufferMap[attributeId] = vbv;
                     }
@@ -102,7 +142,7 @@ namespace CAULDRON_DX12
                     //
                     //  Load index buffers
                     //
-                    int indexAcc = primitive.value("indices", -1);
+                    int indexAcc = primitive.m_indices;
                     if (indexAcc >= 0)
                     {
                         tfAccessor indexBufferAcc;
@@ -110,14 +150,12 @@ namespace CAULDRON_DX12
 
                         D3D12_INDEX_BUFFER_VIEW ibv;
 
-                        // Some exporters use 1-byte indices, need to convert them to shorts
-                        if (indexBufferAcc.m_stride == 1)
+                        // 8 bit indices were already widened to 16 bits by GLTFCommon
+                        if (indexBufferAcc.IsSparse())
                         {
-                            unsigned short *pIndices = (unsigned short *)malloc(indexBufferAcc.m_count * (2 * indexBufferAcc.m_stride));
-                            for (int i = 0; i < indexBufferAcc.m_count; i++)
-                                pIndices[i] = ((unsigned char *)indexBufferAcc.m_data)[i];
-                            m_pStaticBufferPool->AllocIndexBuffer(indexBufferAcc.m_count, 2 * indexBufferAcc.m_stride, pIndices, &ibv);
-                            free(pIndices);
+                            void *pData;
+                            m_pStaticBufferPool->AllocIndexBuffer(indexBufferAcc.m_count, indexBufferAcc.m_type, &pData, &ibv);
+                            indexBufferAcc.CopyTo(pData);
                         }
                         else
                         {
@@ -126,9 +164,42 @@ namespace CAULDRON_DX12
 
                         m_IndexBufferMap[indexAcc] = ibv;
                     }
+
+                    // coarser levels of detail, these are always dense
+                    for (const tfLod &lod : primitive.m_lods)
+                    {
+                        tfAccessor lodBufferAcc;
+                        m_pGLTFCommon->GetBufferDetails(lod.m_indices, &lodBufferAcc);
+
+                        D3D12_INDEX_BUFFER_VIEW ibv;
+                        m_pStaticBufferPool->AllocIndexBuffer(lodBufferAcc.m_count, lodBufferAcc.m_stride, lodBufferAcc.m_data, &ibv);
+
+                        m_IndexBufferMap[lod.m_indices] = ibv;
+                    }
                 }
             }
         }
+
+        //
+        //  Load the instances (EXT_mesh_gpu_instancing), one buffer per stream plus an identity instance at the end
+        //
+        uint32_t instanceCount = (uint32_t)m_pGLTFCommon->m_instanceTranslations.size();
+        if (instanceCount > 0)
+        {
+            XMFLOAT3 *pTranslations, *pScales;
+            XMFLOAT4 *pRotations;
+            m_pStaticBufferPool->AllocVertexBuffer(instanceCount + 1, sizeof(XMFLOAT3), (void **)&pTranslations, &m_instanceVBV[0]);
+            m_pStaticBufferPool->AllocVertexBuffer(instanceCount + 1, sizeof(XMFLOAT4), (void **)&pRotations, &m_instanceVBV[1]);
+            m_pStaticBufferPool->AllocVertexBuffer(instanceCount + 1, sizeof(XMFLOAT3), (void **)&pScales, &m_instanceVBV[2]);
+
+            memcpy(pTranslations, m_pGLTFCommon->m_instanceTranslations.data(), instanceCount * sizeof(XMFLOAT3));
+            memcpy(pRotations, m_pGLTFCommon->m_instanceRotations.data(), instanceCount * sizeof(XMFLOAT4));
+            memcpy(pScales, m_pGLTFCommon->m_instanceScales.data(), instanceCount * sizeof(XMFLOAT3));
+
+            pTranslations[instanceCount] = XMFLOAT3(0, 0, 0);
+            pRotations[instanceCount] = XMFLOAT4(0, 0, 0, 1);
+            pScales[instanceCount] = XMFLOAT3(1, 1, 1);
+        }
     }
 
     void GLTFTexturesAndBuffers::OnDestroy()
@@ -141,7 +212,7 @@ namespace CAULDRON_DX12
 
     Texture *GLTFTexturesAndBuffers::GetTextureViewByID(int id)
     {
-        int tex = m_pTextureNodes->at(id)["source"];
+        int tex = m_pGLTFCommon->m_textures[id].m_source;
         return &m_textures[tex];
     }
 
@@ -176,26 +247,33 @@ namespace CAULDRON_DX12
 
     // Creates buffers and the input assemby at the same time. It needs a list of attributes to use.
     //
-    void GLTFTexturesAndBuffers::CreateGeometry(const json &primitive, const std::vector<std::string> requiredAttributes, std::vector<std::string> &semanticNames, std::vector<D3D12_INPUT_ELEMENT_DESC> &layout, DefineList &defines, Geometry *pGeometry)
+    void GLTFTexturesAndBuffers::CreateGeometry(const tfPrimitives &primitive, const std::vector<std::string> requiredAttributes, std::vector<std::string> &semanticNames, std::vector<D3D12_INPUT_ELEMENT_DESC> &layout, DefineList &defines, Geometry *pGeometry)
     {
         // Get Index buffer view
         //
         tfAccessor indexBuffer;
-        int indexBufferId = primitive.value("indices", -1);
+        int indexBufferId = primitive.m_indices;
         CreateIndexBuffer(indexBufferId, &pGeometry->m_NumIndices, &pGeometry->m_indexType, &pGeometry->m_IBV);
 
+        pGeometry->m_lodNumIndices.resize(primitive.m_lods.size());
+        pGeometry->m_lodIBV.resize(primitive.m_lods.size());
+        for (size_t lod = 0; lod < primitive.m_lods.size(); lod++)
+        {
+            DXGI_FORMAT indexType;
+            CreateIndexBuffer(primitive.m_lods[lod].m_indices, &pGeometry->m_lodNumIndices[lod], &indexType, &pGeometry->m_lodIBV[lod]);
+        }
+
         // Create vertex buffers and input layout
         //
         int cnt = 0;
         layout.resize(requiredAttributes.size());
         semanticNames.resize(requiredAttributes.size());
         pGeometry->m_VBV.resize(requiredAttributes.size());
-        const json &attributes = primitive.at("attributes");
         for (auto attrName : requiredAttributes)
         {
             // get vertex buffer view
             // 
-            const int attr = attributes.find(attrName).value();
+            const int attr = primitive.FindAttribute(attrName);
             pGeometry->m_VBV[cnt] = m_vertexBufferMap[attr];
 
             // Set define so the shaders knows this stream is available
@@ -206,24 +284,89 @@ namespace CAULDRON_DX12
             uint32_t semanticIndex = 0;
             SplitGltfAttribute(attrName, &semanticNames[cnt], &semanticIndex);
 
-            const json &inAccessor = m_pGLTFCommon->m_pAccessors->at(attr);
+            const tfAccessorDesc &inAccessor = m_pGLTFCommon->m_accessors[attr];
+
+            // quantized attributes that come in as integers, the vertex factory converts them to floats
+            const char *pIntegerType = GetIntegerAttributeType(attrName, inAccessor);
+            if (pIntegerType != NULL)
+                defines[attrName + pIntegerType] = std::string("1");
 
             // Create Input Layout
             //
             D3D12_INPUT_ELEMENT_DESC l = {};
             l.SemanticName = semanticNames[cnt].c_str(); // we need to set it in the pipeline function (because of multithreading)
             l.SemanticIndex = semanticIndex;
-            l.Format = GetFormat(inAccessor["type"], inAccessor["componentType"]);
+            l.Format = GetFormat(inAccessor.m_dimension, inAccessor.m_componentType, inAccessor.m_normalized);
             l.InputSlot = (UINT)cnt;
             l.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
             l.InstanceDataStepRate = 0;
             l.AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
             layout[cnt] = l;
 
+            // the morph targets replace these streams with the blended ones
+            if (attrName == "POSITION" && HasMorphDeltas(primitive, MORPH_POSITION))
+                pGeometry->m_morphSlots[MORPH_POSITION] = cnt;
+            else if (attrName == "NORMAL" && HasMorphDeltas(primitive, MORPH_NORMAL))
+                pGeometry->m_morphSlots[MORPH_NORMAL] = cnt;
+
             cnt++;            
         }
     }
 
+    // EXT_mesh_gpu_instancing, appends the per instance streams to the input layout, they go in the slots after the vertex buffers
+    //
+    void GLTFTexturesAndBuffers::AddInstanceStreams(std::vector<D3D12_INPUT_ELEMENT_DESC> &layout, DefineList &defines, Geometry *pGeometry)
+    {
+        static const char *semanticNames[3] = { "INSTANCE_TRANSLATION", "INSTANCE_ROTATION", "INSTANCE_SCALE" };
+        static const DXGI_FORMAT formats[3] = { DXGI_FORMAT_R32G32B32_FLOAT, DXGI_FORMAT_R32G32B32A32_FLOAT, DXGI_FORMAT_R32G32B32_FLOAT };
+
+        for (int i = 0; i < 3; i++)
+        {
+            D3D12_INPUT_ELEMENT_DESC l = {};
+            l.SemanticName = semanticNames[i];
+            l.SemanticIndex = 0;
+            l.Format = formats[i];
+            l.InputSlot = (UINT)pGeometry->m_VBV.size() + i;
+            l.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA;
+            l.InstanceDataStepRate = 1;
+            l.AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
+            layout.push_back(l);
+        }
+
+        defines["HAS_INSTANCING"] = std::string("1");
+        pGeometry->m_bInstanced = true;
+    }
+
+    // All the instances of a node straight from the static buffers, the nodes that are not instanced get the identity instance
+    //
+    void GLTFTexturesAndBuffers::GetInstanceBuffers(int nodeIndex, InstanceBuffers *pInstances)
+    {
+        const tfNode &node = m_pGLTFCommon->m_nodes[nodeIndex];
+        for (int i = 0; i < 3; i++)
+            pInstances->m_VBV[i] = m_instanceVBV[i];
+
+        pInstances->m_startInstance = (node.m_instanceCount > 0) ? node.m_firstInstance : (uint32_t)m_pGLTFCommon->m_instanceTranslations.size();
+        pInstances->m_instanceCount = (node.m_instanceCount > 0) ? node.m_instanceCount : 1;
+    }
+
+    // Only the instances of a node that are in the camera frustum, these get copied to the dynamic buffer ring. Returns how many are visible
+    //
+    uint32_t GLTFTexturesAndBuffers::CullInstances(int nodeIndex, const tfPrimitives &bounds, InstanceBuffers *pInstances, XMMATRIX *pNearestWorld)
+    {
+        uint32_t instanceCount = m_pGLTFCommon->m_nodes[nodeIndex].m_instanceCount;
+        assert(instanceCount > 0);
+
+        XMFLOAT3 *pTranslations, *pScales;
+        XMFLOAT4 *pRotations;
+        m_pDynamicBufferRing->AllocVertexBuffer(instanceCount, sizeof(XMFLOAT3), (void **)&pTranslations, &pInstances->m_VBV[0]);
+        m_pDynamicBufferRing->AllocVertexBuffer(instanceCount, sizeof(XMFLOAT4), (void **)&pRotations, &pInstances->m_VBV[1]);
+        m_pDynamicBufferRing->AllocVertexBuffer(instanceCount, sizeof(XMFLOAT3), (void **)&pScales, &pInstances->m_VBV[2]);
+
+        pInstances->m_startInstance = 0;
+        pInstances->m_instanceCount = m_pGLTFCommon->CullInstances(nodeIndex, bounds, pTranslations, pRotations, pScales, pNearestWorld);
+        return pInstances->m_instanceCount;
+    }
+
     void GLTFTexturesAndBuffers::SetPerFrameConstants()
     {
         m_perFrameConstants = m_pDynamicBufferRing->AllocConstantBuffer(sizeof(per_frame), &m_pGLTFCommon->m_perFrameData);
@@ -231,22 +374,92 @@ namespace CAULDRON_DX12
 
     void GLTFTexturesAndBuffers::SetSkinningMatricesForSkeletons()
     {
-        for (auto &t : m_pGLTFCommon->m_worldSpaceSkeletonMats)
+        // the skinning matrices of all the skins are in one array, each skin uploads its range
+        m_skeletonMatricesBuffer.resize(m_pGLTFCommon->m_skins.size());
+        for (uint32_t i = 0; i < m_pGLTFCommon->m_skins.size(); i++)
+        {
+            const tfSkins &skin = m_pGLTFCommon->m_skins[i];
+            const Matrix2 *pMatrices = &m_pGLTFCommon->m_worldSpaceSkeletonMats[skin.m_firstSkinningMat];
+            m_skeletonMatricesBuffer[i] = m_pDynamicBufferRing->AllocConstantBuffer((uint32_t)(skin.m_InverseBindMatrices.m_count * sizeof(Matrix2)), (void *)pMatrices);
+        }
+    }
+
+    // Blends the morph targets of the nodes that have a weight into the dynamic buffer ring, the rest draw the static streams.
+    // The nodes whose weights didn't change since the last blend only copy it to the ring, its memory only lasts for the frame
+    //
+    void GLTFTexturesAndBuffers::SetMorphedStreams()
+    {
+        const GLTFCommon *pGLTFCommon = m_pGLTFCommon;
+
+        m_morphedStreams.clear();
+        m_firstMorphedStreams.assign(pGLTFCommon->m_nodes.size(), -1);
+        m_morphedNodes.resize(pGLTFCommon->m_nodes.size());
+        for (uint32_t i = 0; i < pGLTFCommon->m_nodes.size(); i++)
         {
-            std::vector<Matrix2> *matrices = &t.second;
-            D3D12_GPU_VIRTUAL_ADDRESS perSkeleton = m_pDynamicBufferRing->AllocConstantBuffer((uint32_t)(matrices->size() * sizeof(Matrix2)), matrices->data());
+            const tfNode &node = pGLTFCommon->m_nodes[i];
+            const float *pWeights = node.m_morphWeightCount ? &pGLTFCommon->m_morphWeights[node.m_firstMorphWeight] : NULL;
+            if (pWeights == NULL || !HasMorphWeights(pWeights, node.m_morphWeightCount))
+            {
+                m_morphedNodes[i].m_weights.clear();
+                continue;
+            }
+
+            MorphedNode &morphed = m_morphedNodes[i];
+            bool bChanged = morphed.m_weights.size() != node.m_morphWeightCount || memcmp(morphed.m_weights.data(), pWeights, node.m_morphWeightCount * sizeof(float)) != 0;
+            if (bChanged)
+                morphed.m_weights.assign(pWeights, pWeights + node.m_morphWeightCount);
+
+            const tfMesh &mesh = pGLTFCommon->m_meshes[node.meshIndex];
+            morphed.m_vertices.resize(mesh.m_pPrimitives.size() * MORPH_STREAM_COUNT);
+            m_firstMorphedStreams[i] = (int)m_morphedStreams.size();
+            m_morphedStreams.resize(m_morphedStreams.size() + mesh.m_pPrimitives.size());
+            for (size_t p = 0; p < mesh.m_pPrimitives.size(); p++)
+            {
+                const tfPrimitives &primitive = mesh.m_pPrimitives[p];
+                MorphedStreams *pStreams = &m_morphedStreams[m_firstMorphedStreams[i] + p];
+                for (int s = 0; s < MORPH_STREAM_COUNT; s++)
+                {
+                    const std::vector<float> &base = primitive.m_morphBase[s];
+                    if (base.empty())
+                        continue;
+
+                    // the ring is write combined memory, the targets get blended here and then copied
+                    std::vector<float> &vertices = morphed.m_vertices[p * MORPH_STREAM_COUNT + s];
+                    if (bChanged || vertices.size() != base.size())
+                    {
+                        vertices = base;
+                        BlendMorphTargets(primitive, (tfMorphStream)s, pWeights, vertices.data());
+                    }
+
+                    void *pData;
+                    if (m_pDynamicBufferRing->AllocVertexBuffer((uint32_t)(vertices.size() / 3), 3 * sizeof(float), &pData, &pStreams->m_VBV[s]))
+                        memcpy(pData, vertices.data(), vertices.size() * sizeof(float));
+                }
+            }
+        }
+    }
+
+    void GLTFTexturesAndBuffers::GetMorphedStreams(int nodeIndex, int primitiveIndex, MorphedStreams *pStreams)
+    {
+        *pStreams = MorphedStreams();
+        if (nodeIndex < (int)m_firstMorphedStreams.size() && m_firstMorphedStreams[nodeIndex] >= 0)
+            *pStreams = m_morphedStreams[m_firstMorphedStreams[nodeIndex] + primitiveIndex];
+    }
 
-            m_skeletonMatricesBuffer[t.first] = perSkeleton;
+    void BindMorphedStreams(ID3D12GraphicsCommandList *pCommandList, const Geometry &geometry, const MorphedStreams &streams)
+    {
+        for (int s = 0; s < MORPH_STREAM_COUNT; s++)
+        {
+            if (geometry.m_morphSlots[s] >= 0 && streams.m_VBV[s].BufferLocation != 0)
+                pCommandList->IASetVertexBuffers((UINT)geometry.m_morphSlots[s], 1, &streams.m_VBV[s]);
         }
     }
 
     D3D12_GPU_VIRTUAL_ADDRESS GLTFTexturesAndBuffers::GetSkinningMatricesBuffer(int skinIndex)
     {
-        auto it = m_skeletonMatricesBuffer.find(skinIndex);
-
-        if (it == m_skeletonMatricesBuffer.end())
+        if (skinIndex < 0 || skinIndex >= (int)m_skeletonMatricesBuffer.size())
             return NULL;
 
-        return it->second;
+        return m_skeletonMatricesBuffer[skinIndex];
     }
 }
@@ -36,18 +36,43 @@ namespace CAULDRON_DX12
         uint32_t m_NumIndices;
         D3D12_INDEX_BUFFER_VIEW m_IBV;
         std::vector<D3D12_VERTEX_BUFFER_VIEW> m_VBV;
+
+        // coarser levels of detail, entry i is tfPrimitives::m_lods[i], they use the same vertex buffers
+        std::vector<uint32_t> m_lodNumIndices;
+        std::vector<D3D12_INDEX_BUFFER_VIEW> m_lodIBV;
+
+        // EXT_mesh_gpu_instancing, the per instance streams get bound right after m_VBV, see AddInstanceStreams()
+        bool m_bInstanced = false;
+
+        // morph targets, the slots of m_VBV the blended POSITION and NORMAL streams replace, -1 when no target moves them
+        int m_morphSlots[MORPH_STREAM_COUNT] = { -1, -1 };
+    };
+
+    // EXT_mesh_gpu_instancing, per instance streams (translation, rotation and scale) and instance range of a draw
+    struct InstanceBuffers
+    {
+        D3D12_VERTEX_BUFFER_VIEW m_VBV[3];
+        uint32_t m_startInstance = 0;
+        uint32_t m_instanceCount = 1;
+    };
+
+    // morph targets, the streams of a draw blended this frame, a BufferLocation of 0 keeps the stream of the geometry
+    struct MorphedStreams
+    {
+        D3D12_VERTEX_BUFFER_VIEW m_VBV[MORPH_STREAM_COUNT] = {};
     };
 
+    // binds the morphed streams over the ones of the geometry, call it after binding m_VBV
+    void BindMorphedStreams(ID3D12GraphicsCommandList *pCommandList, const Geometry &geometry, const MorphedStreams &streams);
+
     class GLTFTexturesAndBuffers
     {
         Device     *m_pDevice;
         UploadHeap *m_pUploadHeap;
 
-        const json *m_pTextureNodes;
-
         std::vector<Texture> m_textures;
 
-        std::map<int, D3D12_GPU_VIRTUAL_ADDRESS> m_skeletonMatricesBuffer;
+        std::vector<D3D12_GPU_VIRTUAL_ADDRESS> m_skeletonMatricesBuffer;   // indexed by skin
         std::vector<D3D12_CONSTANT_BUFFER_VIEW_DESC> m_InverseBindMatrices;
 
         StaticBufferPool *m_pStaticBufferPool;
@@ -57,6 +82,20 @@ namespace CAULDRON_DX12
         std::map<int, D3D12_VERTEX_BUFFER_VIEW> m_vertexBufferMap;
         std::map<int, D3D12_INDEX_BUFFER_VIEW> m_IndexBufferMap;
 
+        // instances of all the nodes, the last one is an identity instance for the nodes that are not instanced
+        D3D12_VERTEX_BUFFER_VIEW m_instanceVBV[3] = {};
+
+        // morph targets, the streams blended this frame, each node with weights takes one entry per primitive starting at m_firstMorphedStreams
+        std::vector<MorphedStreams> m_morphedStreams;
+        std::vector<int> m_firstMorphedStreams;        // -1 for the nodes that are not morphed
+        // the blend of each morphed node is kept and only redone when its weights change, the ring gets a copy every frame
+        struct MorphedNode
+        {
+            std::vector<float> m_weights;                   // the weights of the last blend, empty when there is none
+            std::vector<std::vector<float>> m_vertices;     // blended streams, MORPH_STREAM_COUNT per primitive
+        };
+        std::vector<MorphedNode> m_morphedNodes;
+
     public:
         GLTFCommon *m_pGLTFCommon;
 
@@ -69,10 +108,17 @@ namespace CAULDRON_DX12
 
         void CreateIndexBuffer(int indexBufferId, uint32_t *pNumIndices, DXGI_FORMAT *pIndexType, D3D12_INDEX_BUFFER_VIEW *pIBV);
         void CreateGeometry(int indexBufferId, std::vector<int> &vertexBufferIds, Geometry *pGeometry);
-        void CreateGeometry(const json &primitive, const std::vector<std::string > requiredAttributes, std::vector<std::string> &semanticNames, std::vector<D3D12_INPUT_ELEMENT_DESC> &layout, DefineList &defines, Geometry *pGeometry);
+        void CreateGeometry(const tfPrimitives &primitive, const std::vector<std::string > requiredAttributes, std::vector<std::string> &semanticNames, std::vector<D3D12_INPUT_ELEMENT_DESC> &layout, DefineList &defines, Geometry *pGeometry);
+
+        // EXT_mesh_gpu_instancing
+        void AddInstanceStreams(std::vector<D3D12_INPUT_ELEMENT_DESC> &layout, DefineList &defines, Geometry *pGeometry);
+        void GetInstanceBuffers(int nodeIndex, InstanceBuffers *pInstances);
+        uint32_t CullInstances(int nodeIndex, const tfPrimitives &bounds, InstanceBuffers *pInstances, XMMATRIX *pNearestWorld);
 
         void SetPerFrameConstants();
         void SetSkinningMatricesForSkeletons();
+        void SetMorphedStreams();   // blends the morph targets of the nodes with weights, once per frame after SetAnimationTime()
+        void GetMorphedStreams(int nodeIndex, int primitiveIndex, MorphedStreams *pStreams);
 
         Texture *GetTextureViewByID(int id);
         D3D12_GPU_VIRTUAL_ADDRESS GetSkinningMatricesBuffer(int skinIndex);
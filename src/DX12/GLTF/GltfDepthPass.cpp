@@ -124,34 +124,33 @@ namespace CAULDRON_DX12
 
         // Load Meshes
         //
-        if (j3.find("meshes") != j3.end())
+        if (pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes.size() > 0)
         {
-            const json &meshes = j3["meshes"];
+            const std::vector<tfMesh> &meshes = pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes;
             m_meshes.resize(meshes.size());
             for (uint32_t i = 0; i < meshes.size(); i++)
             {
                 DepthMesh *tfmesh = &m_meshes[i];
 
-                const json &primitives = meshes[i]["primitives"];
+                const std::vector<tfPrimitives> &primitives = meshes[i].m_pPrimitives;
                 tfmesh->m_pPrimitives.resize(primitives.size());
                 for (uint32_t p = 0; p < primitives.size(); p++)
                 {
-                    const json &primitive = primitives[p];
+                    const tfPrimitives &primitive = primitives[p];
                     DepthPrimitives *pPrimitive = &tfmesh->m_pPrimitives[p];
 
                     ExecAsyncIfThereIsAPool(pAsyncPool, [this, i, &primitive, pPrimitive]()
                     {
                         // Set Material
                         //
-                        auto mat = primitive.find("material");
-                        pPrimitive->m_pMaterial = (mat != primitive.end()) ? &m_materialsData[mat.value()] : &m_defaultMaterial;
+                        pPrimitive->m_pMaterial = (primitive.m_material >= 0) ? &m_materialsData[primitive.m_material] : &m_defaultMaterial;
 
                         // make a list of all the attribute names our pass requires, in the case of a depth pass we only need the position and a few other things. 
                         //
                         std::vector<std::string > requiredAttributes;
-                        for (auto const & it : primitive["attributes"].items())
+                        for (const tfAttribute &attribute : primitive.m_attributes)
                         {
-                            const std::string semanticName = it.key();
+                            const std::string &semanticName = attribute.m_name;
                             if (
                                 (semanticName == "POSITION") ||
                                 (semanticName.substr(0, 7) == "WEIGHTS") || // for skinning
@@ -174,6 +173,10 @@ namespace CAULDRON_DX12
                         std::vector<D3D12_INPUT_ELEMENT_DESC> layout;
                         m_pGLTFTexturesAndBuffers->CreateGeometry(primitive, requiredAttributes, semanticNames, layout, defines, &pPrimitive->m_geometry);
 
+                        // meshes used by instanced nodes also read the instance transforms
+                        if (m_pGLTFTexturesAndBuffers->m_pGLTFCommon->IsMeshInstanced(i))
+                            m_pGLTFTexturesAndBuffers->AddInstanceStreams(layout, defines, &pPrimitive->m_geometry);
+
                         // Create Pipeline
                         //
                         bool bUsingSkinning = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->FindMeshSkinId(i) != -1;
@@ -383,6 +386,18 @@ namespace CAULDRON_DX12
                 pCommandList->IASetIndexBuffer(&pGeometry->m_IBV);
                 pCommandList->IASetVertexBuffers(0, (UINT)pGeometry->m_VBV.size(), pGeometry->m_VBV.data());
 
+                MorphedStreams morphed;
+                m_pGLTFTexturesAndBuffers->GetMorphedStreams(i, p, &morphed);
+                BindMorphedStreams(pCommandList, *pGeometry, morphed);
+
+                // all the instances of the node, this pass doesn't cull
+                InstanceBuffers instances;
+                if (pGeometry->m_bInstanced)
+                {
+                    m_pGLTFTexturesAndBuffers->GetInstanceBuffers(i, &instances);
+                    pCommandList->IASetVertexBuffers((UINT)pGeometry->m_VBV.size(), 3, instances.m_VBV);
+                }
+
                 // Bind Descriptor sets
                 //                
                 pCommandList->SetGraphicsRootSignature(pPrimitive->m_rootSignature);
@@ -409,7 +424,7 @@ namespace CAULDRON_DX12
 
                 // Draw
                 //
-                pCommandList->DrawIndexedInstanced(pGeometry->m_NumIndices, 1, 0, 0, 0);
+                pCommandList->DrawIndexedInstanced(pGeometry->m_NumIndices, instances.m_instanceCount, 0, 0, instances.m_startInstance);
             }
         }
     }
@@ -148,35 +148,33 @@ namespace CAULDRON_DX12
 
         // Load Meshes
         //
-        if (j3.find("meshes") != j3.end())
+        if (pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes.size() > 0)
         {
-            const json &meshes = j3["meshes"];
-            const json &accessors = j3["accessors"];
+            const std::vector<tfMesh> &meshes = pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes;
             m_meshes.resize(meshes.size());
             for (uint32_t i = 0; i < meshes.size(); i++)
             {
                 MotionVectorMesh *tfmesh = &m_meshes[i];
 
-                const json &primitives = meshes[i]["primitives"];
+                const std::vector<tfPrimitives> &primitives = meshes[i].m_pPrimitives;
                 tfmesh->m_pPrimitives.resize(primitives.size());
                 for (uint32_t p = 0; p < primitives.size(); p++)
                 {
-                    const json &primitive = primitives[p];
+                    const tfPrimitives &primitive = primitives[p];
                     MotionVectorPrimitives *pPrimitive = &tfmesh->m_pPrimitives[p];
 
                     ExecAsyncIfThereIsAPool(pAsyncPool, [this, i, pGLTFTexturesAndBuffers, normalBufferFormat, &primitive, pPrimitive]()
                     {
                         // Set Material
                         //
-                        auto mat = primitive.find("material");
-                        pPrimitive->m_pMaterial = (mat != primitive.end()) ? &m_materialsData[mat.value()] : &m_defaultMaterial;
+                        pPrimitive->m_pMaterial = (primitive.m_material >= 0) ? &m_materialsData[primitive.m_material] : &m_defaultMaterial;
 
                         // specify attributes needed to render the material
                         //
                         std::vector<std::string> requiredAttributes;
-                        for (auto const & it : primitive["attributes"].items())
+                        for (const tfAttribute &attribute : primitive.m_attributes)
                         {
-                            const std::string semanticName = it.key();
+                            const std::string &semanticName = attribute.m_name;
                             if (                            
                                 (semanticName == "POSITION") ||
                                 (semanticName.substr(0, 7) == "WEIGHTS") || // for skinning
@@ -199,6 +197,10 @@ namespace CAULDRON_DX12
                         std::vector<D3D12_INPUT_ELEMENT_DESC> layout;
                         pGLTFTexturesAndBuffers->CreateGeometry(primitive, requiredAttributes, semanticNames, layout, defines, &pPrimitive->m_Geometry);
 
+                        // meshes used by instanced nodes also read the instance transforms
+                        if (pGLTFTexturesAndBuffers->m_pGLTFCommon->IsMeshInstanced(i))
+                            pGLTFTexturesAndBuffers->AddInstanceStreams(layout, defines, &pPrimitive->m_Geometry);
+
                         // Create Pipeline
                         //
                         bool bUsingSkinning = pGLTFTexturesAndBuffers->m_pGLTFCommon->FindMeshSkinId(i) != -1;
@@ -414,6 +416,18 @@ namespace CAULDRON_DX12
                 pCommandList->IASetIndexBuffer(&pGeometry->m_IBV);
                 pCommandList->IASetVertexBuffers(0, (UINT)pGeometry->m_VBV.size(), pGeometry->m_VBV.data());
 
+                MorphedStreams morphed;
+                m_pGLTFTexturesAndBuffers->GetMorphedStreams(i, p, &morphed);
+                BindMorphedStreams(pCommandList, *pGeometry, morphed);
+
+                // all the instances of the node, this pass doesn't cull
+                InstanceBuffers instances;
+                if (pGeometry->m_bInstanced)
+                {
+                    m_pGLTFTexturesAndBuffers->GetInstanceBuffers(i, &instances);
+                    pCommandList->IASetVertexBuffers((UINT)pGeometry->m_VBV.size(), 3, instances.m_VBV);
+                }
+
                 // Bind Descriptor sets
                 //                
                 pCommandList->SetGraphicsRootSignature(pPrimitive->m_RootSignature);
@@ -440,7 +454,7 @@ namespace CAULDRON_DX12
 
                 // Draw
                 //
-                pCommandList->DrawIndexedInstanced(pGeometry->m_NumIndices, 1, 0, 0, 0);
+                pCommandList->DrawIndexedInstanced(pGeometry->m_NumIndices, instances.m_instanceCount, 0, 0, instances.m_startInstance);
             }
         }
     }
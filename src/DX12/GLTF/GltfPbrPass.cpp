@@ -21,6 +21,8 @@
 #include "GltfPbrPass.h"
 #include "Misc/ThreadPool.h"
 #include "GltfHelpers.h"
+#include "GLTF/GltfSimplifier.h"
+#include "GLTF/GltfMeshlets.h"
 #include "Base/GBuffer.h"
 #include "Base/ShaderCompilerHelper.h"
 
@@ -94,13 +96,13 @@ namespace CAULDRON_DX12
 
         // Load Meshes
         //
-        if (j3.find("meshes") != j3.end())
+        if (m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes.size() > 0)
         {
-            const json &meshes = j3["meshes"];
+            const std::vector<tfMesh> &meshes = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes;
             m_meshes.resize(meshes.size());
             for (uint32_t i = 0; i < meshes.size(); i++)
             {
-                const json &primitives = meshes[i]["primitives"];
+                const std::vector<tfPrimitives> &primitives = meshes[i].m_pPrimitives;
 
                 // Loop through all the primitives (sets of triangles with a same material) and 
                 // 1) create an input layout for the geometry
@@ -111,15 +113,14 @@ namespace CAULDRON_DX12
                 tfmesh->m_pPrimitives.resize(primitives.size());
                 for (uint32_t p = 0; p < primitives.size(); p++)
                 {
-                    const json &primitive = primitives[p];
+                    const tfPrimitives &primitive = primitives[p];
                     PBRPrimitives *pPrimitive = &tfmesh->m_pPrimitives[p];
 
                     ExecAsyncIfThereIsAPool(pAsyncPool, [this, i, &primitive, rtDefines, pPrimitive, bUseSSAOMask]()
                     {
                         // Sets primitive's material, or set a default material if none was specified in the GLTF
                         //
-                        auto mat = primitive.find("material");
-                        pPrimitive->m_pMaterial = (mat != primitive.end()) ? &m_materialsData[mat.value()] : &m_defaultMaterial;
+                        pPrimitive->m_pMaterial = (primitive.m_material >= 0) ? &m_materialsData[primitive.m_material] : &m_defaultMaterial;
 
                         // holds all the #defines from materials, geometry and texture IDs, the VS & PS shaders need this to get the bindings and code paths
                         //
@@ -128,8 +129,8 @@ namespace CAULDRON_DX12
                         // make a list of all the attribute names our pass requires, in the case of PBR we need them all
                         //
                         std::vector<std::string> requiredAttributes;
-                        for (auto const & it : primitive["attributes"].items())
-                            requiredAttributes.push_back(it.key());
+                        for (const tfAttribute &attribute : primitive.m_attributes)
+                            requiredAttributes.push_back(attribute.m_name);
 
                         // create an input layout from the required attributes
                         // shader's can tell the slots from the #defines
@@ -138,6 +139,10 @@ namespace CAULDRON_DX12
                         std::vector<D3D12_INPUT_ELEMENT_DESC> inputLayout;
                         m_pGLTFTexturesAndBuffers->CreateGeometry(primitive, requiredAttributes, semanticNames, inputLayout, defines, &pPrimitive->m_geometry);
 
+                        // meshes used by instanced nodes also read the instance transforms
+                        if (m_pGLTFTexturesAndBuffers->m_pGLTFCommon->IsMeshInstanced(i))
+                            m_pGLTFTexturesAndBuffers->AddInstanceStreams(inputLayout, defines, &pPrimitive->m_geometry);
+
                         // Create the descriptors, the root signature and the pipeline
                         //
                         bool bUsingSkinning = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->FindMeshSkinId(i) != -1;
@@ -419,71 +424,122 @@ namespace CAULDRON_DX12
     //--------------------------------------------------------------------------------------
     void GltfPbrPass::BuildBatchLists(std::vector<BatchList> *pSolid, std::vector<BatchList> *pTransparent)
     {
-        // loop through nodes
+        const GLTFCommon *pGLTFCommon = m_pGLTFTexturesAndBuffers->m_pGLTFCommon;
+        const std::vector<tfNode> *pNodes = &pGLTFCommon->m_nodes;
+        const Matrix2 *pNodesMatrices = pGLTFCommon->m_worldSpaceMats.data();
+
+        // do frustrum culling on the world space boxes of all the primitives at once
         //
-        std::vector<tfNode> *pNodes = &m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_nodes;
-        Matrix2 *pNodesMatrices = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_worldSpaceMats.data();        
+        uint32_t visibleCount = pGLTFCommon->CullPrimitives(pGLTFCommon->m_perFrameData.mCameraCurrViewProj, &m_visiblePrimitives);
 
-        for (uint32_t i = 0; i < pNodes->size(); i++)
+        // loop through the visible primitives
+        //
+        for (uint32_t n = 0; n < visibleCount; n++)
         {
-            tfNode *pNode = &pNodes->at(i);
-            if ((pNode == NULL) || (pNode->meshIndex < 0))
+            uint32_t box = m_visiblePrimitives[n];
+            uint32_t i = pGLTFCommon->m_boxNodes[box];
+            uint32_t p = pGLTFCommon->m_boxPrimitives[box];
+            const tfNode *pNode = &pNodes->at(i);
+            PBRPrimitives *pPrimitive = &m_meshes[pNode->meshIndex].m_pPrimitives[p];
+
+            if (pPrimitive->m_PipelineRender == NULL)
                 continue;
 
             // skinning matrices constant buffer
             D3D12_GPU_VIRTUAL_ADDRESS pPerSkeleton = m_pGLTFTexturesAndBuffers->GetSkinningMatricesBuffer(pNode->skinIndex);
 
-            XMMATRIX mModelViewProj = pNodesMatrices[i].GetCurrent() * m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_perFrameData.mCameraCurrViewProj;
-
-            // loop through primitives
+            // instanced nodes cull each instance and draw the visible ones at once
             //
-            PBRMesh *pMesh = &m_meshes[pNode->meshIndex];
-            for (uint32_t p = 0; p < pMesh->m_pPrimitives.size(); p++)
+            const tfPrimitives &boundingBox = pGLTFCommon->m_meshes[pNode->meshIndex].m_pPrimitives[p];
+            XMMATRIX mNearestWorld = pNodesMatrices[i].GetCurrent();
+            InstanceBuffers instances;
+            if (pNode->m_instanceCount > 0)
             {
-                PBRPrimitives *pPrimitive = &pMesh->m_pPrimitives[p];
-
-                if (pPrimitive->m_PipelineRender == NULL)
+                if (m_pGLTFTexturesAndBuffers->CullInstances(i, boundingBox, &instances, &mNearestWorld) == 0)
                     continue;
+            }
+            else if (pPrimitive->m_geometry.m_bInstanced)
+            {
+                m_pGLTFTexturesAndBuffers->GetInstanceBuffers(i, &instances);
+            }
 
-                // do frustrum culling
-                //
-                tfPrimitives boundingBox = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes[pNode->meshIndex].m_pPrimitives[p];
-                if (CameraFrustumToBoxCollision(mModelViewProj, boundingBox.m_center, boundingBox.m_radius))
-                    continue;
+            PBRMaterialParameters *pPbrParams = &pPrimitive->m_pMaterial->m_pbrMaterialParameters;
+
+            // pick the level of detail, the skinned ones use their world space sphere since their joints place them and not the node
+            //
+            bool bSkinned = pNode->m_instanceCount == 0 && pNode->skinIndex >= 0 && pNode->skinIndex < (int)pGLTFCommon->m_skins.size();
+            const XMFLOAT4 &worldSphere = pGLTFCommon->m_worldSpheres[box];
+            int lod;
+            if (bSkinned)
+                lod = SelectLod(boundingBox, worldSphere, pGLTFCommon->m_perFrameData.cameraPos, pGLTFCommon->m_lodProjectionScale, pGLTFCommon->m_lodMaxScreenError);
+            else
+                lod = SelectLod(boundingBox, mNearestWorld, pGLTFCommon->m_perFrameData.cameraPos, pGLTFCommon->m_lodProjectionScale, pGLTFCommon->m_lodMaxScreenError);
+
+            // the meshlets are in bind pose and belong to the full detail, the primitives that are static in their space cull them and draw
+            // the visible ones from a compacted index buffer
+            //
+            D3D12_INDEX_BUFFER_VIEW meshletsIBV = {};
+            uint32_t meshletsNumIndices = 0;
+            if (lod == 0 && !boundingBox.m_meshlets.empty() && pNode->m_instanceCount == 0 && !bSkinned && boundingBox.m_targets.empty())
+            {
+                if (m_visibleMeshlets.size() < boundingBox.m_meshlets.size())
+                    m_visibleMeshlets.resize(boundingBox.m_meshlets.size());
 
-                PBRMaterialParameters *pPbrParams = &pPrimitive->m_pMaterial->m_pbrMaterialParameters;
+                uint32_t visibleMeshlets = CullMeshlets(boundingBox, mNearestWorld, pGLTFCommon->m_perFrameData.mCameraCurrViewProj, pGLTFCommon->m_perFrameData.cameraPos, !pPbrParams->m_doubleSided, m_visibleMeshlets.data());
+                if (visibleMeshlets == 0)
+                    continue;
 
-                // Set per Object constants from material
-                //
-                per_object cbPerObject;
-                cbPerObject.mCurrentWorld = pNodesMatrices[i].GetCurrent();
-                cbPerObject.mPreviousWorld = pNodesMatrices[i].GetPrevious();
-                cbPerObject.m_pbrParams = pPbrParams->m_params;
-                D3D12_GPU_VIRTUAL_ADDRESS perObjectDesc = m_pDynamicBufferRing->AllocConstantBuffer(sizeof(per_object), &cbPerObject);
-
-                // compute depth for sorting
-                //                
-                XMVECTOR v = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes[pNode->meshIndex].m_pPrimitives[p].m_center;
-                float depth = XMVectorGetW(XMVector4Transform(v, mModelViewProj));
-
-                BatchList t;
-                t.m_depth = depth;
-                t.m_pPrimitive = pPrimitive;
-                t.m_perFrameDesc = m_pGLTFTexturesAndBuffers->GetPerFrameConstants();
-                t.m_perObjectDesc = perObjectDesc;
-                t.m_pPerSkeleton = pPerSkeleton;
-
-                // append primitive to list 
-                //
-                if (pPbrParams->m_blending == false)
+                if (visibleMeshlets < boundingBox.m_meshlets.size())
                 {
-                    pSolid->push_back(t);
-                }
-                else
-                {
-                    pTransparent->push_back(t);
+                    uint32_t numIndices = 0;
+                    for (uint32_t m = 0; m < visibleMeshlets; m++)
+                        numIndices += boundingBox.m_meshlets[m_visibleMeshlets[m]].m_triangleCount * 3;
+
+                    // if the ring is full the whole primitive gets drawn
+                    uint32_t *pIndices;
+                    if (m_pDynamicBufferRing->AllocIndexBuffer(numIndices, sizeof(uint32_t), (void **)&pIndices, &meshletsIBV))
+                        meshletsNumIndices = GetMeshletsIndices(boundingBox, m_visibleMeshlets.data(), visibleMeshlets, pIndices);
                 }
             }
+
+            // Set per Object constants from material
+            //
+            per_object cbPerObject;
+            cbPerObject.mCurrentWorld = pNodesMatrices[i].GetCurrent();
+            cbPerObject.mPreviousWorld = pNodesMatrices[i].GetPrevious();
+            cbPerObject.m_pbrParams = pPbrParams->m_params;
+            D3D12_GPU_VIRTUAL_ADDRESS perObjectDesc = m_pDynamicBufferRing->AllocConstantBuffer(sizeof(per_object), &cbPerObject);
+
+            // compute depth for sorting, the nearest instance for instanced nodes and the world space sphere for the skinned ones
+            //
+            float depth;
+            if (bSkinned)
+                depth = XMVectorGetW(XMVector4Transform(XMVectorSet(worldSphere.x, worldSphere.y, worldSphere.z, 1.0f), pGLTFCommon->m_perFrameData.mCameraCurrViewProj));
+            else
+                depth = XMVectorGetW(XMVector4Transform(boundingBox.m_center, mNearestWorld * pGLTFCommon->m_perFrameData.mCameraCurrViewProj));
+
+            BatchList t;
+            t.m_depth = depth;
+            t.m_pPrimitive = pPrimitive;
+            t.m_perFrameDesc = m_pGLTFTexturesAndBuffers->GetPerFrameConstants();
+            t.m_perObjectDesc = perObjectDesc;
+            t.m_pPerSkeleton = pPerSkeleton;
+            t.m_lod = lod;
+            t.m_meshletsIBV = meshletsIBV;
+            t.m_meshletsNumIndices = meshletsNumIndices;
+            t.m_instances = instances;
+            m_pGLTFTexturesAndBuffers->GetMorphedStreams(i, p, &t.m_morphed);
+
+            // append primitive to list 
+            //
+            if (pPbrParams->m_blending == false)
+            {
+                pSolid->push_back(t);
+            }
+            else
+            {
+                pTransparent->push_back(t);
+            }
         }
     }
 
@@ -498,16 +554,22 @@ namespace CAULDRON_DX12
 
         for (auto &t : *pBatchList)
         {
-            t.m_pPrimitive->DrawPrimitive(pCommandList, pShadowBufferSRV, t.m_perFrameDesc, t.m_perObjectDesc, t.m_pPerSkeleton);
+            t.m_pPrimitive->DrawPrimitive(pCommandList, pShadowBufferSRV, t.m_perFrameDesc, t.m_perObjectDesc, t.m_pPerSkeleton, t.m_lod, t.m_meshletsIBV, t.m_meshletsNumIndices, t.m_instances, t.m_morphed);
         }
     }
 
-    void PBRPrimitives::DrawPrimitive(ID3D12GraphicsCommandList *pCommandList, CBV_SRV_UAV *pShadowBufferSRV, D3D12_GPU_VIRTUAL_ADDRESS perFrameDesc, D3D12_GPU_VIRTUAL_ADDRESS perObjectDesc, D3D12_GPU_VIRTUAL_ADDRESS pPerSkeleton)
+    void PBRPrimitives::DrawPrimitive(ID3D12GraphicsCommandList *pCommandList, CBV_SRV_UAV *pShadowBufferSRV, D3D12_GPU_VIRTUAL_ADDRESS perFrameDesc, D3D12_GPU_VIRTUAL_ADDRESS perObjectDesc, D3D12_GPU_VIRTUAL_ADDRESS pPerSkeleton, int lod, const D3D12_INDEX_BUFFER_VIEW &meshletsIBV, uint32_t meshletsNumIndices, const InstanceBuffers &instances, const MorphedStreams &morphed)
     {
-        // Bind indices and vertices using the right offsets into the buffer
+        // Bind indices and vertices using the right offsets into the buffer, the levels of detail and the culled meshlets only swap the index buffer
         //
-        pCommandList->IASetIndexBuffer(&m_geometry.m_IBV);
+        if (meshletsNumIndices > 0)
+            pCommandList->IASetIndexBuffer(&meshletsIBV);
+        else
+            pCommandList->IASetIndexBuffer((lod > 0) ? &m_geometry.m_lodIBV[lod - 1] : &m_geometry.m_IBV);
         pCommandList->IASetVertexBuffers(0, (UINT)m_geometry.m_VBV.size(), m_geometry.m_VBV.data());
+        BindMorphedStreams(pCommandList, m_geometry, morphed);
+        if (m_geometry.m_bInstanced)
+            pCommandList->IASetVertexBuffers((UINT)m_geometry.m_VBV.size(), 3, instances.m_VBV);
 
         // Bind Descriptor sets
         //
@@ -542,6 +604,7 @@ namespace CAULDRON_DX12
 
         // Draw
         //
-        pCommandList->DrawIndexedInstanced(m_geometry.m_NumIndices, 1, 0, 0, 0);
+        uint32_t numIndices = (meshletsNumIndices > 0) ? meshletsNumIndices : (lod > 0) ? m_geometry.m_lodNumIndices[lod - 1] : m_geometry.m_NumIndices;
+        pCommandList->DrawIndexedInstanced(numIndices, instances.m_instanceCount, 0, 0, instances.m_startInstance);
     }
 }
\ No newline at end of file
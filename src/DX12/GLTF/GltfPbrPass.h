@@ -44,7 +44,7 @@ namespace CAULDRON_DX12
         ID3D12RootSignature	*m_RootSignature;
         ID3D12PipelineState	*m_PipelineRender;
 
-        void DrawPrimitive(ID3D12GraphicsCommandList *pCommandList, CBV_SRV_UAV *pShadowBufferSRV, D3D12_GPU_VIRTUAL_ADDRESS perSceneDesc, D3D12_GPU_VIRTUAL_ADDRESS perObjectDesc, D3D12_GPU_VIRTUAL_ADDRESS pPerSkeleton);
+        void DrawPrimitive(ID3D12GraphicsCommandList *pCommandList, CBV_SRV_UAV *pShadowBufferSRV, D3D12_GPU_VIRTUAL_ADDRESS perSceneDesc, D3D12_GPU_VIRTUAL_ADDRESS perObjectDesc, D3D12_GPU_VIRTUAL_ADDRESS pPerSkeleton, int lod, const D3D12_INDEX_BUFFER_VIEW &meshletsIBV, uint32_t meshletsNumIndices, const InstanceBuffers &instances, const MorphedStreams &morphed);
     };
 
     struct PBRMesh
@@ -70,6 +70,11 @@ namespace CAULDRON_DX12
             D3D12_GPU_VIRTUAL_ADDRESS m_perFrameDesc;
             D3D12_GPU_VIRTUAL_ADDRESS m_perObjectDesc;
             D3D12_GPU_VIRTUAL_ADDRESS m_pPerSkeleton;
+            int m_lod;                      // 0 is the full detail, see SelectLod()
+            D3D12_INDEX_BUFFER_VIEW m_meshletsIBV; // indices of the visible meshlets when some got culled, see CullMeshlets()
+            uint32_t m_meshletsNumIndices = 0;     // 0 draws the whole primitive
+            InstanceBuffers m_instances;    // only bound if the geometry is instanced
+            MorphedStreams m_morphed;       // only bound if the node has morph target weights
             operator float() { return -m_depth; }
         };
 
@@ -100,6 +105,8 @@ namespace CAULDRON_DX12
 
         std::vector<PBRMesh>     m_meshes;
         std::vector<PBRMaterial> m_materialsData;
+        std::vector<uint32_t>    m_visiblePrimitives;   // scratch for GLTFCommon::CullPrimitives(), kept so it doesn't allocate every frame
+        std::vector<uint32_t>    m_visibleMeshlets;     // same for CullMeshlets()
 
         GltfPbrPass::per_frame   m_cbPerFrame;
 
@@ -22,9 +22,23 @@
 
 namespace CAULDRON_DX12
 {
-    DXGI_FORMAT GetFormat(const std::string &str, int id)
+    DXGI_FORMAT GetFormat(int dimension, int id, bool normalized)
     {
-        if (str == "SCALAR")
+        // KHR_mesh_quantization, normalized 8 and 16 bit attributes get unpacked by the input assembler, the rest are read as integers.
+        // VEC3 elements are padded to 4 bytes so they are read as VEC4
+        //
+        if (normalized)
+        {
+            switch (id)
+            {
+            case 5120: return (dimension == 1) ? DXGI_FORMAT_R8_SNORM : (dimension == 2) ? DXGI_FORMAT_R8G8_SNORM : DXGI_FORMAT_R8G8B8A8_SNORM; //(BYTE)
+            case 5121: return (dimension == 1) ? DXGI_FORMAT_R8_UNORM : (dimension == 2) ? DXGI_FORMAT_R8G8_UNORM : DXGI_FORMAT_R8G8B8A8_UNORM; //(UNSIGNED_BYTE)1
+            case 5122: return (dimension == 1) ? DXGI_FORMAT_R16_SNORM : (dimension == 2) ? DXGI_FORMAT_R16G16_SNORM : DXGI_FORMAT_R16G16B16A16_SNORM; //(SHORT)2
+            case 5123: return (dimension == 1) ? DXGI_FORMAT_R16_UNORM : (dimension == 2) ? DXGI_FORMAT_R16G16_UNORM : DXGI_FORMAT_R16G16B16A16_UNORM; //(UNSIGNED_SHORT)2
+            }
+        }
+
+        if (dimension == 1)
         {
             switch (id)
             {
@@ -37,7 +51,7 @@ namespace CAULDRON_DX12
             case 5126: return DXGI_FORMAT_R32_FLOAT; //(FLOAT)
             }
         }
-        else if (str == "VEC2")
+        else if (dimension == 2)
         {
             switch (id)
             {
@@ -50,20 +64,20 @@ namespace CAULDRON_DX12
             case 5126: return DXGI_FORMAT_R32G32_FLOAT; //(FLOAT)
             }
         }
-        else if (str == "VEC3")
+        else if (dimension == 3)
         {
             switch (id)
             {
-            case 5120: return DXGI_FORMAT_UNKNOWN; //(BYTE)
-            case 5121: return DXGI_FORMAT_UNKNOWN; //(UNSIGNED_BYTE)1
-            case 5122: return DXGI_FORMAT_UNKNOWN; //(SHORT)2
-            case 5123: return DXGI_FORMAT_UNKNOWN; //(UNSIGNED_SHORT)2
+            case 5120: return DXGI_FORMAT_R8G8B8A8_SINT; //(BYTE)
+            case 5121: return DXGI_FORMAT_R8G8B8A8_UINT; //(UNSIGNED_BYTE)1
+            case 5122: return DXGI_FORMAT_R16G16B16A16_SINT; //(SHORT)2
+            case 5123: return DXGI_FORMAT_R16G16B16A16_UINT; //(UNSIGNED_SHORT)2
             case 5124: return DXGI_FORMAT_R32G32B32_SINT; //(SIGNED_INT)4
             case 5125: return DXGI_FORMAT_R32G32B32_UINT; //(UNSIGNED_INT)4
             case 5126: return DXGI_FORMAT_R32G32B32_FLOAT; //(FLOAT)
             }
         }
-        else if (str == "VEC4")
+        else if (dimension == 4)
         {
             switch (id)
             {
@@ -22,7 +22,7 @@
 
 namespace CAULDRON_DX12
 {
-    DXGI_FORMAT GetFormat(const std::string &str, int id);
+    DXGI_FORMAT GetFormat(int dimension, int id, bool normalized = false);
     void CreateSamplerForPBR(uint32_t samplerIndex, D3D12_STATIC_SAMPLER_DESC *pSamplerDesc);
     void CreateSamplerForBrdfLut(uint32_t samplerIndex, D3D12_STATIC_SAMPLER_DESC *pSamplerDesc);
     void CreateSamplerForShadowMap(uint32_t samplerIndex, D3D12_STATIC_SAMPLER_DESC *pSamplerDesc);
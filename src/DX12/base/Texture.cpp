@@ -540,19 +540,28 @@ namespace CAULDRON_DX12
     // entry function to initialize an image from a .DDS texture
     //--------------------------------------------------------------------------------------
     bool Texture::InitFromFile(Device* pDevice, UploadHeap* pUploadHeap, const char* pFilename, bool useSRGB, float cutOff, D3D12_RESOURCE_FLAGS resourceFlags)
+    {
+        ImgLoader* img = CreateImageLoader(pFilename);
+        bool result = InitFromLoader(pDevice, pUploadHeap, img, pFilename, useSRGB, cutOff, resourceFlags);
+        delete(img);
+
+        return result;
+    }
+
+    //--------------------------------------------------------------------------------------
+    // same as above but the caller provides the loader, (i.e. to load cooked images)
+    //--------------------------------------------------------------------------------------
+    bool Texture::InitFromLoader(Device* pDevice, UploadHeap* pUploadHeap, ImgLoader *pImgLoader, const char* pFilename, bool useSRGB, float cutOff, D3D12_RESOURCE_FLAGS resourceFlags)
     {
         assert(m_pResource == NULL);
 
-        ImgLoader* img = CreateImageLoader(pFilename);
-        bool result = img->Load(pFilename, cutOff, &m_header);
+        bool result = pImgLoader->Load(pFilename, cutOff, &m_header);
         if (result)
         {
             CreateTextureCommitted(pDevice, pFilename, useSRGB, resourceFlags);
-            LoadAndUpload(pDevice, pUploadHeap, img, m_pResource);
+            LoadAndUpload(pDevice, pUploadHeap, pImgLoader, m_pResource);
         }
 
-        delete(img);
-
         return result;
     }
 }
\ No newline at end of file
@@ -24,9 +24,18 @@
 //  For VS input struct
 //--------------------------------------------------------------------------------------
 
+// KHR_mesh_quantization, DX12 has no SCALED vertex formats so the quantized positions and uvs that are not normalized come in as 
+// integers (the <ATTRIBUTE>_SINT/_UINT defines), gltfVertexFactory() converts them to floats
+//
 struct VS_INPUT_SCENE
 {
+#if defined(POSITION_SINT)
+    int3 Position       :    POSITION;
+#elif defined(POSITION_UINT)
+    uint3 Position      :    POSITION;
+#else
     float3 Position : POSITION; // vertex position
+#endif
 #ifdef HAS_NORMAL
     float3 Normal       :    NORMAL;        // this normal comes in per-vertex
 #endif
@@ -34,11 +43,23 @@ struct VS_INPUT_SCENE
     float4 Tangent      :    TANGENT;       // this normal comes in per-vertex
 #endif
 #ifdef HAS_TEXCOORD_0
+#if defined(TEXCOORD_0_SINT)
+    int2 UV0            :    TEXCOORD0;
+#elif defined(TEXCOORD_0_UINT)
+    uint2 UV0           :    TEXCOORD0;
+#else
     float2 UV0          :    TEXCOORD0;    // vertex texture coords
 #endif
+#endif
 #ifdef HAS_TEXCOORD_1
+#if defined(TEXCOORD_1_SINT)
+    int2 UV1            :    TEXCOORD1;
+#elif defined(TEXCOORD_1_UINT)
+    uint2 UV1           :    TEXCOORD1;
+#else
     float2 UV1          :    TEXCOORD1;    // vertex texture coords
 #endif
+#endif
 
 #ifdef HAS_COLOR_0
     float4 Color0       :    COLOR0;
@@ -61,8 +82,38 @@ struct VS_INPUT_SCENE
 #ifdef HAS_JOINTS_1
     uint4 Joints1       :    JOINTS1;
 #endif
+
+    // EXT_mesh_gpu_instancing, these come in per-instance
+    //
+#ifdef HAS_INSTANCING
+    float3 InstanceTranslation : INSTANCE_TRANSLATION;
+    float4 InstanceRotation    : INSTANCE_ROTATION;
+    float3 InstanceScale       : INSTANCE_SCALE;
+#endif
 };
 
+#ifdef HAS_INSTANCING
+//--------------------------------------------------------------------------------------
+// Instance TRS to matrix, it goes before the world matrix of the node
+//--------------------------------------------------------------------------------------
+matrix GetInstanceMatrix(float3 t, float4 q, float3 s)
+{
+    float3 q2 = q.xyz * 2;
+    float xx = q.x * q2.x, yy = q.y * q2.y, zz = q.z * q2.z;
+    float xy = q.x * q2.y, xz = q.x * q2.z, yz = q.y * q2.z;
+    float wx = q.w * q2.x, wy = q.w * q2.y, wz = q.w * q2.z;
+
+    matrix instanceMatrix =
+    {
+        { (1 - yy - zz) * s.x, (xy - wz) * s.y,     (xz + wy) * s.z,     t.x },
+        { (xy + wz) * s.x,     (1 - xx - zz) * s.y, (yz - wx) * s.z,     t.y },
+        { (xz - wy) * s.x,     (yz + wx) * s.y,     (1 - xx - yy) * s.z, t.z },
+        { 0, 0, 0, 1 }
+    };
+    return instanceMatrix;
+}
+#endif
+
 //--------------------------------------------------------------------------------------
 // mainVS
 //--------------------------------------------------------------------------------------
@@ -70,6 +121,8 @@ VS_OUTPUT_SCENE gltfVertexFactory(VS_INPUT_SCENE input)
 {
     VS_OUTPUT_SCENE Output;
 
+    float3 position = (float3)input.Position;
+
 #ifdef HAS_WEIGHTS_0
     matrix skinningMatrix;
     skinningMatrix  = GetCurrentSkinningMatrix(input.Weights0, input.Joints0);
@@ -86,8 +139,13 @@ VS_OUTPUT_SCENE gltfVertexFactory(VS_INPUT_SCENE input)
     };
 #endif
 
+#ifdef HAS_INSTANCING
+    matrix instanceMatrix = GetInstanceMatrix(input.InstanceTranslation, input.InstanceRotation, input.InstanceScale);
+    matrix transMatrix = mul(mul(GetWorldMatrix(), instanceMatrix), skinningMatrix);
+#else
     matrix transMatrix = mul(GetWorldMatrix(), skinningMatrix);
-    Output.WorldPos = mul(transMatrix, float4(input.Position, 1)).xyz;
+#endif
+    Output.WorldPos = mul(transMatrix, float4(position, 1)).xyz;
     Output.svPosition = mul(GetCameraViewProj(), float4(Output.WorldPos, 1));
 
 #ifdef HAS_MOTION_VECTORS
@@ -110,8 +168,12 @@ VS_OUTPUT_SCENE gltfVertexFactory(VS_INPUT_SCENE input)
 
     Output.svCurrPosition = Output.svPosition; // current's frame vertex position 
 
+#ifdef HAS_INSTANCING
+    matrix prevTransMatrix = mul(mul(GetPrevWorldMatrix(), instanceMatrix), prevSkinningMatrix);
+#else
     matrix prevTransMatrix = mul(GetPrevWorldMatrix(), prevSkinningMatrix);
-    float3 worldPrevPos = mul(prevTransMatrix, float4(input.Position, 1)).xyz;
+#endif
+    float3 worldPrevPos = mul(prevTransMatrix, float4(position, 1)).xyz;
     Output.svPrevPosition = mul(GetPrevCameraViewProj(), float4(worldPrevPos, 1));
 #endif
 
@@ -129,11 +191,11 @@ VS_OUTPUT_SCENE gltfVertexFactory(VS_INPUT_SCENE input)
 #endif
 
 #ifdef HAS_TEXCOORD_0
-    Output.UV0 = input.UV0;
+    Output.UV0 = (float2)input.UV0;
 #endif
 
 #ifdef HAS_TEXCOORD_1
-    Output.UV1 = input.UV1;
+    Output.UV1 = (float2)input.UV1;
 #endif
 
     return Output;
@@ -33,19 +33,51 @@ namespace CAULDRON_VK
         uint32_t m_NumIndices;
         VkDescriptorBufferInfo m_IBV;
         std::vector<VkDescriptorBufferInfo> m_VBV;
+
+        // coarser levels of detail, entry i is tfPrimitives::m_lods[i], they use the same vertex buffers
+        std::vector<uint32_t> m_lodNumIndices;
+        std::vector<VkDescriptorBufferInfo> m_lodIBV;
+
+        // EXT_mesh_gpu_instancing, the per instance streams get bound right after m_VBV, see AddInstanceStreams()
+        bool m_bInstanced = false;
+
+        // morph targets, the bindings of m_VBV the blended POSITION and NORMAL streams replace, -1 when no target moves them
+        int m_morphSlots[MORPH_STREAM_COUNT] = { -1, -1 };
+    };
+
+    // EXT_mesh_gpu_instancing, per instance streams (translation, rotation and scale) and instance range of a draw
+    struct InstanceBuffers
+    {
+        VkDescriptorBufferInfo m_VBV[3];
+        uint32_t m_startInstance = 0;
+        uint32_t m_instanceCount = 1;
+    };
+
+    // the bindings of the per instance streams come after the ones of the vertex attributes, see AddInstanceStreams()
+    inline VkVertexInputRate GetVertexInputRate(const DefineList &defines, uint32_t binding)
+    {
+        auto it = defines.find("ID_INSTANCE_TRANSLATION");
+        return (it != defines.end() && binding >= (uint32_t)std::stoi(it->second)) ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
+    }
+
+    // morph targets, the streams of a draw blended this frame, a VK_NULL_HANDLE buffer keeps the stream of the geometry
+    struct MorphedStreams
+    {
+        VkDescriptorBufferInfo m_VBV[MORPH_STREAM_COUNT] = {};
     };
 
+    // binds the morphed streams over the ones of the geometry, call it after binding m_VBV
+    void BindMorphedStreams(VkCommandBuffer cmd_buf, const Geometry &geometry, const MorphedStreams &streams);
+
     class GLTFTexturesAndBuffers
     {
         Device* m_pDevice;
         UploadHeap *m_pUploadHeap;
 
-        const json *m_pTextureNodes;
-
         std::vector<Texture> m_textures;
         std::vector<VkImageView> m_textureViews;
 
-        std::map<int, VkDescriptorBufferInfo> m_skeletonMatricesBuffer;
+        std::vector<VkDescriptorBufferInfo> m_skeletonMatricesBuffer;   // indexed by skin
 
         StaticBufferPool *m_pStaticBufferPool;
         DynamicBufferRing *m_pDynamicBufferRing;
@@ -54,6 +86,20 @@ namespace CAULDRON_VK
         std::map<int, VkDescriptorBufferInfo> m_vertexBufferMap;
         std::map<int, VkDescriptorBufferInfo> m_IndexBufferMap;
 
+        // instances of all the nodes, the last one is an identity instance for the nodes that are not instanced
+        VkDescriptorBufferInfo m_instanceVBV[3] = {};
+
+        // morph targets, the streams blended this frame, each node with weights takes one entry per primitive starting at m_firstMorphedStreams
+        std::vector<MorphedStreams> m_morphedStreams;
+        std::vector<int> m_firstMorphedStreams;        // -1 for the nodes that are not morphed
+        // the blend of each morphed node is kept and only redone when its weights change, the ring gets a copy every frame
+        struct MorphedNode
+        {
+            std::vector<float> m_weights;                   // the weights of the last blend, empty when there is none
+            std::vector<std::vector<float>> m_vertices;     // blended streams, MORPH_STREAM_COUNT per primitive
+        };
+        std::vector<MorphedNode> m_morphedNodes;
+
     public:
         GLTFCommon *m_pGLTFCommon;
 
@@ -66,12 +112,19 @@ namespace CAULDRON_VK
 
         void CreateIndexBuffer(int indexBufferId, uint32_t *pNumIndices, VkIndexType *pIndexType, VkDescriptorBufferInfo *pIBV);
         void CreateGeometry(int indexBufferId, std::vector<int> &vertexBufferIds, Geometry *pGeometry);
-        void CreateGeometry(const json &primitive, const std::vector<std::string> requiredAttributes, std::vector<VkVertexInputAttributeDescription> &layout, DefineList &defines, Geometry *pGeometry);
+        void CreateGeometry(const tfPrimitives &primitive, const std::vector<std::string> requiredAttributes, std::vector<VkVertexInputAttributeDescription> &layout, DefineList &defines, Geometry *pGeometry);
+
+        // EXT_mesh_gpu_instancing
+        void AddInstanceStreams(std::vector<VkVertexInputAttributeDescription> &layout, DefineList &defines, Geometry *pGeometry);
+        void GetInstanceBuffers(int nodeIndex, InstanceBuffers *pInstances);
+        uint32_t CullInstances(int nodeIndex, const tfPrimitives &bounds, InstanceBuffers *pInstances, XMMATRIX *pNearestWorld);
 
         VkImageView GetTextureViewByID(int id);
 
         VkDescriptorBufferInfo *GetSkinningMatricesBuffer(int skinIndex);
         void SetSkinningMatricesForSkeletons();
         void SetPerFrameConstants();
+        void SetMorphedStreams();   // blends the morph targets of the nodes with weights, once per frame after SetAnimationTime()
+        void GetMorphedStreams(int nodeIndex, int primitiveIndex, MorphedStreams *pStreams);
     };
 }
\ No newline at end of file
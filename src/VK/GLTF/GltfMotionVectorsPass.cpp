@@ -185,35 +185,33 @@ namespace CAULDRON_VK
 
         // Load Meshes
         //
-        if (j3.find("meshes") != j3.end())
+        if (pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes.size() > 0)
         {
-            const json &meshes = j3["meshes"];
-            const json &accessors = j3["accessors"];
+            const std::vector<tfMesh> &meshes = pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes;
             m_meshes.resize(meshes.size());
             for (uint32_t i = 0; i < meshes.size(); i++)
             {
                 MotionVectorMesh *tfmesh = &m_meshes[i];
 
-                const json &primitives = meshes[i]["primitives"];
+                const std::vector<tfPrimitives> &primitives = meshes[i].m_pPrimitives;
                 tfmesh->m_pPrimitives.resize(primitives.size());
                 for (uint32_t p = 0; p < primitives.size(); p++)
                 {
-                    const json &primitive = primitives[p];
+                    const tfPrimitives &primitive = primitives[p];
                     MotionVectorPrimitives *pPrimitive = &tfmesh->m_pPrimitives[p];
 
                     ExecAsyncIfThereIsAPool(pAsyncPool, [this, i, formatsCount, normalBufferFormat, renderPass, definesRenderTargets, &primitive, pPrimitive]()
                     {
                         // Set Material
                         //
-                        auto mat = primitive.find("material");
-                        pPrimitive->m_pMaterial = (mat != primitive.end()) ? &m_materialsData[mat.value()] : &m_defaultMaterial;
+                        pPrimitive->m_pMaterial = (primitive.m_material >= 0) ? &m_materialsData[primitive.m_material] : &m_defaultMaterial;
 
                         // specify attributes needed to render the material
                         //
                         std::vector<std::string> requiredAttributes;
-                        for (auto const & it : primitive["attributes"].items())
+                        for (const tfAttribute &attribute : primitive.m_attributes)
                         {
-                            const std::string semanticName = it.key();
+                            const std::string &semanticName = attribute.m_name;
                             if (
                                 (semanticName == "POSITION") ||
                                 (semanticName.substr(0, 7) == "WEIGHTS") || // for skinning
@@ -235,6 +233,10 @@ namespace CAULDRON_VK
                         std::vector<VkVertexInputAttributeDescription> layout;
                         m_pGLTFTexturesAndBuffers->CreateGeometry(primitive, requiredAttributes, layout, defines, &pPrimitive->m_geometry);
 
+                        // meshes used by instanced nodes also read the instance transforms
+                        if (m_pGLTFTexturesAndBuffers->m_pGLTFCommon->IsMeshInstanced(i))
+                            m_pGLTFTexturesAndBuffers->AddInstanceStreams(layout, defines, &pPrimitive->m_geometry);
+
                         // Create Pipeline
                         //
                         int skinId = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->FindMeshSkinId(i);
@@ -368,7 +370,7 @@ namespace CAULDRON_VK
             {
                 vi_binding[i].binding = layout[i].binding;
                 vi_binding[i].stride = SizeOfFormat(layout[i].format);
-                vi_binding[i].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+                vi_binding[i].inputRate = GetVertexInputRate(defines, layout[i].binding);
             }
 
             VkPipelineVertexInputStateCreateInfo vi = {};
@@ -581,6 +583,19 @@ namespace CAULDRON_VK
                     vkCmdBindVertexBuffers(cmd_buf, i, 1, &pGeometry->m_VBV[i].buffer, &pGeometry->m_VBV[i].offset);
                 }
 
+                MorphedStreams morphed;
+                m_pGLTFTexturesAndBuffers->GetMorphedStreams(i, p, &morphed);
+                BindMorphedStreams(cmd_buf, *pGeometry, morphed);
+
+                // all the instances of the node, this pass doesn't cull
+                InstanceBuffers instances;
+                if (pGeometry->m_bInstanced)
+                {
+                    m_pGLTFTexturesAndBuffers->GetInstanceBuffers(i, &instances);
+                    for (uint32_t stream = 0; stream < 3; stream++)
+                        vkCmdBindVertexBuffers(cmd_buf, (uint32_t)pGeometry->m_VBV.size() + stream, 1, &instances.m_VBV[stream].buffer, &instances.m_VBV[stream].offset);
+                }
+
                 vkCmdBindIndexBuffer(cmd_buf, pGeometry->m_IBV.buffer, pGeometry->m_IBV.offset, pGeometry->m_indexType);
 
                 // Bind Descriptor sets
@@ -599,7 +614,7 @@ namespace CAULDRON_VK
 
                 // Draw
                 //
-                vkCmdDrawIndexed(cmd_buf, pGeometry->m_NumIndices, 1, 0, 0, 0);
+                vkCmdDrawIndexed(cmd_buf, pGeometry->m_NumIndices, instances.m_instanceCount, 0, 0, instances.m_startInstance);
             }
         }
 
@@ -20,6 +20,8 @@
 #include "stdafx.h"
 #include "Misc/Async.h"
 #include "GltfHelpers.h"
+#include "GLTF/GltfSimplifier.h"
+#include "GLTF/GltfMeshlets.h"
 #include "Base/Helper.h"
 #include "Base/ShaderCompilerHelper.h"
 #include "Base/ExtDebugUtils.h"
@@ -157,14 +159,14 @@ namespace CAULDRON_VK
 
         // Load Meshes
         //
-        if (j3.find("meshes") != j3.end())
+        if (pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes.size() > 0)
         {
-            const json &meshes = j3["meshes"];
+            const std::vector<tfMesh> &meshes = pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes;
 
             m_meshes.resize(meshes.size());
             for (uint32_t i = 0; i < meshes.size(); i++)
             {
-                const json &primitives = meshes[i]["primitives"];
+                const std::vector<tfPrimitives> &primitives = meshes[i].m_pPrimitives;
 
                 // Loop through all the primitives (sets of triangles with a same material) and 
                 // 1) create an input layout for the geometry
@@ -176,15 +178,14 @@ namespace CAULDRON_VK
 
                 for (uint32_t p = 0; p < primitives.size(); p++)
                 {
-                    const json &primitive = primitives[p];                
+                    const tfPrimitives &primitive = primitives[p];
                     PBRPrimitives *pPrimitive = &tfmesh->m_pPrimitives[p];
 
                     ExecAsyncIfThereIsAPool(pAsyncPool, [this, i, rtDefines, &primitive, pPrimitive, bUseSSAOMask]()
                     {
                         // Sets primitive's material, or set a default material if none was specified in the GLTF
                         //
-                        auto mat = primitive.find("material");
-                        pPrimitive->m_pMaterial = (mat != primitive.end()) ? &m_materialsData[mat.value()] : &m_defaultMaterial;
+                        pPrimitive->m_pMaterial = (primitive.m_material >= 0) ? &m_materialsData[primitive.m_material] : &m_defaultMaterial;
 
                         // holds all the #defines from materials, geometry and texture IDs, the VS & PS shaders need this to get the bindings and code paths
                         //
@@ -193,8 +194,8 @@ namespace CAULDRON_VK
                         // make a list of all the attribute names our pass requires, in the case of PBR we need them all
                         //
                         std::vector<std::string> requiredAttributes;
-                        for (auto const & it : primitive["attributes"].items())
-                            requiredAttributes.push_back(it.key());
+                        for (const tfAttribute &attribute : primitive.m_attributes)
+                            requiredAttributes.push_back(attribute.m_name);
 
                         // create an input layout from the required attributes
                         // shader's can tell the slots from the #defines
@@ -202,6 +203,10 @@ namespace CAULDRON_VK
                         std::vector<VkVertexInputAttributeDescription> inputLayout;
                         m_pGLTFTexturesAndBuffers->CreateGeometry(primitive, requiredAttributes, inputLayout, defines, &pPrimitive->m_geometry);
 
+                        // meshes used by instanced nodes also read the instance transforms
+                        if (m_pGLTFTexturesAndBuffers->m_pGLTFCommon->IsMeshInstanced(i))
+                            m_pGLTFTexturesAndBuffers->AddInstanceStreams(inputLayout, defines, &pPrimitive->m_geometry);
+
                         // Create descriptors and pipelines
                         //
                         int skinId = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->FindMeshSkinId(i);
@@ -459,7 +464,7 @@ namespace CAULDRON_VK
         {
             vi_binding[i].binding = layout[i].binding;
             vi_binding[i].stride = SizeOfFormat(layout[i].format);
-            vi_binding[i].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+            vi_binding[i].inputRate = GetVertexInputRate(defines, layout[i].binding);
         }
 
         VkPipelineVertexInputStateCreateInfo vi = {};
@@ -671,72 +676,123 @@ namespace CAULDRON_VK
     //--------------------------------------------------------------------------------------
     void GltfPbrPass::BuildBatchLists(std::vector<BatchList> *pSolid, std::vector<BatchList> *pTransparent)
     {
-        // loop through nodes
+        const GLTFCommon *pGLTFCommon = m_pGLTFTexturesAndBuffers->m_pGLTFCommon;
+        const std::vector<tfNode> *pNodes = &pGLTFCommon->m_nodes;
+        const Matrix2 *pNodesMatrices = pGLTFCommon->m_worldSpaceMats.data();
+
+        // do frustrum culling on the world space boxes of all the primitives at once
         //
-        std::vector<tfNode> *pNodes = &m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_nodes;
-        Matrix2 *pNodesMatrices = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_worldSpaceMats.data();
+        uint32_t visibleCount = pGLTFCommon->CullPrimitives(pGLTFCommon->m_perFrameData.mCameraCurrViewProj, &m_visiblePrimitives);
 
-        for (uint32_t i = 0; i < pNodes->size(); i++)
+        // loop through the visible primitives
+        //
+        for (uint32_t n = 0; n < visibleCount; n++)
         {
-            tfNode *pNode = &pNodes->at(i);
-            if ((pNode == NULL) || (pNode->meshIndex < 0))
+            uint32_t box = m_visiblePrimitives[n];
+            uint32_t i = pGLTFCommon->m_boxNodes[box];
+            uint32_t p = pGLTFCommon->m_boxPrimitives[box];
+            const tfNode *pNode = &pNodes->at(i);
+            PBRPrimitives *pPrimitive = &m_meshes[pNode->meshIndex].m_pPrimitives[p];
+
+            if (pPrimitive->m_pipeline == VK_NULL_HANDLE)
                 continue;
 
             // skinning matrices constant buffer
             VkDescriptorBufferInfo *pPerSkeleton = m_pGLTFTexturesAndBuffers->GetSkinningMatricesBuffer(pNode->skinIndex);
 
-            XMMATRIX mModelViewProj = pNodesMatrices[i].GetCurrent() * m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_perFrameData.mCameraCurrViewProj;
-
-            // loop through primitives
+            // instanced nodes cull each instance and draw the visible ones at once
             //
-            PBRMesh *pMesh = &m_meshes[pNode->meshIndex];
-            for (uint32_t p = 0; p < pMesh->m_pPrimitives.size(); p++)
+            const tfPrimitives &boundingBox = pGLTFCommon->m_meshes[pNode->meshIndex].m_pPrimitives[p];
+            XMMATRIX mNearestWorld = pNodesMatrices[i].GetCurrent();
+            InstanceBuffers instances;
+            if (pNode->m_instanceCount > 0)
             {
-                PBRPrimitives *pPrimitive = &pMesh->m_pPrimitives[p];
-
-                if (pPrimitive->m_pipeline == VK_NULL_HANDLE)
-                    continue;
-
-                // do frustrum culling
-                //
-                tfPrimitives boundingBox = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes[pNode->meshIndex].m_pPrimitives[p];
-                if (CameraFrustumToBoxCollision(mModelViewProj, boundingBox.m_center, boundingBox.m_radius))
+                if (m_pGLTFTexturesAndBuffers->CullInstances(i, boundingBox, &instances, &mNearestWorld) == 0)
                     continue;
+            }
+            else if (pPrimitive->m_geometry.m_bInstanced)
+            {
+                m_pGLTFTexturesAndBuffers->GetInstanceBuffers(i, &instances);
+            }
 
-                PBRMaterialParameters *pPbrParams = &pPrimitive->m_pMaterial->m_pbrMaterialParameters;
+            PBRMaterialParameters *pPbrParams = &pPrimitive->m_pMaterial->m_pbrMaterialParameters;
 
-                // Set per Object constants from material
-                //
-                per_object *cbPerObject;
-                VkDescriptorBufferInfo perObjectDesc;
-                m_pDynamicBufferRing->AllocConstantBuffer(sizeof(per_object), (void **)&cbPerObject, &perObjectDesc);
-                cbPerObject->mCurrentWorld = pNodesMatrices[i].GetCurrent();
-                cbPerObject->mPreviousWorld = pNodesMatrices[i].GetPrevious();
-                cbPerObject->m_pbrParams = pPbrParams->m_params;
-
-                // compute depth for sorting
-                //
-                XMVECTOR v = m_pGLTFTexturesAndBuffers->m_pGLTFCommon->m_meshes[pNode->meshIndex].m_pPrimitives[p].m_center;
-                float depth = XMVectorGetW(XMVector4Transform(v, mModelViewProj));
+            // pick the level of detail, the skinned ones use their world space sphere since their joints place them and not the node
+            //
+            bool bSkinned = pNode->m_instanceCount == 0 && pNode->skinIndex >= 0 && pNode->skinIndex < (int)pGLTFCommon->m_skins.size();
+            const XMFLOAT4 &worldSphere = pGLTFCommon->m_worldSpheres[box];
+            int lod;
+            if (bSkinned)
+                lod = SelectLod(boundingBox, worldSphere, pGLTFCommon->m_perFrameData.cameraPos, pGLTFCommon->m_lodProjectionScale, pGLTFCommon->m_lodMaxScreenError);
+            else
+                lod = SelectLod(boundingBox, mNearestWorld, pGLTFCommon->m_perFrameData.cameraPos, pGLTFCommon->m_lodProjectionScale, pGLTFCommon->m_lodMaxScreenError);
+
+            // the meshlets are in bind pose and belong to the full detail, the primitives that are static in their space cull them and draw
+            // the visible ones from a compacted index buffer
+            //
+            VkDescriptorBufferInfo meshletsIBV = {};
+            uint32_t meshletsNumIndices = 0;
+            if (lod == 0 && !boundingBox.m_meshlets.empty() && pNode->m_instanceCount == 0 && !bSkinned && boundingBox.m_targets.empty())
+            {
+                if (m_visibleMeshlets.size() < boundingBox.m_meshlets.size())
+                    m_visibleMeshlets.resize(boundingBox.m_meshlets.size());
 
-                BatchList t;
-                t.m_depth = depth;
-                t.m_pPrimitive = pPrimitive;
-                t.m_perFrameDesc = m_pGLTFTexturesAndBuffers->m_perFrameConstants;
-                t.m_perObjectDesc = perObjectDesc;
-                t.m_pPerSkeleton = pPerSkeleton;
+                uint32_t visibleMeshlets = CullMeshlets(boundingBox, mNearestWorld, pGLTFCommon->m_perFrameData.mCameraCurrViewProj, pGLTFCommon->m_perFrameData.cameraPos, !pPbrParams->m_doubleSided, m_visibleMeshlets.data());
+                if (visibleMeshlets == 0)
+                    continue;
 
-                // append primitive to list 
-                //
-                if (pPbrParams->m_blending == false)
+                if (visibleMeshlets < boundingBox.m_meshlets.size())
                 {
-                    pSolid->push_back(t);
-                }
-                else
-                {
-                    pTransparent->push_back(t);
+                    uint32_t numIndices = 0;
+                    for (uint32_t m = 0; m < visibleMeshlets; m++)
+                        numIndices += boundingBox.m_meshlets[m_visibleMeshlets[m]].m_triangleCount * 3;
+
+                    // if the ring is full the whole primitive gets drawn
+                    uint32_t *pIndices;
+                    if (m_pDynamicBufferRing->AllocIndexBuffer(numIndices, sizeof(uint32_t), (void **)&pIndices, &meshletsIBV))
+                        meshletsNumIndices = GetMeshletsIndices(boundingBox, m_visibleMeshlets.data(), visibleMeshlets, pIndices);
                 }
             }
+
+            // Set per Object constants from material
+            //
+            per_object *cbPerObject;
+            VkDescriptorBufferInfo perObjectDesc;
+            m_pDynamicBufferRing->AllocConstantBuffer(sizeof(per_object), (void **)&cbPerObject, &perObjectDesc);
+            cbPerObject->mCurrentWorld = pNodesMatrices[i].GetCurrent();
+            cbPerObject->mPreviousWorld = pNodesMatrices[i].GetPrevious();
+            cbPerObject->m_pbrParams = pPbrParams->m_params;
+
+            // compute depth for sorting, the nearest instance for instanced nodes and the world space sphere for the skinned ones
+            //
+            float depth;
+            if (bSkinned)
+                depth = XMVectorGetW(XMVector4Transform(XMVectorSet(worldSphere.x, worldSphere.y, worldSphere.z, 1.0f), pGLTFCommon->m_perFrameData.mCameraCurrViewProj));
+            else
+                depth = XMVectorGetW(XMVector4Transform(boundingBox.m_center, mNearestWorld * pGLTFCommon->m_perFrameData.mCameraCurrViewProj));
+
+            BatchList t;
+            t.m_depth = depth;
+            t.m_pPrimitive = pPrimitive;
+            t.m_perFrameDesc = m_pGLTFTexturesAndBuffers->m_perFrameConstants;
+            t.m_perObjectDesc = perObjectDesc;
+            t.m_pPerSkeleton = pPerSkeleton;
+            t.m_lod = lod;
+            t.m_meshletsIBV = meshletsIBV;
+            t.m_meshletsNumIndices = meshletsNumIndices;
+            t.m_instances = instances;
+            m_pGLTFTexturesAndBuffers->GetMorphedStreams(i, p, &t.m_morphed);
+
+            // append primitive to list 
+            //
+            if (pPbrParams->m_blending == false)
+            {
+                pSolid->push_back(t);
+            }
+            else
+            {
+                pTransparent->push_back(t);
+            }
         }
     }
 
@@ -746,22 +802,37 @@ namespace CAULDRON_VK
         
         for (auto &t : *pBatchList)
         {
-            t.m_pPrimitive->DrawPrimitive(commandBuffer, t.m_perFrameDesc, t.m_perObjectDesc, t.m_pPerSkeleton);
+            t.m_pPrimitive->DrawPrimitive(commandBuffer, t.m_perFrameDesc, t.m_perObjectDesc, t.m_pPerSkeleton, t.m_lod, t.m_meshletsIBV, t.m_meshletsNumIndices, t.m_instances, t.m_morphed);
         }
 
         SetPerfMarkerEnd(commandBuffer);
     }
 
-    void PBRPrimitives::DrawPrimitive(VkCommandBuffer cmd_buf, VkDescriptorBufferInfo perFrameDesc, VkDescriptorBufferInfo perObjectDesc, VkDescriptorBufferInfo *pPerSkeleton)
+    void PBRPrimitives::DrawPrimitive(VkCommandBuffer cmd_buf, VkDescriptorBufferInfo perFrameDesc, VkDescriptorBufferInfo perObjectDesc, VkDescriptorBufferInfo *pPerSkeleton, int lod, const VkDescriptorBufferInfo &meshletsIBV, uint32_t meshletsNumIndices, const InstanceBuffers &instances, const MorphedStreams &morphed)
     {
-        // Bind indices and vertices using the right offsets into the buffer
+        // Bind indices and vertices using the right offsets into the buffer, the levels of detail and the culled meshlets only swap the index buffer
         //
         for (uint32_t i = 0; i < m_geometry.m_VBV.size(); i++)
         {
             vkCmdBindVertexBuffers(cmd_buf, i, 1, &m_geometry.m_VBV[i].buffer, &m_geometry.m_VBV[i].offset);
         }
+        BindMorphedStreams(cmd_buf, m_geometry, morphed);
+
+        if (m_geometry.m_bInstanced)
+        {
+            for (uint32_t i = 0; i < 3; i++)
+                vkCmdBindVertexBuffers(cmd_buf, (uint32_t)m_geometry.m_VBV.size() + i, 1, &instances.m_VBV[i].buffer, &instances.m_VBV[i].offset);
+        }
 
-        vkCmdBindIndexBuffer(cmd_buf, m_geometry.m_IBV.buffer, m_geometry.m_IBV.offset, m_geometry.m_indexType);
+        if (meshletsNumIndices > 0)
+        {
+            vkCmdBindIndexBuffer(cmd_buf, meshletsIBV.buffer, meshletsIBV.offset, VK_INDEX_TYPE_UINT32);
+        }
+        else
+        {
+            const VkDescriptorBufferInfo &ibv = (lod > 0) ? m_geometry.m_lodIBV[lod - 1] : m_geometry.m_IBV;
+            vkCmdBindIndexBuffer(cmd_buf, ibv.buffer, ibv.offset, m_geometry.m_indexType);
+        }
 
         // Bind Descriptor sets
         //
@@ -779,6 +850,7 @@ namespace CAULDRON_VK
 
         // Draw
         //
-        vkCmdDrawIndexed(cmd_buf, m_geometry.m_NumIndices, 1, 0, 0, 0);
+        uint32_t numIndices = (meshletsNumIndices > 0) ? meshletsNumIndices : (lod > 0) ? m_geometry.m_lodNumIndices[lod - 1] : m_geometry.m_NumIndices;
+        vkCmdDrawIndexed(cmd_buf, numIndices, instances.m_instanceCount, 0, 0, instances.m_startInstance);
     }
 }
\ No newline at end of file
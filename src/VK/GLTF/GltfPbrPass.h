@@ -48,7 +48,7 @@ namespace CAULDRON_VK
         VkDescriptorSet m_uniformsDescriptorSet = VK_NULL_HANDLE;
         VkDescriptorSetLayout m_uniformsDescriptorSetLayout = VK_NULL_HANDLE;
 
-        void DrawPrimitive(VkCommandBuffer cmd_buf, VkDescriptorBufferInfo perSceneDesc, VkDescriptorBufferInfo perObjectDesc, VkDescriptorBufferInfo *pPerSkeleton);
+        void DrawPrimitive(VkCommandBuffer cmd_buf, VkDescriptorBufferInfo perSceneDesc, VkDescriptorBufferInfo perObjectDesc, VkDescriptorBufferInfo *pPerSkeleton, int lod, const VkDescriptorBufferInfo &meshletsIBV, uint32_t meshletsNumIndices, const InstanceBuffers &instances, const MorphedStreams &morphed);
     };
 
     struct PBRMesh
@@ -74,6 +74,11 @@ namespace CAULDRON_VK
             VkDescriptorBufferInfo m_perFrameDesc;
             VkDescriptorBufferInfo m_perObjectDesc;
             VkDescriptorBufferInfo *m_pPerSkeleton;
+            int m_lod;                      // 0 is the full detail, see SelectLod()
+            VkDescriptorBufferInfo m_meshletsIBV; // 32 bit indices of the visible meshlets when some got culled, see CullMeshlets()
+            uint32_t m_meshletsNumIndices = 0;    // 0 draws the whole primitive
+            InstanceBuffers m_instances;    // only bound if the geometry is instanced
+            MorphedStreams m_morphed;       // only bound if the node has morph target weights
             operator float() { return -m_depth; }
         };
 
@@ -104,6 +109,8 @@ namespace CAULDRON_VK
 
         std::vector<PBRMesh> m_meshes;
         std::vector<PBRMaterial> m_materialsData;
+        std::vector<uint32_t> m_visiblePrimitives;     // scratch for GLTFCommon::CullPrimitives(), kept so it doesn't allocate every frame
+        std::vector<uint32_t> m_visibleMeshlets;       // same for CullMeshlets()
 
         GltfPbrPass::per_frame m_cbPerFrame;
 
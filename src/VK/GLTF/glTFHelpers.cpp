@@ -22,9 +22,23 @@
 
 namespace CAULDRON_VK
 {
-    VkFormat GetFormat(const std::string &str, int id)
+    VkFormat GetFormat(int dimension, int id, bool normalized)
     {
-        if (str == "SCALAR")
+        // KHR_mesh_quantization, normalized 8 and 16 bit attributes get unpacked by the input assembler.
+        // VEC3 elements are padded to 4 bytes so they are read as VEC4
+        //
+        if (normalized)
+        {
+            switch (id)
+            {
+            case 5120: return (dimension == 1) ? VK_FORMAT_R8_SNORM : (dimension == 2) ? VK_FORMAT_R8G8_SNORM : VK_FORMAT_R8G8B8A8_SNORM; //(BYTE)
+            case 5121: return (dimension == 1) ? VK_FORMAT_R8_UNORM : (dimension == 2) ? VK_FORMAT_R8G8_UNORM : VK_FORMAT_R8G8B8A8_UNORM; //(UNSIGNED_BYTE)1
+            case 5122: return (dimension == 1) ? VK_FORMAT_R16_SNORM : (dimension == 2) ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R16G16B16A16_SNORM; //(SHORT)2
+            case 5123: return (dimension == 1) ? VK_FORMAT_R16_UNORM : (dimension == 2) ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R16G16B16A16_UNORM; //(UNSIGNED_SHORT)2
+            }
+        }
+
+        if (dimension == 1)
         {
             switch (id)
             {
@@ -37,7 +51,7 @@ namespace CAULDRON_VK
             case 5126: return VK_FORMAT_R32_SFLOAT; //(FLOAT)
             }
         }
-        else if (str == "VEC2")
+        else if (dimension == 2)
         {
             switch (id)
             {
@@ -50,7 +64,7 @@ namespace CAULDRON_VK
             case 5126: return VK_FORMAT_R32G32_SFLOAT; //(FLOAT)
             }
         }
-        else if (str == "VEC3")
+        else if (dimension == 3)
         {
             switch (id)
             {
@@ -63,7 +77,7 @@ namespace CAULDRON_VK
             case 5126: return VK_FORMAT_R32G32B32_SFLOAT; //(FLOAT)
             }
         }
-        else if (str == "VEC4")
+        else if (dimension == 4)
         {
             switch (id)
             {
@@ -80,6 +94,21 @@ namespace CAULDRON_VK
         return VK_FORMAT_UNDEFINED;
     }
 
+    // Integers that are not normalized but need to be read as floats, like the quantized positions and uvs of KHR_mesh_quantization
+    //
+    VkFormat GetScaledFormat(int dimension, int id)
+    {
+        switch (id)
+        {
+        case 5120: return (dimension == 1) ? VK_FORMAT_R8_SSCALED : (dimension == 2) ? VK_FORMAT_R8G8_SSCALED : VK_FORMAT_R8G8B8A8_SSCALED; //(BYTE)
+        case 5121: return (dimension == 1) ? VK_FORMAT_R8_USCALED : (dimension == 2) ? VK_FORMAT_R8G8_USCALED : VK_FORMAT_R8G8B8A8_USCALED; //(UNSIGNED_BYTE)1
+        case 5122: return (dimension == 1) ? VK_FORMAT_R16_SSCALED : (dimension == 2) ? VK_FORMAT_R16G16_SSCALED : VK_FORMAT_R16G16B16A16_SSCALED; //(SHORT)2
+        case 5123: return (dimension == 1) ? VK_FORMAT_R16_USCALED : (dimension == 2) ? VK_FORMAT_R16G16_USCALED : VK_FORMAT_R16G16B16A16_USCALED; //(UNSIGNED_SHORT)2
+        }
+
+        return GetFormat(dimension, id);
+    }
+
     uint32_t SizeOfFormat(VkFormat format)
     {
         switch (format)
@@ -91,6 +120,8 @@ namespace CAULDRON_VK
         case VK_FORMAT_R32_SINT: return 4;//(SIGNED_INT)4
         case VK_FORMAT_R32_UINT: return 4;//(UNSIGNED_INT)4
         case VK_FORMAT_R32_SFLOAT: return 4;//(FLOAT)
+        case VK_FORMAT_R8_SNORM: case VK_FORMAT_R8_UNORM: case VK_FORMAT_R8_SSCALED: case VK_FORMAT_R8_USCALED: return 1;
+        case VK_FORMAT_R16_SNORM: case VK_FORMAT_R16_UNORM: case VK_FORMAT_R16_SSCALED: case VK_FORMAT_R16_USCALED: return 2;
 
         case VK_FORMAT_R8G8_SINT: return 2 * 1;//(BYTE)
         case VK_FORMAT_R8G8_UINT: return 2 * 1;//(UNSIGNED_BYTE)1
@@ -99,6 +130,8 @@ namespace CAULDRON_VK
         case VK_FORMAT_R32G32_SINT: return 2 * 4;//(SIGNED_INT)4
         case VK_FORMAT_R32G32_UINT: return 2 * 4;//(UNSIGNED_INT)4
         case VK_FORMAT_R32G32_SFLOAT: return 2 * 4;//(FLOAT)
+        case VK_FORMAT_R8G8_SNORM: case VK_FORMAT_R8G8_UNORM: case VK_FORMAT_R8G8_SSCALED: case VK_FORMAT_R8G8_USCALED: return 2 * 1;
+        case VK_FORMAT_R16G16_SNORM: case VK_FORMAT_R16G16_UNORM: case VK_FORMAT_R16G16_SSCALED: case VK_FORMAT_R16G16_USCALED: return 2 * 2;
 
         case VK_FORMAT_UNDEFINED: return 0;//(BYTE) (UNSIGNED_BYTE) (SHORT) (UNSIGNED_SHORT)
         case VK_FORMAT_R32G32B32_SINT: return 3 * 4;//(SIGNED_INT)4
@@ -112,6 +145,8 @@ namespace CAULDRON_VK
         case VK_FORMAT_R32G32B32A32_SINT: return 4 * 4;//(SIGNED_INT)4
         case VK_FORMAT_R32G32B32A32_UINT: return 4 * 4;//(UNSIGNED_INT)4
         case VK_FORMAT_R32G32B32A32_SFLOAT: return 4 * 4;//(FLOAT)
+        case VK_FORMAT_R8G8B8A8_SNORM: case VK_FORMAT_R8G8B8A8_UNORM: case VK_FORMAT_R8G8B8A8_SSCALED: case VK_FORMAT_R8G8B8A8_USCALED: return 4 * 1;
+        case VK_FORMAT_R16G16B16A16_SNORM: case VK_FORMAT_R16G16B16A16_UNORM: case VK_FORMAT_R16G16B16A16_SSCALED: case VK_FORMAT_R16G16B16A16_USCALED: return 4 * 2;
         }
 
         return 0;
@@ -23,6 +23,7 @@
 
 namespace CAULDRON_VK
 {
-    VkFormat GetFormat(const std::string &str, int id);
+    VkFormat GetFormat(int dimension, int id, bool normalized = false);
+    VkFormat GetScaledFormat(int dimension, int id);
     uint32_t SizeOfFormat(VkFormat format);
 }
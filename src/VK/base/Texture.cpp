@@ -459,20 +459,29 @@ namespace CAULDRON_VK
     // entry function to initialize an image from a .DDS texture
     //--------------------------------------------------------------------------------------
     bool Texture::InitFromFile(Device *pDevice, UploadHeap *pUploadHeap, const char *pFilename, bool useSRGB, VkImageUsageFlags usageFlags, float cutOff)
+    {
+        ImgLoader* img = CreateImageLoader(pFilename);
+        bool result = InitFromLoader(pDevice, pUploadHeap, img, pFilename, useSRGB, usageFlags, cutOff);
+        delete(img);
+
+        return result;
+    }
+
+    //--------------------------------------------------------------------------------------
+    // same as above but the caller provides the loader, (i.e. to load cooked images)
+    //--------------------------------------------------------------------------------------
+    bool Texture::InitFromLoader(Device *pDevice, UploadHeap *pUploadHeap, ImgLoader *pImgLoader, const char *pFilename, bool useSRGB, VkImageUsageFlags usageFlags, float cutOff)
     {
         m_pDevice = pDevice;
         assert(m_pResource == NULL);
 
-        ImgLoader* img = CreateImageLoader(pFilename);
-        bool result = img->Load(pFilename, cutOff, &m_header);
+        bool result = pImgLoader->Load(pFilename, cutOff, &m_header);
         if (result)
         {
             m_pResource = CreateTextureCommitted(pDevice, pUploadHeap, pFilename, useSRGB, usageFlags);
-            LoadAndUpload(pDevice, pUploadHeap, img, m_pResource);
+            LoadAndUpload(pDevice, pUploadHeap, pImgLoader, m_pResource);
         }
 
-        delete(img);
-
         return result;
     }
 
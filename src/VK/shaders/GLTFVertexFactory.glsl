@@ -45,6 +45,29 @@
     layout (location = ID_JOINTS_1) in  uvec4 a_Joints1;
 #endif
 
+// EXT_mesh_gpu_instancing, these come in per-instance
+#ifdef ID_INSTANCE_TRANSLATION
+    layout (location = ID_INSTANCE_TRANSLATION) in vec3 a_InstanceTranslation;
+    layout (location = ID_INSTANCE_ROTATION) in vec4 a_InstanceRotation;
+    layout (location = ID_INSTANCE_SCALE) in vec3 a_InstanceScale;
+
+// Instance TRS to matrix, it goes before the world matrix of the node
+mat4 GetInstanceMatrix(vec3 t, vec4 q, vec3 s)
+{
+    vec3 q2 = q.xyz * 2.0;
+    float xx = q.x * q2.x, yy = q.y * q2.y, zz = q.z * q2.z;
+    float xy = q.x * q2.y, xz = q.x * q2.z, yz = q.y * q2.z;
+    float wx = q.w * q2.x, wy = q.w * q2.y, wz = q.w * q2.z;
+
+    // the constructor takes columns
+    return mat4(
+        vec4(1.0 - yy - zz, xy + wz, xz - wy, 0.0) * s.x,
+        vec4(xy - wz, 1.0 - xx - zz, yz + wx, 0.0) * s.y,
+        vec4(xz + wy, yz - wx, 1.0 - xx - yy, 0.0) * s.z,
+        vec4(t, 1.0));
+}
+#endif
+
 layout (location = 0) out VS2PS Output;
 
 void gltfVertexFactory()
@@ -65,7 +88,12 @@ void gltfVertexFactory()
     };
 #endif
 
+#ifdef ID_INSTANCE_TRANSLATION
+	mat4 instanceMatrix = GetInstanceMatrix(a_InstanceTranslation, a_InstanceRotation, a_InstanceScale);
+	mat4 transMatrix = GetWorldMatrix() * instanceMatrix * skinningMatrix;
+#else
 	mat4 transMatrix = GetWorldMatrix() * skinningMatrix;
+#endif
 	vec4 pos = transMatrix * vec4(a_Position,1);
 	Output.WorldPos = vec3(pos.xyz) / pos.w;
 	gl_Position = GetCameraViewProj() * pos; // needs w for proper perspective correction
@@ -73,7 +101,11 @@ void gltfVertexFactory()
 #ifdef HAS_MOTION_VECTORS
 	Output.CurrPosition = gl_Position; // current's frame vertex position 
 
+#ifdef ID_INSTANCE_TRANSLATION
+	mat4 prevTransMatrix = GetPrevWorldMatrix() * instanceMatrix * skinningMatrix;
+#else
 	mat4 prevTransMatrix = GetPrevWorldMatrix() * skinningMatrix;
+#endif
 	vec3 worldPrevPos = (prevTransMatrix * vec4(a_Position, 1)).xyz;
 	Output.PrevPosition = GetPrevCameraViewProj() * vec4(worldPrevPos, 1);
 #endif
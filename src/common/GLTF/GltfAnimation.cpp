@@ -0,0 +1,910 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfStructures.h"
+#include "GltfAnimation.h"
+#include "Misc/Misc.h"
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <algorithm>
+
+// sparse values get unpacked once all the channels are known
+struct UnpackedValues
+{
+    tfAnimationChannels *pChannels;         // NULL for the weight channels
+    size_t index;
+    const tfAccessor *pAccessor;
+};
+
+static void AddChannel(const tfSampler *pSampler, int slot, tfAnimationChannels *pLinear, tfAnimationChannels *pCubic, std::vector<UnpackedValues> *pUnpacked)
+{
+    if (pSampler == NULL)
+        return;
+
+    const tfAccessor &value = pSampler->m_value;
+    bool bCubic = (pSampler->m_interpolation == INTERPOLATION_CUBICSPLINE);
+    int valuesPerKey = bCubic ? 3 : 1;
+    if (value.m_count < pSampler->m_time.m_count * valuesPerKey)
+    {
+        Trace(format("Animation sampler with %i keyframe times but only %i values, ignored\n", pSampler->m_time.m_count, value.m_count));
+        return;
+    }
+
+    tfAnimationChannels *pChannels = bCubic ? pCubic : pLinear;
+    pChannels->m_slots.push_back(slot);
+    pChannels->m_timeTracks.push_back(pSampler->m_timeTrack);
+    pChannels->m_decoders.push_back((pSampler->m_keyFormat != KEYS_FLOAT) ? pSampler : NULL);
+    pChannels->m_steps.push_back(pSampler->m_interpolation == INTERPOLATION_STEP);
+
+    // the pointer is set once m_unpackedValues doesn't grow anymore
+    if (value.IsSparse() || value.m_data == NULL)
+    {
+        UnpackedValues unpacked = { pChannels, pChannels->m_values.size(), &value };
+        pUnpacked->push_back(unpacked);
+        pChannels->m_values.push_back(NULL);
+        pChannels->m_strides.push_back(value.m_dimension);
+    }
+    else
+    {
+        pChannels->m_values.push_back((const float *)value.m_data);
+        pChannels->m_strides.push_back(value.m_stride / sizeof(float));
+    }
+}
+
+//
+// Writes the translation, rotation and scale of the transform in a slot of the pose, an identity for a NULL transform
+//
+static void StoreRestPose(const Transform *pTransform, float *pPose, uint32_t stride, uint32_t slot)
+{
+    XMFLOAT3 t(0, 0, 0), s(1, 1, 1);
+    XMFLOAT4 r(0, 0, 0, 1);
+    if (pTransform)
+    {
+        XMStoreFloat3(&t, pTransform->m_translation);
+        XMStoreFloat4(&r, XMQuaternionRotationMatrix(pTransform->m_rotation));
+        XMStoreFloat3(&s, pTransform->m_scale);
+    }
+
+    pPose[POSE_TX * stride + slot] = t.x;
+    pPose[POSE_TY * stride + slot] = t.y;
+    pPose[POSE_TZ * stride + slot] = t.z;
+    pPose[POSE_RX * stride + slot] = r.x;
+    pPose[POSE_RY * stride + slot] = r.y;
+    pPose[POSE_RZ * stride + slot] = r.z;
+    pPose[POSE_RW * stride + slot] = r.w;
+    pPose[POSE_SX * stride + slot] = s.x;
+    pPose[POSE_SY * stride + slot] = s.y;
+    pPose[POSE_SZ * stride + slot] = s.z;
+}
+
+void CompileAnimation(const std::vector<tfNode> &nodes, tfAnimation *pAnimation)
+{
+    tfCompiledAnimation &compiled = pAnimation->m_compiled;
+    compiled = tfCompiledAnimation();
+
+    // m_channels is a map so the nodes come sorted, the ones that only animate morph target weights don't need a matrix
+    for (auto &it : pAnimation->m_channels)
+    {
+        const tfChannel &channel = it.second;
+        if (it.first >= 0 && it.first < (int)nodes.size() && (channel.m_pTranslation || channel.m_pRotation || channel.m_pScale))
+            compiled.m_nodes.push_back(it.first);
+    }
+
+    uint32_t count = (uint32_t)compiled.m_nodes.size();
+    compiled.m_stride = (count + 3) & ~3;
+
+    // the rest pose covers the paths without a channel, the padding is an identity so the composition doesn't produce NaNs
+    compiled.m_pose.resize(POSE_STREAM_COUNT * compiled.m_stride);
+    for (uint32_t i = 0; i < compiled.m_stride; i++)
+    {
+        StoreRestPose((i < count) ? &nodes[compiled.m_nodes[i]].m_tranform : NULL, compiled.m_pose.data(), compiled.m_stride, i);
+    }
+
+    std::vector<UnpackedValues> unpacked;
+    for (uint32_t slot = 0; slot < count; slot++)
+    {
+        const tfChannel &channel = pAnimation->m_channels[compiled.m_nodes[slot]];
+        AddChannel(channel.m_pTranslation, slot, &compiled.m_translations, &compiled.m_cubicTranslations, &unpacked);
+        AddChannel(channel.m_pRotation, slot, &compiled.m_rotations, &compiled.m_cubicRotations, &unpacked);
+        AddChannel(channel.m_pScale, slot, &compiled.m_scales, &compiled.m_cubicScales, &unpacked);
+    }
+
+    for (auto &it : pAnimation->m_channels)
+    {
+        const tfSampler *pSampler = it.second.m_pWeights;
+        if (pSampler == NULL || it.first < 0 || it.first >= (int)nodes.size() || nodes[it.first].m_morphWeightCount == 0)
+            continue;
+
+        const tfNode &node = nodes[it.first];
+        const tfAccessor &value = pSampler->m_value;
+        int valuesPerKey = (pSampler->m_interpolation == INTERPOLATION_CUBICSPLINE) ? 3 : 1;
+        if (value.m_count < pSampler->m_time.m_count * valuesPerKey * (int)node.m_morphWeightCount)
+        {
+            Trace(format("Animation of the weights of node %i with %i keyframe times but only %i values, ignored\n", it.first, pSampler->m_time.m_count, value.m_count));
+            continue;
+        }
+
+        tfWeightChannel weights = { node.m_firstMorphWeight, node.m_morphWeightCount, pSampler->m_timeTrack, (const float *)value.m_data, pSampler->m_interpolation };
+        compiled.m_weights.push_back(weights);
+
+        // the weights of a key are read as a block, strided values get unpacked too
+        if (value.IsSparse() || value.m_data == NULL || value.m_stride != sizeof(float))
+        {
+            UnpackedValues u = { NULL, compiled.m_weights.size() - 1, &value };
+            unpacked.push_back(u);
+        }
+    }
+
+    size_t unpackedSize = 0;
+    for (const UnpackedValues &u : unpacked)
+        unpackedSize += (size_t)u.pAccessor->m_count * u.pAccessor->m_dimension;
+
+    compiled.m_unpackedValues.resize(unpackedSize);
+    float *pUnpacked = compiled.m_unpackedValues.data();
+    for (const UnpackedValues &u : unpacked)
+    {
+        u.pAccessor->CopyTo(pUnpacked);
+        if (u.pChannels)
+            u.pChannels->m_values[u.index] = pUnpacked;
+        else
+            compiled.m_weights[u.index].m_pValues = pUnpacked;
+        pUnpacked += (size_t)u.pAccessor->m_count * u.pAccessor->m_dimension;
+    }
+}
+
+//
+// (x, y, z, 0) without reading past the 3 floats
+//
+static inline __m128 LoadFloat3(const float *p)
+{
+    return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double *)p)), _mm_load_ss(p + 2));
+}
+
+//
+// Writes the 4 lanes of v in the stream, lanes beyond count are ignored. The slots are consecutive for the nodes that have the
+// channel in all the paths (skeletons usually), those take a single store
+//
+static inline void StoreLanes(__m128 v, float *pStream, const int *pSlots, uint32_t lanes)
+{
+    if (lanes == 4 && pSlots[3] == pSlots[0] + 3)
+    {
+        _mm_storeu_ps(pStream + pSlots[0], v);
+        return;
+    }
+
+    float values[4];
+    _mm_storeu_ps(values, v);
+    for (uint32_t k = 0; k < lanes; k++)
+        pStream[pSlots[k]] = values[k];
+}
+
+//
+// The opposite of StoreLanes(), the lanes beyond count repeat the first one
+//
+static inline __m128 LoadLanes(const float *pStream, const int *pSlots, uint32_t lanes)
+{
+    if (lanes == 4 && pSlots[3] == pSlots[0] + 3)
+        return _mm_loadu_ps(pStream + pSlots[0]);
+
+    float values[4];
+    for (uint32_t k = 0; k < 4; k++)
+        values[k] = pStream[pSlots[(k < lanes) ? k : 0]];
+    return _mm_loadu_ps(values);
+}
+
+//
+// Loads the keyframe pairs of 4 channels, transposed so each register holds a component of the 4 channels.
+// The lanes beyond the last channel repeat it
+//
+template<bool bQuaternion>
+static inline void LoadKeys(const tfAnimationChannels &channels, uint32_t first, uint32_t lanes, const int curr[4], const int next[4], __m128 a[4], __m128 b[4])
+{
+    for (uint32_t k = 0; k < 4; k++)
+    {
+        uint32_t c = first + std::min(k, lanes - 1);
+        if (channels.m_decoders[c] != NULL)
+        {
+            float currValue[4] = {}, nextValue[4] = {};
+            channels.m_decoders[c]->GetKey(curr[k], currValue);
+            channels.m_decoders[c]->GetKey(next[k], nextValue);
+            a[k] = _mm_loadu_ps(currValue);
+            b[k] = _mm_loadu_ps(nextValue);
+        }
+        else
+        {
+            const float *pCurr = channels.m_values[c] + curr[k] * channels.m_strides[c];
+            const float *pNext = channels.m_values[c] + next[k] * channels.m_strides[c];
+            a[k] = bQuaternion ? _mm_loadu_ps(pCurr) : LoadFloat3(pCurr);
+            b[k] = bQuaternion ? _mm_loadu_ps(pNext) : LoadFloat3(pNext);
+        }
+    }
+
+    _MM_TRANSPOSE4_PS(a[0], a[1], a[2], a[3]);
+    _MM_TRANSPOSE4_PS(b[0], b[1], b[2], b[3]);
+}
+
+//
+// Same as above taking the keys from the cursors of the time tracks
+//
+template<bool bQuaternion>
+static inline uint32_t GatherKeys(const tfAnimationChannels &channels, const tfTimeTrack *pTimeTracks, uint32_t first, __m128 a[4], __m128 b[4], __m128 *pFrac)
+{
+    uint32_t count = (uint32_t)channels.m_slots.size();
+    uint32_t lanes = std::min<uint32_t>(4, count - first);
+
+    int curr[4], next[4];
+    float frac[4];
+    for (uint32_t k = 0; k < 4; k++)
+    {
+        uint32_t c = first + std::min(k, lanes - 1);
+        const tfTimeTrack &track = pTimeTracks[channels.m_timeTracks[c]];
+
+        // STEP interpolates the key with itself, that is exact for the slerp too
+        curr[k] = track.m_curr;
+        next[k] = channels.m_steps[c] ? track.m_curr : track.m_next;
+        frac[k] = channels.m_steps[c] ? 0.0f : track.m_frac;
+    }
+
+    LoadKeys<bQuaternion>(channels, first, lanes, curr, next, a, b);
+    *pFrac = _mm_loadu_ps(frac);
+    return lanes;
+}
+
+static inline void LerpVectors(const __m128 a[4], const __m128 b[4], __m128 frac, __m128 v[3])
+{
+    for (int c = 0; c < 3; c++)
+        v[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(b[c], a[c]), frac));
+}
+
+//
+// Polynomial approximation of slerp by Eberly, the weights are off by less than 3e-5 for quaternions up to 90 degrees apart,
+// which is always the case once the shortest path is taken
+//
+static const float s_slerpU[8] = { 1.0f / (1 * 3), 1.0f / (2 * 5), 1.0f / (3 * 7), 1.0f / (4 * 9), 1.0f / (5 * 11), 1.0f / (6 * 13), 1.0f / (7 * 15), 1.90110745351730037f / (8 * 17) };
+static const float s_slerpV[8] = { 1.0f / 3, 2.0f / 5, 3.0f / 7, 4.0f / 9, 5.0f / 11, 6.0f / 13, 7.0f / 15, 1.90110745351730037f * 8 / 17 };
+
+static inline __m128 SlerpWeight(__m128 t, __m128 xm1)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sqrT = _mm_mul_ps(t, t);
+    __m128 f = one;
+    for (int i = 7; i >= 0; i--)
+    {
+        __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(s_slerpU[i]), sqrT), _mm_set1_ps(s_slerpV[i])), xm1);
+        f = _mm_add_ps(one, _mm_mul_ps(b, f));
+    }
+    return _mm_mul_ps(t, f);
+}
+
+static inline void SlerpQuaternions(const __m128 a[4], const __m128 b[4], __m128 frac, __m128 v[4])
+{
+    // shortest path, the second quaternion gets flipped when the dot product is negative
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_add_ps(_mm_mul_ps(a[2], b[2]), _mm_mul_ps(a[3], b[3])));
+    __m128 sign = _mm_and_ps(dot, signMask);
+    __m128 xm1 = _mm_sub_ps(_mm_xor_ps(dot, sign), _mm_set1_ps(1.0f));
+
+    __m128 weightA = SlerpWeight(_mm_sub_ps(_mm_set1_ps(1.0f), frac), xm1);
+    __m128 weightB = _mm_xor_ps(SlerpWeight(frac, xm1), sign);
+
+    for (int c = 0; c < 4; c++)
+        v[c] = _mm_add_ps(_mm_mul_ps(a[c], weightA), _mm_mul_ps(b[c], weightB));
+}
+
+static void SampleVectors(const tfAnimationChannels &channels, const tfTimeTrack *pTimeTracks, float *pPose, uint32_t stride)
+{
+    for (uint32_t i = 0; i < channels.m_slots.size(); i += 4)
+    {
+        __m128 a[4], b[4], frac, v[3];
+        uint32_t lanes = GatherKeys<false>(channels, pTimeTracks, i, a, b, &frac);
+
+        LerpVectors(a, b, frac, v);
+        for (int c = 0; c < 3; c++)
+            StoreLanes(v[c], pPose + c * stride, &channels.m_slots[i], lanes);
+    }
+}
+
+static void SampleQuaternions(const tfAnimationChannels &channels, const tfTimeTrack *pTimeTracks, float *pPose, uint32_t stride)
+{
+    for (uint32_t i = 0; i < channels.m_slots.size(); i += 4)
+    {
+        __m128 a[4], b[4], frac, v[4];
+        uint32_t lanes = GatherKeys<true>(channels, pTimeTracks, i, a, b, &frac);
+
+        SlerpQuaternions(a, b, frac, v);
+        for (int c = 0; c < 4; c++)
+            StoreLanes(v[c], pPose + (POSE_RX + c) * stride, &channels.m_slots[i], lanes);
+    }
+}
+
+//
+// CUBICSPLINE, Hermite spline between the values of the keys using the out tangent of the first key and the in tangent of the second,
+// both scaled by the time between the keys. The rotations get normalized afterwards.
+// The channels are never compressed, the values are in the order in tangent, value, out tangent for each key
+//
+template<bool bQuaternion>
+static void SampleCubic(const tfAnimationChannels &channels, const tfTimeTrack *pTimeTracks, float *pStreams, uint32_t stride)
+{
+    const int components = bQuaternion ? 4 : 3;
+    for (uint32_t i = 0; i < channels.m_slots.size(); i += 4)
+    {
+        uint32_t lanes = std::min<uint32_t>(4, (uint32_t)channels.m_slots.size() - i);
+
+        __m128 v0[4], b0[4], a1[4], v1[4];
+        float frac[4], duration[4];
+        for (uint32_t k = 0; k < 4; k++)
+        {
+            uint32_t c = i + std::min(k, lanes - 1);
+            const tfTimeTrack &track = pTimeTracks[channels.m_timeTracks[c]];
+            const float *pValues = channels.m_values[c];
+            int valueStride = channels.m_strides[c];
+
+            const float *pValue0 = pValues + (track.m_curr * 3 + 1) * valueStride;
+            const float *pOut0 = pValues + (track.m_curr * 3 + 2) * valueStride;
+            const float *pIn1 = pValues + (track.m_next * 3 + 0) * valueStride;
+            const float *pValue1 = pValues + (track.m_next * 3 + 1) * valueStride;
+            v0[k] = bQuaternion ? _mm_loadu_ps(pValue0) : LoadFloat3(pValue0);
+            b0[k] = bQuaternion ? _mm_loadu_ps(pOut0) : LoadFloat3(pOut0);
+            a1[k] = bQuaternion ? _mm_loadu_ps(pIn1) : LoadFloat3(pIn1);
+            v1[k] = bQuaternion ? _mm_loadu_ps(pValue1) : LoadFloat3(pValue1);
+
+            frac[k] = track.m_frac;
+            duration[k] = track.m_pTimes[track.m_next] - track.m_pTimes[track.m_curr];
+        }
+
+        _MM_TRANSPOSE4_PS(v0[0], v0[1], v0[2], v0[3]);
+        _MM_TRANSPOSE4_PS(b0[0], b0[1], b0[2], b0[3]);
+        _MM_TRANSPOSE4_PS(a1[0], a1[1], a1[2], a1[3]);
+        _MM_TRANSPOSE4_PS(v1[0], v1[1], v1[2], v1[3]);
+
+        // Hermite basis
+        __m128 t = _mm_loadu_ps(frac);
+        __m128 dt = _mm_loadu_ps(duration);
+        __m128 t2 = _mm_mul_ps(t, t);
+        __m128 t3 = _mm_mul_ps(t2, t);
+        __m128 h01 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), t2), _mm_mul_ps(_mm_set1_ps(2.0f), t3));
+        __m128 h00 = _mm_sub_ps(_mm_set1_ps(1.0f), h01);
+        __m128 h10 = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(t3, _mm_mul_ps(_mm_set1_ps(2.0f), t2)), t), dt);
+        __m128 h11 = _mm_mul_ps(_mm_sub_ps(t3, t2), dt);
+
+        __m128 result[4];
+        for (int c = 0; c < components; c++)
+        {
+            result[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h00, v0[c]), _mm_mul_ps(h10, b0[c])), _mm_add_ps(_mm_mul_ps(h01, v1[c]), _mm_mul_ps(h11, a1[c])));
+        }
+
+        if (bQuaternion)
+        {
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(result[0], result[0]), _mm_mul_ps(result[1], result[1])), _mm_add_ps(_mm_mul_ps(result[2], result[2]), _mm_mul_ps(result[3], result[3]))));
+            for (int c = 0; c < 4; c++)
+                result[c] = _mm_div_ps(result[c], length);
+        }
+
+        for (int c = 0; c < components; c++)
+            StoreLanes(result[c], pStreams + c * stride, &channels.m_slots[i], lanes);
+    }
+}
+
+void SampleAnimation(tfAnimation *pAnimation, float time)
+{
+    tfCompiledAnimation &compiled = pAnimation->m_compiled;
+
+    // the samplers sharing a time track only look up the keys once
+    for (tfTimeTrack &track : pAnimation->m_timeTracks)
+        track.Seek(time);
+
+    const tfTimeTrack *pTimeTracks = pAnimation->m_timeTracks.data();
+    float *pPose = compiled.m_pose.data();
+    SampleVectors(compiled.m_translations, pTimeTracks, pPose + POSE_TX * compiled.m_stride, compiled.m_stride);
+    SampleQuaternions(compiled.m_rotations, pTimeTracks, pPose, compiled.m_stride);
+    SampleVectors(compiled.m_scales, pTimeTracks, pPose + POSE_SX * compiled.m_stride, compiled.m_stride);
+
+    SampleCubic<false>(compiled.m_cubicTranslations, pTimeTracks, pPose + POSE_TX * compiled.m_stride, compiled.m_stride);
+    SampleCubic<true>(compiled.m_cubicRotations, pTimeTracks, pPose + POSE_RX * compiled.m_stride, compiled.m_stride);
+    SampleCubic<false>(compiled.m_cubicScales, pTimeTracks, pPose + POSE_SX * compiled.m_stride, compiled.m_stride);
+}
+
+//
+// Linear channels of an instance of a crowd, 4 channels at a time. The instances go sorted by time, so the keyframes loaded for the
+// previous instance (pLoaded, 8 registers per group of 4 channels, and pLoadedKeys) are reused while the keys are the same
+//
+template<bool bQuaternion>
+static void SampleInstance(const tfAnimationChannels &channels, const int *pKeys, const float *pFracs, __m128 *pLoaded, int *pLoadedKeys, float *pPose, uint32_t stride)
+{
+    for (uint32_t i = 0; i < channels.m_slots.size(); i += 4)
+    {
+        uint32_t lanes = std::min<uint32_t>(4, (uint32_t)channels.m_slots.size() - i);
+
+        int curr[4], next[4];
+        float frac[4];
+        bool bLoaded = true;
+        for (uint32_t k = 0; k < 4; k++)
+        {
+            uint32_t c = i + std::min(k, lanes - 1);
+            int track = channels.m_timeTracks[c];
+            curr[k] = pKeys[track * 2 + 0];
+            next[k] = channels.m_steps[c] ? curr[k] : pKeys[track * 2 + 1];
+            frac[k] = channels.m_steps[c] ? 0.0f : pFracs[track];
+            bLoaded = bLoaded && curr[k] == pLoadedKeys[i * 2 + k] && next[k] == pLoadedKeys[i * 2 + 4 + k];
+        }
+
+        __m128 *a = pLoaded + i * 2;
+        __m128 *b = a + 4;
+        if (!bLoaded)
+        {
+            LoadKeys<bQuaternion>(channels, i, lanes, curr, next, a, b);
+            memcpy(pLoadedKeys + i * 2, curr, sizeof(curr));
+            memcpy(pLoadedKeys + i * 2 + 4, next, sizeof(next));
+        }
+
+        __m128 v[4];
+        if (bQuaternion)
+        {
+            SlerpQuaternions(a, b, _mm_loadu_ps(frac), v);
+            for (int c = 0; c < 4; c++)
+                StoreLanes(v[c], pPose + c * stride, &channels.m_slots[i], lanes);
+        }
+        else
+        {
+            LerpVectors(a, b, _mm_loadu_ps(frac), v);
+            for (int c = 0; c < 3; c++)
+                StoreLanes(v[c], pPose + c * stride, &channels.m_slots[i], lanes);
+        }
+    }
+}
+
+void SampleAnimationInstances(const tfAnimation &animation, const float *pTimes, uint32_t instanceCount, tfAnimationInstances *pInstances)
+{
+    const tfCompiledAnimation &compiled = animation.m_compiled;
+    uint32_t trackCount = (uint32_t)animation.m_timeTracks.size();
+
+    pInstances->m_poseSize = (uint32_t)compiled.m_pose.size();
+    pInstances->m_poses.resize((size_t)instanceCount * pInstances->m_poseSize);
+
+    // the animations loop, same as SetAnimationTime()
+    pInstances->m_times.resize(instanceCount);
+    pInstances->m_order.resize(instanceCount);
+    for (uint32_t n = 0; n < instanceCount; n++)
+    {
+        pInstances->m_times[n] = (animation.m_duration > 0) ? fmod(pTimes[n], animation.m_duration) : 0.0f;
+        pInstances->m_order[n] = n;
+    }
+
+    const float *pLoopedTimes = pInstances->m_times.data();
+    std::sort(pInstances->m_order.begin(), pInstances->m_order.end(), [pLoopedTimes](uint32_t a, uint32_t b) { return pLoopedTimes[a] < pLoopedTimes[b]; });
+
+    // each time track walks the sorted times once, mostly moving forward a key or two
+    pInstances->m_cursors.resize(trackCount);
+    pInstances->m_keys.resize((size_t)instanceCount * trackCount * 2);
+    pInstances->m_fracs.resize((size_t)instanceCount * trackCount);
+    for (uint32_t t = 0; t < trackCount; t++)
+    {
+        tfTimeTrack &cursor = pInstances->m_cursors[t];
+        cursor = tfTimeTrack();
+        cursor.m_pTimes = animation.m_timeTracks[t].m_pTimes;
+        cursor.m_count = animation.m_timeTracks[t].m_count;
+
+        for (uint32_t n = 0; n < instanceCount; n++)
+        {
+            cursor.Seek(pLoopedTimes[pInstances->m_order[n]]);
+
+            size_t entry = (size_t)n * trackCount + t;
+            pInstances->m_keys[entry * 2 + 0] = cursor.m_curr;
+            pInstances->m_keys[entry * 2 + 1] = cursor.m_next;
+            pInstances->m_fracs[entry] = cursor.m_frac;
+        }
+    }
+
+    // room for the keyframes of every group of 4 channels of each path, nothing is loaded yet
+    const tfAnimationChannels *pPaths[3] = { &compiled.m_translations, &compiled.m_rotations, &compiled.m_scales };
+    size_t loadedOffsets[4] = {};
+    for (int p = 0; p < 3; p++)
+        loadedOffsets[p + 1] = loadedOffsets[p] + ((pPaths[p]->m_slots.size() + 3) & ~3) * 2;
+    pInstances->m_loaded.resize(loadedOffsets[3]);
+    pInstances->m_loadedKeys.assign(loadedOffsets[3], -1);
+
+    bool bCubic = !compiled.m_cubicTranslations.m_slots.empty() || !compiled.m_cubicRotations.m_slots.empty() || !compiled.m_cubicScales.m_slots.empty();
+    for (uint32_t n = 0; n < instanceCount; n++)
+    {
+        const int *pKeys = &pInstances->m_keys[(size_t)n * trackCount * 2];
+        const float *pFracs = &pInstances->m_fracs[(size_t)n * trackCount];
+        __m128 *pLoaded = pInstances->m_loaded.data();
+        int *pLoadedKeys = pInstances->m_loadedKeys.data();
+
+        // instances in sync share the pose
+        float *pPose = &pInstances->m_poses[(size_t)pInstances->m_order[n] * pInstances->m_poseSize];
+        if (n > 0 && pLoopedTimes[pInstances->m_order[n]] == pLoopedTimes[pInstances->m_order[n - 1]])
+        {
+            memcpy(pPose, &pInstances->m_poses[(size_t)pInstances->m_order[n - 1] * pInstances->m_poseSize], pInstances->m_poseSize * sizeof(float));
+            continue;
+        }
+
+        // the rest pose covers the paths without channels
+        memcpy(pPose, compiled.m_pose.data(), pInstances->m_poseSize * sizeof(float));
+
+        SampleInstance<false>(compiled.m_translations, pKeys, pFracs, pLoaded + loadedOffsets[0], pLoadedKeys + loadedOffsets[0], pPose + POSE_TX * compiled.m_stride, compiled.m_stride);
+        SampleInstance<true>(compiled.m_rotations, pKeys, pFracs, pLoaded + loadedOffsets[1], pLoadedKeys + loadedOffsets[1], pPose + POSE_RX * compiled.m_stride, compiled.m_stride);
+        SampleInstance<false>(compiled.m_scales, pKeys, pFracs, pLoaded + loadedOffsets[2], pLoadedKeys + loadedOffsets[2], pPose + POSE_SX * compiled.m_stride, compiled.m_stride);
+
+        // the cubic channels are sampled through the cursors, these get the keys of the instance
+        if (bCubic)
+        {
+            for (uint32_t t = 0; t < trackCount; t++)
+            {
+                pInstances->m_cursors[t].m_curr = pKeys[t * 2 + 0];
+                pInstances->m_cursors[t].m_next = pKeys[t * 2 + 1];
+                pInstances->m_cursors[t].m_frac = pFracs[t];
+            }
+
+            const tfTimeTrack *pCursors = pInstances->m_cursors.data();
+            SampleCubic<false>(compiled.m_cubicTranslations, pCursors, pPose + POSE_TX * compiled.m_stride, compiled.m_stride);
+            SampleCubic<true>(compiled.m_cubicRotations, pCursors, pPose + POSE_RX * compiled.m_stride, compiled.m_stride);
+            SampleCubic<false>(compiled.m_cubicScales, pCursors, pPose + POSE_SX * compiled.m_stride, compiled.m_stride);
+        }
+    }
+}
+
+//
+// The weights of a key are consecutive so each channel gets sampled 4 targets at a time, CUBICSPLINE uses the same Hermite spline as above
+//
+void SampleMorphWeights(const tfAnimation &animation, float *pMorphWeights)
+{
+    for (const tfWeightChannel &channel : animation.m_compiled.m_weights)
+    {
+        const tfTimeTrack &track = animation.m_timeTracks[channel.m_timeTrack];
+        float *pOut = pMorphWeights + channel.m_firstWeight;
+        uint32_t count = channel.m_count;
+
+        if (channel.m_interpolation == INTERPOLATION_CUBICSPLINE)
+        {
+            const float *pValue0 = channel.m_pValues + (track.m_curr * 3 + 1) * count;
+            const float *pOut0 = channel.m_pValues + (track.m_curr * 3 + 2) * count;
+            const float *pIn1 = channel.m_pValues + (track.m_next * 3 + 0) * count;
+            const float *pValue1 = channel.m_pValues + (track.m_next * 3 + 1) * count;
+
+            float t = track.m_frac, t2 = t * t, t3 = t2 * t;
+            float dt = track.m_pTimes[track.m_next] - track.m_pTimes[track.m_curr];
+            float h01 = 3.0f * t2 - 2.0f * t3;
+            float h00 = 1.0f - h01;
+            float h10 = (t3 - 2.0f * t2 + t) * dt;
+            float h11 = (t3 - t2) * dt;
+
+            uint32_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(h00), _mm_loadu_ps(pValue0 + i)), _mm_mul_ps(_mm_set1_ps(h10), _mm_loadu_ps(pOut0 + i))),
+                                      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(h01), _mm_loadu_ps(pValue1 + i)), _mm_mul_ps(_mm_set1_ps(h11), _mm_loadu_ps(pIn1 + i))));
+                _mm_storeu_ps(pOut + i, v);
+            }
+            for (; i < count; i++)
+                pOut[i] = h00 * pValue0[i] + h10 * pOut0[i] + h01 * pValue1[i] + h11 * pIn1[i];
+        }
+        else
+        {
+            // STEP holds the key until the next one
+            bool bStep = (channel.m_interpolation == INTERPOLATION_STEP);
+            const float *pCurr = channel.m_pValues + track.m_curr * count;
+            const float *pNext = channel.m_pValues + (bStep ? track.m_curr : track.m_next) * count;
+            float frac = bStep ? 0.0f : track.m_frac;
+
+            uint32_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 a = _mm_loadu_ps(pCurr + i);
+                __m128 b = _mm_loadu_ps(pNext + i);
+                _mm_storeu_ps(pOut + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(frac))));
+            }
+            for (; i < count; i++)
+                pOut[i] = pCurr[i] + (pNext[i] - pCurr[i]) * frac;
+        }
+    }
+}
+
+//
+// Hamilton product of 4 quaternions in SoA form
+//
+static inline void MultiplyQuaternions(const __m128 a[4], const __m128 b[4], __m128 q[4])
+{
+    __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[3], b[0]), _mm_mul_ps(a[0], b[3])), _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1])));
+    __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[3], b[1]), _mm_mul_ps(a[1], b[3])), _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2])));
+    __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[3], b[2]), _mm_mul_ps(a[2], b[3])), _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0])));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(a[3], b[3]), _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2])));
+    q[0] = x;
+    q[1] = y;
+    q[2] = z;
+    q[3] = w;
+}
+
+static inline void NormalizeQuaternions(__m128 q[4])
+{
+    __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(q[0], q[0]), _mm_mul_ps(q[1], q[1])), _mm_add_ps(_mm_mul_ps(q[2], q[2]), _mm_mul_ps(q[3], q[3])));
+    __m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSq));
+    for (int c = 0; c < 4; c++)
+        q[c] = _mm_mul_ps(q[c], invLength);
+}
+
+// sign bits of the lanes where the dot product of the quaternions is negative, q and -q are the same rotation
+static inline __m128 OppositeSides(const __m128 a[4], const __m128 b[4])
+{
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_add_ps(_mm_mul_ps(a[2], b[2]), _mm_mul_ps(a[3], b[3])));
+    return _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+}
+
+static const tfPoseStream s_vectorStreams[6] = { POSE_TX, POSE_TY, POSE_TZ, POSE_SX, POSE_SY, POSE_SZ };
+
+//
+// Accumulates the sampled pose of a regular layer with its weight, 4 animated nodes at a time
+//
+static void BlendLayer(const tfCompiledAnimation &compiled, float weight, const float *pJointWeights, tfPosePool *pPool)
+{
+    const uint32_t stride = pPool->m_stride;
+    const float *pPose = compiled.m_pose.data();
+    float *pBlended = pPool->GetPose(POOL_BLENDED);
+
+    for (uint32_t i = 0; i < compiled.m_nodes.size(); i += 4)
+    {
+        const int *pNodes = &compiled.m_nodes[i];
+        uint32_t lanes = std::min<uint32_t>(4, (uint32_t)compiled.m_nodes.size() - i);
+
+        __m128 w = _mm_set1_ps(weight);
+        if (pJointWeights)
+            w = _mm_mul_ps(w, LoadLanes(pJointWeights, pNodes, lanes));
+
+        // the rotations go to the side of the ones accumulated so far, or they would cancel out
+        __m128 sum[4], q[4];
+        for (int c = 0; c < 4; c++)
+        {
+            sum[c] = LoadLanes(pBlended + (POSE_RX + c) * stride, pNodes, lanes);
+            q[c] = _mm_loadu_ps(pPose + (POSE_RX + c) * compiled.m_stride + i);
+        }
+        __m128 flip = OppositeSides(sum, q);
+        for (int c = 0; c < 4; c++)
+            StoreLanes(_mm_add_ps(sum[c], _mm_mul_ps(w, _mm_xor_ps(q[c], flip))), pBlended + (POSE_RX + c) * stride, pNodes, lanes);
+
+        for (tfPoseStream s : s_vectorStreams)
+        {
+            __m128 v = _mm_loadu_ps(pPose + s * compiled.m_stride + i);
+            StoreLanes(_mm_add_ps(LoadLanes(pBlended + s * stride, pNodes, lanes), _mm_mul_ps(w, v)), pBlended + s * stride, pNodes, lanes);
+        }
+
+        StoreLanes(_mm_add_ps(LoadLanes(pPool->m_weights.data(), pNodes, lanes), w), pPool->m_weights.data(), pNodes, lanes);
+    }
+}
+
+//
+// Accumulates the difference between the sampled pose of an additive layer and the rest pose, scaled by its weight: translations
+// add up, scales multiply and rotations get chained, each one taken from the identity with an nlerp
+//
+static void AddLayer(const tfCompiledAnimation &compiled, float weight, const float *pJointWeights, tfPosePool *pPool)
+{
+    const uint32_t stride = pPool->m_stride;
+    const float *pPose = compiled.m_pose.data();
+    const float *pRest = pPool->GetPose(POOL_REST);
+    float *pAdditive = pPool->GetPose(POOL_ADDITIVE);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for (uint32_t i = 0; i < compiled.m_nodes.size(); i += 4)
+    {
+        const int *pNodes = &compiled.m_nodes[i];
+        uint32_t lanes = std::min<uint32_t>(4, (uint32_t)compiled.m_nodes.size() - i);
+
+        __m128 w = _mm_set1_ps(weight);
+        if (pJointWeights)
+            w = _mm_mul_ps(w, LoadLanes(pJointWeights, pNodes, lanes));
+
+        // conjugate(rest) * q, on the shortest arc
+        __m128 rest[4], q[4], delta[4], sum[4];
+        for (int c = 0; c < 4; c++)
+        {
+            rest[c] = LoadLanes(pRest + (POSE_RX + c) * stride, pNodes, lanes);
+            q[c] = _mm_loadu_ps(pPose + (POSE_RX + c) * compiled.m_stride + i);
+            sum[c] = LoadLanes(pAdditive + (POSE_RX + c) * stride, pNodes, lanes);
+        }
+        for (int c = 0; c < 3; c++)
+            rest[c] = _mm_xor_ps(rest[c], _mm_set1_ps(-0.0f));
+        MultiplyQuaternions(rest, q, delta);
+        __m128 flip = _mm_and_ps(_mm_cmplt_ps(delta[3], _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+        for (int c = 0; c < 3; c++)
+            delta[c] = _mm_mul_ps(w, _mm_xor_ps(delta[c], flip));
+        delta[3] = _mm_add_ps(_mm_sub_ps(one, w), _mm_mul_ps(w, _mm_xor_ps(delta[3], flip)));
+        NormalizeQuaternions(delta);
+        MultiplyQuaternions(sum, delta, q);
+        for (int c = 0; c < 4; c++)
+            StoreLanes(q[c], pAdditive + (POSE_RX + c) * stride, pNodes, lanes);
+
+        for (int c = 0; c < 3; c++)
+        {
+            float *pStream = pAdditive + (POSE_TX + c) * stride;
+            __m128 t = _mm_loadu_ps(pPose + (POSE_TX + c) * compiled.m_stride + i);
+            __m128 difference = _mm_sub_ps(t, LoadLanes(pRest + (POSE_TX + c) * stride, pNodes, lanes));
+            StoreLanes(_mm_add_ps(LoadLanes(pStream, pNodes, lanes), _mm_mul_ps(w, difference)), pStream, pNodes, lanes);
+        }
+
+        // a rest scale of 0 has no ratio, it is taken as 1
+        for (int c = 0; c < 3; c++)
+        {
+            float *pStream = pAdditive + (POSE_SX + c) * stride;
+            __m128 s = _mm_loadu_ps(pPose + (POSE_SX + c) * compiled.m_stride + i);
+            __m128 restScale = LoadLanes(pRest + (POSE_SX + c) * stride, pNodes, lanes);
+            __m128 valid = _mm_cmpneq_ps(restScale, _mm_setzero_ps());
+            __m128 ratio = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(s, restScale)), _mm_andnot_ps(valid, one));
+            __m128 factor = _mm_add_ps(one, _mm_mul_ps(w, _mm_sub_ps(ratio, one)));
+            StoreLanes(_mm_mul_ps(LoadLanes(pStream, pNodes, lanes), factor), pStream, pNodes, lanes);
+        }
+    }
+}
+
+void InitPosePool(const std::vector<tfNode> &nodes, tfPosePool *pPool)
+{
+    uint32_t count = (uint32_t)nodes.size();
+    pPool->m_stride = (count + 3) & ~3;
+    pPool->m_poses.assign((size_t)POOL_POSE_COUNT * POSE_STREAM_COUNT * pPool->m_stride, 0.0f);
+    pPool->m_weights.assign(pPool->m_stride, 0.0f);
+    pPool->m_bTouched.assign(count, 0);
+    pPool->m_nodes.clear();
+    pPool->m_nodes.reserve(count);
+
+    float *pRest = pPool->GetPose(POOL_REST);
+    for (uint32_t i = 0; i < pPool->m_stride; i++)
+    {
+        StoreRestPose((i < count) ? &nodes[i].m_tranform : NULL, pRest, pPool->m_stride, i);
+    }
+}
+
+void BlendAnimationLayers(std::vector<tfAnimation> &animations, const tfAnimationLayer *pLayers, uint32_t layerCount, tfPosePool *pPool)
+{
+    const uint32_t stride = pPool->m_stride;
+    const float *pRest = pPool->GetPose(POOL_REST);
+    float *pBlended = pPool->GetPose(POOL_BLENDED);
+    float *pAdditive = pPool->GetPose(POOL_ADDITIVE);
+    float *pResult = pPool->GetPose(POOL_RESULT);
+
+    // the nodes of the layers start with nothing blended and no difference added, the ones of a layer without weight get the rest pose
+    for (int node : pPool->m_nodes)
+        pPool->m_bTouched[node] = 0;
+    pPool->m_nodes.clear();
+
+    for (uint32_t l = 0; l < layerCount; l++)
+    {
+        if (pLayers[l].m_animation >= animations.size())
+            continue;
+
+        for (int node : animations[pLayers[l].m_animation].m_compiled.m_nodes)
+        {
+            if (pPool->m_bTouched[node])
+                continue;
+
+            pPool->m_bTouched[node] = 1;
+            pPool->m_nodes.push_back(node);
+            for (uint32_t c = 0; c < POSE_STREAM_COUNT; c++)
+            {
+                pBlended[c * stride + node] = 0.0f;
+                pAdditive[c * stride + node] = (c == POSE_RW || c >= POSE_SX) ? 1.0f : 0.0f;
+            }
+            pPool->m_weights[node] = 0.0f;
+        }
+    }
+    std::sort(pPool->m_nodes.begin(), pPool->m_nodes.end());
+
+    // a single pass over the layers, each one gets sampled and accumulated right away
+    for (uint32_t l = 0; l < layerCount; l++)
+    {
+        const tfAnimationLayer &layer = pLayers[l];
+        if (layer.m_animation >= animations.size() || !(layer.m_weight > 0.0f))
+            continue;
+
+        tfAnimation *pAnimation = &animations[layer.m_animation];
+        SampleAnimation(pAnimation, (pAnimation->m_duration > 0) ? fmod(layer.m_time, pAnimation->m_duration) : 0.0f);
+        if (layer.m_bAdditive)
+            AddLayer(pAnimation->m_compiled, layer.m_weight, layer.m_pJointWeights, pPool);
+        else
+            BlendLayer(pAnimation->m_compiled, layer.m_weight, layer.m_pJointWeights, pPool);
+    }
+
+    // the rest pose takes the weight the regular layers left, then the sums get normalized and the additive layers applied
+    const __m128 one = _mm_set1_ps(1.0f);
+    const uint32_t count = (uint32_t)pPool->m_nodes.size();
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        const int *pNodes = &pPool->m_nodes[i];
+        uint32_t lanes = std::min<uint32_t>(4, count - i);
+
+        __m128 weight = LoadLanes(pPool->m_weights.data(), pNodes, lanes);
+        __m128 restWeight = _mm_max_ps(_mm_sub_ps(one, weight), _mm_setzero_ps());
+        __m128 invTotal = _mm_div_ps(one, _mm_add_ps(weight, restWeight));
+
+        __m128 sum[4], rest[4], additive[4], q[4];
+        for (int c = 0; c < 4; c++)
+        {
+            sum[c] = LoadLanes(pBlended + (POSE_RX + c) * stride, pNodes, lanes);
+            rest[c] = LoadLanes(pRest + (POSE_RX + c) * stride, pNodes, lanes);
+            additive[c] = LoadLanes(pAdditive + (POSE_RX + c) * stride, pNodes, lanes);
+        }
+        __m128 flip = OppositeSides(sum, rest);
+        for (int c = 0; c < 4; c++)
+            sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(restWeight, _mm_xor_ps(rest[c], flip)));
+        NormalizeQuaternions(sum);
+        MultiplyQuaternions(sum, additive, q);
+        for (int c = 0; c < 4; c++)
+            _mm_storeu_ps(pResult + (POSE_RX + c) * stride + i, q[c]);
+
+        for (tfPoseStream s : s_vectorStreams)
+        {
+            __m128 v = _mm_add_ps(LoadLanes(pBlended + s * stride, pNodes, lanes), _mm_mul_ps(restWeight, LoadLanes(pRest + s * stride, pNodes, lanes)));
+            v = _mm_mul_ps(v, invTotal);
+
+            __m128 difference = LoadLanes(pAdditive + s * stride, pNodes, lanes);
+            v = (s < POSE_SX) ? _mm_add_ps(v, difference) : _mm_mul_ps(v, difference);
+            _mm_storeu_ps(pResult + s * stride + i, v);
+        }
+    }
+}
+
+//
+// Same as Transform::GetWorldMat(), scale * rotation * translation, the rows of the rotation get scaled and the translation is the last row
+//
+void ComposePose(const tfCompiledAnimation &compiled, const float *pPose, XMMATRIX *pAnimatedMats)
+{
+    ComposePose(compiled.m_nodes.data(), (uint32_t)compiled.m_nodes.size(), pPose, compiled.m_stride, pAnimatedMats);
+}
+
+void ComposePose(const int *pNodes, uint32_t nodeCount, const float *pPose, uint32_t stride, XMMATRIX *pAnimatedMats)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    for (uint32_t i = 0; i < nodeCount; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(pPose + POSE_RX * stride + i);
+        __m128 y = _mm_loadu_ps(pPose + POSE_RY * stride + i);
+        __m128 z = _mm_loadu_ps(pPose + POSE_RZ * stride + i);
+        __m128 w = _mm_loadu_ps(pPose + POSE_RW * stride + i);
+
+        __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+        __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+        __m128 sx = _mm_loadu_ps(pPose + POSE_SX * stride + i);
+        __m128 sy = _mm_loadu_ps(pPose + POSE_SY * stride + i);
+        __m128 sz = _mm_loadu_ps(pPose + POSE_SZ * stride + i);
+
+        __m128 row0[4] = { _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx), _mm_mul_ps(_mm_add_ps(xy, wz), sx), _mm_mul_ps(_mm_sub_ps(xz, wy), sx), _mm_setzero_ps() };
+        __m128 row1[4] = { _mm_mul_ps(_mm_sub_ps(xy, wz), sy), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy), _mm_mul_ps(_mm_add_ps(yz, wx), sy), _mm_setzero_ps() };
+        __m128 row2[4] = { _mm_mul_ps(_mm_add_ps(xz, wy), sz), _mm_mul_ps(_mm_sub_ps(yz, wx), sz), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz), _mm_setzero_ps() };
+        __m128 row3[4] = { _mm_loadu_ps(pPose + POSE_TX * stride + i), _mm_loadu_ps(pPose + POSE_TY * stride + i), _mm_loadu_ps(pPose + POSE_TZ * stride + i), one };
+
+        // each register holds an element of the 4 matrices, transposing gives the rows of each matrix
+        _MM_TRANSPOSE4_PS(row0[0], row0[1], row0[2], row0[3]);
+        _MM_TRANSPOSE4_PS(row1[0], row1[1], row1[2], row1[3]);
+        _MM_TRANSPOSE4_PS(row2[0], row2[1], row2[2], row2[3]);
+        _MM_TRANSPOSE4_PS(row3[0], row3[1], row3[2], row3[3]);
+
+        uint32_t lanes = std::min<uint32_t>(4, nodeCount - i);
+        for (uint32_t k = 0; k < lanes; k++)
+        {
+            XMMATRIX &m = pAnimatedMats[pNodes[i + k]];
+            m.r[0] = row0[k];
+            m.r[1] = row1[k];
+            m.r[2] = row2[k];
+            m.r[3] = row3[k];
+        }
+    }
+}
@@ -0,0 +1,55 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+//
+// Evaluation of the compiled animations (tfCompiledAnimation) used by GLTFCommon::SetAnimationTime().
+// The channels get sampled 4 at a time with SSE, the rotations with a polynomial slerp that needs no trigonometry
+// (D. Eberly, "A Fast and Accurate Algorithm for Computing SLERP"), and the pose gets composed into matrices 4 nodes at a time.
+// STEP channels go with the linear ones, CUBICSPLINE channels are evaluated apart since they need the tangents.
+// Crowds get evaluated with the instances sorted by time, so each time track is walked once and consecutive instances that land
+// between the same keys reuse the keyframes already loaded.
+// Layers get blended in a pool of poses indexed by node: the regular layers are accumulated with their weights (the rotations on the
+// side of the ones accumulated so far) and normalized at the end, the rest pose taking the weight they leave, and the additive ones
+// accumulate their difference with the rest pose that gets applied on top.
+//
+
+// groups the channels of the animation by path, needs the time tracks of the animation to be built already
+void CompileAnimation(const std::vector<tfNode> &nodes, tfAnimation *pAnimation);
+
+// moves the time tracks of the animation to the given time and samples its channels into the pose of the compiled animation
+void SampleAnimation(tfAnimation *pAnimation, float time);
+
+// crowds, samples the animation for instanceCount instances each one at its own time in a single pass, the time tracks of the 
+// animation are not moved so it can run concurrently with SetAnimationTime() and with other batches of instances
+void SampleAnimationInstances(const tfAnimation &animation, const float *pTimes, uint32_t instanceCount, tfAnimationInstances *pInstances);
+
+// samples the morph target weight channels into pMorphWeights (GLTFCommon::m_morphWeights), after SampleAnimation() moved the time tracks
+void SampleMorphWeights(const tfAnimation &animation, float *pMorphWeights);
+
+// pose blending, sizes the pool for the nodes and stores their rest pose in it
+void InitPosePool(const std::vector<tfNode> &nodes, tfPosePool *pPool);
+
+// samples the animation of each layer and blends it in the pool as it goes, the pose of the nodes in pPool->m_nodes ends up in POOL_RESULT
+void BlendAnimationLayers(std::vector<tfAnimation> &animations, const tfAnimationLayer *pLayers, uint32_t layerCount, tfPosePool *pPool);
+
+// turns the pose into the object space matrices of the animated nodes, pAnimatedMats is indexed by node
+void ComposePose(const tfCompiledAnimation &compiled, const float *pPose, XMMATRIX *pAnimatedMats);
+void ComposePose(const int *pNodes, uint32_t nodeCount, const float *pPose, uint32_t stride, XMMATRIX *pAnimatedMats);
@@ -0,0 +1,374 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfCommon.h"
+#include "Misc/Misc.h"
+#include "Misc/Async.h"
+#include <cfloat>
+#include <set>
+#include <algorithm>
+
+//
+// Import time animation compression. Each linear sampler keeps only the keys that the linear interpolation (slerp for the rotations) 
+// can't rebuild within the error, and these get quantized to 48 bits, see tfKeyFormat. The keys get chosen against the quantized 
+// values so the error bound holds for the final result. The new times and values are new buffers, so SaveCooked() caches the result.
+//
+// The error is measured in scene units: translations directly, rotations and scales by how far they move the end of the bones 
+// of the joint (the longest of the translations of its children, or of its own when it has none).
+//
+
+#define COMPRESSION_MAX_SPAN 256    // most keys a single interpolation may replace, bounds the cost of the search
+
+struct CompressedSampler
+{
+    tfSampler *pSampler;
+    int path;                       // 0 translation, 1 rotation, 2 scale
+    float lever;
+
+    std::vector<float> times;
+    std::vector<uint16_t> words;
+    float rangeMin[3] = {};
+    float rangeExtent[3] = {};
+
+    float error = 0;                // largest error measured at the original keys and halfway between them
+};
+
+static void EncodeQuat48(const float *pQuat, uint16_t *pWords)
+{
+    // q and -q are the same rotation, the dropped component is the largest so the others are within +-1/sqrt(2)
+    int dropped = 0;
+    for (int c = 1; c < 4; c++)
+    {
+        if (fabsf(pQuat[c]) > fabsf(pQuat[dropped]))
+            dropped = c;
+    }
+
+    float length = sqrtf(pQuat[0] * pQuat[0] + pQuat[1] * pQuat[1] + pQuat[2] * pQuat[2] + pQuat[3] * pQuat[3]);
+    float sign = (pQuat[dropped] < 0) ? -1.0f : 1.0f;
+    float scale = (length > 0) ? sign / length : 0;
+
+    for (int c = 0, w = 0; c < 4; c++)
+    {
+        if (c == dropped)
+            continue;
+        float v = (pQuat[c] * scale + 0.70710678f) * (32767.0f / 1.41421356f);
+        pWords[w++] = (uint16_t)(std::min(std::max((int)(v + 0.5f), 0), 32767) << 1);
+    }
+
+    pWords[0] |= dropped & 1;
+    pWords[1] |= dropped >> 1;
+}
+
+static void EncodeVector48(const float *pVector, const float *pRangeMin, const float *pRangeExtent, uint16_t *pWords)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        float v = (pRangeExtent[c] > 0) ? (pVector[c] - pRangeMin[c]) / pRangeExtent[c] * 65535.0f : 0;
+        pWords[c] = (uint16_t)std::min(std::max((int)(v + 0.5f), 0), 65535);
+    }
+}
+
+static void Interpolate(const float *pA, const float *pB, float t, bool bRotation, float *pResult)
+{
+    if (!bRotation)
+    {
+        for (int c = 0; c < 3; c++)
+            pResult[c] = pA[c] + (pB[c] - pA[c]) * t;
+        return;
+    }
+
+    XMFLOAT4 result;
+    XMStoreFloat4(&result, XMQuaternionSlerp(XMVectorSet(pA[0], pA[1], pA[2], pA[3]), XMVectorSet(pB[0], pB[1], pB[2], pB[3]), t));
+    pResult[0] = result.x;
+    pResult[1] = result.y;
+    pResult[2] = result.z;
+    pResult[3] = result.w;
+}
+
+static float Distance(const float *pA, const float *pB, bool bRotation, float lever)
+{
+    // the angle of the rotation between the quaternions, from the chord since acos() is too coarse for small angles
+    if (bRotation)
+    {
+        float sign = (pA[0] * pB[0] + pA[1] * pB[1] + pA[2] * pB[2] + pA[3] * pB[3] < 0) ? -1.0f : 1.0f;
+        float chord = 0;
+        for (int c = 0; c < 4; c++)
+            chord += (pA[c] - sign * pB[c]) * (pA[c] - sign * pB[c]);
+        return 4.0f * asinf(std::min(sqrtf(chord) * 0.5f, 1.0f)) * lever;
+    }
+
+    float dx = pA[0] - pB[0], dy = pA[1] - pB[1], dz = pA[2] - pB[2];
+    return sqrtf(dx * dx + dy * dy + dz * dz) * lever;
+}
+
+//
+// value of the sampler at the given time, with the keys (times and values) passed in
+//
+static void Sample(const float *pTimes, const float *pValues, int count, int dimension, float time, bool bRotation, float *pResult)
+{
+    int key = (int)(std::upper_bound(pTimes, pTimes + count, time) - pTimes) - 1;
+    if (key < 0 || key >= count - 1)
+    {
+        key = std::min(std::max(key, 0), count - 1);
+        memcpy(pResult, pValues + key * dimension, dimension * sizeof(float));
+        return;
+    }
+
+    float t = (time - pTimes[key]) / (pTimes[key + 1] - pTimes[key]);
+    Interpolate(pValues + key * dimension, pValues + (key + 1) * dimension, t, bRotation, pResult);
+}
+
+static void CompressSampler(float maxError, CompressedSampler *pResult)
+{
+    const tfSampler &sampler = *pResult->pSampler;
+    const bool bRotation = (pResult->path == 1);
+    const int dimension = bRotation ? 4 : 3;
+    const int count = std::min(sampler.m_time.m_count, sampler.m_value.m_count);
+    const float lever = pResult->lever;
+
+    std::vector<float> times(count);
+    std::vector<float> values(count * dimension);
+    for (int i = 0; i < count; i++)
+    {
+        times[i] = *(const float *)sampler.m_time.Get(i);
+        sampler.GetKey(i, &values[i * dimension]);
+    }
+
+    // every key gets quantized first, the search interpolates the quantized keys
+    //
+    if (!bRotation)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            float minimum = FLT_MAX, maximum = -FLT_MAX;
+            for (int i = 0; i < count; i++)
+            {
+                minimum = std::min(minimum, values[i * 3 + c]);
+                maximum = std::max(maximum, values[i * 3 + c]);
+            }
+            pResult->rangeMin[c] = minimum;
+            pResult->rangeExtent[c] = maximum - minimum;
+        }
+    }
+
+    tfSampler decoder;
+    decoder.m_keyFormat = bRotation ? KEYS_QUAT48 : KEYS_VECTOR48;
+    memcpy(decoder.m_rangeMin, pResult->rangeMin, sizeof(decoder.m_rangeMin));
+    memcpy(decoder.m_rangeExtent, pResult->rangeExtent, sizeof(decoder.m_rangeExtent));
+    decoder.m_value.m_count = count;
+    decoder.m_value.m_stride = 3 * sizeof(uint16_t);
+
+    std::vector<uint16_t> words(count * 3);
+    std::vector<float> quantized(count * dimension);
+    decoder.m_value.m_data = words.data();
+    for (int i = 0; i < count; i++)
+    {
+        if (bRotation)
+            EncodeQuat48(&values[i * 4], &words[i * 3]);
+        else
+            EncodeVector48(&values[i * 3], pResult->rangeMin, pResult->rangeExtent, &words[i * 3]);
+        decoder.GetKey(i, &quantized[i * dimension]);
+    }
+
+    // greedy, from the last key kept the interpolation reaches as far as it can stay within the error of the keys it replaces
+    //
+    std::vector<int> kept;
+    kept.push_back(0);
+
+    bool bConstant = true;
+    for (int i = 1; i < count && bConstant; i++)
+        bConstant = Distance(&quantized[0], &values[i * dimension], bRotation, lever) <= maxError;
+
+    if (!bConstant)
+    {
+        int start = 0;
+        int end = 1;
+        while (end < count - 1)
+        {
+            bool bFits = (end + 1 - start) <= COMPRESSION_MAX_SPAN;
+            for (int i = start + 1; i <= end && bFits; i++)
+            {
+                float t = (times[i] - times[start]) / (times[end + 1] - times[start]);
+                float interpolated[4];
+                Interpolate(&quantized[start * dimension], &quantized[(end + 1) * dimension], t, bRotation, interpolated);
+                bFits = Distance(interpolated, &values[i * dimension], bRotation, lever) <= maxError;
+            }
+
+            if (!bFits)
+            {
+                kept.push_back(end);
+                start = end;
+            }
+            end++;
+        }
+
+        if (count > 1)
+            kept.push_back(count - 1);
+    }
+
+    pResult->times.resize(kept.size());
+    pResult->words.resize(kept.size() * 3);
+    std::vector<float> reduced(kept.size() * dimension);
+    for (size_t k = 0; k < kept.size(); k++)
+    {
+        pResult->times[k] = times[kept[k]];
+        memcpy(&pResult->words[k * 3], &words[kept[k] * 3], 3 * sizeof(uint16_t));
+        memcpy(&reduced[k * dimension], &quantized[kept[k] * dimension], dimension * sizeof(float));
+    }
+
+    // the report, the compressed keys against the original ones at every key and halfway to the next one
+    //
+    for (int i = 0; i < count; i++)
+    {
+        float sampled[4], original[4];
+        Sample(pResult->times.data(), reduced.data(), (int)kept.size(), dimension, times[i], bRotation, sampled);
+        pResult->error = std::max(pResult->error, Distance(sampled, &values[i * dimension], bRotation, lever));
+
+        if (i + 1 < count)
+        {
+            float time = (times[i] + times[i + 1]) * 0.5f;
+            Sample(times.data(), values.data(), count, dimension, time, bRotation, original);
+            Sample(pResult->times.data(), reduced.data(), (int)kept.size(), dimension, time, bRotation, sampled);
+            pResult->error = std::max(pResult->error, Distance(sampled, original, bRotation, lever));
+        }
+    }
+}
+
+void GLTFCommon::CompressAnimations(float maxError, AsyncPool *pAsyncPool)
+{
+    Profile p("GLTFCommon::CompressAnimations");
+
+    // how far the rotation and scale of each node reach
+    //
+    std::vector<float> levers(m_nodes.size(), 0.0f);
+    for (size_t n = 0; n < m_nodes.size(); n++)
+    {
+        for (tfNodeIdx child : m_nodes[n].m_children)
+            levers[n] = std::max(levers[n], XMVectorGetX(XMVector3Length(m_nodes[child].m_tranform.m_translation)));
+
+        if (levers[n] == 0.0f)
+            levers[n] = XMVectorGetX(XMVector3Length(m_nodes[n].m_tranform.m_translation));
+        if (levers[n] == 0.0f)
+            levers[n] = 1.0f;
+    }
+
+    std::vector<CompressedSampler> results;
+    for (tfAnimation &animation : m_animations)
+    {
+        for (auto &it : animation.m_channels)
+        {
+            tfSampler *pSamplers[3] = { it.second.m_pTranslation, it.second.m_pRotation, it.second.m_pScale };
+            for (int path = 0; path < 3; path++)
+            {
+                // already compressed when coming from the cooked cache, only the linear samplers get their keys reduced
+                if (pSamplers[path] == NULL || pSamplers[path]->m_keyFormat != KEYS_FLOAT || pSamplers[path]->m_time.m_count == 0 || pSamplers[path]->m_interpolation != INTERPOLATION_LINEAR)
+                    continue;
+
+                CompressedSampler result;
+                result.pSampler = pSamplers[path];
+                result.path = path;
+                // translations are measured as they are
+                result.lever = (path == 0 || it.first < 0 || it.first >= (int)m_nodes.size()) ? 1.0f : levers[it.first];
+                results.push_back(result);
+            }
+        }
+    }
+
+    // samplers are compressed concurrently, the tasks only read the scene
+    //
+    Sync samplersCompressed;
+    for (CompressedSampler &result : results)
+    {
+        ExecAsyncIfThereIsAPool(pAsyncPool, [&result, maxError]()
+        {
+            CompressSampler(maxError, &result);
+        }, &samplersCompressed);
+    }
+
+    samplersCompressed.Wait();
+
+    // what the samplers read before, the time accessors are often shared
+    //
+    size_t bytesBefore = 0, bytesAfter = 0, keysBefore = 0, keysAfter = 0;
+    std::set<const void *> timesBefore;
+    for (const CompressedSampler &result : results)
+    {
+        const tfSampler &sampler = *result.pSampler;
+        if (timesBefore.insert(sampler.m_time.m_data).second)
+            bytesBefore += sampler.m_time.m_count * sizeof(float);
+        bytesBefore += sampler.m_value.m_count * sampler.m_value.m_dimension * sizeof(float);
+        keysBefore += sampler.m_value.m_count;
+    }
+
+    // new buffers with the times and the words, samplers that ended up with the same times share them and so their time track
+    //
+    float errors[3] = {};
+    std::map<std::vector<float>, const void *> timesAfter;
+    for (CompressedSampler &result : results)
+    {
+        tfSampler *pSampler = result.pSampler;
+        int keyCount = (int)result.times.size();
+
+        auto times = timesAfter.find(result.times);
+        if (times == timesAfter.end())
+        {
+            size_t size = result.times.size() * sizeof(float);
+            char *pData = new char[size];
+            memcpy(pData, result.times.data(), size);
+            AddBuffer(pData, size);
+            times = timesAfter.insert(std::make_pair(result.times, (const void *)pData)).first;
+            bytesAfter += size;
+        }
+
+        pSampler->m_time.m_data = times->second;
+        pSampler->m_time.m_count = keyCount;
+        pSampler->m_time.m_stride = sizeof(float);
+        pSampler->m_time.m_sparseCount = 0;
+
+        size_t size = result.words.size() * sizeof(uint16_t);
+        char *pData = new char[size];
+        memcpy(pData, result.words.data(), size);
+        AddBuffer(pData, size);
+        bytesAfter += size;
+
+        pSampler->m_value.m_data = pData;
+        pSampler->m_value.m_count = keyCount;
+        pSampler->m_value.m_stride = 3 * sizeof(uint16_t);
+        pSampler->m_value.m_dimension = 3;
+        pSampler->m_value.m_type = sizeof(uint16_t);
+        pSampler->m_value.m_sparseCount = 0;
+
+        pSampler->m_keyFormat = (result.path == 1) ? KEYS_QUAT48 : KEYS_VECTOR48;
+        memcpy(pSampler->m_rangeMin, result.rangeMin, sizeof(result.rangeMin));
+        memcpy(pSampler->m_rangeExtent, result.rangeExtent, sizeof(result.rangeExtent));
+
+        keysAfter += keyCount;
+        errors[result.path] = std::max(errors[result.path], result.error);
+    }
+
+    CompileAnimations();
+
+    if (!results.empty())
+    {
+        Trace(format("CompressAnimations: %s, %d samplers, %d -> %d keys, %.1f KB -> %.1f KB (%.1fx), max error %f (translation %f, rotation %f, scale %f)\n", 
+            m_filename.c_str(), (int)results.size(), (int)keysBefore, (int)keysAfter, bytesBefore / 1024.0f, bytesAfter / 1024.0f, 
+            bytesAfter > 0 ? float(bytesBefore) / bytesAfter : 0.0f, maxError, errors[0], errors[1], errors[2]));
+    }
+}
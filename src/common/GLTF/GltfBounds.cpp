@@ -0,0 +1,284 @@
+// AMD Cauldron code
+//
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfCommon.h"
+#include "GltfHelpers.h"
+#include "Misc/Misc.h"
+#include <cfloat>
+
+//
+// World space bounds of the primitives. Each node with a mesh owns a range of boxes and spheres that TransformScene() updates when the
+// node moves: the box of the primitive gets transformed, the instanced nodes take the box around all their instances and the skinned
+// ones the box around the boxes of their joints (the vertices are a blend of the joints that move them, so they can't leave those)
+//
+
+// grows the box given by its corners with the transformed one
+static inline void GrowBox(const XMMATRIX &mWorld, XMVECTOR center, XMVECTOR extent, XMVECTOR *pMin, XMVECTOR *pMax)
+{
+    XMVECTOR worldCenter, worldExtent;
+    TransformBox(mWorld, center, extent, &worldCenter, &worldExtent);
+    *pMin = XMVectorMin(*pMin, worldCenter - worldExtent);
+    *pMax = XMVectorMax(*pMax, worldCenter + worldExtent);
+}
+
+XMMATRIX GLTFCommon::GetInstanceMatrix(uint32_t instance) const
+{
+    return XMMatrixScalingFromVector(XMLoadFloat3(&m_instanceScales[instance])) * XMMatrixRotationQuaternion(XMLoadFloat4(&m_instanceRotations[instance])) * XMMatrixTranslationFromVector(XMLoadFloat3(&m_instanceTranslations[instance]));
+}
+
+//
+// The box of the vertices each joint moves, in the space of the mesh. The morph targets move the vertices too, the box of a vertex
+// grows by the sum of the deltas of each sign so it holds any weights between 0 and 1
+//
+void GLTFCommon::ComputeJointBounds()
+{
+    for (tfMesh &mesh : m_meshes)
+    {
+        for (tfPrimitives &primitive : mesh.m_pPrimitives)
+        {
+            primitive.m_jointBounds.clear();
+
+            int position = primitive.FindAttribute("POSITION");
+            if (position < 0 || primitive.FindAttribute("JOINTS_0") < 0 || primitive.FindAttribute("WEIGHTS_0") < 0)
+                continue;
+
+            tfAccessor positions;
+            GetBufferDetails(position, &positions);
+            const tfAccessorDesc &positionDesc = m_accessors[position];
+
+            std::vector<XMFLOAT3> morphMin, morphMax;
+            for (const tfMorphTarget &target : primitive.m_targets)
+            {
+                const tfMorphDeltas &deltas = target.m_deltas[MORPH_POSITION];
+                if (deltas.m_vertices.empty())
+                    continue;
+
+                morphMin.resize(positions.m_count, XMFLOAT3(0, 0, 0));
+                morphMax.resize(positions.m_count, XMFLOAT3(0, 0, 0));
+                for (size_t i = 0; i < deltas.m_vertices.size(); i++)
+                {
+                    float *pMin = &morphMin[deltas.m_vertices[i]].x;
+                    float *pMax = &morphMax[deltas.m_vertices[i]].x;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        float delta = deltas.m_deltas[i * 3 + c];
+                        pMin[c] += std::min(delta, 0.0f);
+                        pMax[c] += std::max(delta, 0.0f);
+                    }
+                }
+            }
+
+            // all the sets of joints and weights, the joints with a weight of 0 don't move the vertex
+            std::vector<XMVECTOR> jointMin, jointMax;
+            for (int set = 0; ; set++)
+            {
+                int joints = primitive.FindAttribute(format("JOINTS_%i", set));
+                int weights = primitive.FindAttribute(format("WEIGHTS_%i", set));
+                if (joints < 0 || weights < 0)
+                    break;
+
+                tfAccessor jointsAccessor, weightsAccessor;
+                GetBufferDetails(joints, &jointsAccessor);
+                GetBufferDetails(weights, &weightsAccessor);
+                const tfAccessorDesc &jointsDesc = m_accessors[joints];
+                const tfAccessorDesc &weightsDesc = m_accessors[weights];
+
+                int vertexCount = std::min(positions.m_count, std::min(jointsAccessor.m_count, weightsAccessor.m_count));
+                for (int v = 0; v < vertexCount; v++)
+                {
+                    float p[3], j[4], w[4];
+                    DequantizeToFloat(positions.Get(v), 1, 0, 3, positionDesc.m_componentType, positionDesc.m_normalized, p);
+                    DequantizeToFloat(jointsAccessor.Get(v), 1, 0, 4, jointsDesc.m_componentType, false, j);
+                    DequantizeToFloat(weightsAccessor.Get(v), 1, 0, 4, weightsDesc.m_componentType, weightsDesc.m_normalized, w);
+
+                    XMVECTOR vertexMin = XMVectorSet(p[0], p[1], p[2], 0.0f);
+                    XMVECTOR vertexMax = vertexMin;
+                    if (!morphMin.empty())
+                    {
+                        vertexMin += XMLoadFloat3(&morphMin[v]);
+                        vertexMax += XMLoadFloat3(&morphMax[v]);
+                    }
+
+                    for (int k = 0; k < 4; k++)
+                    {
+                        if (w[k] <= 0.0f)
+                            continue;
+
+                        uint32_t joint = (uint32_t)j[k];
+                        if (joint >= jointMin.size())
+                        {
+                            jointMin.resize(joint + 1, XMVectorReplicate(FLT_MAX));
+                            jointMax.resize(joint + 1, XMVectorReplicate(-FLT_MAX));
+                        }
+                        jointMin[joint] = XMVectorMin(jointMin[joint], vertexMin);
+                        jointMax[joint] = XMVectorMax(jointMax[joint], vertexMax);
+                    }
+                }
+            }
+
+            for (uint32_t joint = 0; joint < jointMin.size(); joint++)
+            {
+                if (XMVectorGetX(jointMin[joint]) > XMVectorGetX(jointMax[joint]))
+                    continue;
+
+                tfJointBounds bounds;
+                bounds.m_joint = joint;
+                XMStoreFloat3(&bounds.m_center, (jointMin[joint] + jointMax[joint]) * 0.5f);
+                XMStoreFloat3(&bounds.m_extent, (jointMax[joint] - jointMin[joint]) * 0.5f);
+                primitive.m_jointBounds.push_back(bounds);
+            }
+        }
+    }
+}
+
+//
+// Appends the bounds of the primitives of a node, they get their values when the node gets transformed
+//
+void GLTFCommon::AddWorldBoxes(tfNodeIdx nodeIndex)
+{
+    tfNode *pNode = &m_nodes[nodeIndex];
+    pNode->m_firstBox = m_worldBoxes.m_count;
+    if (pNode->meshIndex < 0 || pNode->meshIndex >= m_meshes.size())
+        return;
+
+    if (pNode->skinIndex >= 0 && pNode->skinIndex < m_skins.size())
+        m_skins[pNode->skinIndex].m_skinnedNodes.push_back(nodeIndex);
+
+    uint32_t primitiveCount = (uint32_t)m_meshes[pNode->meshIndex].m_pPrimitives.size();
+    m_worldBoxes.Resize(pNode->m_firstBox + primitiveCount);
+    m_worldSpheres.resize(pNode->m_firstBox + primitiveCount, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+    for (uint32_t p = 0; p < primitiveCount; p++)
+    {
+        m_boxNodes.push_back(nodeIndex);
+        m_boxPrimitives.push_back(p);
+    }
+}
+
+//
+// Called by TransformNodes() for the nodes that moved and by TransformSkin() for the skinned ones, each node owns its range of
+// bounds so the chunks and the skins can run concurrently
+//
+void GLTFCommon::UpdateWorldBoxes(tfNodeIdx nodeIndex)
+{
+    const tfNode &node = m_nodes[nodeIndex];
+    if (node.meshIndex < 0 || node.meshIndex >= m_meshes.size())
+        return;
+
+    const std::vector<tfPrimitives> &primitives = m_meshes[node.meshIndex].m_pPrimitives;
+    const tfSkins *pSkin = (node.skinIndex >= 0 && node.skinIndex < m_skins.size()) ? &m_skins[node.skinIndex] : NULL;
+    XMMATRIX mWorld = m_worldSpaceMats[nodeIndex].GetCurrent();
+
+    for (uint32_t p = 0; p < primitives.size(); p++)
+    {
+        const tfPrimitives &primitive = primitives[p];
+
+        // the vertex shader applies the matrix of the node after the instance or the skinning matrices
+        XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+        if (node.m_instanceCount > 0)
+        {
+            for (uint32_t i = node.m_firstInstance; i < node.m_firstInstance + node.m_instanceCount; i++)
+                GrowBox(GetInstanceMatrix(i) * mWorld, primitive.m_center, primitive.m_radius, &boxMin, &boxMax);
+        }
+        else if (pSkin)
+        {
+            const Matrix2 *pSkinningMats = &m_worldSpaceSkeletonMats[pSkin->m_firstSkinningMat];
+            for (const tfJointBounds &bounds : primitive.m_jointBounds)
+            {
+                if (bounds.m_joint < (uint32_t)pSkin->m_InverseBindMatrices.m_count)
+                    GrowBox(pSkinningMats[bounds.m_joint].GetCurrent() * mWorld, XMLoadFloat3(&bounds.m_center), XMLoadFloat3(&bounds.m_extent), &boxMin, &boxMax);
+            }
+        }
+
+        // the primitives that are neither get the box of the primitive, and so do the skinned ones without joints
+        XMVECTOR center, extent;
+        if (XMVector3LessOrEqual(boxMin, boxMax))
+        {
+            center = (boxMin + boxMax) * 0.5f;
+            extent = (boxMax - boxMin) * 0.5f;
+        }
+        else
+        {
+            TransformBox(mWorld, primitive.m_center, primitive.m_radius, &center, &extent);
+        }
+        m_worldBoxes.Set(node.m_firstBox + p, center, extent);
+
+        // the sphere around the box, a tighter one around the transformed sphere of the primitive when it only gets the node matrix
+        float radius = XMVectorGetX(XMVector3Length(extent));
+        if (node.m_instanceCount == 0 && pSkin == NULL)
+        {
+            float scaleSq = std::max(XMVectorGetX(XMVector3LengthSq(mWorld.r[0])), std::max(XMVectorGetX(XMVector3LengthSq(mWorld.r[1])), XMVectorGetX(XMVector3LengthSq(mWorld.r[2]))));
+            radius = std::min(radius, XMVectorGetX(XMVector3Length(primitive.m_radius)) * sqrtf(scaleSq));
+        }
+        m_worldSpheres[node.m_firstBox + p] = XMFLOAT4(XMVectorGetX(center), XMVectorGetY(center), XMVectorGetZ(center), radius);
+    }
+}
+
+uint32_t GLTFCommon::CullPrimitives(const XMMATRIX &mViewProj, std::vector<uint32_t> *pVisible) const
+{
+    FrustumPlanes planes;
+    ExtractFrustumPlanes(mViewProj, &planes);
+
+    if (pVisible->size() < m_worldBoxes.m_count)
+        pVisible->resize(m_worldBoxes.m_count);
+    return CullBoxes(planes, m_worldBoxes, pVisible->data());
+}
+
+bool GLTFCommon::GetSceneBounds(XMVECTOR *pCenter, XMVECTOR *pExtent)
+{
+    if (m_transformedScene < 0)
+        return false;
+
+    if (m_bSceneBoundsDirty)
+    {
+        m_bSceneBoundsDirty = false;
+
+        float boxMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float boxMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        const float *pCenters[3] = { m_worldBoxes.m_centerX.data(), m_worldBoxes.m_centerY.data(), m_worldBoxes.m_centerZ.data() };
+        const float *pExtents[3] = { m_worldBoxes.m_extentX.data(), m_worldBoxes.m_extentY.data(), m_worldBoxes.m_extentZ.data() };
+
+        // only the nodes of the scene, the boxes of the others are not transformed
+        for (tfNodeIdx nodeIdx : m_scenes[m_transformedScene].m_flatNodes)
+        {
+            const tfNode &node = m_nodes[nodeIdx];
+            if (node.meshIndex < 0 || node.meshIndex >= m_meshes.size())
+                continue;
+
+            uint32_t end = node.m_firstBox + (uint32_t)m_meshes[node.meshIndex].m_pPrimitives.size();
+            for (uint32_t b = node.m_firstBox; b < end; b++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    boxMin[c] = std::min(boxMin[c], pCenters[c][b] - pExtents[c][b]);
+                    boxMax[c] = std::max(boxMax[c], pCenters[c][b] + pExtents[c][b]);
+                }
+            }
+        }
+
+        m_sceneCenter = XMVectorSet(boxMax[0] + boxMin[0], boxMax[1] + boxMin[1], boxMax[2] + boxMin[2], 0.0f) * 0.5f;
+        m_sceneExtent = XMVectorSet(boxMax[0] - boxMin[0], boxMax[1] - boxMin[1], boxMax[2] - boxMin[2], 0.0f) * 0.5f;
+    }
+
+    // no primitives leave the box inverted
+    *pCenter = m_sceneCenter;
+    *pExtent = m_sceneExtent;
+    return XMVector3GreaterOrEqual(m_sceneExtent, XMVectorZero());
+}
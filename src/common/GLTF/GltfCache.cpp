@@ -0,0 +1,865 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfCommon.h"
+#include "GltfPbrMaterial.h"
+#include "Misc/Misc.h"
+#include "Misc/Hash.h"
+#include "Misc/Async.h"
+#include "Misc/ImgLoader.h"
+#include "Misc/DxgiFormatHelper.h"
+#include "Misc/MemoryMappedFile.h"
+
+//
+// The cooked cache is a binary snapshot of everything GLTFCommon::Load produces plus the mip chains of the images. 
+// It is saved next to the glTF as <filename>.cooked and loaded by mapping it, the buffers and the images are used in place.
+// It holds the size, last write time and hash of each source file. Loading only compares the sizes and times, a source gets
+// hashed when these don't match (i.e. it got touched) and if its contents changed the cache gets ignored.
+// GLTFCommon::Load() does both when the app sets tfImportOptions::bUseCookedCache.
+//
+// Layout:
+//     CookedHeader
+//     names of the source files, each one followed by its CookedSource
+//     tables (the JSON that is left, accessors, meshes, nodes, skins, animations...)
+//     buffers, 16 byte aligned
+//     images, each one is a CookedImageHeader followed by the slices (array elements x mips), 16 byte aligned
+//
+
+#define COOKED_MAGIC   0x4B4F4F43 // 'COOK'
+#define COOKED_VERSION 9
+
+struct CookedHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t importHash;
+};
+
+struct CookedSource
+{
+    uint64_t size;
+    uint64_t writeTime;
+    uint64_t hash;
+};
+
+struct CookedSlice
+{
+    uint32_t bytesWidth;
+    uint32_t rows;
+};
+
+struct CookedImageHeader
+{
+    IMG_INFO info;
+    uint32_t sliceCount;
+    // followed by sliceCount CookedSlices and then the pixels
+};
+
+//
+// Writes the cache sequentially
+//
+class CacheWriter
+{
+public:
+    CacheWriter(FILE *pFile) : m_pFile(pFile) {}
+
+    void Write(const void *pData, size_t size)
+    {
+        if (size > 0)
+            fwrite(pData, size, 1, m_pFile);
+        m_offset += size;
+    }
+
+    template <class T> void Write(const T &value) { Write(&value, sizeof(T)); }
+
+    void WriteString(const std::string &str)
+    {
+        Write((uint32_t)str.size());
+        Write(str.data(), str.size());
+    }
+
+    // only for vectors of plain structs
+    template <class T> void WriteVector(const std::vector<T> &v)
+    {
+        Write((uint32_t)v.size());
+        Write(v.data(), v.size() * sizeof(T));
+    }
+
+    void Align(size_t alignment)
+    {
+        static const char zeroes[16] = {};
+        assert(alignment <= sizeof(zeroes));
+        Write(zeroes, AlignUp<size_t>(m_offset, alignment) - m_offset);
+    }
+
+private:
+    FILE *m_pFile;
+    size_t m_offset = 0;
+};
+
+//
+// Reads the mapped cache, if it runs out of data it flags it instead of reading past the end
+//
+class CacheReader
+{
+public:
+    CacheReader(const char *pData, size_t size) : m_pData(pData), m_pCurrent(pData), m_pEnd(pData + size) {}
+
+    bool IsValid() const { return m_bValid; }
+
+    const char *Read(size_t size)
+    {
+        if (size > (size_t)(m_pEnd - m_pCurrent))
+        {
+            m_bValid = false;
+            m_pCurrent = m_pEnd;
+            return NULL;
+        }
+
+        const char *p = m_pCurrent;
+        m_pCurrent += size;
+        return p;
+    }
+
+    template <class T> void Read(T *pValue)
+    {
+        const char *p = Read(sizeof(T));
+        if (p)
+            memcpy(pValue, p, sizeof(T));
+    }
+
+    void ReadString(std::string *pStr)
+    {
+        uint32_t size = 0;
+        Read(&size);
+        const char *p = Read(size);
+        if (p)
+            pStr->assign(p, size);
+    }
+
+    template <class T> void ReadVector(std::vector<T> *pV)
+    {
+        uint32_t size = 0;
+        Read(&size);
+        const char *p = Read(size * sizeof(T));
+        if (p)
+        {
+            pV->resize(size);
+            memcpy(pV->data(), p, size * sizeof(T));
+        }
+    }
+
+    void Align(size_t alignment)
+    {
+        size_t offset = m_pCurrent - m_pData;
+        Read(AlignUp<size_t>(offset, alignment) - offset);
+    }
+
+private:
+    const char *m_pData;
+    const char *m_pCurrent;
+    const char *m_pEnd;
+    bool m_bValid = true;
+};
+
+//
+// Serves the mip chains of a cooked image, these are already in the layout the textures want
+//
+class CookedImgLoader : public ImgLoader
+{
+public:
+    CookedImgLoader(const char *pImage) : m_pImage(pImage) {}
+
+    bool Load(const char *pFilename, float cutOff, IMG_INFO *pInfo)
+    {
+        const CookedImageHeader *pHeader = (const CookedImageHeader *)m_pImage;
+        *pInfo = pHeader->info;
+
+        m_pSlices = (const CookedSlice *)(m_pImage + sizeof(CookedImageHeader));
+        m_sliceCount = pHeader->sliceCount;
+        m_pPixels = m_pImage + AlignUp<size_t>(sizeof(CookedImageHeader) + m_sliceCount * sizeof(CookedSlice), 16);
+        m_currentSlice = 0;
+        return true;
+    }
+
+    // each call returns the next slice
+    void CopyPixels(void *pDest, uint32_t stride, uint32_t bytesWidth, uint32_t height)
+    {
+        assert(m_currentSlice < m_sliceCount);
+        const CookedSlice &slice = m_pSlices[m_currentSlice++];
+
+        uint32_t rowSize = std::min<uint32_t>(bytesWidth, slice.bytesWidth);
+        uint32_t rows = std::min<uint32_t>(height, slice.rows);
+        for (uint32_t y = 0; y < rows; y++)
+        {
+            memcpy((char *)pDest + y * stride, m_pPixels + y * slice.bytesWidth, rowSize);
+        }
+
+        m_pPixels += slice.bytesWidth * slice.rows;
+    }
+
+private:
+    const char *m_pImage;
+    const CookedSlice *m_pSlices = NULL;
+    uint32_t m_sliceCount = 0;
+    uint32_t m_currentSlice = 0;
+    const char *m_pPixels = NULL;
+};
+
+//
+// Decodes an image and computes its mips, the result is a CookedImageHeader followed by the pixels
+//
+static bool CookImage(const std::string &filename, float cutOff, std::vector<char> *pCooked)
+{
+    ImgLoader *img = CreateImageLoader(filename.c_str());
+
+    IMG_INFO info;
+    bool result = img->Load(filename.c_str(), cutOff, &info);
+    if (result)
+    {
+        // same sizes the textures use when uploading, note that bytesPerPixel in BC formats is treated as bytesPerBlock
+        //
+        uint32_t bytePP = (uint32_t)GetPixelByteSize(info.format);
+        bool bBlockCompressed = (info.format >= DXGI_FORMAT_BC1_TYPELESS) && (info.format <= DXGI_FORMAT_BC5_SNORM);
+
+        std::vector<CookedSlice> slices;
+        size_t pixelsSize = 0;
+        for (uint32_t a = 0; a < info.arraySize; a++)
+        {
+            for (uint32_t mip = 0; mip < info.mipMapCount; mip++)
+            {
+                uint32_t width = std::max<uint32_t>(info.width >> mip, 1);
+                uint32_t height = std::max<uint32_t>(info.height >> mip, 1);
+
+                CookedSlice slice;
+                slice.bytesWidth = bBlockCompressed ? ((width + 3) / 4) * bytePP : width * bytePP;
+                slice.rows = bBlockCompressed ? (height + 3) / 4 : height;
+                slices.push_back(slice);
+
+                pixelsSize += slice.bytesWidth * slice.rows;
+            }
+        }
+
+        CookedImageHeader header = {};
+        header.info = info;
+        header.sliceCount = (uint32_t)slices.size();
+
+        size_t headerSize = AlignUp<size_t>(sizeof(CookedImageHeader) + slices.size() * sizeof(CookedSlice), 16);
+        pCooked->resize(headerSize + pixelsSize);
+        memcpy(pCooked->data(), &header, sizeof(header));
+        memcpy(pCooked->data() + sizeof(header), slices.data(), slices.size() * sizeof(CookedSlice));
+
+        char *pPixels = pCooked->data() + headerSize;
+        for (const CookedSlice &slice : slices)
+        {
+            img->CopyPixels(pPixels, slice.bytesWidth, slice.bytesWidth, slice.rows);
+            pPixels += slice.bytesWidth * slice.rows;
+        }
+    }
+
+    delete(img);
+
+    return result;
+}
+
+//
+// Size and last write time of a source file, returns false if it is missing
+//
+static bool GetSourceStamp(const std::string &filename, CookedSource *pSource)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data))
+        return false;
+
+    pSource->size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    pSource->writeTime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+static bool HashSource(const std::string &filename, uint64_t *pHash)
+{
+    MemoryMappedFile file;
+    if (!file.Open(filename.c_str()))
+        return false;
+
+    *pHash = Hash(file.GetData(), file.GetSize());
+    return true;
+}
+
+//
+// A source with the same size and time is taken as unchanged, only the touched ones get read and hashed
+//
+static bool IsSourceUnchanged(const std::string &filename, const CookedSource &cooked)
+{
+    CookedSource current;
+    if (!GetSourceStamp(filename, &current) || current.size != cooked.size)
+        return false;
+
+    if (current.writeTime == cooked.writeTime)
+        return true;
+
+    return HashSource(filename, &current.hash) && current.hash == cooked.hash;
+}
+
+//
+// tfAccessors point into the buffers, in the cache the pointers are stored as buffer index + offset (-1 for NULL)
+//
+static void WritePointer(CacheWriter *pWriter, const void *pointer, const std::vector<const char *> &buffersData, const std::vector<size_t> &buffersSize)
+{
+    int32_t buffer = -1;
+    uint64_t offset = 0;
+    for (int i = 0; i < buffersData.size() && pointer != NULL; i++)
+    {
+        const char *pData = (const char *)pointer;
+        if (pData >= buffersData[i] && pData < buffersData[i] + buffersSize[i])
+        {
+            buffer = i;
+            offset = pData - buffersData[i];
+            break;
+        }
+    }
+    assert(buffer >= 0 || pointer == NULL);
+
+    pWriter->Write(buffer);
+    pWriter->Write(offset);
+}
+
+static void WriteAccessor(CacheWriter *pWriter, const tfAccessor &accessor, const std::vector<const char *> &buffersData, const std::vector<size_t> &buffersSize)
+{
+    WritePointer(pWriter, accessor.m_data, buffersData, buffersSize);
+    pWriter->Write(accessor.m_count);
+    pWriter->Write(accessor.m_stride);
+    pWriter->Write(accessor.m_dimension);
+    pWriter->Write(accessor.m_type);
+
+    pWriter->Write(accessor.m_sparseCount);
+    if (accessor.m_sparseCount > 0)
+    {
+        pWriter->Write(accessor.m_sparseIndexSize);
+        WritePointer(pWriter, accessor.m_sparseIndices, buffersData, buffersSize);
+        WritePointer(pWriter, accessor.m_sparseValues, buffersData, buffersSize);
+    }
+}
+
+// the buffers come after the tables, the pointers get patched once they are read
+//
+struct PointerPatches
+{
+    std::vector<const void **> m_pointers;
+    std::vector<int32_t> m_buffers;
+    std::vector<uint64_t> m_offsets;
+};
+
+static void ReadPointer(CacheReader *pReader, const void **pPointer, PointerPatches *pPatches)
+{
+    int32_t buffer = -1;
+    uint64_t offset = 0;
+    pReader->Read(&buffer);
+    pReader->Read(&offset);
+
+    pPatches->m_pointers.push_back(pPointer);
+    pPatches->m_buffers.push_back(buffer);
+    pPatches->m_offsets.push_back(offset);
+}
+
+static void ReadAccessor(CacheReader *pReader, tfAccessor *pAccessor, PointerPatches *pPatches)
+{
+    ReadPointer(pReader, &pAccessor->m_data, pPatches);
+    pReader->Read(&pAccessor->m_count);
+    pReader->Read(&pAccessor->m_stride);
+    pReader->Read(&pAccessor->m_dimension);
+    pReader->Read(&pAccessor->m_type);
+
+    pReader->Read(&pAccessor->m_sparseCount);
+    if (pAccessor->m_sparseCount > 0)
+    {
+        pReader->Read(&pAccessor->m_sparseIndexSize);
+        ReadPointer(pReader, &pAccessor->m_sparseIndices, pPatches);
+        ReadPointer(pReader, &pAccessor->m_sparseValues, pPatches);
+    }
+}
+
+//
+// Saves the loaded scene, call it after Load()
+//
+bool GLTFCommon::SaveCooked(AsyncPool *pAsyncPool, size_t importHash) const
+{
+    Profile p("GLTFCommon::SaveCooked");
+
+    // the cache gets invalidated when any of these files changes
+    //
+    std::vector<std::string> sources;
+    sources.push_back(m_filename);
+    for (const std::string &uri : m_buffersUri)
+    {
+        if (!uri.empty())
+            sources.push_back(uri);
+    }
+    for (const tfImageDesc &image : m_images)
+    {
+        if (!image.m_uri.empty())
+            sources.push_back(image.m_uri);
+    }
+
+    CookedHeader header = {};
+    header.magic = COOKED_MAGIC;
+    header.version = COOKED_VERSION;
+    header.importHash = importHash;
+
+    std::vector<CookedSource> sourceStamps(sources.size());
+    for (int i = 0; i < sources.size(); i++)
+    {
+        if (!GetSourceStamp(m_path + sources[i], &sourceStamps[i]) || !HashSource(m_path + sources[i], &sourceStamps[i].hash))
+            return false;
+    }
+
+    // decode the images and compute their mips, same settings as GLTFTexturesAndBuffers::LoadTextures
+    //
+    static const json noMaterials = json::array();
+    auto materialsIt = j3.find("materials");
+    const json &materials = (materialsIt != j3.end()) ? *materialsIt : noMaterials;
+
+    Sync imagesCooked;
+    std::vector<std::vector<char>> images(m_images.size());
+    for (int i = 0; i < m_images.size(); i++)
+    {
+        if (m_images[i].m_uri.empty())
+            continue;
+
+        ExecAsyncIfThereIsAPool(pAsyncPool, [this, i, &materials, &images]()
+        {
+            bool useSRGB;
+            float cutOff;
+            GetSrgbAndCutOffOfImageGivenItsUse(i, materials, &useSRGB, &cutOff);
+
+            if (!CookImage(m_path + m_images[i].m_uri, cutOff, &images[i]))
+                Trace(format("The image %s could not be cooked\n", m_images[i].m_uri.c_str()));
+        }, &imagesCooked);
+    }
+
+    // only these tasks get waited for, the pool might be running other work of the app
+    imagesCooked.Wait();
+
+    // write to a temporary file so a partial cache never gets used
+    //
+    std::string filename = m_path + m_filename + ".cooked";
+    std::string tmpFilename = filename + ".tmp";
+
+    FILE *pFile;
+    if (fopen_s(&pFile, tmpFilename.c_str(), "wb") != 0)
+    {
+        Trace(format("The file %s cannot be created\n", tmpFilename.c_str()));
+        return false;
+    }
+
+    CacheWriter writer(pFile);
+    writer.Write(header);
+
+    writer.Write((uint32_t)sources.size());
+    for (int i = 0; i < sources.size(); i++)
+    {
+        writer.WriteString(sources[i]);
+        writer.Write(sourceStamps[i]);
+    }
+
+    // tables
+    //
+    writer.WriteString(j3.dump());
+
+    writer.WriteVector(m_accessors);
+    writer.WriteVector(m_bufferViews);
+    writer.WriteVector(m_textures);
+
+    writer.Write((uint32_t)m_images.size());
+    for (const tfImageDesc &image : m_images)
+        writer.WriteString(image.m_uri);
+
+    writer.Write((uint32_t)m_meshes.size());
+    for (const tfMesh &mesh : m_meshes)
+    {
+        writer.Write((uint32_t)mesh.m_pPrimitives.size());
+        for (const tfPrimitives &primitive : mesh.m_pPrimitives)
+        {
+            writer.Write(primitive.m_center);
+            writer.Write(primitive.m_radius);
+            writer.Write((uint32_t)primitive.m_attributes.size());
+            for (const tfAttribute &attribute : primitive.m_attributes)
+            {
+                writer.WriteString(attribute.m_name);
+                writer.Write(attribute.m_accessor);
+            }
+            writer.Write(primitive.m_indices);
+            writer.Write(primitive.m_material);
+            writer.Write(primitive.m_mode);
+            writer.WriteVector(primitive.m_meshlets);
+            writer.WriteVector(primitive.m_meshletVertices);
+            writer.WriteVector(primitive.m_meshletTriangles);
+            writer.WriteVector(primitive.m_lods);
+
+            // the deltas get extracted again when loading
+            writer.Write((uint32_t)primitive.m_targets.size());
+            for (const tfMorphTarget &target : primitive.m_targets)
+                writer.Write(target.m_accessors);
+        }
+        writer.WriteVector(mesh.m_weights);
+    }
+
+    writer.Write((uint32_t)m_nodes.size());
+    for (const tfNode &node : m_nodes)
+    {
+        writer.WriteVector(node.m_children);
+        writer.Write(node.skinIndex);
+        writer.Write(node.meshIndex);
+        writer.Write(node.channel);
+        writer.Write(node.bIsJoint);
+        writer.WriteString(node.m_name);
+        writer.Write(node.m_tranform.m_rotation);
+        writer.Write(node.m_tranform.m_translation);
+        writer.Write(node.m_tranform.m_scale);
+        writer.Write(node.m_firstInstance);
+        writer.Write(node.m_instanceCount);
+        writer.WriteVector(node.m_weights);
+    }
+    writer.WriteVector(m_instanceTranslations);
+    writer.WriteVector(m_instanceRotations);
+    writer.WriteVector(m_instanceScales);
+
+    writer.Write((uint32_t)m_scenes.size());
+    for (const tfScene &scene : m_scenes)
+        writer.WriteVector(scene.m_nodes);
+
+    writer.Write((uint32_t)m_skins.size());
+    for (const tfSkins &skin : m_skins)
+    {
+        WriteAccessor(&writer, skin.m_InverseBindMatrices, m_buffersData, m_buffersSize);
+        writer.Write((int32_t)(skin.m_pSkeleton ? skin.m_pSkeleton - m_nodes.data() : -1));
+        writer.WriteVector(skin.m_jointsNodeIdx);
+    }
+
+    writer.Write((uint32_t)m_animations.size());
+    for (const tfAnimation &animation : m_animations)
+    {
+        writer.Write(animation.m_duration);
+        writer.Write((uint32_t)animation.m_channels.size());
+        for (auto const &it : animation.m_channels)
+        {
+            writer.Write(it.first);
+
+            const tfSampler *pSamplers[4] = { it.second.m_pTranslation, it.second.m_pRotation, it.second.m_pScale, it.second.m_pWeights };
+            for (const tfSampler *pSampler : pSamplers)
+            {
+                writer.Write((uint32_t)(pSampler != NULL));
+                if (pSampler)
+                {
+                    WriteAccessor(&writer, pSampler->m_time, m_buffersData, m_buffersSize);
+                    WriteAccessor(&writer, pSampler->m_value, m_buffersData, m_buffersSize);
+                    writer.Write((int32_t)pSampler->m_interpolation);
+                    writer.Write((int32_t)pSampler->m_keyFormat);
+                    writer.Write(pSampler->m_rangeMin);
+                    writer.Write(pSampler->m_rangeExtent);
+                }
+            }
+        }
+    }
+
+    writer.WriteVector(m_cameras);
+    writer.WriteVector(m_lights);
+    writer.WriteVector(m_lightInstances);
+
+    // buffers, GPU-ready since the indices got widened while loading
+    //
+    writer.Write((uint32_t)m_buffersData.size());
+    for (int i = 0; i < m_buffersData.size(); i++)
+    {
+        writer.Write((uint64_t)m_buffersSize[i]);
+        writer.Align(16);
+        writer.Write(m_buffersData[i], m_buffersSize[i]);
+    }
+
+    // images with their mip chains
+    //
+    writer.Write((uint32_t)images.size());
+    for (const std::vector<char> &image : images)
+    {
+        writer.Write((uint64_t)image.size());
+        writer.Align(16);
+        writer.Write(image.data(), image.size());
+    }
+
+    bool result = (ferror(pFile) == 0);
+    fclose(pFile);
+
+    if (result)
+    {
+        remove(filename.c_str());
+        result = (rename(tmpFilename.c_str(), filename.c_str()) == 0);
+    }
+
+    if (!result)
+    {
+        Trace(format("The file %s could not be written\n", filename.c_str()));
+        remove(tmpFilename.c_str());
+    }
+
+    return result;
+}
+
+//
+// Loads a scene saved with SaveCooked, returns false if there is no cache or if it is stale. Then the glTF needs to be loaded with Load()
+//
+bool GLTFCommon::LoadCooked(const std::string &path, const std::string &filename, size_t importHash)
+{
+    Profile p("GLTFCommon::LoadCooked");
+
+    MemoryMappedFile *pFile = new MemoryMappedFile();
+    if (!pFile->Open((path + filename + ".cooked").c_str()))
+    {
+        delete pFile;
+        return false;
+    }
+
+    CacheReader reader(pFile->GetData(), pFile->GetSize());
+
+    CookedHeader header = {};
+    reader.Read(&header);
+
+    bool bUnchanged = (header.magic == COOKED_MAGIC && header.version == COOKED_VERSION && header.importHash == importHash);
+
+    uint32_t sourceCount = 0;
+    reader.Read(&sourceCount);
+    for (uint32_t i = 0; i < sourceCount && reader.IsValid() && bUnchanged; i++)
+    {
+        std::string source;
+        CookedSource stamp = {};
+        reader.ReadString(&source);
+        reader.Read(&stamp);
+        bUnchanged = reader.IsValid() && IsSourceUnchanged(path + source, stamp);
+    }
+
+    if (!reader.IsValid() || !bUnchanged)
+    {
+        Trace(format("The cooked cache of %s is missing or stale\n", filename.c_str()));
+        delete pFile;
+        return false;
+    }
+
+    Unload();
+
+    m_path = path;
+    m_filename = filename;
+    m_mappedFiles.push_back(pFile);
+
+    // tables
+    //
+    std::string dom;
+    reader.ReadString(&dom);
+    j3 = json::parse(dom, nullptr, false);
+    if (j3.is_discarded())
+    {
+        Trace(format("The cooked cache of %s is corrupted\n", filename.c_str()));
+        Unload();
+        return false;
+    }
+
+    reader.ReadVector(&m_accessors);
+    reader.ReadVector(&m_bufferViews);
+    reader.ReadVector(&m_textures);
+
+    uint32_t count = 0;
+    reader.Read(&count);
+    m_images.resize(reader.IsValid() ? count : 0);
+    for (tfImageDesc &image : m_images)
+        reader.ReadString(&image.m_uri);
+
+    reader.Read(&count);
+    m_meshes.resize(reader.IsValid() ? count : 0);
+    for (tfMesh &mesh : m_meshes)
+    {
+        reader.Read(&count);
+        mesh.m_pPrimitives.resize(reader.IsValid() ? count : 0);
+        for (tfPrimitives &primitive : mesh.m_pPrimitives)
+        {
+            reader.Read(&primitive.m_center);
+            reader.Read(&primitive.m_radius);
+            reader.Read(&count);
+            primitive.m_attributes.resize(reader.IsValid() ? count : 0);
+            for (tfAttribute &attribute : primitive.m_attributes)
+            {
+                reader.ReadString(&attribute.m_name);
+                reader.Read(&attribute.m_accessor);
+            }
+            reader.Read(&primitive.m_indices);
+            reader.Read(&primitive.m_material);
+            reader.Read(&primitive.m_mode);
+            reader.ReadVector(&primitive.m_meshlets);
+            reader.ReadVector(&primitive.m_meshletVertices);
+            reader.ReadVector(&primitive.m_meshletTriangles);
+            reader.ReadVector(&primitive.m_lods);
+
+            reader.Read(&count);
+            primitive.m_targets.resize(reader.IsValid() ? count : 0);
+            for (tfMorphTarget &target : primitive.m_targets)
+                reader.Read(&target.m_accessors);
+        }
+        reader.ReadVector(&mesh.m_weights);
+    }
+
+    reader.Read(&count);
+    m_nodes.resize(reader.IsValid() ? count : 0);
+    for (tfNode &node : m_nodes)
+    {
+        reader.ReadVector(&node.m_children);
+        reader.Read(&node.skinIndex);
+        reader.Read(&node.meshIndex);
+        reader.Read(&node.channel);
+        reader.Read(&node.bIsJoint);
+        reader.ReadString(&node.m_name);
+        reader.Read(&node.m_tranform.m_rotation);
+        reader.Read(&node.m_tranform.m_translation);
+        reader.Read(&node.m_tranform.m_scale);
+        reader.Read(&node.m_firstInstance);
+        reader.Read(&node.m_instanceCount);
+        reader.ReadVector(&node.m_weights);
+    }
+    reader.ReadVector(&m_instanceTranslations);
+    reader.ReadVector(&m_instanceRotations);
+    reader.ReadVector(&m_instanceScales);
+
+    reader.Read(&count);
+    m_scenes.resize(reader.IsValid() ? count : 0);
+    for (tfScene &scene : m_scenes)
+        reader.ReadVector(&scene.m_nodes);
+
+    // the accessors of the skins and animations get patched once the buffers are read
+    PointerPatches patches;
+
+    reader.Read(&count);
+    m_skins.resize(reader.IsValid() ? count : 0);
+    for (tfSkins &skin : m_skins)
+    {
+        ReadAccessor(&reader, &skin.m_InverseBindMatrices, &patches);
+
+        int32_t skeleton = -1;
+        reader.Read(&skeleton);
+        skin.m_pSkeleton = (skeleton >= 0 && skeleton < m_nodes.size()) ? &m_nodes[skeleton] : NULL;
+
+        reader.ReadVector(&skin.m_jointsNodeIdx);
+    }
+
+    reader.Read(&count);
+    m_animations.resize(reader.IsValid() ? count : 0);
+    for (tfAnimation &animation : m_animations)
+    {
+        reader.Read(&animation.m_duration);
+
+        uint32_t channelCount = 0;
+        reader.Read(&channelCount);
+        for (uint32_t c = 0; c < channelCount && reader.IsValid(); c++)
+        {
+            int node = -1;
+            reader.Read(&node);
+            tfChannel *tfchannel = &animation.m_channels[node];
+
+            tfSampler **ppSamplers[4] = { &tfchannel->m_pTranslation, &tfchannel->m_pRotation, &tfchannel->m_pScale, &tfchannel->m_pWeights };
+            for (tfSampler **ppSampler : ppSamplers)
+            {
+                uint32_t hasSampler = 0;
+                reader.Read(&hasSampler);
+                if (hasSampler)
+                {
+                    tfSampler *tfsmp = new tfSampler();
+                    ReadAccessor(&reader, &tfsmp->m_time, &patches);
+                    ReadAccessor(&reader, &tfsmp->m_value, &patches);
+
+                    int32_t interpolation = INTERPOLATION_LINEAR;
+                    reader.Read(&interpolation);
+                    tfsmp->m_interpolation = (tfInterpolation)interpolation;
+
+                    int32_t keyFormat = KEYS_FLOAT;
+                    reader.Read(&keyFormat);
+                    tfsmp->m_keyFormat = (tfKeyFormat)keyFormat;
+                    reader.Read(&tfsmp->m_rangeMin);
+                    reader.Read(&tfsmp->m_rangeExtent);
+                    *ppSampler = tfsmp;
+                }
+            }
+        }
+    }
+
+    reader.ReadVector(&m_cameras);
+    reader.ReadVector(&m_lights);
+    reader.ReadVector(&m_lightInstances);
+
+    // buffers, these are used in place
+    //
+    reader.Read(&count);
+    m_buffersData.resize(reader.IsValid() ? count : 0);
+    m_buffersSize.resize(m_buffersData.size());
+    m_buffersUri.resize(m_buffersData.size());
+    for (int i = 0; i < m_buffersData.size(); i++)
+    {
+        uint64_t size = 0;
+        reader.Read(&size);
+        reader.Align(16);
+        m_buffersData[i] = reader.Read((size_t)size);
+        m_buffersSize[i] = (size_t)size;
+    }
+
+    for (int i = 0; i < patches.m_pointers.size(); i++)
+    {
+        int32_t buffer = patches.m_buffers[i];
+        *patches.m_pointers[i] = (buffer >= 0 && buffer < m_buffersData.size() && m_buffersData[buffer] != NULL) ? m_buffersData[buffer] + patches.m_offsets[i] : NULL;
+    }
+
+    // images, empty ones were not cooked
+    //
+    reader.Read(&count);
+    m_cookedImages.resize(reader.IsValid() ? count : 0);
+    for (int i = 0; i < m_cookedImages.size(); i++)
+    {
+        uint64_t size = 0;
+        reader.Read(&size);
+        reader.Align(16);
+        const char *pImage = reader.Read((size_t)size);
+        m_cookedImages[i] = (size > 0) ? pImage : NULL;
+    }
+
+    if (!reader.IsValid() || !AreBuffersLoaded())
+    {
+        Trace(format("The cooked cache of %s is corrupted\n", filename.c_str()));
+        Unload();
+        return false;
+    }
+
+    InitTransformedData();
+
+    return true;
+}
+
+//
+// Returns a loader that serves the cooked mip chain of an image or NULL if the image wasn't cooked, the caller owns the loader
+//
+ImgLoader *GLTFCommon::CreateCookedImageLoader(int imageIndex) const
+{
+    if (imageIndex >= m_cookedImages.size() || m_cookedImages[imageIndex] == NULL)
+        return NULL;
+
+    return new CookedImgLoader(m_cookedImages[imageIndex]);
+}
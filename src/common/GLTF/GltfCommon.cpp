@@ -21,296 +21,940 @@
 #include "GltfCommon.h"
 #include "GltfHelpers.h"
 #include "Misc/Misc.h"
+#include "Misc/MemoryMappedFile.h"
+#include "Misc/Async.h"
+#include "Misc/Hash.h"
+#include "GltfMeshopt.h"
+#include "GltfSimplifier.h"
+#include "GltfSkinning.h"
+#include "GltfAnimation.h"
+#include <cfloat>
+#include <atomic>
 
-bool GLTFCommon::Load(const std::string &path, const std::string &filename)
+//
+// Binary glTF container, see https://github.com/KhronosGroup/glTF/tree/master/specification/2.0#glb-file-format-specification
+//
+const uint32_t GLB_MAGIC = 0x46546C67;         // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;    // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;     // "BIN\0"
+
+struct GlbHeader
 {
-    Profile p("GLTFCommon::Load");
+    uint32_t magic;
+    uint32_t version;
+    uint32_t length;
+};
 
-    m_path = path;
+struct GlbChunk
+{
+    uint32_t length;
+    uint32_t type;
+};
+
+//
+// Gets the contents of a binary file, either reading it into memory owned by this class or, if bMapBuffers is set, mapping it read-only
+// Can be called from several threads at once
+//
+const char *GLTFCommon::LoadBinaryFile(const std::string &filename, bool bMapBuffers, size_t *pSize)
+{
+    if (bMapBuffers)
+    {
+        MemoryMappedFile *pFile = new MemoryMappedFile();
+        if (!pFile->Open(filename.c_str()))
+        {
+            delete pFile;
+            return NULL;
+        }
 
-    std::ifstream f(path + filename);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_mappedFiles.push_back(pFile);
+        }
+        *pSize = pFile->GetSize();
+        return pFile->GetData();
+    }
+
+    std::ifstream f(filename, std::ios::in | std::ios::binary);
     if (!f)
+        return NULL;
+
+    f.seekg(0, f.end);
+    std::streamoff length = f.tellg();
+    f.seekg(0, f.beg);
+
+    // empty files can't be mapped, fail on both paths
+    if (length <= 0)
+        return NULL;
+
+    char *p = new char[length];
+    f.read(p, length);
+
     {
-        Trace(format("The file %s cannot be found\n", filename.c_str()));
-        return false;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_allocatedData.push_back(p);
     }
 
-    f >> j3;
+    *pSize = (size_t)length;
+    return p;
+}
+
+//
+// Parses the JSON chunk of a .glb straight from the container and returns a pointer to the BIN chunk (NULL if there is none)
+//
+bool GLTFCommon::ParseGlb(const char *pData, size_t size, const char **ppBinChunk, const json::parser_callback_t &onParse)
+{
+    *ppBinChunk = NULL;
+
+    if (size < sizeof(GlbHeader) + sizeof(GlbChunk))
+        return false;
 
-    // Load Buffers
+    const GlbHeader *pHeader = (const GlbHeader *)pData;
+    if (pHeader->magic != GLB_MAGIC || pHeader->version != 2 || pHeader->length > size)
+        return false;
+
+    // first chunk must be the JSON
     //
-    if (j3.find("buffers") != j3.end())
+    const char *pEnd = pData + pHeader->length;
+    const char *pChunk = pData + sizeof(GlbHeader);
+    const GlbChunk *pJsonChunk = (const GlbChunk *)pChunk;
+    const char *pJson = pChunk + sizeof(GlbChunk);
+    if (pJsonChunk->type != GLB_CHUNK_JSON || pJson + pJsonChunk->length > pEnd)
+        return false;
+
+    // optional BIN chunk, chunks are 4 byte aligned. Find it before parsing so the buffers can be set up while parsing
+    //
+    pChunk = pJson + AlignUp<uint32_t>(pJsonChunk->length, 4);
+    if (pChunk + sizeof(GlbChunk) <= pEnd)
     {
-        const json &buffers = j3["buffers"];
-        m_buffersData.resize(buffers.size());
-        for (int i = 0; i < buffers.size(); i++)
-        {
-            const std::string &name = buffers[i]["uri"];
-            std::ifstream ff(path + name, std::ios::in | std::ios::binary);
+        const GlbChunk *pBinChunk = (const GlbChunk *)pChunk;
+        if (pBinChunk->type == GLB_CHUNK_BIN && pChunk + sizeof(GlbChunk) + pBinChunk->length <= pEnd)
+            *ppBinChunk = pChunk + sizeof(GlbChunk);
+    }
 
-            ff.seekg(0, ff.end);
-            std::streamoff length = ff.tellg();
-            ff.seekg(0, ff.beg);
+    j3 = json::parse(pJson, pJson + pJsonChunk->length, onParse);
 
-            char *p = new char[length];
-            ff.read(p, length);
-            m_buffersData[i] = p;
+    return true;
+}
+
+//
+// These turn the big glTF tables into flat typed arrays, they get called by the parser as soon as each table is read
+//
+static void ParseBufferViews(const json &bufferViews, std::vector<tfBufferViewDesc> *pBufferViews)
+{
+    pBufferViews->resize(bufferViews.size());
+    for (int i = 0; i < bufferViews.size(); i++)
+    {
+        const json &bufferView = bufferViews[i];
+        tfBufferViewDesc *pBufferView = &pBufferViews->at(i);
+
+        pBufferView->m_buffer = bufferView.value("buffer", -1);
+        pBufferView->m_byteOffset = bufferView.value("byteOffset", 0);
+        pBufferView->m_byteLength = bufferView.value("byteLength", 0);
+        pBufferView->m_byteStride = bufferView.value("byteStride", 0);
+
+        auto extensions = bufferView.find("extensions");
+        if (extensions == bufferView.end())
+            continue;
+
+        auto meshopt = extensions->find("EXT_meshopt_compression");
+        if (meshopt == extensions->end())
+            continue;
+
+        tfMeshoptDesc *pMeshopt = &pBufferView->m_meshopt;
+        pMeshopt->m_buffer = meshopt->value("buffer", -1);
+        pMeshopt->m_byteOffset = meshopt->value("byteOffset", 0);
+        pMeshopt->m_byteLength = meshopt->value("byteLength", 0);
+        pMeshopt->m_byteStride = meshopt->value("byteStride", 0);
+        pMeshopt->m_count = meshopt->value("count", 0);
+
+        std::string mode = meshopt->value("mode", std::string("ATTRIBUTES"));
+        if (mode == "TRIANGLES")
+            pMeshopt->m_mode = MESHOPT_MODE_TRIANGLES;
+        else if (mode == "INDICES")
+            pMeshopt->m_mode = MESHOPT_MODE_INDICES;
+
+        std::string filter = meshopt->value("filter", std::string("NONE"));
+        if (filter == "OCTAHEDRAL")
+            pMeshopt->m_filter = MESHOPT_FILTER_OCTAHEDRAL;
+        else if (filter == "QUATERNION")
+            pMeshopt->m_filter = MESHOPT_FILTER_QUATERNION;
+        else if (filter == "EXPONENTIAL")
+            pMeshopt->m_filter = MESHOPT_FILTER_EXPONENTIAL;
+    }
+}
+
+static void ParseAccessors(const json &accessors, std::vector<tfAccessorDesc> *pAccessors)
+{
+    pAccessors->resize(accessors.size());
+    for (int i = 0; i < accessors.size(); i++)
+    {
+        const json &accessor = accessors[i];
+        tfAccessorDesc *pAccessor = &pAccessors->at(i);
+
+        pAccessor->m_bufferView = accessor.value("bufferView", -1);
+        pAccessor->m_byteOffset = accessor.value("byteOffset", 0);
+        pAccessor->m_componentType = accessor.value("componentType", 0);
+        pAccessor->m_dimension = GetDimensions(accessor.value("type", std::string()));
+        pAccessor->m_count = accessor.value("count", 0);
+        pAccessor->m_normalized = accessor.value("normalized", false);
+
+        auto min = accessor.find("min");
+        auto max = accessor.find("max");
+        if (min != accessor.end() && max != accessor.end())
+        {
+            pAccessor->m_hasMinMax = true;
+            for (int c = 0; c < 4 && c < min->size() && c < max->size(); c++)
+            {
+                pAccessor->m_min[c] = (*min)[c];
+                pAccessor->m_max[c] = (*max)[c];
+            }
+        }
+
+        auto sparse = accessor.find("sparse");
+        if (sparse != accessor.end())
+        {
+            const json &indices = (*sparse)["indices"];
+            const json &values = (*sparse)["values"];
+
+            pAccessor->m_sparseCount = sparse->value("count", 0);
+            pAccessor->m_sparseIndicesBufferView = indices.value("bufferView", -1);
+            pAccessor->m_sparseIndicesByteOffset = indices.value("byteOffset", 0);
+            pAccessor->m_sparseIndicesComponentType = indices.value("componentType", 5125);
+            pAccessor->m_sparseValuesBufferView = values.value("bufferView", -1);
+            pAccessor->m_sparseValuesByteOffset = values.value("byteOffset", 0);
         }
     }
+}
 
-    // Load Meshes
-    //
-    m_pAccessors = &j3["accessors"];
-    m_pBufferViews = &j3["bufferViews"];
-    const json &meshes = j3["meshes"];
-    m_meshes.resize(meshes.size());
+static void ParseMeshes(const json &meshes, std::vector<tfMesh> *pMeshes)
+{
+    pMeshes->resize(meshes.size());
     for (int i = 0; i < meshes.size(); i++)
     {
-        tfMesh *tfmesh = &m_meshes[i];
-        auto &primitives = meshes[i]["primitives"];
+        const json &primitives = meshes[i]["primitives"];
+
+        tfMesh *tfmesh = &pMeshes->at(i);
         tfmesh->m_pPrimitives.resize(primitives.size());
         for (int p = 0; p < primitives.size(); p++)
         {
+            const json &primitive = primitives[p];
             tfPrimitives *pPrimitive = &tfmesh->m_pPrimitives[p];
 
-            int positionId = primitives[p]["attributes"]["POSITION"];
-            const json &accessor = m_pAccessors->at(positionId);
+            // the attributes are stored in a map, so these come out sorted by name
+            for (auto const &it : primitive["attributes"].items())
+                pPrimitive->m_attributes.push_back({ it.key(), it.value().get<int>() });
 
-            XMVECTOR max = GetVector(GetElementJsonArray(accessor, "max", { 0.0, 0.0, 0.0, 0.0 }));
-            XMVECTOR min = GetVector(GetElementJsonArray(accessor, "min", { 0.0, 0.0, 0.0, 0.0 }));
+            pPrimitive->m_indices = primitive.value("indices", -1);
+            pPrimitive->m_material = primitive.value("material", -1);
+            pPrimitive->m_mode = primitive.value("mode", 4);
 
-            pPrimitive->m_center = (min + max)*.5;
-            pPrimitive->m_radius = max - pPrimitive->m_center;
-
-            pPrimitive->m_center = XMVectorSetW(pPrimitive->m_center, 1.0f); //set the W to 1 since this is a position not a direction
+            // morph targets, their deltas get extracted by InitTransformedData()
+            auto targets = primitive.find("targets");
+            if (targets != primitive.end())
+            {
+                pPrimitive->m_targets.resize(targets->size());
+                for (int t = 0; t < targets->size(); t++)
+                {
+                    pPrimitive->m_targets[t].m_accessors[MORPH_POSITION] = (*targets)[t].value("POSITION", -1);
+                    pPrimitive->m_targets[t].m_accessors[MORPH_NORMAL] = (*targets)[t].value("NORMAL", -1);
+                }
+            }
         }
+
+        // all the primitives have the same number of targets, the weights default to 0
+        size_t targetCount = tfmesh->m_pPrimitives.empty() ? 0 : tfmesh->m_pPrimitives[0].m_targets.size();
+        tfmesh->m_weights = meshes[i].value("weights", std::vector<float>());
+        tfmesh->m_weights.resize(targetCount, 0.0f);
+    }
+}
+
+static void ParseImages(const json &images, std::vector<tfImageDesc> *pImages)
+{
+    pImages->resize(images.size());
+    for (int i = 0; i < images.size(); i++)
+        pImages->at(i).m_uri = images[i].value("uri", std::string());
+}
+
+static void ParseTextures(const json &textures, std::vector<tfTextureDesc> *pTextures)
+{
+    pTextures->resize(textures.size());
+    for (int i = 0; i < textures.size(); i++)
+    {
+        pTextures->at(i).m_source = textures[i].value("source", -1);
+        pTextures->at(i).m_sampler = textures[i].value("sampler", -1);
+    }
+}
+
+//
+// returns a top level array of the glTF or an empty one if it is not present 
+//
+static const json &GetSection(const json &root, const char *name)
+{
+    static const json empty = json::array();
+
+    auto it = root.find(name);
+    return (it != root.end()) ? *it : empty;
+}
+
+//
+// Splits [0, count) in one range per core and runs job(begin, end) on each one in its own task. The loading tasks block waiting for 
+// the buffers and Async::Wait() lets a new thread take the core of a waiting one, a task per item could start thousands of threads
+//
+static void ExecRangesAsync(AsyncPool *pAsyncPool, int count, const std::function<void(int, int)> &job, Sync *pSync)
+{
+    int taskCount = std::min<int>(count, (pAsyncPool != NULL) ? std::max<int>(std::thread::hardware_concurrency(), 1) : 1);
+    for (int t = 0; t < taskCount; t++)
+    {
+        int begin = (int)((int64_t)count * t / taskCount);
+        int end = (int)((int64_t)count * (t + 1) / taskCount);
+        ExecAsyncIfThereIsAPool(pAsyncPool, [job, begin, end]() { job(begin, end); }, pSync);
     }
+}
 
-    // Load lights
+//
+// Loads a .gltf or a .glb file, when bMapBuffers is set the binary buffers are memory mapped instead of being copied to the heap.
+// If there is an AsyncPool the buffers are read while the rest of the JSON is being parsed and the sections are loaded concurrently
+//
+bool GLTFCommon::Load(const std::string &path, const std::string &filename, bool bMapBuffers, AsyncPool *pAsyncPool)
+{
+    Profile p("GLTFCommon::Load");
+
+    m_path = path;
+    m_filename = filename;
+
+    // Kick off the buffer reads as soon as the parser is done with the 'buffers' array. 
+    // The big tables are converted to typed arrays as soon as they are parsed and then dropped from the DOM (returning false discards them)
     //
-    if (j3.find("extensions") != j3.end())
+    Sync buffersLoaded;
+    std::vector<bool> fallbackBuffers;
+    bool bBuffersValid = true;
+    const char *pBinChunk = NULL;
+    std::string topLevelKey;
+    json::parser_callback_t onParse = [&](int depth, json::parse_event_t event, json &parsed)
+    {
+        if (depth == 1 && event == json::parse_event_t::key)
+        {
+            topLevelKey = parsed.get<std::string>();
+        }
+        else if (depth == 1 && event == json::parse_event_t::array_end)
+        {
+            if (topLevelKey == "buffers")
+                bBuffersValid = LoadBuffers(parsed, pBinChunk, bMapBuffers, pAsyncPool, &buffersLoaded, &fallbackBuffers);
+            else if (topLevelKey == "bufferViews")
+                ParseBufferViews(parsed, &m_bufferViews);
+            else if (topLevelKey == "accessors")
+                ParseAccessors(parsed, &m_accessors);
+            else if (topLevelKey == "meshes")
+                ParseMeshes(parsed, &m_meshes);
+            else if (topLevelKey == "images")
+                ParseImages(parsed, &m_images);
+            else if (topLevelKey == "textures")
+                ParseTextures(parsed, &m_textures);
+            else
+                return true;
+
+            return false;
+        }
+        return true;
+    };
+
+    try
     {
-        const json &extensions = j3["extensions"];
-        if (extensions.find("KHR_lights_punctual") != extensions.end())
+        if (filename.size() > 4 && _stricmp(filename.c_str() + filename.size() - 4, ".glb") == 0)
         {
-            const json &KHR_lights_punctual = extensions["KHR_lights_punctual"];
-            if (KHR_lights_punctual.find("lights") != KHR_lights_punctual.end())
+            size_t size;
+            const char *pData = LoadBinaryFile(path + filename, bMapBuffers, &size);
+            if (pData == NULL)
             {
-                const json &lights = KHR_lights_punctual["lights"];
-                m_lights.resize(lights.size());
-                for (int i = 0; i < lights.size(); i++)
-                {
-                    json::object_t light = lights[i];
-                    m_lights[i].m_color = GetElementVector(light, "color", XMVectorSet(1, 1, 1, 0));
-                    m_lights[i].m_range = GetElementFloat(light, "range", 105);
-                    m_lights[i].m_intensity = GetElementFloat(light, "intensity", 1);
-                    m_lights[i].m_innerConeAngle = GetElementFloat(light, "spot/innerConeAngle", 0);
-                    m_lights[i].m_outerConeAngle = GetElementFloat(light, "spot/outerConeAngle", XM_PIDIV4);
-
-                    std::string name = GetElementString(light, "type", "");
-                    if (name == "spot")
-                        m_lights[i].m_type = tfLight::LIGHT_SPOTLIGHT;
-                    else if (name == "point")
-                        m_lights[i].m_type = tfLight::LIGHT_POINTLIGHT;
-                    else if (name == "directional")
-                        m_lights[i].m_type = tfLight::LIGHT_DIRECTIONAL;
-                }
+                Trace(format("The file %s cannot be found\n", filename.c_str()));
+                return false;
+            }
+
+            if (!ParseGlb(pData, size, &pBinChunk, onParse))
+            {
+                Trace(format("The file %s is not a valid glb file\n", filename.c_str()));
+                buffersLoaded.Wait();
+                Unload();
+                return false;
             }
         }
+        else
+        {
+            std::ifstream f(path + filename);
+            if (!f)
+            {
+                Trace(format("The file %s cannot be found\n", filename.c_str()));
+                return false;
+            }
+
+            j3 = json::parse(f, onParse);
+        }
+    }
+    catch (...)
+    {
+        // the buffer reads the parser started signal buffersLoaded, they have to be done before it goes out of scope
+        buffersLoaded.Wait();
+        Unload();
+        throw;
     }
 
-    // Load cameras
+    // the parser keeps the keys of the tables the callback discarded, drop them so the DOM can be dumped and parsed again
     //
-    if (j3.find("cameras") != j3.end())
+    for (auto it = j3.begin(); it != j3.end();)
     {
-        const json &cameras = j3["cameras"];
-        m_cameras.resize(cameras.size());
-        for (int i = 0; i < cameras.size(); i++)
-        {
-            const json &camera = cameras[i];
-            tfCamera *tfcamera = &m_cameras[i];
+        if (it->is_discarded())
+            it = j3.erase(it);
+        else
+            ++it;
+    }
+
+    // EXT_meshopt_compression, the compressed buffer views get decoded into their fallback buffers as soon as the buffers are loaded, 
+    // split in one range of views per core
+    //
+    std::vector<int> compressedViews;
+    for (int i = 0; i < m_bufferViews.size(); i++)
+    {
+        const tfBufferViewDesc &bufferView = m_bufferViews[i];
+
+        // if the view doesn't point to a fallback buffer its data is there uncompressed
+        if (bufferView.m_meshopt.m_buffer < 0 || bufferView.m_buffer < 0 || bufferView.m_buffer >= fallbackBuffers.size() || !fallbackBuffers[bufferView.m_buffer])
+            continue;
+
+        compressedViews.push_back(i);
+    }
 
-            tfcamera->yfov = GetElementFloat(camera, "perspective/yfov", 0.1f);
-            tfcamera->znear = GetElementFloat(camera, "perspective/znear", 0.1f);
-            tfcamera->zfar = GetElementFloat(camera, "perspective/zfar", 100.0f);
-            tfcamera->m_nodeIndex = -1;
+    Sync bufferViewsDecoded;
+    bool bDecodeFailed = false;
+    ExecRangesAsync(pAsyncPool, (int)compressedViews.size(), [this, &compressedViews, &buffersLoaded, &bDecodeFailed](int begin, int end)
+    {
+        Async::Wait(&buffersLoaded);
+        if (!AreBuffersLoaded())
+            return;
+
+        for (int i = begin; i < end; i++)
+        {
+            if (!DecodeMeshoptBufferView(compressedViews[i]))
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                bDecodeFailed = true;
+            }
         }
+    }, &bufferViewsDecoded);
+
+    // From here on the JSON is only read, size all the tables first so the sections can be loaded concurrently and reference each other
+    //
+    const json &cameras = GetSection(j3, "cameras");
+    const json &nodes = GetSection(j3, "nodes");
+    const json &scenes = GetSection(j3, "scenes");
+    const json &skins = GetSection(j3, "skins");
+    const json &animations = GetSection(j3, "animations");
+
+    m_cameras.resize(cameras.size());
+    m_nodes.resize(nodes.size());
+    m_scenes.resize(scenes.size());
+    m_skins.resize(skins.size());
+    m_animations.resize(animations.size());
+
+    // only these tasks get waited for, the pool might be running other work of the app
+    Sync sectionsLoaded;
+    ExecAsyncIfThereIsAPool(pAsyncPool, [this]() { LoadMeshes(); }, &sectionsLoaded);
+    ExecAsyncIfThereIsAPool(pAsyncPool, [this]() { LoadLights(); }, &sectionsLoaded);
+    ExecAsyncIfThereIsAPool(pAsyncPool, [this, &cameras]() { LoadCameras(cameras); }, &sectionsLoaded);
+    ExecAsyncIfThereIsAPool(pAsyncPool, [this, &nodes]() { LoadNodes(nodes); }, &sectionsLoaded);
+    ExecAsyncIfThereIsAPool(pAsyncPool, [this, &scenes]() { LoadScenes(scenes); }, &sectionsLoaded);
+
+    // skins and animations point into the buffers, these need to be loaded first
+    //
+    ExecAsyncIfThereIsAPool(pAsyncPool, [this, &skins, &buffersLoaded, &bufferViewsDecoded]()
+    {
+        Async::Wait(&buffersLoaded);
+        Async::Wait(&bufferViewsDecoded);
+        if (AreBuffersLoaded())
+            LoadSkins(skins);
+    }, &sectionsLoaded);
+
+    ExecRangesAsync(pAsyncPool, (int)animations.size(), [this, &animations, &buffersLoaded, &bufferViewsDecoded](int begin, int end)
+    {
+        Async::Wait(&buffersLoaded);
+        Async::Wait(&bufferViewsDecoded);
+        if (!AreBuffersLoaded())
+            return;
+
+        for (int i = begin; i < end; i++)
+            LoadAnimation(animations[i], &m_animations[i]);
+    }, &sectionsLoaded);
+
+    // wait for all the sections
+    //
+    buffersLoaded.Wait();
+    bufferViewsDecoded.Wait();
+    sectionsLoaded.Wait();
+
+    if (!bBuffersValid || !AreBuffersLoaded() || bDecodeFailed)
+    {
+        Unload();
+        return false;
     }
 
-    // Load nodes
+    DequantizeAnimations(animations);
+    LoadInstances(nodes);
+
+    // these sections are in the typed arrays now, only the small ones like the materials stay in the DOM
+    //
+    j3.erase("cameras");
+    j3.erase("nodes");
+    j3.erase("scenes");
+    j3.erase("skins");
+    j3.erase("animations");
+
+    WidenByteIndices();
+
+    InitTransformedData();
+
+    return true;
+}
+
+//
+// The cache holds the output of the import stages, it is stamped with their settings so changing them cooks it again
+//
+static size_t HashImportOptions(const tfImportOptions &options)
+{
+    size_t hash = HashInt(options.bOptimizeMeshes);
+    hash = HashFloat(options.overdrawThreshold, hash);
+    hash = HashInt(options.lodCount, hash);
+    hash = HashFloat(options.lodReduction, hash);
+    hash = HashInt(options.bBuildMeshlets, hash);
+    hash = HashInt(options.meshletMaxVertices, hash);
+    hash = HashInt(options.meshletMaxTriangles, hash);
+    hash = HashInt(options.bCompressAnimations, hash);
+    hash = HashFloat(options.animationMaxError, hash);
+    return hash;
+}
+
+//
+// With bUseCookedCache the cache gets mapped when it is up to date, otherwise the glTF gets loaded and cooked for the next runs
+//
+bool GLTFCommon::Load(const std::string &path, const std::string &filename, const tfImportOptions &options, AsyncPool *pAsyncPool)
+{
+    size_t importHash = HashImportOptions(options);
+    if (options.bUseCookedCache && LoadCooked(path, filename, importHash))
+        return true;
+
+    if (!Load(path, filename, options.bMapBuffers, pAsyncPool))
+        return false;
+
+    // the optimization renumbers the vertices, the levels of detail and the meshlets are built from its output
     //
-    if (j3.find("nodes") != j3.end())
+    if (options.bOptimizeMeshes)
+        OptimizeMeshes(options.overdrawThreshold, pAsyncPool);
+
+    if (options.lodCount > 0)
+        BuildLods(options.lodCount, options.lodReduction, pAsyncPool);
+
+    if (options.bBuildMeshlets)
+        BuildMeshlets(options.meshletMaxVertices, options.meshletMaxTriangles, pAsyncPool);
+
+    if (options.bCompressAnimations)
+        CompressAnimations(options.animationMaxError, pAsyncPool);
+
+    // a cache that could not be written only costs the next run a full load
+    if (options.bUseCookedCache)
+        SaveCooked(pAsyncPool, importHash);
+
+    return true;
+}
+
+//
+// Reads the buffers, one task per buffer. pSync gets signaled when all of them are loaded, returns false if a buffer has no source
+//
+bool GLTFCommon::LoadBuffers(const json &buffers, const char *pBinChunk, bool bMapBuffers, AsyncPool *pAsyncPool, Sync *pSync, std::vector<bool> *pFallbackBuffers)
+{
+    bool bResult = true;
+    m_buffersData.resize(buffers.size());
+    m_buffersSize.resize(buffers.size());
+    m_buffersUri.resize(buffers.size());
+    pFallbackBuffers->resize(buffers.size());
+    for (int i = 0; i < buffers.size(); i++)
     {
-        const json &nodes = j3["nodes"];
-        m_nodes.resize(nodes.size());
-        for (int i = 0; i < nodes.size(); i++)
+        m_buffersSize[i] = buffers[i].value("byteLength", (size_t)0);
+
+        // EXT_meshopt_compression fallback buffers are not read (they might not even have a uri), the compressed buffer views get decoded into them
+        auto extensions = buffers[i].find("extensions");
+        if (extensions != buffers[i].end() && extensions->find("EXT_meshopt_compression") != extensions->end() && (*extensions)["EXT_meshopt_compression"].value("fallback", false))
         {
-            tfNode *tfnode = &m_nodes[i];
+            char *pData = new char[m_buffersSize[i]]();
+            m_buffersData[i] = pData;
+            pFallbackBuffers->at(i) = true;
 
-            // Read node data
-            //
-            json::object_t node = nodes[i];
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_allocatedData.push_back(pData);
+            continue;
+        }
 
-            if (node.find("children") != node.end())
+        // in a .glb the first buffer has no uri, it is the BIN chunk and we use it in place
+        if (buffers[i].find("uri") == buffers[i].end())
+        {
+            if (i != 0 || pBinChunk == NULL)
             {
-                for (int c = 0; c < node["children"].size(); c++)
-                {
-                    int nodeID = node["children"][c];
-                    tfnode->m_children.push_back(nodeID);
-                }
+                Trace(format("Buffer %i has no uri and there is no BIN chunk for it\n", i));
+                bResult = false;
+                continue;
             }
+            m_buffersData[i] = pBinChunk;
+            continue;
+        }
+
+        std::string name = buffers[i]["uri"];
+        m_buffersUri[i] = name;
+        ExecAsyncIfThereIsAPool(pAsyncPool, [this, i, name, bMapBuffers]()
+        {
+            size_t size;
+            m_buffersData[i] = LoadBinaryFile(m_path + name, bMapBuffers, &size);
+            if (m_buffersData[i] == NULL)
+                Trace(format("The file %s cannot be found\n", name.c_str()));
+        }, pSync);
+    }
+
+    return bResult;
+}
+
+//
+// Decodes an EXT_meshopt_compression buffer view into its fallback buffer, each view writes its own range so these can run concurrently
+//
+bool GLTFCommon::DecodeMeshoptBufferView(int bufferViewIndex)
+{
+    const tfBufferViewDesc &bufferView = m_bufferViews[bufferViewIndex];
+    const tfMeshoptDesc &meshopt = bufferView.m_meshopt;
+
+    size_t size = (size_t)meshopt.m_count * meshopt.m_byteStride;
+    if (meshopt.m_buffer >= m_buffersData.size() || (size_t)meshopt.m_byteOffset + meshopt.m_byteLength > m_buffersSize[meshopt.m_buffer] ||
+        size > bufferView.m_byteLength || (size_t)bufferView.m_byteOffset + size > m_buffersSize[bufferView.m_buffer])
+    {
+        Trace(format("Buffer view %i has an invalid EXT_meshopt_compression range\n", bufferViewIndex));
+        return false;
+    }
+
+    const unsigned char *pSource = (const unsigned char *)m_buffersData[meshopt.m_buffer] + meshopt.m_byteOffset;
+    // the fallback buffers are the only writable ones, LoadBuffers allocates them
+    char *pDestination = const_cast<char *>(m_buffersData[bufferView.m_buffer]) + bufferView.m_byteOffset;
+
+    bool result = false;
+    switch (meshopt.m_mode)
+    {
+    case MESHOPT_MODE_ATTRIBUTES: result = MeshoptDecodeVertexBuffer(pDestination, meshopt.m_count, meshopt.m_byteStride, pSource, meshopt.m_byteLength); break;
+    case MESHOPT_MODE_TRIANGLES: result = MeshoptDecodeIndexBuffer(pDestination, meshopt.m_count, meshopt.m_byteStride, pSource, meshopt.m_byteLength); break;
+    case MESHOPT_MODE_INDICES: result = MeshoptDecodeIndexSequence(pDestination, meshopt.m_count, meshopt.m_byteStride, pSource, meshopt.m_byteLength); break;
+    }
+
+    if (!result)
+    {
+        Trace(format("Buffer view %i cannot be decoded, the EXT_meshopt_compression data is corrupted\n", bufferViewIndex));
+        return false;
+    }
+
+    switch (meshopt.m_filter)
+    {
+    case MESHOPT_FILTER_OCTAHEDRAL: MeshoptDecodeFilterOct(pDestination, meshopt.m_count, meshopt.m_byteStride); break;
+    case MESHOPT_FILTER_QUATERNION: MeshoptDecodeFilterQuat(pDestination, meshopt.m_count, meshopt.m_byteStride); break;
+    case MESHOPT_FILTER_EXPONENTIAL: MeshoptDecodeFilterExp(pDestination, meshopt.m_count, meshopt.m_byteStride); break;
+    case MESHOPT_FILTER_NONE: break;
+    }
+
+    return true;
+}
+
+bool GLTFCommon::AreBuffersLoaded() const
+{
+    for (int i = 0; i < m_buffersData.size(); i++)
+    {
+        if (m_buffersData[i] == NULL)
+            return false;
+    }
+
+    return true;
+}
 
-            tfnode->meshIndex = GetElementInt(node, "mesh", -1);
-            tfnode->skinIndex = GetElementInt(node, "skin", -1);
+void GLTFCommon::LoadMeshes()
+{
+    for (int i = 0; i < m_meshes.size(); i++)
+    {
+        tfMesh *tfmesh = &m_meshes[i];
+        for (int p = 0; p < tfmesh->m_pPrimitives.size(); p++)
+        {
+            tfPrimitives *pPrimitive = &tfmesh->m_pPrimitives[p];
+
+            int positionId = pPrimitive->FindAttribute("POSITION");
+            if (positionId < 0)
+                continue;
 
-            int cameraIdx = GetElementInt(node, "camera", -1);
-            if (cameraIdx >= 0)
-                m_cameras[cameraIdx].m_nodeIndex = i;
+            const tfAccessorDesc &accessor = m_accessors[positionId];
 
-            int lightIdx = GetElementInt(node, "extensions/KHR_lights_punctual/light", -1);
-            if (lightIdx >= 0)
+            // quantized positions store min/max before normalization, the rest of the dequantization is in the node matrices
+            float minMax[2][4];
+            for (int c = 0; c < 4; c++)
             {
-                m_lightInstances.push_back({ lightIdx, i});
+                minMax[0][c] = DequantizeValue(accessor.m_min[c], accessor.m_componentType, accessor.m_normalized);
+                minMax[1][c] = DequantizeValue(accessor.m_max[c], accessor.m_componentType, accessor.m_normalized);
             }
 
-            tfnode->m_tranform.m_translation = GetElementVector(node, "translation", XMVectorSet(0, 0, 0, 0));
-            tfnode->m_tranform.m_scale = GetElementVector(node, "scale", XMVectorSet(1, 1, 1, 0));
+            XMVECTOR max = XMVectorSet(minMax[1][0], minMax[1][1], minMax[1][2], minMax[1][3]);
+            XMVECTOR min = XMVectorSet(minMax[0][0], minMax[0][1], minMax[0][2], minMax[0][3]);
 
-            if (node.find("name") != node.end())
-                tfnode->m_name = GetElementString(node, "name", "unnamed");
+            pPrimitive->m_center = (min + max)*.5;
+            pPrimitive->m_radius = max - pPrimitive->m_center;
 
-            if (node.find("rotation") != node.end())
-                tfnode->m_tranform.m_rotation = XMMatrixRotationQuaternion(GetVector(node["rotation"].get<json::array_t>()));
-            else if (node.find("matrix") != node.end())
-                tfnode->m_tranform.m_rotation = GetMatrix(node["matrix"].get<json::array_t>());
-            else
-                tfnode->m_tranform.m_rotation = XMMatrixIdentity();
+            pPrimitive->m_center = XMVectorSetW(pPrimitive->m_center, 1.0f); //set the W to 1 since this is a position not a direction
         }
     }
+}
 
-    // Load scenes
-    //
-    if (j3.find("scenes") != j3.end())
+void GLTFCommon::LoadLights()
+{
+    const json &root = j3;
+    auto extensions = root.find("extensions");
+    if (extensions == root.end())
+        return;
+
+    auto KHR_lights_punctual = extensions->find("KHR_lights_punctual");
+    if (KHR_lights_punctual == extensions->end())
+        return;
+
+    auto lightsIt = KHR_lights_punctual->find("lights");
+    if (lightsIt == KHR_lights_punctual->end())
+        return;
+
+    const json &lights = *lightsIt;
+    m_lights.resize(lights.size());
+    for (int i = 0; i < lights.size(); i++)
+    {
+        json::object_t light = lights[i];
+        m_lights[i].m_color = GetElementVector(light, "color", XMVectorSet(1, 1, 1, 0));
+        m_lights[i].m_range = GetElementFloat(light, "range", 105);
+        m_lights[i].m_intensity = GetElementFloat(light, "intensity", 1);
+        m_lights[i].m_innerConeAngle = GetElementFloat(light, "spot/innerConeAngle", 0);
+        m_lights[i].m_outerConeAngle = GetElementFloat(light, "spot/outerConeAngle", XM_PIDIV4);
+
+        std::string name = GetElementString(light, "type", "");
+        if (name == "spot")
+            m_lights[i].m_type = tfLight::LIGHT_SPOTLIGHT;
+        else if (name == "point")
+            m_lights[i].m_type = tfLight::LIGHT_POINTLIGHT;
+        else if (name == "directional")
+            m_lights[i].m_type = tfLight::LIGHT_DIRECTIONAL;
+    }
+}
+
+void GLTFCommon::LoadCameras(const json &cameras)
+{
+    // note that m_nodeIndex is set by LoadNodes
+    for (int i = 0; i < cameras.size(); i++)
     {
-        const json &scenes = j3["scenes"];
-        m_scenes.resize(scenes.size());
-        for (int i = 0; i < scenes.size(); i++)
+        const json &camera = cameras[i];
+        tfCamera *tfcamera = &m_cameras[i];
+
+        tfcamera->yfov = GetElementFloat(camera, "perspective/yfov", 0.1f);
+        tfcamera->znear = GetElementFloat(camera, "perspective/znear", 0.1f);
+        tfcamera->zfar = GetElementFloat(camera, "perspective/zfar", 100.0f);
+    }
+}
+
+void GLTFCommon::LoadNodes(const json &nodes)
+{
+    for (int i = 0; i < nodes.size(); i++)
+    {
+        tfNode *tfnode = &m_nodes[i];
+
+        // Read node data
+        //
+        json::object_t node = nodes[i];
+
+        if (node.find("children") != node.end())
         {
-            auto scene = scenes[i];
-            for (int n = 0; n < scene["nodes"].size(); n++)
+            for (int c = 0; c < node["children"].size(); c++)
             {
-                int nodeId = scene["nodes"][n];
-                m_scenes[i].m_nodes.push_back(nodeId);
+                int nodeID = node["children"][c];
+                tfnode->m_children.push_back(nodeID);
             }
         }
+
+        tfnode->meshIndex = GetElementInt(node, "mesh", -1);
+        tfnode->skinIndex = GetElementInt(node, "skin", -1);
+
+        int cameraIdx = GetElementInt(node, "camera", -1);
+        if (cameraIdx >= 0)
+            m_cameras[cameraIdx].m_nodeIndex = i;
+
+        int lightIdx = GetElementInt(node, "extensions/KHR_lights_punctual/light", -1);
+        if (lightIdx >= 0)
+        {
+            m_lightInstances.push_back({ lightIdx, i});
+        }
+
+        tfnode->m_tranform.m_translation = GetElementVector(node, "translation", XMVectorSet(0, 0, 0, 0));
+        tfnode->m_tranform.m_scale = GetElementVector(node, "scale", XMVectorSet(1, 1, 1, 0));
+
+        if (node.find("name") != node.end())
+            tfnode->m_name = GetElementString(node, "name", "unnamed");
+
+        if (node.find("weights") != node.end())
+            tfnode->m_weights = node["weights"].get<std::vector<float>>();
+
+        if (node.find("rotation") != node.end())
+            tfnode->m_tranform.m_rotation = XMMatrixRotationQuaternion(GetVector(node["rotation"].get<json::array_t>()));
+        else if (node.find("matrix") != node.end())
+            tfnode->m_tranform.m_rotation = GetMatrix(node["matrix"].get<json::array_t>());
+        else
+            tfnode->m_tranform.m_rotation = XMMatrixIdentity();
     }
+}
 
-    // Load skins
-    //
-    if (j3.find("skins") != j3.end())
+void GLTFCommon::LoadScenes(const json &scenes)
+{
+    for (int i = 0; i < scenes.size(); i++)
     {
-        const json &skins = j3["skins"];
-        m_skins.resize(skins.size());
-        for (uint32_t i = 0; i < skins.size(); i++)
+        const json &scene = scenes[i];
+        for (int n = 0; n < scene["nodes"].size(); n++)
         {
-            GetBufferDetails(skins[i]["inverseBindMatrices"].get<int>(), &m_skins[i].m_InverseBindMatrices);
+            int nodeId = scene["nodes"][n];
+            m_scenes[i].m_nodes.push_back(nodeId);
+        }
+    }
+}
 
-            if (skins[i].find("skeleton") != skins[i].end())
-                m_skins[i].m_pSkeleton = &m_nodes[skins[i]["skeleton"]];
+void GLTFCommon::LoadSkins(const json &skins)
+{
+    for (uint32_t i = 0; i < skins.size(); i++)
+    {
+        GetBufferDetails(skins[i]["inverseBindMatrices"].get<int>(), &m_skins[i].m_InverseBindMatrices);
 
-            const json &joints = skins[i]["joints"];
-            for (uint32_t n = 0; n < joints.size(); n++)
-            {
-                m_skins[i].m_jointsNodeIdx.push_back(joints[n]);
-            }
+        if (skins[i].find("skeleton") != skins[i].end())
+            m_skins[i].m_pSkeleton = &m_nodes[skins[i]["skeleton"]];
 
+        const json &joints = skins[i]["joints"];
+        for (uint32_t n = 0; n < joints.size(); n++)
+        {
+            m_skins[i].m_jointsNodeIdx.push_back(joints[n]);
         }
     }
+}
 
-    // Load animations
-    //
-    if (j3.find("animations") != j3.end())
+void GLTFCommon::LoadAnimation(const json &animation, tfAnimation *tfanim)
+{
+    const json &channels = animation["channels"];
+    const json &samplers = animation["samplers"];
+
+    for (int c = 0; c < channels.size(); c++)
     {
-        const json &animations = j3["animations"];
-        m_animations.resize(animations.size());
-        for (int i = 0; i < animations.size(); i++)
-        {
-            const json &channels = animations[i]["channels"];
-            const json &samplers = animations[i]["samplers"];
+        json::object_t channel = channels[c];
+        int sampler = channel["sampler"];
+        int node = GetElementInt(channel, "target/node", -1);
+        std::string path = GetElementString(channel, "target/path", std::string());
 
-            tfAnimation *tfanim = &m_animations[i];
-            for (int c = 0; c < channels.size(); c++)
-            {
-                json::object_t channel = channels[c];
-                int sampler = channel["sampler"];
-                int node = GetElementInt(channel, "target/node", -1);
-                std::string path = GetElementString(channel, "target/path", std::string());
+        tfChannel *tfchannel;
 
-                tfChannel *tfchannel;
+        auto ch = tfanim->m_channels.find(node);
+        if (ch == tfanim->m_channels.end())
+        {
+            tfchannel = &tfanim->m_channels[node];
+        }
+        else
+        {
+            tfchannel = &ch->second;
+        }
 
-                auto ch = tfanim->m_channels.find(node);
-                if (ch == tfanim->m_channels.end())
-                {
-                    tfchannel = &tfanim->m_channels[node];
-                }
-                else
-                {
-                    tfchannel = &ch->second;
-                }
+        tfSampler *tfsmp = new tfSampler();
 
-                tfSampler *tfsmp = new tfSampler();
+        // Get time line
+        //
+        GetBufferDetails(samplers[sampler]["input"], &tfsmp->m_time);
+        assert(tfsmp->m_time.m_stride == 4);
 
-                // Get time line
-                //
-                GetBufferDetails(samplers[sampler]["input"], &tfsmp->m_time);
-                assert(tfsmp->m_time.m_stride == 4);
+        tfanim->m_duration = std::max<float>(tfanim->m_duration, *(float*)tfsmp->m_time.Get(tfsmp->m_time.m_count - 1));
 
-                tfanim->m_duration = std::max<float>(tfanim->m_duration, *(float*)tfsmp->m_time.Get(tfsmp->m_time.m_count - 1));
+        // Get value line
+        //
+        GetBufferDetails(samplers[sampler]["output"], &tfsmp->m_value);
 
-                // Get value line
-                //
-                GetBufferDetails(samplers[sampler]["output"], &tfsmp->m_value);
+        std::string interpolation = samplers[sampler].value("interpolation", std::string("LINEAR"));
+        if (interpolation == "STEP")
+            tfsmp->m_interpolation = INTERPOLATION_STEP;
+        else if (interpolation == "CUBICSPLINE")
+            tfsmp->m_interpolation = INTERPOLATION_CUBICSPLINE;
 
-                // Index appropriately
-                // 
-                if (path == "translation")
-                {
-                    tfchannel->m_pTranslation = tfsmp;
-                    assert(tfsmp->m_value.m_stride == 3 * 4);
-                    assert(tfsmp->m_value.m_dimension == 3);
-                }
-                else if (path == "rotation")
-                {
-                    tfchannel->m_pRotation = tfsmp;
-                    assert(tfsmp->m_value.m_stride == 4 * 4);
-                    assert(tfsmp->m_value.m_dimension == 4);
-                }
-                else if (path == "scale")
-                {
-                    tfchannel->m_pScale = tfsmp;
-                    assert(tfsmp->m_value.m_stride == 3 * 4);
-                    assert(tfsmp->m_value.m_dimension == 3);
-                }
-            }
+        // Index appropriately
+        // 
+        // quantized values get converted to floats later on by DequantizeAnimations()
+        //
+        if (path == "translation")
+        {
+            tfchannel->m_pTranslation = tfsmp;
+            assert(tfsmp->m_value.m_dimension == 3);
+        }
+        else if (path == "rotation")
+        {
+            tfchannel->m_pRotation = tfsmp;
+            assert(tfsmp->m_value.m_dimension == 4);
+        }
+        else if (path == "scale")
+        {
+            tfchannel->m_pScale = tfsmp;
+            assert(tfsmp->m_value.m_dimension == 3);
+        }
+        else if (path == "weights")
+        {
+            tfchannel->m_pWeights = tfsmp;
+            assert(tfsmp->m_value.m_dimension == 1);
+        }
+        else
+        {
+            delete tfsmp;
         }
     }
-
-    InitTransformedData();
-
-    return true;
 }
 
 void GLTFCommon::Unload()
 {
-    for (int i = 0; i < m_buffersData.size(); i++)
+    for (int i = 0; i < m_allocatedData.size(); i++)
     {
-        delete[] m_buffersData[i];
+        delete[] m_allocatedData[i];
     }
-    m_buffersData.clear();
+    m_allocatedData.clear();
+
+    for (int i = 0; i < m_mappedFiles.size(); i++)
+    {
+        delete m_mappedFiles[i];
+    }
+    m_mappedFiles.clear();
 
+    m_buffersData.clear();
+    m_buffersSize.clear();
+    m_buffersUri.clear();
+    m_cookedImages.clear();
+
+    m_accessors.clear();
+    m_bufferViews.clear();
+    m_images.clear();
+    m_textures.clear();
+    m_meshes.clear();
     m_animations.clear();
     m_nodes.clear();
+    m_instanceTranslations.clear();
+    m_instanceRotations.clear();
+    m_instanceScales.clear();
     m_scenes.clear();
+    m_skins.clear();
+    m_worldSpaceSkeletonMats.clear();
+    m_inverseBindMats.clear();
+    m_jointMats.clear();
+    m_morphWeights.clear();
+    m_posePool = tfPosePool();
+    m_worldBoxes = CullingBoxes();
+    m_worldSpheres.clear();
+    m_boxNodes.clear();
+    m_boxPrimitives.clear();
+    m_cameras.clear();
+    m_lights.clear();
+    m_lightInstances.clear();
 
     j3.clear();
 }
@@ -327,92 +971,96 @@ void GLTFCommon::SetAnimationTime(uint32_t animationIndex, float time)
         //loop animation
         time = fmod(time, anim->m_duration);
 
-        for (auto it = anim->m_channels.begin(); it != anim->m_channels.end(); it++)
-        {
-            Transform *pSourceTrans = &m_nodes[it->first].m_tranform;
-            Transform animated;
-
-            float frac, *pCurr, *pNext;
+        // the compiled animation samples all its channels into a pose that gets turned into matrices, see GltfAnimation.cpp
+        SampleAnimation(anim, time);
+        ComposePose(anim->m_compiled, anim->m_compiled.m_pose.data(), m_animatedMats.data());
+        SampleMorphWeights(*anim, m_morphWeights.data());
 
-            // Animate translation
-            //
-            if (it->second.m_pTranslation != NULL)
-            {
-                it->second.m_pTranslation->SampleLinear(time, &frac, &pCurr, &pNext);
-                animated.m_translation = (1.0f - frac) * XMVectorSet(pCurr[0], pCurr[1], pCurr[2], 0) + (frac)*XMVectorSet(pNext[0], pNext[1], pNext[2], 0);
-            }
-            else
-            {
-                animated.m_translation = pSourceTrans->m_translation;
-            }
+        for (int node : anim->m_compiled.m_nodes)
+        {
+            m_dirtyNodes[node] = 1;
+        }
+    }
+}
 
-            // Animate rotation
-            //
-            if (it->second.m_pRotation != NULL)
-            {
-                it->second.m_pRotation->SampleLinear(time, &frac, &pCurr, &pNext);
-                animated.m_rotation = XMMatrixRotationQuaternion(XMQuaternionSlerp(XMVectorSet(pCurr[0], pCurr[1], pCurr[2], pCurr[3]), XMVectorSet(pNext[0], pNext[1], pNext[2], pNext[3]), frac));
-            }
-            else
-            {
-                animated.m_rotation = pSourceTrans->m_rotation;
-            }
+//
+// Same as above for a crowd, m_animatedMats and the state of the animation are not touched
+//
+void GLTFCommon::SetAnimationTimes(uint32_t animationIndex, const float *pTimes, uint32_t instanceCount, tfAnimationInstances *pInstances) const
+{
+    if (animationIndex < m_animations.size())
+    {
+        SampleAnimationInstances(m_animations[animationIndex], pTimes, instanceCount, pInstances);
+    }
+}
 
-            // Animate scale
-            //
-            if (it->second.m_pScale != NULL)
-            {
-                it->second.m_pScale->SampleLinear(time, &frac, &pCurr, &pNext);
-                animated.m_scale = (1.0f - frac) * XMVectorSet(pCurr[0], pCurr[1], pCurr[2], 0) + (frac)*XMVectorSet(pNext[0], pNext[1], pNext[2], 0);
-            }
-            else
-            {
-                animated.m_scale = pSourceTrans->m_scale;
-            }
+//
+// Blends the layers and animates the matrices of the nodes they touch
+//
+void GLTFCommon::SetAnimationLayers(const tfAnimationLayer *pLayers, uint32_t layerCount)
+{
+    BlendAnimationLayers(m_animations, pLayers, layerCount, &m_posePool);
+    ComposePose(m_posePool.m_nodes.data(), (uint32_t)m_posePool.m_nodes.size(), m_posePool.GetPose(POOL_RESULT), m_posePool.m_stride, m_animatedMats.data());
 
-            m_animatedMats[it->first] = animated.GetWorldMat();
-        }
+    for (int node : m_posePool.m_nodes)
+    {
+        m_dirtyNodes[node] = 1;
     }
 }
 
-void GLTFCommon::GetBufferDetails(int accessor, tfAccessor *pAccessor) const
+const char *GLTFCommon::GetBufferViewData(int bufferViewIdx, uint32_t byteOffset) const
 {
-    const json &inAccessor = m_pAccessors->at(accessor);
-
-    int32_t bufferViewIdx = inAccessor.value("bufferView", -1);
-    assert(bufferViewIdx >= 0);
-    const json &bufferView = m_pBufferViews->at(bufferViewIdx);
+    const tfBufferViewDesc &bufferView = m_bufferViews[bufferViewIdx];
 
-    int32_t bufferIdx = bufferView.value("buffer", -1);
+    int32_t bufferIdx = bufferView.m_buffer;
     assert(bufferIdx >= 0);
 
-    char *buffer = m_buffersData[bufferIdx];
+    return m_buffersData[bufferIdx] + bufferView.m_byteOffset + byteOffset;
+}
+
+void GLTFCommon::GetBufferDetails(int accessor, tfAccessor *pAccessor) const
+{
+    const tfAccessorDesc &inAccessor = m_accessors[accessor];
 
-    int32_t offset = bufferView.value("byteOffset", 0);
+    pAccessor->m_dimension = inAccessor.m_dimension;
+    pAccessor->m_type = GetFormatSize(inAccessor.m_componentType);
+    pAccessor->m_stride = pAccessor->m_dimension * pAccessor->m_type;
+    pAccessor->m_count = inAccessor.m_count;
 
-    int byteLength = bufferView["byteLength"];
+    // sparse accessors might not have a buffer view, their base data is all zeros
+    int32_t bufferViewIdx = inAccessor.m_bufferView;
+    assert(bufferViewIdx >= 0 || inAccessor.m_sparseCount > 0);
+    if (bufferViewIdx >= 0)
+    {
+        const tfBufferViewDesc &bufferView = m_bufferViews[bufferViewIdx];
 
-    int32_t byteOffset = inAccessor.value("byteOffset", 0);
-    offset += byteOffset;
-    byteLength -= byteOffset;
+        pAccessor->m_data = GetBufferViewData(bufferViewIdx, inAccessor.m_byteOffset);
+        if (bufferView.m_byteStride > 0)
+            pAccessor->m_stride = bufferView.m_byteStride;
+    }
+    else
+    {
+        pAccessor->m_data = NULL;
+    }
 
-    pAccessor->m_data = &buffer[offset];
-    pAccessor->m_dimension = GetDimensions(inAccessor["type"]);
-    pAccessor->m_type = GetFormatSize(inAccessor["componentType"]);
-    pAccessor->m_stride = pAccessor->m_dimension * pAccessor->m_type;
-    pAccessor->m_count = inAccessor["count"];
+    pAccessor->m_sparseCount = inAccessor.m_sparseCount;
+    if (inAccessor.m_sparseCount > 0)
+    {
+        pAccessor->m_sparseIndexSize = GetFormatSize(inAccessor.m_sparseIndicesComponentType);
+        pAccessor->m_sparseIndices = GetBufferViewData(inAccessor.m_sparseIndicesBufferView, inAccessor.m_sparseIndicesByteOffset);
+        pAccessor->m_sparseValues = GetBufferViewData(inAccessor.m_sparseValuesBufferView, inAccessor.m_sparseValuesByteOffset);
+    }
 }
 
-void GLTFCommon::GetAttributesAccessors(const json &gltfAttributes, std::vector<char*> *pStreamNames, std::vector<tfAccessor> *pAccessors) const
+void GLTFCommon::GetAttributesAccessors(const tfPrimitives &primitive, std::vector<char*> *pStreamNames, std::vector<tfAccessor> *pAccessors) const
 {
-    int streamIndex = 0;
     for (int s = 0; s < pStreamNames->size(); s++)
     {
-        auto attr = gltfAttributes.find(pStreamNames->at(s));
-        if (attr != gltfAttributes.end())
+        int attr = primitive.FindAttribute(pStreamNames->at(s));
+        if (attr >= 0)
         {
             tfAccessor accessor;
-            GetBufferDetails(attr.value(), &accessor);
+            GetBufferDetails(attr, &accessor);
             pAccessors->push_back(accessor);
         }
     }
@@ -446,22 +1094,226 @@ int GLTFCommon::GetInverseBindMatricesBufferSizeByID(int id) const
 }
 
 //
-// Transforms a node hierarchy recursively 
+// Flattens the hierarchy of a scene in level order (breadth first), with the parent of each node next to it.
+// Nodes reachable twice (invalid in glTF) are only kept the first time, that way a broken file can't loop forever
 //
-void GLTFCommon::TransformNodes(XMMATRIX world, const std::vector<tfNodeIdx> *pNodes)
+void GLTFCommon::FlattenHierarchy(int sceneIndex)
 {
-    m_worldSpaceMats.resize(m_nodes.size());
+    tfScene &scene = m_scenes[sceneIndex];
+    scene.m_flatNodes.clear();
+    scene.m_flatParents.clear();
+    scene.m_levels.clear();
+
+    std::vector<bool> visited(m_nodes.size(), false);
+    for (tfNodeIdx root : scene.m_nodes)
+    {
+        if (root >= 0 && root < (tfNodeIdx)m_nodes.size() && !visited[root])
+        {
+            visited[root] = true;
+            scene.m_flatNodes.push_back(root);
+            scene.m_flatParents.push_back(-1);
+        }
+    }
+
+    // each level is the children of the previous one
+    uint32_t levelStart = 0;
+    while (levelStart < scene.m_flatNodes.size())
+    {
+        uint32_t levelEnd = (uint32_t)scene.m_flatNodes.size();
+        scene.m_levels.push_back(levelStart);
+
+        for (uint32_t n = levelStart; n < levelEnd; n++)
+        {
+            tfNodeIdx parent = scene.m_flatNodes[n];
+            for (tfNodeIdx child : m_nodes[parent].m_children)
+            {
+                if (child < 0 || child >= (tfNodeIdx)m_nodes.size() || visited[child])
+                    continue;
+
+                visited[child] = true;
+                scene.m_flatNodes.push_back(child);
+                scene.m_flatParents.push_back(parent);
+            }
+        }
+
+        levelStart = levelEnd;
+    }
+    scene.m_levels.push_back((uint32_t)scene.m_flatNodes.size());
+}
+
+//
+// GPUs don't support 8 bit indices, these get widened to 16 bits once here (and end up GPU-ready in the cooked cache)
+//
+void GLTFCommon::WidenByteIndices()
+{
+    for (tfMesh &mesh : m_meshes)
+    {
+        for (tfPrimitives &primitive : mesh.m_pPrimitives)
+        {
+            // shared accessors are converted only once since their component type changes
+            if (primitive.m_indices < 0 || m_accessors[primitive.m_indices].m_componentType != 5121) // UNSIGNED_BYTE
+                continue;
+
+            tfAccessor indices;
+            GetBufferDetails(primitive.m_indices, &indices);
+
+            size_t size = indices.m_count * sizeof(uint16_t);
+            char *pData = new char[size];
+            for (int i = 0; i < indices.m_count; i++)
+                ((uint16_t *)pData)[i] = *(const uint8_t *)indices.Get(i);
+
+            // the new buffer is dense, sparse indices got applied by Get()
+            tfAccessorDesc *pAccessor = &m_accessors[primitive.m_indices];
+            pAccessor->m_bufferView = AddBuffer(pData, size);
+            pAccessor->m_byteOffset = 0;
+            pAccessor->m_componentType = 5123; // UNSIGNED_SHORT
+            pAccessor->m_sparseCount = 0;
+        }
+    }
+}
+
+//
+// KHR_mesh_quantization allows normalized integers in the rotation and weight outputs, the samplers interpolate floats so these get converted once here
+//
+void GLTFCommon::DequantizeAnimations(const json &animations)
+{
+    for (int a = 0; a < animations.size(); a++)
+    {
+        const json &channels = animations[a]["channels"];
+        const json &samplers = animations[a]["samplers"];
+
+        for (int c = 0; c < channels.size(); c++)
+        {
+            const json &channel = channels[c];
+            int output = samplers[channel["sampler"].get<int>()]["output"];
+
+            tfChannel &tfchannel = m_animations[a].m_channels[channel["target"].value("node", -1)];
+            std::string path = channel["target"].value("path", std::string());
+
+            tfSampler *tfsmp = NULL;
+            if (path == "translation")
+                tfsmp = tfchannel.m_pTranslation;
+            else if (path == "rotation")
+                tfsmp = tfchannel.m_pRotation;
+            else if (path == "scale")
+                tfsmp = tfchannel.m_pScale;
+            else if (path == "weights")
+                tfsmp = tfchannel.m_pWeights;
+
+            // quantized outputs are 8 or 16 bits
+            if (tfsmp == NULL || tfsmp->m_value.m_type == 4)
+                continue;
+
+            // the accessor might be shared by several samplers, it is only converted the first time
+            const tfAccessorDesc &accessor = m_accessors[output];
+            if (accessor.m_componentType != 5126)
+            {
+                size_t size = (size_t)tfsmp->m_value.m_count * tfsmp->m_value.m_dimension * sizeof(float);
+                char *pData = new char[size];
+                const tfAccessor &value = tfsmp->m_value;
+                if (value.IsSparse())
+                {
+                    for (int i = 0; i < value.m_count; i++)
+                        DequantizeToFloat(value.Get(i), 1, value.m_stride, value.m_dimension, accessor.m_componentType, accessor.m_normalized, (float *)pData + i * value.m_dimension);
+                }
+                else
+                {
+                    DequantizeToFloat(value.m_data, value.m_count, value.m_stride, value.m_dimension, accessor.m_componentType, accessor.m_normalized, (float *)pData);
+                }
+
+                tfAccessorDesc *pAccessor = &m_accessors[output];
+                pAccessor->m_bufferView = AddBuffer(pData, size);
+                pAccessor->m_byteOffset = 0;
+                pAccessor->m_componentType = 5126; // FLOAT
+                pAccessor->m_normalized = false;
+                pAccessor->m_sparseCount = 0;
+            }
+
+            GetBufferDetails(output, &tfsmp->m_value);
+        }
+    }
+}
+
+//
+// EXT_mesh_gpu_instancing, the TRS accessors of the instanced nodes are appended to the SoA instance arrays and the node keeps the range.
+// KHR_mesh_quantization allows normalized integers in them, these get converted to floats here
+//
+void GLTFCommon::LoadInstances(const json &nodes)
+{
+    static const char *attributeNames[3] = { "TRANSLATION", "ROTATION", "SCALE" };
+    static const int dimensions[3] = { 3, 4, 3 };
 
-    for (uint32_t n = 0; n < pNodes->size(); n++)
+    for (int i = 0; i < nodes.size(); i++)
     {
-        uint32_t nodeIdx = pNodes->at(n);
+        json::object_t node = nodes[i];
+        int accessors[3];
+        for (int a = 0; a < 3; a++)
+            accessors[a] = GetElementInt(node, (std::string("extensions/EXT_mesh_gpu_instancing/attributes/") + attributeNames[a]).c_str(), -1);
+
+        // all the attributes have the same count, a missing one takes the default value
+        uint32_t count = 0;
+        for (int a = 0; a < 3; a++)
+        {
+            if (accessors[a] >= 0)
+            {
+                if (count != 0 && count != m_accessors[accessors[a]].m_count)
+                    Trace(format("EXT_mesh_gpu_instancing: the attributes of node %i have different counts\n", i));
+                count = (count == 0) ? m_accessors[accessors[a]].m_count : std::min<uint32_t>(count, m_accessors[accessors[a]].m_count);
+            }
+        }
+
+        if (count == 0)
+            continue;
+
+        tfNode &tfnode = m_nodes[i];
+        tfnode.m_firstInstance = (uint32_t)m_instanceTranslations.size();
+        tfnode.m_instanceCount = count;
+
+        m_instanceTranslations.resize(tfnode.m_firstInstance + count, XMFLOAT3(0, 0, 0));
+        m_instanceRotations.resize(tfnode.m_firstInstance + count, XMFLOAT4(0, 0, 0, 1));
+        m_instanceScales.resize(tfnode.m_firstInstance + count, XMFLOAT3(1, 1, 1));
 
-        XMMATRIX m = m_animatedMats[nodeIdx] * world;
-        m_worldSpaceMats[nodeIdx].Set(m);
-        TransformNodes(m, &m_nodes[nodeIdx].m_children);
+        float *pOut[3] = { &m_instanceTranslations[tfnode.m_firstInstance].x, &m_instanceRotations[tfnode.m_firstInstance].x, &m_instanceScales[tfnode.m_firstInstance].x };
+        for (int a = 0; a < 3; a++)
+        {
+            if (accessors[a] < 0)
+                continue;
+
+            const tfAccessorDesc &accessorDesc = m_accessors[accessors[a]];
+            tfAccessor accessor;
+            GetBufferDetails(accessors[a], &accessor);
+            if (accessor.m_dimension != dimensions[a])
+            {
+                Trace(format("EXT_mesh_gpu_instancing: the %s of node %i has the wrong type\n", attributeNames[a], i));
+                continue;
+            }
+
+            for (uint32_t n = 0; n < count; n++)
+                DequantizeToFloat(accessor.Get(n), 1, 0, dimensions[a], accessorDesc.m_componentType, accessorDesc.m_normalized, pOut[a] + n * dimensions[a]);
+        }
     }
 }
 
+//
+// Adds memory created by the loader as a new buffer with a buffer view that covers it all, returns the buffer view index.
+// Not thread safe, only call it once all the sections are loaded
+//
+int GLTFCommon::AddBuffer(char *pData, size_t size)
+{
+    m_allocatedData.push_back(pData);
+
+    tfBufferViewDesc bufferView;
+    bufferView.m_buffer = (int)m_buffersData.size();
+    bufferView.m_byteLength = (uint32_t)size;
+
+    m_buffersData.push_back(pData);
+    m_buffersSize.push_back(size);
+    m_buffersUri.push_back(std::string());
+
+    m_bufferViews.push_back(bufferView);
+    return (int)m_bufferViews.size() - 1;
+}
+
 //
 // Initializes the GLTFCommonTransformed structure 
 //
@@ -470,10 +1322,25 @@ void GLTFCommon::InitTransformedData()
     // initializes matrix buffers to have the same dimension as the nodes
     m_worldSpaceMats.resize(m_nodes.size());
 
-    // same thing for the skinning matrices but using the size of the InverseBindMatrices
+    // same thing for the skinning matrices but using the size of the InverseBindMatrices, all the skins share one array
+    uint32_t skinningMatCount = 0;
+    for (uint32_t i = 0; i < m_skins.size(); i++)
+    {
+        m_skins[i].m_firstSkinningMat = skinningMatCount;
+        skinningMatCount += m_skins[i].m_InverseBindMatrices.m_count;
+    }
+    m_worldSpaceSkeletonMats.resize(skinningMatCount);
+    m_jointMats.resize(skinningMatCount);
+
+    // the inverse binds get unpacked once so the skinning runs over aligned arrays
+    m_inverseBindMats.resize(skinningMatCount);
     for (uint32_t i = 0; i < m_skins.size(); i++)
     {
-        m_worldSpaceSkeletonMats[i].resize(m_skins[i].m_InverseBindMatrices.m_count);
+        const tfSkins &skin = m_skins[i];
+        for (int j = 0; j < skin.m_InverseBindMatrices.m_count; j++)
+        {
+            m_inverseBindMats[skin.m_firstSkinningMat + j] = XMLoadFloat4x4((const XMFLOAT4X4 *)skin.m_InverseBindMatrices.Get(j));
+        }
     }
 
     // sets the animated data to the default values of the nodes
@@ -483,31 +1350,263 @@ void GLTFCommon::InitTransformedData()
     {
         m_animatedMats[i] = m_nodes[i].m_tranform.GetWorldMat();
     }
+
+    // morph targets, the weights of all the nodes go in one array and the deltas of the targets get extracted
+    m_morphWeights.clear();
+    for (tfNode &node : m_nodes)
+    {
+        AddMorphWeights(&node);
+    }
+    CompileMorphTargets();
+
+    // the bounds get their values the first time the nodes get transformed, the skinned ones when their skin does
+    ComputeJointBounds();
+    m_worldBoxes = CullingBoxes();
+    m_worldSpheres.clear();
+    m_boxNodes.clear();
+    m_boxPrimitives.clear();
+    for (tfSkins &skin : m_skins)
+    {
+        skin.m_skinnedNodes.clear();
+    }
+    for (uint32_t i = 0; i < m_nodes.size(); i++)
+    {
+        AddWorldBoxes(i);
+    }
+    m_bSceneBoundsDirty = true;
+
+    // everything gets transformed the first time
+    m_dirtyNodes.assign(m_nodes.size(), 1);
+    m_nodeChanges.assign(m_nodes.size(), NODE_STATIC);
+    m_transformedScene = -1;
+    m_transformedWorld = XMMatrixIdentity();
+
+    // time tracks and the representation SetAnimationTime() evaluates
+    CompileAnimations();
+    InitPosePool(m_nodes, &m_posePool);
+
+    // the hierarchies get flattened once so TransformScene() doesn't have to recurse
+    for (int i = 0; i < m_scenes.size(); i++)
+    {
+        FlattenHierarchy(i);
+    }
+}
+
+//
+// Builds the time tracks and the compiled animations, again every time the samplers change
+//
+void GLTFCommon::CompileAnimations()
+{
+    // the samplers that share their input accessor share the time track, so the keys are only looked up once per frame
+    for (tfAnimation &animation : m_animations)
+    {
+        animation.m_timeTracks.clear();
+        std::map<const void *, int> tracks;
+        for (auto &it : animation.m_channels)
+        {
+            tfSampler *pSamplers[4] = { it.second.m_pTranslation, it.second.m_pRotation, it.second.m_pScale, it.second.m_pWeights };
+            for (tfSampler *pSampler : pSamplers)
+            {
+                if (pSampler == NULL)
+                    continue;
+
+                // the tracks point straight to the buffer unless the times need to be unpacked
+                const tfAccessor &time = pSampler->m_time;
+                bool bDense = !time.IsSparse() && time.m_stride == sizeof(float);
+                if (bDense)
+                {
+                    auto track = tracks.find(time.m_data);
+                    if (track != tracks.end() && animation.m_timeTracks[track->second].m_count == time.m_count)
+                    {
+                        pSampler->m_timeTrack = track->second;
+                        continue;
+                    }
+                    tracks[time.m_data] = (int)animation.m_timeTracks.size();
+                }
+
+                pSampler->m_timeTrack = (int)animation.m_timeTracks.size();
+                animation.m_timeTracks.push_back(tfTimeTrack());
+
+                tfTimeTrack &track = animation.m_timeTracks.back();
+                track.m_count = time.m_count;
+                if (bDense)
+                {
+                    track.m_pTimes = (const float *)time.m_data;
+                }
+                else
+                {
+                    track.m_denseTimes.resize(time.m_count);
+                    for (int i = 0; i < time.m_count; i++)
+                        track.m_denseTimes[i] = *(const float *)time.Get(i);
+                }
+            }
+        }
+
+        // m_timeTracks doesn't grow anymore
+        for (tfTimeTrack &track : animation.m_timeTracks)
+        {
+            if (!track.m_denseTimes.empty())
+                track.m_pTimes = track.m_denseTimes.data();
+        }
+
+        CompileAnimation(m_nodes, &animation);
+    }
 }
 
+//
+// TransformScene() only goes multithreaded for scenes with at least this many nodes, the levels of the hierarchy get split in chunks of this size
+//
+#define PARALLEL_TRANSFORM_MIN_NODES 2048
+#define PARALLEL_TRANSFORM_CHUNK     512
+
 //
 // Takes the animated matrices and processes the hierarchy, also computes the skinning matrix buffers. 
+// Only the nodes that are dirty or whose parent moved get a new matrix, the ones that moved the frame before just get their previous matrix
+// updated (NODE_SETTLED) and the rest aren't touched at all (NODE_STATIC)
 //
-void GLTFCommon::TransformScene(int sceneIndex, XMMATRIX world)
+void GLTFCommon::TransformScene(int sceneIndex, XMMATRIX world, ThreadPool *pThreadPool)
 {
-    // transform all the nodes of the scene (and make 
-    //           
-    std::vector<int> sceneNodes = { m_scenes[sceneIndex].m_nodes };
-    TransformNodes(world, &sceneNodes);
+    // a different scene or world matrix moves all the roots
+    bool bWorldChanged = (sceneIndex != m_transformedScene);
+    for (int r = 0; r < 4; r++)
+        bWorldChanged |= !XMVector4Equal(world.r[r], m_transformedWorld.r[r]);
+    m_transformedScene = sceneIndex;
+    m_transformedWorld = world;
+
+    const tfScene &scene = m_scenes[sceneIndex];
+    uint32_t nodeCount = (uint32_t)scene.m_flatNodes.size();
 
-    //process skeletons, takes the skinning matrices from the scene and puts them into a buffer that the vertex shader will consume
+    // small scenes are faster in a single pass
     //
-    for (uint32_t i = 0; i < m_skins.size(); i++)
+    if (pThreadPool == NULL || nodeCount < PARALLEL_TRANSFORM_MIN_NODES)
     {
-        tfSkins &skin = m_skins[i];
+        if (TransformNodes(scene, 0, nodeCount, world, bWorldChanged))
+            m_bSceneBoundsDirty = true;
+        for (uint32_t i = 0; i < m_skins.size(); i++)
+            TransformSkin(i);
+        return;
+    }
 
-        //pick the matrices that affect the skin and multiply by the inverse of the bind         
-        const XMMATRIX *pM = (const XMMATRIX *)skin.m_InverseBindMatrices.m_data;
-        std::vector<Matrix2> &skinningMats = m_worldSpaceSkeletonMats[i];
-        for (int j = 0; j < skin.m_InverseBindMatrices.m_count; j++)
+    // the nodes of a level only depend on the level above, the chunks of a level run concurrently and this thread takes the last one
+    //
+    Sync done;
+    std::atomic<bool> bMoved{ false };
+    for (size_t l = 0; l + 1 < scene.m_levels.size(); l++)
+    {
+        uint32_t begin = scene.m_levels[l];
+        uint32_t end = scene.m_levels[l + 1];
+        for (; end - begin > PARALLEL_TRANSFORM_CHUNK; begin += PARALLEL_TRANSFORM_CHUNK)
+        {
+            done.Inc();
+            pThreadPool->AddJob([this, &scene, begin, world, bWorldChanged, &bMoved, &done]()
+            {
+                if (TransformNodes(scene, begin, begin + PARALLEL_TRANSFORM_CHUNK, world, bWorldChanged))
+                    bMoved = true;
+                done.Dec();
+            });
+        }
+
+        if (TransformNodes(scene, begin, end, world, bWorldChanged))
+            bMoved = true;
+        done.Wait();
+    }
+
+    // the boxes only change when a node moves, the chunks are done so the flag gets set once here
+    if (bMoved)
+        m_bSceneBoundsDirty = true;
+
+    // once all the joints are there the skins are independent from each other
+    //
+    for (uint32_t i = 1; i < m_skins.size(); i++)
+    {
+        done.Inc();
+        pThreadPool->AddJob([this, i, &done]()
+        {
+            TransformSkin(i);
+            done.Dec();
+        });
+    }
+
+    if (m_skins.size() > 0)
+        TransformSkin(0);
+    done.Wait();
+}
+
+//
+// Transforms the entries [begin, end) of the flattened hierarchy of a scene, the parents of these need to be transformed already.
+// Returns true if any of them moved
+//
+bool GLTFCommon::TransformNodes(const tfScene &scene, uint32_t begin, uint32_t end, XMMATRIX world, bool bWorldChanged)
+{
+    const tfNodeIdx *pFlatNodes = scene.m_flatNodes.data();
+    const tfNodeIdx *pFlatParents = scene.m_flatParents.data();
+    const tfNode *pNodes = m_nodes.data();
+    const XMMATRIX *pAnimatedMats = m_animatedMats.data();
+    Matrix2 *pWorldSpaceMats = m_worldSpaceMats.data();
+    uint8_t *pDirtyNodes = m_dirtyNodes.data();
+    uint8_t *pNodeChanges = m_nodeChanges.data();
+    bool bMoved = false;
+    for (uint32_t n = begin; n < end; n++)
+    {
+        tfNodeIdx nodeIdx = pFlatNodes[n];
+        tfNodeIdx parentIdx = pFlatParents[n];
+
+        bool bParentMoved = (parentIdx >= 0) ? (pNodeChanges[parentIdx] == NODE_MOVED) : bWorldChanged;
+        if (pDirtyNodes[nodeIdx] || bParentMoved)
         {
-            skinningMats[j].Set( XMMatrixMultiply(pM[j], m_worldSpaceMats[skin.m_jointsNodeIdx[j]].GetCurrent()));
+            pWorldSpaceMats[nodeIdx].Set(pAnimatedMats[nodeIdx] * ((parentIdx >= 0) ? pWorldSpaceMats[parentIdx].GetCurrent() : world));
+            pNodeChanges[nodeIdx] = NODE_MOVED;
+            pDirtyNodes[nodeIdx] = 0;
+            bMoved = true;
+            if (pNodes[nodeIdx].skinIndex < 0 || pNodes[nodeIdx].skinIndex >= m_skins.size())
+                UpdateWorldBoxes(nodeIdx);
         }
+        else if (pNodeChanges[nodeIdx] == NODE_MOVED)
+        {
+            pWorldSpaceMats[nodeIdx].Keep();
+            pNodeChanges[nodeIdx] = NODE_SETTLED;
+        }
+        else
+        {
+            pNodeChanges[nodeIdx] = NODE_STATIC;
+        }
+    }
+
+    return bMoved;
+}
+
+//
+// Takes the matrices of the joints of a skin and multiplies them by the inverse of the bind, these are what the vertex shader consumes.
+// The joints get gathered first so the multiplies run batched over contiguous arrays, a skin gets skipped when none of its joints changed
+//
+void GLTFCommon::TransformSkin(uint32_t skinIndex)
+{
+    const tfSkins &skin = m_skins[skinIndex];
+    uint32_t first = skin.m_firstSkinningMat;
+    uint32_t count = skin.m_InverseBindMatrices.m_count;
+
+    // each skin owns its range of the arrays so the skins can run concurrently
+    bool bChanged = false;
+    XMMATRIX *pJointMats = &m_jointMats[first];
+    for (uint32_t j = 0; j < count; j++)
+    {
+        tfNodeIdx jointIdx = skin.m_jointsNodeIdx[j];
+        bChanged |= (m_nodeChanges[jointIdx] != NODE_STATIC);
+        pJointMats[j] = m_worldSpaceMats[jointIdx].GetCurrent();
+    }
+
+    // the joints that didn't move get the same matrix again and their previous one catches up, same as Matrix2::Keep()
+    if (bChanged)
+    {
+        static_assert(sizeof(Matrix2) == 2 * sizeof(XMMATRIX), "ComputeSkinningMatrices() expects the (current, previous) pairs of Matrix2");
+        ComputeSkinningMatrices(&m_inverseBindMats[first], pJointMats, count, (XMMATRIX *)&m_worldSpaceSkeletonMats[first]);
+    }
+
+    // the bounds of the skinned nodes follow their joints
+    for (tfNodeIdx nodeIdx : skin.m_skinnedNodes)
+    {
+        if (bChanged || m_nodeChanges[nodeIdx] == NODE_MOVED)
+            UpdateWorldBoxes(nodeIdx);
     }
 }
 
@@ -528,6 +1627,27 @@ bool GLTFCommon::GetCamera(uint32_t cameraIdx, Camera *pCam) const
 // Sets the per frame data from the GLTF, returns a pointer to it in case the user wants to override some values
 // The scene needs to be animated and transformed before we can set the per_frame data. We need those final matrices for the lights and the camera.
 //
+//
+// Fits the orthographic projection of a directional light to the box of the scene seen from the light, so everything that can 
+// cast a shadow on the scene is in the shadow map
+//
+XMMATRIX GLTFCommon::GetDirectionalShadowProjection(const XMMATRIX &lightView)
+{
+    XMVECTOR center, extent;
+    if (!GetSceneBounds(&center, &extent))
+        return XMMatrixOrthographicRH(30.0, 30.0, 0.1f, 100.0f);
+
+    // the box in light space, padded so a flat scene still gets some depth range
+    XMVECTOR lightCenter = XMVector3Transform(center, lightView);
+    XMVECTOR lightExtent = XMVectorAbs(lightView.r[0]) * XMVectorSplatX(extent) + XMVectorAbs(lightView.r[1]) * XMVectorSplatY(extent) + XMVectorAbs(lightView.r[2]) * XMVectorSplatZ(extent);
+    lightExtent += XMVectorReplicate(0.01f);
+
+    // the light looks down -z
+    XMVECTOR boxMin = lightCenter - lightExtent;
+    XMVECTOR boxMax = lightCenter + lightExtent;
+    return XMMatrixOrthographicOffCenterRH(XMVectorGetX(boxMin), XMVectorGetX(boxMax), XMVectorGetY(boxMin), XMVectorGetY(boxMax), -XMVectorGetZ(boxMax), -XMVectorGetZ(boxMin));
+}
+
 per_frame *GLTFCommon::SetPerFrameData(const Camera &cam)
 {
     Matrix2  *pMats = m_worldSpaceMats.data();
@@ -537,6 +1657,7 @@ per_frame *GLTFCommon::SetPerFrameData(const Camera &cam)
     m_perFrameData.mCameraPrevViewProj = cam.GetPrevView() * cam.GetProjection();
     m_perFrameData.mInverseCameraCurrViewProj = XMMatrixInverse(nullptr, m_perFrameData.mCameraCurrViewProj);
     m_perFrameData.cameraPos = cam.GetPosition();
+    m_lodProjectionScale = GetLodProjectionScale(cam);
 
     // Process lights
     m_perFrameData.lightCount = (int32_t)m_lightInstances.size();
@@ -552,7 +1673,7 @@ per_frame *GLTFCommon::SetPerFrameData(const Camera &cam)
         if (lightData.m_type == LightType_Spot)
             pSL->mLightViewProj = lightView * XMMatrixPerspectiveFovRH(lightData.m_outerConeAngle * 2.0f, 1, .1f, 100.0f);
         else if (lightData.m_type == LightType_Directional)
-            pSL->mLightViewProj = lightView * XMMatrixOrthographicRH(30.0, 30.0, 0.1f, 100.0f);
+            pSL->mLightViewProj = lightView * GetDirectionalShadowProjection(lightView);
 
         GetXYZ(pSL->direction, XMVector4Transform(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMMatrixTranspose(lightView)));
         GetXYZ(pSL->color, lightData.m_color);
@@ -575,10 +1696,79 @@ tfNodeIdx GLTFCommon::AddNode(const tfNode& node)
     m_scenes[0].m_nodes.push_back(idx);
     
     m_animatedMats.push_back(node.m_tranform.GetWorldMat());
+    m_worldSpaceMats.push_back(Matrix2());
+    m_dirtyNodes.push_back(1);
+    m_nodeChanges.push_back(NODE_STATIC);
+    AddMorphWeights(&m_nodes.back());
+    AddWorldBoxes(idx);
+    InitPosePool(m_nodes, &m_posePool);
+    FlattenHierarchy(0);
 
     return idx;
 }
 
+//
+// Appends the morph target weights of a node to m_morphWeights, these start with the weights of the node or else the ones of its mesh
+//
+void GLTFCommon::AddMorphWeights(tfNode *pNode)
+{
+    pNode->m_firstMorphWeight = (uint32_t)m_morphWeights.size();
+    pNode->m_morphWeightCount = 0;
+    if (pNode->meshIndex < 0 || pNode->meshIndex >= m_meshes.size())
+        return;
+
+    const std::vector<float> &meshWeights = m_meshes[pNode->meshIndex].m_weights;
+    const std::vector<float> &weights = (pNode->m_weights.size() == meshWeights.size()) ? pNode->m_weights : meshWeights;
+    pNode->m_morphWeightCount = (uint32_t)weights.size();
+    m_morphWeights.insert(m_morphWeights.end(), weights.begin(), weights.end());
+}
+
+//
+// EXT_mesh_gpu_instancing, meshes used by an instanced node need pipelines that read the per instance streams
+//
+bool GLTFCommon::IsMeshInstanced(int meshIndex) const
+{
+    for (const tfNode &node : m_nodes)
+    {
+        if (node.meshIndex == meshIndex && node.m_instanceCount > 0)
+            return true;
+    }
+    return false;
+}
+
+//
+// EXT_mesh_gpu_instancing, frustum culls the instances of a node against the camera and writes the TRS of the visible ones in SoA form, returns how many are visible.
+// pNearestWorld gets the world matrix of the visible instance that is closest to the camera, that is the one that picks the level of detail
+//
+uint32_t GLTFCommon::CullInstances(int nodeIndex, const tfPrimitives &bounds, XMFLOAT3 *pTranslations, XMFLOAT4 *pRotations, XMFLOAT3 *pScales, XMMATRIX *pNearestWorld) const
+{
+    const tfNode &node = m_nodes[nodeIndex];
+    XMMATRIX mWorld = m_worldSpaceMats[nodeIndex].GetCurrent();
+
+    float nearest = FLT_MAX;
+    uint32_t count = 0;
+    for (uint32_t i = node.m_firstInstance; i < node.m_firstInstance + node.m_instanceCount; i++)
+    {
+        XMMATRIX mInstanceWorld = GetInstanceMatrix(i) * mWorld;
+        if (CameraFrustumToBoxCollision(mInstanceWorld * m_perFrameData.mCameraCurrViewProj, bounds.m_center, bounds.m_radius))
+            continue;
+
+        pTranslations[count] = m_instanceTranslations[i];
+        pRotations[count] = m_instanceRotations[i];
+        pScales[count] = m_instanceScales[i];
+        count++;
+
+        float distance = XMVectorGetX(XMVector3LengthSq(XMVector3Transform(bounds.m_center, mInstanceWorld) - m_perFrameData.cameraPos));
+        if (distance < nearest)
+        {
+            nearest = distance;
+            *pNearestWorld = mInstanceWorld;
+        }
+    }
+
+    return count;
+}
+
 int GLTFCommon::AddLight(const tfNode& node, const tfLight& light)
 {
     int nodeID = AddNode(node);
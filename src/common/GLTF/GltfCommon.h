@@ -20,6 +20,7 @@
 #pragma once
 #include "../json/json.h"
 #include "../Misc/Camera.h"
+#include "../Misc/FrustumCulling.h"
 #include "GltfStructures.h"
 
 // The GlTF file is loaded in 2 steps
@@ -37,12 +38,20 @@
 
 using json = nlohmann::json;
 
+class MemoryMappedFile;
+class ImgLoader;
+class AsyncPool;
+class Sync;
+class ThreadPool;
+
+
 class Matrix2
 {
     XMMATRIX m_current;
     XMMATRIX m_previous;
 public:
     void Set(XMMATRIX m) { m_previous = m_current; m_current = m; }
+    void Keep() { m_previous = m_current; }   // the matrix didn't change this frame, the previous one catches up
     XMMATRIX GetCurrent() const { return m_current; }
     XMMATRIX GetPrevious() const { return m_previous; }
 };
@@ -90,15 +99,36 @@ struct per_frame
     Light     lights[80];
 };
 
+//
+// What GLTFCommon::Load() does on top of loading the glTF, the apps usually fill these from their settings
+//
+struct tfImportOptions
+{
+    bool bMapBuffers = false;                  // memory map the binary buffers instead of copying them to the heap
+    bool bUseCookedCache = false;              // load the cooked cache when it is up to date, else cook the scene once it is loaded
+
+    // import stages, they run before cooking so the cache holds their output
+    bool bOptimizeMeshes = false;              // see OptimizeMeshes()
+    float overdrawThreshold = 1.05f;
+    int lodCount = 0;                          // levels of detail per primitive, see BuildLods()
+    float lodReduction = 0.5f;
+    bool bBuildMeshlets = false;               // see BuildMeshlets(), the passes cull the meshlets of the primitives that have them
+    uint32_t meshletMaxVertices = 64;
+    uint32_t meshletMaxTriangles = 124;
+    bool bCompressAnimations = false;          // see CompressAnimations()
+    float animationMaxError = 0.0005f;
+};
+
 //
 // GLTFCommon, common stuff that is API agnostic
 //
 class GLTFCommon
 {
 public:
-    json j3;
+    json j3;                                   // only the small sections (materials, extensions...) are kept, the rest is in the typed arrays
 
     std::string m_path;
+    std::string m_filename;
     std::vector<tfScene> m_scenes;
     std::vector<tfMesh> m_meshes;
     std::vector<tfSkins> m_skins;
@@ -108,36 +138,149 @@ public:
 
     std::vector<tfNode> m_nodes;
 
+    // EXT_mesh_gpu_instancing, the transforms of the instances of all the nodes in SoA form, they go before the transform of the node
+    std::vector<XMFLOAT3> m_instanceTranslations;
+    std::vector<XMFLOAT4> m_instanceRotations;   // quaternions
+    std::vector<XMFLOAT3> m_instanceScales;
+
     std::vector<tfAnimation> m_animations;
-    std::vector<char *> m_buffersData;
+    std::vector<const char *> m_buffersData;   // one pointer per glTF buffer (read-only, it might be mapped), for .glb files buffer 0 points straight into the container
+    std::vector<size_t> m_buffersSize;         // size in bytes of each buffer
+    std::vector<std::string> m_buffersUri;     // file each buffer comes from, empty for the .glb BIN chunk and for buffers created by the loader
+    std::vector<char *> m_allocatedData;       // memory owned by this class that m_buffersData points into, released in Unload()
+    std::vector<MemoryMappedFile *> m_mappedFiles; // read-only mappings m_buffersData points into when loading with bMapBuffers
+    std::mutex m_mutex;                        // guards m_allocatedData and m_mappedFiles, buffers are loaded concurrently
 
-    const json *m_pAccessors;
-    const json *m_pBufferViews;
+    // typed glTF tables, these are not kept in j3
+    std::vector<tfAccessorDesc> m_accessors;
+    std::vector<tfBufferViewDesc> m_bufferViews;
+    std::vector<tfImageDesc> m_images;
+    std::vector<tfTextureDesc> m_textures;
+    std::vector<const char *> m_cookedImages;  // mip chains of the images when loaded from a cooked cache, see GltfCache.cpp
 
     std::vector<XMMATRIX> m_animatedMats;       // object space matrices of each node after being animated
 
     std::vector<Matrix2> m_worldSpaceMats;     // world space matrices of each node after processing the hierarchy
-    std::map<int, std::vector<Matrix2>> m_worldSpaceSkeletonMats; // skinning matrices, following the m_jointsNodeIdx order
+    std::vector<Matrix2> m_worldSpaceSkeletonMats; // skinning matrices of all the skins, each one takes its joints from tfSkins::m_firstSkinningMat
+
+    // morph targets, the weights of all the nodes, each one takes its range from tfNode::m_firstMorphWeight. SetAnimationTime() writes the 
+    // animated ones, see GltfMorphTargets.h for the blending
+    std::vector<float> m_morphWeights;
+
+    // change tracking, TransformScene() only recomputes the nodes that are dirty or have a parent that moved
+    enum NodeChange { NODE_STATIC = 0, NODE_SETTLED = 1, NODE_MOVED = 2 };
+    std::vector<uint8_t> m_dirtyNodes;         // set by SetAnimationTime() and AddNode(), set it too when writing m_animatedMats directly
+    std::vector<uint8_t> m_nodeChanges;        // NodeChange of each node in the last TransformScene(), passes can skip the NODE_STATIC ones
+
+    // world space bounds of the primitives of the nodes with a mesh, TransformScene() updates the ones of the nodes that moved (or whose 
+    // joints moved), see GltfBounds.cpp. The boxes of the instanced nodes hold all their instances, those of the skinned ones all their joints
+    CullingBoxes m_worldBoxes;                 // in SoA form for CullBoxes()
+    std::vector<XMFLOAT4> m_worldSpheres;      // center and radius
+    std::vector<tfNodeIdx> m_boxNodes;         // node and primitive of each one
+    std::vector<uint32_t> m_boxPrimitives;
 
     per_frame m_perFrameData;
 
-    bool Load(const std::string &path, const std::string &filename);
+    // level of detail selection, see SelectLod() in GltfSimplifier.h
+    float m_lodProjectionScale = 1.0f;         // set by SetPerFrameData()
+    float m_lodMaxScreenError = 1.0f / 1080.0f; // a pixel at 1080p
+
+    bool Load(const std::string &path, const std::string &filename, bool bMapBuffers = false, AsyncPool *pAsyncPool = NULL);
+    // loads the glTF and runs the import stages the options ask for, see tfImportOptions
+    bool Load(const std::string &path, const std::string &filename, const tfImportOptions &options, AsyncPool *pAsyncPool = NULL);
     void Unload();
 
+    // cooked cache, a binary snapshot of the loaded scene and the mip chains of its images that gets memory mapped, see GltfCache.cpp
+    // importHash identifies the import stages that ran before cooking, a cache cooked with other ones is stale
+    bool LoadCooked(const std::string &path, const std::string &filename, size_t importHash = 0);
+    bool SaveCooked(AsyncPool *pAsyncPool = NULL, size_t importHash = 0) const;
+    ImgLoader *CreateCookedImageLoader(int imageIndex) const;
+
+    // optional import stage, reorders indices and vertices for the vertex cache, overdraw and vertex fetch, see GltfOptimizer.cpp
+    // call it after Load() and before SaveCooked() so the optimized buffers get cached
+    void OptimizeMeshes(float overdrawThreshold = 1.05f, AsyncPool *pAsyncPool = NULL);
+
+    // splits the primitives in meshlets with bounding spheres and backface cones for finer culling, see GltfMeshlets.h
+    void BuildMeshlets(uint32_t maxVertices = 64, uint32_t maxTriangles = 124, AsyncPool *pAsyncPool = NULL);
+
+    // builds lodCount levels of detail per primitive with quadric simplification, each one has 'reduction' times the triangles of the previous one
+    void BuildLods(int lodCount = 4, float reduction = 0.5f, AsyncPool *pAsyncPool = NULL);
+
+    // drops the keys the interpolation can rebuild and quantizes the rest to 48 bits, maxError is in scene units (how far a translation 
+    // or the end of the bones of a joint may move), see GltfAnimationCompression.cpp
+    void CompressAnimations(float maxError = 0.0005f, AsyncPool *pAsyncPool = NULL);
+
     // misc functions
     int FindMeshSkinId(int meshId) const;
     int GetInverseBindMatricesBufferSizeByID(int id) const;
+    const char *GetBufferViewData(int bufferViewIdx, uint32_t byteOffset) const;
     void GetBufferDetails(int accessor, tfAccessor *pAccessor) const;
-    void GetAttributesAccessors(const json &gltfAttributes, std::vector<char*> *pStreamNames, std::vector<tfAccessor> *pAccessors) const;
+    void GetAttributesAccessors(const tfPrimitives &primitive, std::vector<char*> *pStreamNames, std::vector<tfAccessor> *pAccessors) const;
 
     // transformation and animation functions
     void SetAnimationTime(uint32_t animationIndex, float time);
-    void TransformScene(int sceneIndex, XMMATRIX world);
+    // crowds, poses many instances of the scene playing the same animation at their own times in one pass. The local poses end up in
+    // pInstances->m_poses, ComposePose() in GltfAnimation.h turns each one into matrices laid out like m_animatedMats
+    void SetAnimationTimes(uint32_t animationIndex, const float *pTimes, uint32_t instanceCount, tfAnimationInstances *pInstances) const;
+    // blends several animations in one pass, each layer with its weight, optionally additive or masked per node (see tfAnimationLayer).
+    // The layers get blended on the translation, rotation and scale of the nodes in a preallocated pool and composed once, the morph
+    // target weights are left as they are
+    void SetAnimationLayers(const tfAnimationLayer *pLayers, uint32_t layerCount);
+    void TransformScene(int sceneIndex, XMMATRIX world, ThreadPool *pThreadPool = NULL); // with a pool big scenes get transformed a level of the hierarchy at a time
     per_frame *SetPerFrameData(const Camera &cam);
     bool GetCamera(uint32_t cameraIdx, Camera *pCam) const;
     tfNodeIdx AddNode(const tfNode& node);
+    // frustum culls m_worldBoxes, pVisible gets the indices of the visible ones (it only grows), returns how many there are
+    uint32_t CullPrimitives(const XMMATRIX &mViewProj, std::vector<uint32_t> *pVisible) const;
+    // box around all the primitives of the last transformed scene (for fitting shadow frustums and such), false when there are none
+    bool GetSceneBounds(XMVECTOR *pCenter, XMVECTOR *pExtent);
     int AddLight(const tfNode& node, const tfLight& light);
+
+    // EXT_mesh_gpu_instancing
+    bool IsMeshInstanced(int meshIndex) const;
+    uint32_t CullInstances(int nodeIndex, const tfPrimitives &bounds, XMFLOAT3 *pTranslations, XMFLOAT4 *pRotations, XMFLOAT3 *pScales, XMMATRIX *pNearestWorld) const;
 private:
+    const char *LoadBinaryFile(const std::string &filename, bool bMapBuffers, size_t *pSize);
+    bool ParseGlb(const char *pData, size_t size, const char **ppBinChunk, const json::parser_callback_t &onParse);
+
+    // these load the different sections of the glTF, they can run concurrently
+    bool LoadBuffers(const json &buffers, const char *pBinChunk, bool bMapBuffers, AsyncPool *pAsyncPool, Sync *pSync, std::vector<bool> *pFallbackBuffers);
+    bool DecodeMeshoptBufferView(int bufferViewIndex);
+    bool AreBuffersLoaded() const;
+    void LoadMeshes();
+    void LoadLights();
+    void LoadCameras(const json &cameras);
+    void LoadNodes(const json &nodes);
+    void LoadScenes(const json &scenes);
+    void LoadSkins(const json &skins);
+    void LoadAnimation(const json &animation, tfAnimation *tfanim);
+    void WidenByteIndices();
+    void DequantizeAnimations(const json &animations);
+    void LoadInstances(const json &nodes);
+    int AddBuffer(char *pData, size_t size);
     void InitTransformedData(); //this is called after loading the data from the GLTF
-    void TransformNodes(XMMATRIX world, const std::vector<tfNodeIdx> *pNodes);
+    void FlattenHierarchy(int sceneIndex);
+    void CompileAnimations();
+    void CompileMorphTargets();
+    void AddMorphWeights(tfNode *pNode);
+    void AddWorldBoxes(tfNodeIdx nodeIndex);
+    void UpdateWorldBoxes(tfNodeIdx nodeIndex);
+    void ComputeJointBounds();
+    XMMATRIX GetInstanceMatrix(uint32_t instance) const;
+    XMMATRIX GetDirectionalShadowProjection(const XMMATRIX &lightView);
+    bool TransformNodes(const tfScene &scene, uint32_t begin, uint32_t end, XMMATRIX world, bool bWorldChanged);
+    void TransformSkin(uint32_t skinIndex);
+
+    std::vector<XMMATRIX> m_inverseBindMats;   // same layout as m_worldSpaceSkeletonMats
+    std::vector<XMMATRIX> m_jointMats;         // scratch where TransformSkin() gathers the world matrices of the joints, same layout too
+
+    tfPosePool m_posePool;                     // poses SetAnimationLayers() blends in, sized by InitTransformedData()
+
+    // the bounds of the scene get computed when asked for and kept until a box changes
+    bool m_bSceneBoundsDirty = true;           // set by TransformScene() when a node moved, once the chunks are done
+    XMVECTOR m_sceneCenter;
+    XMVECTOR m_sceneExtent;
+
+    int m_transformedScene = -1;               // scene and world matrix of the last TransformScene(), changing any of them moves every node
+    XMMATRIX m_transformedWorld;
 };
@@ -24,6 +24,8 @@ using json = nlohmann::json;
 
 int GetFormatSize(int id);
 int GetDimensions(const std::string &str);
+float DequantizeValue(float value, int id, bool normalized);
+void DequantizeToFloat(const void *pData, int count, int stride, int dimension, int id, bool normalized, float *pOut);
 void SplitGltfAttribute(std::string attribute, std::string *semanticName, uint32_t *semanticIndex);
 
 XMVECTOR GetVector(const json::array_t &accessor);
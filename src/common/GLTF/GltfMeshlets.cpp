@@ -0,0 +1,287 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfCommon.h"
+#include "GltfHelpers.h"
+#include "GltfMeshlets.h"
+#include "Misc/Misc.h"
+#include "Misc/Async.h"
+
+//
+// Ritter's bounding sphere, starts with the most distant pair of the extreme points along the axes and grows to fit the rest
+//
+static void ComputeBoundingSphere(const std::vector<XMFLOAT3> &points, XMFLOAT3 *pCenter, float *pRadius)
+{
+    size_t pmin[3] = { 0, 0, 0 };
+    size_t pmax[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        const float *p = &points[i].x;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (p[axis] < (&points[pmin[axis]].x)[axis])
+                pmin[axis] = i;
+            if (p[axis] > (&points[pmax[axis]].x)[axis])
+                pmax[axis] = i;
+        }
+    }
+
+    float bestDistance = -1.0f;
+    int bestAxis = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float distance = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&points[pmax[axis]]) - XMLoadFloat3(&points[pmin[axis]])));
+        if (distance > bestDistance)
+        {
+            bestDistance = distance;
+            bestAxis = axis;
+        }
+    }
+
+    XMVECTOR center = (XMLoadFloat3(&points[pmin[bestAxis]]) + XMLoadFloat3(&points[pmax[bestAxis]])) * 0.5f;
+    float radius = sqrtf(bestDistance) * 0.5f;
+
+    for (const XMFLOAT3 &point : points)
+    {
+        XMVECTOR p = XMLoadFloat3(&point);
+        float distance = XMVectorGetX(XMVector3Length(p - center));
+        if (distance > radius)
+        {
+            float newRadius = (radius + distance) * 0.5f;
+            center += (p - center) * ((newRadius - radius) / distance);
+            radius = newRadius;
+        }
+    }
+
+    XMStoreFloat3(pCenter, center);
+    *pRadius = radius;
+}
+
+static void ComputeMeshletBounds(const tfPrimitives &primitive, const std::vector<XMFLOAT3> &positions, tfMeshlet *pMeshlet)
+{
+    const uint32_t *pVertices = &primitive.m_meshletVertices[pMeshlet->m_vertexOffset];
+    const uint8_t *pTriangles = &primitive.m_meshletTriangles[pMeshlet->m_triangleOffset];
+
+    std::vector<XMFLOAT3> points(pMeshlet->m_vertexCount);
+    for (uint32_t v = 0; v < pMeshlet->m_vertexCount; v++)
+        points[v] = positions[pVertices[v]];
+
+    ComputeBoundingSphere(points, &pMeshlet->m_center, &pMeshlet->m_radius);
+
+    // the cone axis is the average of the normals and its aperture is given by the normal that is the most apart from it
+    std::vector<XMFLOAT3> normals;
+    XMVECTOR axis = XMVectorZero();
+    for (uint32_t t = 0; t < pMeshlet->m_triangleCount; t++)
+    {
+        XMVECTOR p0 = XMLoadFloat3(&points[pTriangles[t * 3 + 0]]);
+        XMVECTOR p1 = XMLoadFloat3(&points[pTriangles[t * 3 + 1]]);
+        XMVECTOR p2 = XMLoadFloat3(&points[pTriangles[t * 3 + 2]]);
+
+        XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+        if (XMVectorGetX(XMVector3LengthSq(n)) == 0.0f)
+            continue;
+
+        n = XMVector3Normalize(n);
+        normals.push_back(XMFLOAT3());
+        XMStoreFloat3(&normals.back(), n);
+        axis += n;
+    }
+
+    float minDot = 1.0f;
+    if (XMVectorGetX(XMVector3LengthSq(axis)) > 0.0f)
+    {
+        axis = XMVector3Normalize(axis);
+        for (const XMFLOAT3 &n : normals)
+            minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&n))));
+    }
+    else
+    {
+        minDot = 0.0f;
+    }
+
+    // with a cone wider than ~85 degrees there is hardly any view where the whole cluster is backfacing
+    if (minDot <= 0.1f)
+    {
+        pMeshlet->m_coneAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        pMeshlet->m_coneCutoff = 1.0f;
+    }
+    else
+    {
+        XMStoreFloat3(&pMeshlet->m_coneAxis, axis);
+        pMeshlet->m_coneCutoff = sqrtf(1.0f - minDot * minDot);
+    }
+}
+
+//
+// Greedy scan, the triangles are added in their order to the current meshlet until the vertex or the triangle limit is hit.
+// The meshlets are as good as the locality of the triangles, that is why this is better done after OptimizeMeshes()
+//
+static void BuildPrimitiveMeshlets(const GLTFCommon *pGLTFCommon, tfPrimitives *pPrimitive, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    tfAccessor indexAccessor;
+    pGLTFCommon->GetBufferDetails(pPrimitive->m_indices, &indexAccessor);
+
+    int positionAttr = pPrimitive->FindAttribute("POSITION");
+    const tfAccessorDesc &positionDesc = pGLTFCommon->m_accessors[positionAttr];
+
+    tfAccessor positionAccessor;
+    pGLTFCommon->GetBufferDetails(positionAttr, &positionAccessor);
+
+    std::vector<XMFLOAT3> positions(positionAccessor.m_count);
+    for (int v = 0; v < positionAccessor.m_count; v++)
+        DequantizeToFloat(positionAccessor.Get(v), 1, 0, 3, positionDesc.m_componentType, positionDesc.m_normalized, &positions[v].x);
+
+    pPrimitive->m_meshlets.clear();
+    pPrimitive->m_meshletVertices.clear();
+    pPrimitive->m_meshletTriangles.clear();
+
+    // local index of each vertex in the current meshlet, 0xff when it is not in it
+    std::vector<uint8_t> localIndex(positions.size(), 0xff);
+
+    tfMeshlet meshlet = {};
+    for (int i = 0; i + 2 < indexAccessor.m_count; i += 3)
+    {
+        uint32_t triangle[3];
+        for (int k = 0; k < 3; k++)
+        {
+            const void *pIndex = indexAccessor.Get(i + k);
+            triangle[k] = (indexAccessor.m_type == 4) ? *(const uint32_t *)pIndex : *(const uint16_t *)pIndex;
+        }
+
+        if (triangle[0] >= positions.size() || triangle[1] >= positions.size() || triangle[2] >= positions.size())
+            continue;
+
+        uint32_t newVertices = 0;
+        for (int k = 0; k < 3; k++)
+            newVertices += (localIndex[triangle[k]] == 0xff && (k < 1 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1])) ? 1 : 0;
+
+        if (meshlet.m_vertexCount + newVertices > maxVertices || meshlet.m_triangleCount + 1 > maxTriangles)
+        {
+            for (uint32_t v = 0; v < meshlet.m_vertexCount; v++)
+                localIndex[pPrimitive->m_meshletVertices[meshlet.m_vertexOffset + v]] = 0xff;
+
+            pPrimitive->m_meshlets.push_back(meshlet);
+
+            meshlet = {};
+            meshlet.m_vertexOffset = (uint32_t)pPrimitive->m_meshletVertices.size();
+            meshlet.m_triangleOffset = (uint32_t)pPrimitive->m_meshletTriangles.size();
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = triangle[k];
+            if (localIndex[v] == 0xff)
+            {
+                localIndex[v] = (uint8_t)meshlet.m_vertexCount++;
+                pPrimitive->m_meshletVertices.push_back(v);
+            }
+            pPrimitive->m_meshletTriangles.push_back(localIndex[v]);
+        }
+        meshlet.m_triangleCount++;
+    }
+
+    if (meshlet.m_triangleCount > 0)
+        pPrimitive->m_meshlets.push_back(meshlet);
+
+    for (tfMeshlet &m : pPrimitive->m_meshlets)
+        ComputeMeshletBounds(*pPrimitive, positions, &m);
+}
+
+//
+// Builds the meshlets of every indexed triangle list, call it after Load() (and after OptimizeMeshes() if it is used) 
+// and before SaveCooked() so the meshlets get cached
+//
+void GLTFCommon::BuildMeshlets(uint32_t maxVertices, uint32_t maxTriangles, AsyncPool *pAsyncPool)
+{
+    Profile p("GLTFCommon::BuildMeshlets");
+
+    maxVertices = std::min<uint32_t>(std::max<uint32_t>(maxVertices, 3), MESHLET_MAX_VERTICES);
+    maxTriangles = std::min<uint32_t>(std::max<uint32_t>(maxTriangles, 1), MESHLET_MAX_TRIANGLES);
+
+    Sync meshletsBuilt;
+    for (tfMesh &mesh : m_meshes)
+    {
+        for (tfPrimitives &primitive : mesh.m_pPrimitives)
+        {
+            if (primitive.m_mode != 4 || primitive.m_indices < 0 || primitive.FindAttribute("POSITION") < 0)
+                continue;
+
+            tfPrimitives *pPrimitive = &primitive;
+            ExecAsyncIfThereIsAPool(pAsyncPool, [this, pPrimitive, maxVertices, maxTriangles]()
+            {
+                BuildPrimitiveMeshlets(this, pPrimitive, maxVertices, maxTriangles);
+            }, &meshletsBuilt);
+        }
+    }
+
+    meshletsBuilt.Wait();
+}
+
+uint32_t CullMeshlets(const tfPrimitives &primitive, const XMMATRIX &mWorld, const XMMATRIX &mCameraViewProj, XMVECTOR cameraPos, bool bCullBackfaces, uint32_t *pVisible)
+{
+    // frustum planes in the space of the primitive (Gribb/Hartmann), same planes as CameraFrustumToBoxCollision()
+    XMMATRIX m = XMMatrixTranspose(mWorld * mCameraViewProj);
+    XMVECTOR planes[5] = { m.r[3] + m.r[0], m.r[3] - m.r[0], m.r[3] + m.r[1], m.r[3] - m.r[1], m.r[2] };
+    for (XMVECTOR &plane : planes)
+        plane = plane / XMVector3Length(plane);
+
+    // with a non uniform scale the cone test is an approximation since the normals don't transform like the positions
+    XMVECTOR det;
+    XMVECTOR camera = XMVector3Transform(cameraPos, XMMatrixInverse(&det, mWorld));
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < primitive.m_meshlets.size(); i++)
+    {
+        const tfMeshlet &meshlet = primitive.m_meshlets[i];
+        XMVECTOR center = XMVectorSetW(XMLoadFloat3(&meshlet.m_center), 1.0f);
+
+        bool bCulled = false;
+        for (XMVECTOR plane : planes)
+            bCulled |= XMVectorGetX(XMVector4Dot(plane, center)) < -meshlet.m_radius;
+
+        if (bCullBackfaces)
+        {
+            XMVECTOR view = XMVectorSetW(center - camera, 0.0f);
+            float distance = XMVectorGetX(XMVector3Length(view));
+            bCulled |= XMVectorGetX(XMVector3Dot(view, XMLoadFloat3(&meshlet.m_coneAxis))) >= meshlet.m_coneCutoff * distance + meshlet.m_radius;
+        }
+
+        if (!bCulled)
+            pVisible[visibleCount++] = i;
+    }
+
+    return visibleCount;
+}
+
+uint32_t GetMeshletsIndices(const tfPrimitives &primitive, const uint32_t *pMeshlets, uint32_t meshletCount, uint32_t *pIndices)
+{
+    uint32_t indexCount = 0;
+    for (uint32_t i = 0; i < meshletCount; i++)
+    {
+        const tfMeshlet &meshlet = primitive.m_meshlets[pMeshlets[i]];
+        const uint32_t *pVertices = &primitive.m_meshletVertices[meshlet.m_vertexOffset];
+        const uint8_t *pTriangles = &primitive.m_meshletTriangles[meshlet.m_triangleOffset];
+
+        for (uint32_t j = 0; j < meshlet.m_triangleCount * 3; j++)
+            pIndices[indexCount++] = pVertices[pTriangles[j]];
+    }
+
+    return indexCount;
+}
@@ -0,0 +1,45 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+//
+// Meshlets split the primitives in clusters of up to a few dozens of triangles so the parts that are off screen or backfacing 
+// can be culled without culling the whole primitive. GLTFCommon::BuildMeshlets() builds them at import, they get cooked.
+//
+// Their bounds are in the space of the primitive in bind pose, skinned or morphed primitives shouldn't be culled with them.
+//
+
+#define MESHLET_MAX_VERTICES 255    // the triangles index the vertices of the meshlet with bytes
+#define MESHLET_MAX_TRIANGLES 512
+
+struct tfPrimitives;
+
+//
+// Frustum and backface cone culling of the meshlets of a primitive. mWorld places the primitive in the world and cameraPos is 
+// the camera position in world space, the double sided materials need bCullBackfaces off. Writes the indices of the visible 
+// meshlets to pVisible and returns how many there are
+//
+uint32_t CullMeshlets(const tfPrimitives &primitive, const XMMATRIX &mWorld, const XMMATRIX &mCameraViewProj, XMVECTOR cameraPos, bool bCullBackfaces, uint32_t *pVisible);
+
+//
+// Writes the triangles of the given meshlets as indices of the primitive, to compact an index buffer with the visible ones. 
+// Returns the number of indices written
+//
+uint32_t GetMeshletsIndices(const tfPrimitives &primitive, const uint32_t *pMeshlets, uint32_t meshletCount, uint32_t *pIndices);
@@ -0,0 +1,681 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfMeshopt.h"
+#include <intrin.h>
+#include <tmmintrin.h>
+
+//
+// Vertex codec. The vertices are split in blocks, each byte of the vertex is delta encoded against the previous vertex and
+// stored as a stream of zigzag encoded bytes. These streams get packed in groups of 16 bytes that use 0, 2, 4 or 8 bits per byte.
+//
+#define VERTEX_HEADER               0xa0
+#define VERTEX_BLOCK_SIZE_BYTES     8192
+#define VERTEX_BLOCK_MAX_SIZE       256
+#define BYTE_GROUP_SIZE             16
+#define BYTE_GROUP_DECODE_LIMIT     24
+#define TAIL_MAX_SIZE               32
+
+#define INDEX_HEADER                0xe0
+#define SEQUENCE_HEADER             0xd0
+
+static bool HasSsse3()
+{
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 1);
+    return (cpuInfo[2] & (1 << 9)) != 0;
+}
+
+static const bool s_hasSsse3 = HasSsse3();
+
+static size_t GetVertexBlockSize(size_t vertexSize)
+{
+    // the block has to fit in VERTEX_BLOCK_SIZE_BYTES and hold a whole number of byte groups
+    size_t result = (VERTEX_BLOCK_SIZE_BYTES / vertexSize) & ~(BYTE_GROUP_SIZE - 1);
+    return (result < VERTEX_BLOCK_MAX_SIZE) ? result : VERTEX_BLOCK_MAX_SIZE;
+}
+
+static unsigned char Unzigzag8(unsigned char v)
+{
+    return (unsigned char)(-(v & 1)) ^ (v >> 1);
+}
+
+static const unsigned char *DecodeBytesGroup(const unsigned char *pData, unsigned char *pBuffer, int bitsLog2)
+{
+    // values that don't fit in the bits are marked with all bits set and stored as a full byte after the packed bits
+    //
+    switch (bitsLog2)
+    {
+    case 0:
+        memset(pBuffer, 0, BYTE_GROUP_SIZE);
+        return pData;
+    case 1:
+    case 2:
+    {
+        const int bits = 1 << bitsLog2;
+        const unsigned char escape = (unsigned char)((1 << bits) - 1);
+        const unsigned char *pExtra = pData + BYTE_GROUP_SIZE * bits / 8;
+        for (int i = 0; i < BYTE_GROUP_SIZE; i++)
+        {
+            int shift = 8 - bits - (i * bits) % 8;
+            unsigned char enc = (pData[i * bits / 8] >> shift) & escape;
+            pBuffer[i] = (enc == escape) ? *pExtra++ : enc;
+        }
+        return pExtra;
+    }
+    default:
+        memcpy(pBuffer, pData, BYTE_GROUP_SIZE);
+        return pData + BYTE_GROUP_SIZE;
+    }
+}
+
+//
+// SSSE3 version, the escaped bytes get moved into place with a shuffle. For each 8 bit mask of escaped lanes the table
+// holds the shuffle that gathers them and the count says how many bytes they took
+//
+struct ByteGroupTables
+{
+    unsigned char m_shuffle[256][8];
+    unsigned char m_count[256];
+
+    ByteGroupTables()
+    {
+        for (int mask = 0; mask < 256; mask++)
+        {
+            unsigned char count = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                m_shuffle[mask][i] = (mask & (1 << i)) ? count++ : 0x80;
+            }
+            m_count[mask] = count;
+        }
+    }
+};
+
+static const ByteGroupTables s_byteGroupTables;
+
+static __m128i DecodeShuffleMask(int mask0, int mask1)
+{
+    __m128i sm0 = _mm_loadl_epi64((const __m128i *)&s_byteGroupTables.m_shuffle[mask0]);
+    __m128i sm1 = _mm_loadl_epi64((const __m128i *)&s_byteGroupTables.m_shuffle[mask1]);
+
+    // the second half reads after the bytes used by the first one, the 0x80 lanes stay negative
+    __m128i sm1r = _mm_add_epi8(sm1, _mm_set1_epi8(s_byteGroupTables.m_count[mask0]));
+
+    return _mm_unpacklo_epi64(sm0, sm1r);
+}
+
+static const unsigned char *DecodeBytesGroupSsse3(const unsigned char *pData, unsigned char *pBuffer, int bitsLog2)
+{
+    __m128i sel;
+    __m128i rest;
+    switch (bitsLog2)
+    {
+    case 0:
+        _mm_storeu_si128((__m128i *)pBuffer, _mm_setzero_si128());
+        return pData;
+    case 1:
+    {
+        // spread the 2 bit values so each one lands in the low bits of its byte, first value in the top bits
+        int packed;
+        memcpy(&packed, pData, sizeof(packed));
+        __m128i sel2 = _mm_cvtsi32_si128(packed);
+        __m128i sel22 = _mm_unpacklo_epi8(_mm_srli_epi16(sel2, 4), sel2);
+        __m128i sel2222 = _mm_unpacklo_epi8(_mm_srli_epi16(sel22, 2), sel22);
+        sel = _mm_and_si128(sel2222, _mm_set1_epi8(3));
+        rest = _mm_loadu_si128((const __m128i *)(pData + 4));
+        pData += 4;
+        break;
+    }
+    case 2:
+    {
+        __m128i sel4 = _mm_loadl_epi64((const __m128i *)pData);
+        __m128i sel44 = _mm_unpacklo_epi8(_mm_srli_epi16(sel4, 4), sel4);
+        sel = _mm_and_si128(sel44, _mm_set1_epi8(15));
+        rest = _mm_loadu_si128((const __m128i *)(pData + 8));
+        pData += 8;
+        break;
+    }
+    default:
+        _mm_storeu_si128((__m128i *)pBuffer, _mm_loadu_si128((const __m128i *)pData));
+        return pData + BYTE_GROUP_SIZE;
+    }
+
+    __m128i escape = _mm_set1_epi8((char)((1 << (1 << bitsLog2)) - 1));
+    __m128i mask = _mm_cmpeq_epi8(sel, escape);
+    int mask16 = _mm_movemask_epi8(mask);
+    int mask0 = mask16 & 255;
+    int mask1 = mask16 >> 8;
+
+    __m128i result = _mm_or_si128(_mm_shuffle_epi8(rest, DecodeShuffleMask(mask0, mask1)), _mm_andnot_si128(mask, sel));
+    _mm_storeu_si128((__m128i *)pBuffer, result);
+
+    return pData + s_byteGroupTables.m_count[mask0] + s_byteGroupTables.m_count[mask1];
+}
+
+static const unsigned char *DecodeBytes(const unsigned char *pData, const unsigned char *pDataEnd, unsigned char *pBuffer, size_t bufferSize)
+{
+    assert(bufferSize % BYTE_GROUP_SIZE == 0);
+
+    // 2 bits per group with the bits used by the group, rounded up to bytes
+    const unsigned char *pHeader = pData;
+    size_t headerSize = (bufferSize / BYTE_GROUP_SIZE + 3) / 4;
+    if (size_t(pDataEnd - pData) < headerSize)
+        return NULL;
+
+    pData += headerSize;
+
+    for (size_t i = 0; i < bufferSize; i += BYTE_GROUP_SIZE)
+    {
+        // the stream always ends with the tail, so checking the limit here allows the groups to read past their end
+        if (size_t(pDataEnd - pData) < BYTE_GROUP_DECODE_LIMIT)
+            return NULL;
+
+        size_t headerOffset = i / BYTE_GROUP_SIZE;
+        int bitsLog2 = (pHeader[headerOffset / 4] >> ((headerOffset % 4) * 2)) & 3;
+
+        pData = s_hasSsse3 ? DecodeBytesGroupSsse3(pData, pBuffer + i, bitsLog2) : DecodeBytesGroup(pData, pBuffer + i, bitsLog2);
+    }
+
+    return pData;
+}
+
+static const unsigned char *DecodeVertexBlock(const unsigned char *pData, const unsigned char *pDataEnd, unsigned char *pVertexData, size_t vertexCount, size_t vertexSize, unsigned char lastVertex[256])
+{
+    assert(vertexCount > 0 && vertexCount <= VERTEX_BLOCK_MAX_SIZE);
+
+    unsigned char buffer[VERTEX_BLOCK_MAX_SIZE * 4];
+    size_t vertexCountAligned = (vertexCount + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+
+    if (!s_hasSsse3)
+    {
+        for (size_t k = 0; k < vertexSize; k++)
+        {
+            pData = DecodeBytes(pData, pDataEnd, buffer, vertexCountAligned);
+            if (pData == NULL)
+                return NULL;
+
+            unsigned char p = lastVertex[k];
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                p += Unzigzag8(buffer[i]);
+                pVertexData[i * vertexSize + k] = p;
+            }
+            lastVertex[k] = p;
+        }
+
+        return pData;
+    }
+
+    // 4 byte streams at a time, these get transposed so each 32 bit lane holds 4 bytes of a vertex.
+    // The deltas are summed across the lanes and the vertices are written with a single store each
+    //
+    for (size_t k = 0; k < vertexSize; k += 4)
+    {
+        for (size_t j = 0; j < 4; j++)
+        {
+            pData = DecodeBytes(pData, pDataEnd, buffer + j * vertexCountAligned, vertexCountAligned);
+            if (pData == NULL)
+                return NULL;
+        }
+
+        int last;
+        memcpy(&last, lastVertex + k, 4);
+        __m128i prev = _mm_set1_epi32(last);
+
+        for (size_t i = 0; i < vertexCount; i += 16)
+        {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(buffer + vertexCountAligned * 0 + i));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(buffer + vertexCountAligned * 1 + i));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(buffer + vertexCountAligned * 2 + i));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(buffer + vertexCountAligned * 3 + i));
+
+            __m128i t0 = _mm_unpacklo_epi8(r0, r1);
+            __m128i t1 = _mm_unpackhi_epi8(r0, r1);
+            __m128i t2 = _mm_unpacklo_epi8(r2, r3);
+            __m128i t3 = _mm_unpackhi_epi8(r2, r3);
+
+            __m128i vertices[4];
+            vertices[0] = _mm_unpacklo_epi16(t0, t2);
+            vertices[1] = _mm_unpackhi_epi16(t0, t2);
+            vertices[2] = _mm_unpacklo_epi16(t1, t3);
+            vertices[3] = _mm_unpackhi_epi16(t1, t3);
+
+            for (int v = 0; v < 4; v++)
+            {
+                // unzigzag
+                __m128i r = vertices[v];
+                __m128i xl = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(r, _mm_set1_epi8(1)));
+                __m128i xr = _mm_and_si128(_mm_srli_epi16(r, 1), _mm_set1_epi8(127));
+                r = _mm_xor_si128(xl, xr);
+
+                // prefix sum of the 4 vertices plus the previous one
+                r = _mm_add_epi8(r, _mm_slli_si128(r, 4));
+                r = _mm_add_epi8(r, _mm_slli_si128(r, 8));
+                r = _mm_add_epi8(r, prev);
+
+                int out[4];
+                _mm_storeu_si128((__m128i *)out, r);
+
+                size_t first = i + v * 4;
+                size_t count = (vertexCount > first) ? std::min<size_t>(vertexCount - first, 4) : 0;
+                for (size_t c = 0; c < count; c++)
+                {
+                    memcpy(pVertexData + (first + c) * vertexSize + k, &out[c], 4);
+                }
+
+                if (count > 0)
+                    prev = _mm_set1_epi32(out[count - 1]);
+            }
+        }
+
+        last = _mm_cvtsi128_si32(prev);
+        memcpy(lastVertex + k, &last, 4);
+    }
+
+    return pData;
+}
+
+bool MeshoptDecodeVertexBuffer(void *pDestination, size_t count, size_t byteStride, const unsigned char *pBuffer, size_t bufferSize)
+{
+    if (byteStride == 0 || byteStride > 256 || byteStride % 4 != 0)
+        return false;
+
+    const unsigned char *pData = pBuffer;
+    const unsigned char *pDataEnd = pBuffer + bufferSize;
+
+    if (bufferSize < 1 + byteStride)
+        return false;
+
+    unsigned char header = *pData++;
+    if ((header & 0xf0) != VERTEX_HEADER || (header & 0x0f) > 0)
+        return false;
+
+    // the first vertex is at the end of the stream, everything is delta encoded from it
+    unsigned char lastVertex[256];
+    memcpy(lastVertex, pDataEnd - byteStride, byteStride);
+
+    size_t blockSize = GetVertexBlockSize(byteStride);
+
+    for (size_t offset = 0; offset < count; offset += blockSize)
+    {
+        size_t blockCount = std::min<size_t>(blockSize, count - offset);
+
+        pData = DecodeVertexBlock(pData, pDataEnd, (unsigned char *)pDestination + offset * byteStride, blockCount, byteStride, lastVertex);
+        if (pData == NULL)
+            return false;
+    }
+
+    size_t tailSize = std::max<size_t>(byteStride, TAIL_MAX_SIZE);
+    return size_t(pDataEnd - pData) == tailSize;
+}
+
+//
+// Index codecs, triangles are encoded with a FIFO of recently seen edges and vertices, the rest of the indices are varints
+//
+static unsigned int DecodeVByte(const unsigned char *&pData)
+{
+    unsigned char lead = *pData++;
+    if (lead < 128)
+        return lead;
+
+    // up to 4 more bytes, this terminates even for malformed data
+    unsigned int result = lead & 127;
+    unsigned int shift = 7;
+    for (int i = 0; i < 4; i++)
+    {
+        unsigned char group = *pData++;
+        result |= unsigned(group & 127) << shift;
+        shift += 7;
+
+        if (group < 128)
+            break;
+    }
+
+    return result;
+}
+
+static unsigned int DecodeIndex(const unsigned char *&pData, unsigned int last)
+{
+    unsigned int v = DecodeVByte(pData);
+    unsigned int d = (v >> 1) ^ -int(v & 1);
+
+    return last + d;
+}
+
+static void WriteTriangle(void *pDestination, size_t offset, size_t indexSize, unsigned int a, unsigned int b, unsigned int c)
+{
+    if (indexSize == 2)
+    {
+        ((unsigned short *)pDestination)[offset + 0] = (unsigned short)a;
+        ((unsigned short *)pDestination)[offset + 1] = (unsigned short)b;
+        ((unsigned short *)pDestination)[offset + 2] = (unsigned short)c;
+    }
+    else
+    {
+        ((unsigned int *)pDestination)[offset + 0] = a;
+        ((unsigned int *)pDestination)[offset + 1] = b;
+        ((unsigned int *)pDestination)[offset + 2] = c;
+    }
+}
+
+struct IndexFifos
+{
+    unsigned int m_edges[16][2];
+    unsigned int m_vertices[16];
+    size_t m_edgeOffset = 0;
+    size_t m_vertexOffset = 0;
+
+    IndexFifos()
+    {
+        memset(m_edges, -1, sizeof(m_edges));
+        memset(m_vertices, -1, sizeof(m_vertices));
+    }
+
+    // these have to match the encoder exactly
+    void PushEdge(unsigned int a, unsigned int b)
+    {
+        m_edges[m_edgeOffset][0] = a;
+        m_edges[m_edgeOffset][1] = b;
+        m_edgeOffset = (m_edgeOffset + 1) & 15;
+    }
+
+    void PushVertex(unsigned int v, bool cond = true)
+    {
+        m_vertices[m_vertexOffset] = v;
+        m_vertexOffset = (m_vertexOffset + cond) & 15;
+    }
+};
+
+bool MeshoptDecodeIndexBuffer(void *pDestination, size_t count, size_t indexSize, const unsigned char *pBuffer, size_t bufferSize)
+{
+    if (count % 3 != 0 || (indexSize != 2 && indexSize != 4))
+        return false;
+
+    // header, 1 byte per triangle and the 16 byte codeaux table
+    if (bufferSize < 1 + count / 3 + 16)
+        return false;
+
+    if ((pBuffer[0] & 0xf0) != INDEX_HEADER)
+        return false;
+
+    int version = pBuffer[0] & 0x0f;
+    if (version > 1)
+        return false;
+
+    IndexFifos fifos;
+    unsigned int next = 0;
+    unsigned int last = 0;
+
+    // version 1 uses the codes 13 and 14 for the indices that are next to the last one
+    int fecMax = (version >= 1) ? 13 : 15;
+
+    const unsigned char *pCode = pBuffer + 1;
+    const unsigned char *pData = pCode + count / 3;
+    const unsigned char *pDataSafeEnd = pBuffer + bufferSize - 16;
+    const unsigned char *pCodeauxTable = pDataSafeEnd;
+
+    for (size_t i = 0; i < count; i += 3)
+    {
+        // a triangle reads at most 16 bytes, the codeaux table after pDataSafeEnd makes the reads below safe
+        if (pData > pDataSafeEnd)
+            return false;
+
+        unsigned char codeTri = *pCode++;
+
+        if (codeTri < 0xf0)
+        {
+            // edge from the FIFO plus a vertex that is either new, from the FIFO or a free index
+            int fe = codeTri >> 4;
+            unsigned int a = fifos.m_edges[(fifos.m_edgeOffset - 1 - fe) & 15][0];
+            unsigned int b = fifos.m_edges[(fifos.m_edgeOffset - 1 - fe) & 15][1];
+
+            int fec = codeTri & 15;
+            if (fec < fecMax)
+            {
+                unsigned int c = (fec == 0) ? next : fifos.m_vertices[(fifos.m_vertexOffset - 1 - fec) & 15];
+                next += (fec == 0);
+
+                WriteTriangle(pDestination, i, indexSize, a, b, c);
+
+                fifos.PushVertex(c, fec == 0);
+                fifos.PushEdge(c, b);
+                fifos.PushEdge(a, c);
+            }
+            else
+            {
+                // 13 and 14 mean last - 1 and last + 1
+                unsigned int c = (fec != 15) ? last + (fec - (fec ^ 3)) : DecodeIndex(pData, last);
+                last = c;
+
+                WriteTriangle(pDestination, i, indexSize, a, b, c);
+
+                fifos.PushVertex(c);
+                fifos.PushEdge(c, b);
+                fifos.PushEdge(a, c);
+            }
+        }
+        else if (codeTri < 0xfe)
+        {
+            // no edge in the FIFO, the first vertex is new and the others are described by the codeaux table
+            unsigned char codeaux = pCodeauxTable[codeTri & 15];
+            int feb = codeaux >> 4;
+            int fec = codeaux & 15;
+
+            unsigned int a = next++;
+
+            unsigned int b = (feb == 0) ? next : fifos.m_vertices[(fifos.m_vertexOffset - feb) & 15];
+            next += (feb == 0);
+
+            unsigned int c = (fec == 0) ? next : fifos.m_vertices[(fifos.m_vertexOffset - fec) & 15];
+            next += (fec == 0);
+
+            WriteTriangle(pDestination, i, indexSize, a, b, c);
+
+            fifos.PushVertex(a);
+            fifos.PushVertex(b, feb == 0);
+            fifos.PushVertex(c, fec == 0);
+            fifos.PushEdge(b, a);
+            fifos.PushEdge(c, b);
+            fifos.PushEdge(a, c);
+        }
+        else
+        {
+            // same as above but the codeaux byte is in the data and the vertices can be free indices
+            unsigned char codeaux = *pData++;
+            int fea = (codeTri == 0xfe) ? 0 : 15;
+            int feb = codeaux >> 4;
+            int fec = codeaux & 15;
+
+            // 0xfe with a codeaux of 0 restarts the numbering of the new vertices
+            if (codeaux == 0)
+                next = 0;
+
+            unsigned int a = (fea == 0) ? next++ : 0;
+            unsigned int b = (feb == 0) ? next++ : fifos.m_vertices[(fifos.m_vertexOffset - feb) & 15];
+            unsigned int c = (fec == 0) ? next++ : fifos.m_vertices[(fifos.m_vertexOffset - fec) & 15];
+
+            if (fea == 15)
+                last = a = DecodeIndex(pData, last);
+            if (feb == 15)
+                last = b = DecodeIndex(pData, last);
+            if (fec == 15)
+                last = c = DecodeIndex(pData, last);
+
+            WriteTriangle(pDestination, i, indexSize, a, b, c);
+
+            fifos.PushVertex(a);
+            fifos.PushVertex(b, (feb == 0) || (feb == 15));
+            fifos.PushVertex(c, (fec == 0) || (fec == 15));
+            fifos.PushEdge(b, a);
+            fifos.PushEdge(c, b);
+            fifos.PushEdge(a, c);
+        }
+    }
+
+    // all the data has to be used, up to the codeaux table
+    return pData == pDataSafeEnd;
+}
+
+bool MeshoptDecodeIndexSequence(void *pDestination, size_t count, size_t indexSize, const unsigned char *pBuffer, size_t bufferSize)
+{
+    if (indexSize != 2 && indexSize != 4)
+        return false;
+
+    // header, 1 byte per index and a 4 byte tail
+    if (bufferSize < 1 + count + 4)
+        return false;
+
+    if ((pBuffer[0] & 0xf0) != SEQUENCE_HEADER || (pBuffer[0] & 0x0f) > 1)
+        return false;
+
+    const unsigned char *pData = pBuffer + 1;
+    const unsigned char *pDataSafeEnd = pBuffer + bufferSize - 4;
+
+    // indices are deltas against one of the last two baselines
+    unsigned int last[2] = { 0, 0 };
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // a varint is at most 5 bytes, the tail makes the read safe
+        if (pData >= pDataSafeEnd)
+            return false;
+
+        unsigned int v = DecodeVByte(pData);
+
+        unsigned int current = v & 1;
+        v >>= 1;
+
+        unsigned int d = (v >> 1) ^ -int(v & 1);
+        unsigned int index = last[current] + d;
+        last[current] = index;
+
+        if (indexSize == 2)
+            ((unsigned short *)pDestination)[i] = (unsigned short)index;
+        else
+            ((unsigned int *)pDestination)[i] = index;
+    }
+
+    return pData == pDataSafeEnd;
+}
+
+//
+// Filters
+//
+template <class T>
+static void DecodeFilterOct(T *pData, size_t count)
+{
+    // x and y are the octahedral coordinates, z holds the value that encodes 1.0
+    const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float x = float(pData[i * 4 + 0]);
+        float y = float(pData[i * 4 + 1]);
+        float z = float(pData[i * 4 + 2]) - fabsf(x) - fabsf(y);
+
+        // unfold the lower hemisphere
+        float t = (z >= 0.0f) ? 0.0f : z;
+        x += (x >= 0.0f) ? t : -t;
+        y += (y >= 0.0f) ? t : -t;
+
+        float s = max / sqrtf(x * x + y * y + z * z);
+
+        pData[i * 4 + 0] = T(int(x * s + (x >= 0.0f ? 0.5f : -0.5f)));
+        pData[i * 4 + 1] = T(int(y * s + (y >= 0.0f ? 0.5f : -0.5f)));
+        pData[i * 4 + 2] = T(int(z * s + (z >= 0.0f ? 0.5f : -0.5f)));
+    }
+}
+
+void MeshoptDecodeFilterOct(void *pData, size_t count, size_t byteStride)
+{
+    if (byteStride == 4)
+        DecodeFilterOct((signed char *)pData, count);
+    else if (byteStride == 8)
+        DecodeFilterOct((short *)pData, count);
+}
+
+void MeshoptDecodeFilterQuat(void *pData, size_t count, size_t byteStride)
+{
+    if (byteStride != 8)
+        return;
+
+    short *pQuat = (short *)pData;
+    const float scale = 1.0f / sqrtf(2.0f);
+
+    for (size_t i = 0; i < count; i++, pQuat += 4)
+    {
+        // the 4th component has the index of the largest component in the low 2 bits and the scale of the other 3
+        int sf = pQuat[3] | 3;
+        float ss = scale / float(sf);
+
+        float x = float(pQuat[0]) * ss;
+        float y = float(pQuat[1]) * ss;
+        float z = float(pQuat[2]) * ss;
+
+        // the largest component is reconstructed, clamp to avoid NaNs coming from rounding
+        float ww = 1.0f - x * x - y * y - z * z;
+        float w = sqrtf(ww >= 0.0f ? ww : 0.0f);
+
+        int qc = pQuat[3] & 3;
+
+        pQuat[(qc + 1) & 3] = short(int(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f)));
+        pQuat[(qc + 2) & 3] = short(int(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f)));
+        pQuat[(qc + 3) & 3] = short(int(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f)));
+        pQuat[(qc + 0) & 3] = short(int(w * 32767.0f + 0.5f));
+    }
+}
+
+void MeshoptDecodeFilterExp(void *pData, size_t count, size_t byteStride)
+{
+    // each 32 bit value is a 24 bit mantissa and an 8 bit exponent, 4 of them at a time with SSE2
+    //
+    unsigned int *pValues = (unsigned int *)pData;
+    size_t valueCount = count * (byteStride / 4);
+
+    size_t i = 0;
+    for (; i + 4 <= valueCount; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(pValues + i));
+
+        __m128i m = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+        __m128i e = _mm_srai_epi32(v, 24);
+
+        // 2^e built from the exponent bits
+        __m128 f = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+        __m128 r = _mm_mul_ps(f, _mm_cvtepi32_ps(m));
+
+        _mm_storeu_ps((float *)(pValues + i), r);
+    }
+
+    for (; i < valueCount; i++)
+    {
+        unsigned int v = pValues[i];
+        int m = int(v << 8) >> 8;
+        int e = int(v) >> 24;
+
+        unsigned int bits = unsigned(e + 127) << 23;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        f *= float(m);
+
+        memcpy(pValues + i, &f, sizeof(f));
+    }
+}
@@ -0,0 +1,36 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+//
+// Decoders for EXT_meshopt_compression buffer views
+// https://github.com/KhronosGroup/glTF/tree/master/extensions/2.0/Vendor/EXT_meshopt_compression
+//
+// The codecs return false when the data is malformed, the filters work in place on the decoded data.
+// SSSE3 gets used when the CPU supports it.
+//
+
+bool MeshoptDecodeVertexBuffer(void *pDestination, size_t count, size_t byteStride, const unsigned char *pBuffer, size_t bufferSize);
+bool MeshoptDecodeIndexBuffer(void *pDestination, size_t count, size_t indexSize, const unsigned char *pBuffer, size_t bufferSize);
+bool MeshoptDecodeIndexSequence(void *pDestination, size_t count, size_t indexSize, const unsigned char *pBuffer, size_t bufferSize);
+
+void MeshoptDecodeFilterOct(void *pData, size_t count, size_t byteStride);
+void MeshoptDecodeFilterQuat(void *pData, size_t count, size_t byteStride);
+void MeshoptDecodeFilterExp(void *pData, size_t count, size_t byteStride);
@@ -0,0 +1,217 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfCommon.h"
+#include "GltfHelpers.h"
+#include "GltfMorphTargets.h"
+#include "Misc/Misc.h"
+#include <xmmintrin.h>
+
+//
+// The box of the primitive comes from the min and max of POSITION, the targets can move the vertices out of it. Each one grows it by its 
+// most negative and most positive delta on each axis so it holds any weights between 0 and 1. It starts again from the accessor every 
+// time, so compiling the targets twice (or after loading the cooked box) doesn't grow it twice
+//
+static void GrowMorphedBounds(const tfAccessorDesc &position, tfPrimitives *pPrimitive)
+{
+    XMVECTOR growMin = XMVectorZero();
+    XMVECTOR growMax = XMVectorZero();
+    for (const tfMorphTarget &target : pPrimitive->m_targets)
+    {
+        const std::vector<float> &deltas = target.m_deltas[MORPH_POSITION].m_deltas;
+        XMVECTOR targetMin = XMVectorZero();
+        XMVECTOR targetMax = XMVectorZero();
+        for (size_t i = 0; i < deltas.size(); i += 3)
+        {
+            XMVECTOR delta = XMVectorSet(deltas[i + 0], deltas[i + 1], deltas[i + 2], 0.0f);
+            targetMin = XMVectorMin(targetMin, delta);
+            targetMax = XMVectorMax(targetMax, delta);
+        }
+        growMin += targetMin;
+        growMax += targetMax;
+    }
+
+    // POSITION is in floats when it has deltas, its min and max need no dequantization
+    XMVECTOR min = XMVectorSet(position.m_min[0], position.m_min[1], position.m_min[2], 0.0f) + growMin;
+    XMVECTOR max = XMVectorSet(position.m_max[0], position.m_max[1], position.m_max[2], 0.0f) + growMax;
+    pPrimitive->m_center = XMVectorSetW((min + max) * 0.5f, 1.0f);
+    pPrimitive->m_radius = (max - min) * 0.5f;
+}
+
+//
+// Extracts the sparse deltas of the morph targets, only the vertices with a delta that is not zero are kept.
+// The targets are blended in floats, the streams of the primitive need to be floats too. The box of the primitives gets grown by the targets
+//
+void GLTFCommon::CompileMorphTargets()
+{
+    static const char *streamNames[MORPH_STREAM_COUNT] = { "POSITION", "NORMAL" };
+
+    for (int m = 0; m < m_meshes.size(); m++)
+    {
+        for (tfPrimitives &primitive : m_meshes[m].m_pPrimitives)
+        {
+            for (int s = 0; s < MORPH_STREAM_COUNT; s++)
+            {
+                int base = primitive.FindAttribute(streamNames[s]);
+                bool bFloats = base >= 0 && m_accessors[base].m_componentType == 5126 && m_accessors[base].m_dimension == 3; // FLOAT
+                bool bWarned = false;
+
+                for (tfMorphTarget &target : primitive.m_targets)
+                {
+                    tfMorphDeltas &deltas = target.m_deltas[s];
+                    deltas = tfMorphDeltas();
+                    if (target.m_accessors[s] < 0)
+                        continue;
+
+                    const tfAccessorDesc &desc = m_accessors[target.m_accessors[s]];
+                    if (!bFloats || desc.m_dimension != 3)
+                    {
+                        if (!bWarned)
+                            Trace(format("The %s morph targets of mesh %i need the stream in floats, ignored\n", streamNames[s], m));
+                        bWarned = true;
+                        continue;
+                    }
+
+                    tfAccessor accessor;
+                    GetBufferDetails(target.m_accessors[s], &accessor);
+                    int vertexCount = std::min(accessor.m_count, m_accessors[base].m_count);
+
+                    auto addVertex = [&](uint32_t v)
+                    {
+                        float delta[3];
+                        DequantizeToFloat(accessor.Get(v), 1, 0, 3, desc.m_componentType, desc.m_normalized, delta);
+                        if (delta[0] != 0.0f || delta[1] != 0.0f || delta[2] != 0.0f)
+                        {
+                            deltas.m_vertices.push_back(v);
+                            deltas.m_deltas.insert(deltas.m_deltas.end(), delta, delta + 3);
+                        }
+                    };
+
+                    // sparse accessors without a buffer view are zero but for the listed vertices
+                    if (accessor.m_data == NULL)
+                    {
+                        for (int i = 0; i < accessor.m_sparseCount; i++)
+                        {
+                            uint32_t v = accessor.GetSparseIndex(i);
+                            if (v < (uint32_t)vertexCount)
+                                addVertex(v);
+                        }
+                    }
+                    else
+                    {
+                        for (int v = 0; v < vertexCount; v++)
+                            addVertex(v);
+                    }
+                }
+
+                // the base the backends blend the targets on every time the weights change, copied once here
+                primitive.m_morphBase[s].clear();
+                if (HasMorphDeltas(primitive, (tfMorphStream)s))
+                {
+                    tfAccessor stream;
+                    GetBufferDetails(base, &stream);
+                    primitive.m_morphBase[s].resize((size_t)stream.m_count * 3);
+                    stream.CopyTo(primitive.m_morphBase[s].data());
+                }
+
+                if (s == MORPH_POSITION && bFloats && !primitive.m_targets.empty())
+                    GrowMorphedBounds(m_accessors[base], &primitive);
+            }
+        }
+    }
+}
+
+bool HasMorphWeights(const float *pWeights, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (pWeights[i] != 0.0f)
+            return true;
+    }
+    return false;
+}
+
+bool HasMorphDeltas(const tfPrimitives &primitive, tfMorphStream stream)
+{
+    for (const tfMorphTarget &target : primitive.m_targets)
+    {
+        if (!target.m_deltas[stream].m_vertices.empty())
+            return true;
+    }
+    return false;
+}
+
+//
+// The deltas are tightly packed so they get scaled 4 vertices (3 registers) at a time. The vertices are scattered, but the targets
+// tend to move whole regions of the mesh and when the 4 of them are consecutive the sums are done in place too
+//
+void BlendMorphTargets(const tfPrimitives &primitive, tfMorphStream stream, const float *pWeights, float *pVertices)
+{
+    for (size_t t = 0; t < primitive.m_targets.size(); t++)
+    {
+        const tfMorphDeltas &deltas = primitive.m_targets[t].m_deltas[stream];
+        if (pWeights[t] == 0.0f || deltas.m_vertices.empty())
+            continue;
+
+        const uint32_t *pIndices = deltas.m_vertices.data();
+        const float *pDeltas = deltas.m_deltas.data();
+        size_t count = deltas.m_vertices.size();
+        const __m128 weight = _mm_set1_ps(pWeights[t]);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 d0 = _mm_mul_ps(_mm_loadu_ps(pDeltas + i * 3 + 0), weight);
+            __m128 d1 = _mm_mul_ps(_mm_loadu_ps(pDeltas + i * 3 + 4), weight);
+            __m128 d2 = _mm_mul_ps(_mm_loadu_ps(pDeltas + i * 3 + 8), weight);
+
+            // the vertices are sorted, so they are consecutive when the 4th is 3 after the 1st
+            if (pIndices[i + 3] == pIndices[i] + 3)
+            {
+                float *pOut = pVertices + pIndices[i] * 3;
+                _mm_storeu_ps(pOut + 0, _mm_add_ps(_mm_loadu_ps(pOut + 0), d0));
+                _mm_storeu_ps(pOut + 4, _mm_add_ps(_mm_loadu_ps(pOut + 4), d1));
+                _mm_storeu_ps(pOut + 8, _mm_add_ps(_mm_loadu_ps(pOut + 8), d2));
+            }
+            else
+            {
+                float scaled[12];
+                _mm_storeu_ps(scaled + 0, d0);
+                _mm_storeu_ps(scaled + 4, d1);
+                _mm_storeu_ps(scaled + 8, d2);
+                for (int k = 0; k < 4; k++)
+                {
+                    float *pOut = pVertices + pIndices[i + k] * 3;
+                    pOut[0] += scaled[k * 3 + 0];
+                    pOut[1] += scaled[k * 3 + 1];
+                    pOut[2] += scaled[k * 3 + 2];
+                }
+            }
+        }
+
+        for (; i < count; i++)
+        {
+            float *pOut = pVertices + pIndices[i] * 3;
+            pOut[0] += pDeltas[i * 3 + 0] * pWeights[t];
+            pOut[1] += pDeltas[i * 3 + 1] * pWeights[t];
+            pOut[2] += pDeltas[i * 3 + 2] * pWeights[t];
+        }
+    }
+}
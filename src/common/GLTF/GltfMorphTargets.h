@@ -0,0 +1,34 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+//
+// Morph targets blended on the CPU. The deltas of the targets are sparse (tfMorphDeltas), so only the targets with a weight and only the
+// vertices they move get touched. The backends blend the POSITION and NORMAL streams of the morphed nodes into the dynamic buffer ring
+//
+
+// true when a weight is not zero, with all of them at zero the vertices are the ones of the static buffers
+bool HasMorphWeights(const float *pWeights, uint32_t count);
+
+// true when a target of the primitive moves the stream
+bool HasMorphDeltas(const tfPrimitives &primitive, tfMorphStream stream);
+
+// pVertices holds the stream of the primitive, 3 floats per vertex, and gets the deltas of the targets scaled by pWeights added
+void BlendMorphTargets(const tfPrimitives &primitive, tfMorphStream stream, const float *pWeights, float *pVertices);
@@ -0,0 +1,559 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfCommon.h"
+#include "GltfHelpers.h"
+#include "Misc/Misc.h"
+#include "Misc/Async.h"
+
+//
+// Import time mesh optimization, the triangles of each primitive get reordered for the post transform vertex cache and then 
+// clustered to reduce overdraw, finally the vertices get reordered in the order the indices first use them so the fetches are 
+// as linear as possible. The reordered indices and vertex streams are new buffers, so SaveCooked() caches the result.
+//
+// The cache is modeled as a 16 entries FIFO, that is what ACMR (average cache miss ratio, misses per triangle) and 
+// ATVR (average transformed vertex ratio, misses per vertex, 1.0 is perfect) get measured with.
+//
+
+#define VCACHE_SIZE 16
+
+//
+// Forsyth's 'Linear-Speed Vertex Cache Optimisation' scores, the scoring cache is an LRU a bit bigger than the one simulated
+//
+#define VCACHE_SCORE_SIZE 32
+#define VCACHE_MAX_VALENCE 32
+
+struct VertexScoreTable
+{
+    float cache[VCACHE_SCORE_SIZE];
+    float live[VCACHE_MAX_VALENCE];
+
+    VertexScoreTable()
+    {
+        for (int i = 0; i < VCACHE_SCORE_SIZE; i++)
+        {
+            // the last triangle gets the same score for its 3 vertices so the next one doesn't depend on their order
+            cache[i] = (i < 3) ? 0.75f : powf(1.0f - (i - 3) / float(VCACHE_SCORE_SIZE - 3), 1.5f);
+        }
+
+        live[0] = 0.0f;
+        for (int i = 1; i < VCACHE_MAX_VALENCE; i++)
+        {
+            // boost the vertices with few triangles left so these get finished and don't end up as lonely triangles
+            live[i] = 2.0f * powf((float)i, -0.5f);
+        }
+    }
+
+    float Get(int cachePosition, uint32_t liveTriangles) const
+    {
+        if (liveTriangles == 0)
+            return 0.0f;
+
+        float score = (cachePosition >= 0) ? cache[cachePosition] : 0.0f;
+        return score + live[std::min<uint32_t>(liveTriangles, VCACHE_MAX_VALENCE - 1)];
+    }
+};
+
+static const VertexScoreTable s_vertexScores;
+
+//
+// FIFO cache simulation, a vertex is in the cache if it missed less than VCACHE_SIZE misses ago. Returns the misses of the triangle
+//
+static uint32_t UpdateCache(const uint32_t *pTriangle, uint32_t *pTimestamps, uint32_t *pTimestamp)
+{
+    uint32_t misses = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        uint32_t v = pTriangle[k];
+        if (*pTimestamp - pTimestamps[v] > VCACHE_SIZE)
+        {
+            pTimestamps[v] = (*pTimestamp)++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+static void AnalyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t *pMisses, uint32_t *pUniqueVertices)
+{
+    // the timestamps start far enough in the past so all vertices miss the first time
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = VCACHE_SIZE + 1;
+
+    uint32_t misses = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        misses += UpdateCache(&indices[i], timestamps.data(), &timestamp);
+
+    uint32_t uniqueVertices = 0;
+    for (uint32_t t : timestamps)
+        uniqueVertices += (t != 0) ? 1 : 0;
+
+    *pMisses = misses;
+    *pUniqueVertices = uniqueVertices;
+}
+
+//
+// Greedy triangle ordering, picks the triangle with the best score among the ones using the vertices in the cache. 
+// When none of them has triangles left the next triangle in the input order is used, these restarts are returned in pClusters,
+// since the cache starts cold there, they are the boundaries the overdraw optimization can reorder without hurting the cache.
+//
+static void OptimizeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, std::vector<uint32_t> *pOut, std::vector<uint32_t> *pClusters)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    // triangles adjacent to each vertex, the live ones are kept at the front of each list
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        liveTriangles[indices[i]]++;
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + liveTriangles[v];
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = s_vertexScores.Get(-1, liveTriangles[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3 + 0]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<bool> emitted(triangleCount, false);
+
+    uint32_t cache[VCACHE_SCORE_SIZE + 3];
+    uint32_t newCache[VCACHE_SCORE_SIZE + 3];
+    size_t cacheCount = 0;
+
+    pOut->resize(triangleCount * 3);
+    pClusters->clear();
+    pClusters->push_back(0);
+
+    size_t inputCursor = 0;
+    int currentTriangle = 0;
+    for (size_t output = 0; output < triangleCount; output++)
+    {
+        const uint32_t *pTriangle = &indices[currentTriangle * 3];
+        for (int k = 0; k < 3; k++)
+            (*pOut)[output * 3 + k] = pTriangle[k];
+
+        emitted[currentTriangle] = true;
+        triangleScore[currentTriangle] = 0.0f;
+
+        // the triangle vertices go to the front of the LRU
+        size_t newCacheCount = 0;
+        for (int k = 0; k < 3; k++)
+            newCache[newCacheCount++] = pTriangle[k];
+
+        for (size_t i = 0; i < cacheCount; i++)
+        {
+            uint32_t v = cache[i];
+            if (v != pTriangle[0] && v != pTriangle[1] && v != pTriangle[2])
+                newCache[newCacheCount++] = v;
+        }
+
+        // remove the triangle from the adjacency of its vertices
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = pTriangle[k];
+            uint32_t *pList = &adjacency[offsets[v]];
+            for (uint32_t i = 0; i < liveTriangles[v]; i++)
+            {
+                if (pList[i] == (uint32_t)currentTriangle)
+                {
+                    std::swap(pList[i], pList[liveTriangles[v] - 1]);
+                    break;
+                }
+            }
+            liveTriangles[v]--;
+        }
+
+        // update the scores of the vertices that moved in the cache (or fell out of it) and of their triangles
+        for (size_t i = 0; i < newCacheCount; i++)
+        {
+            uint32_t v = newCache[i];
+            float score = s_vertexScores.Get(i < VCACHE_SCORE_SIZE ? (int)i : -1, liveTriangles[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+
+            const uint32_t *pList = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < liveTriangles[v]; j++)
+                triangleScore[pList[j]] += delta;
+        }
+
+        cacheCount = std::min<size_t>(newCacheCount, VCACHE_SCORE_SIZE);
+        memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+
+        // next triangle, the best one among the ones using the cached vertices
+        int bestTriangle = -1;
+        float bestScore = 0.0f;
+        for (size_t i = 0; i < cacheCount; i++)
+        {
+            uint32_t v = cache[i];
+            const uint32_t *pList = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < liveTriangles[v]; j++)
+            {
+                uint32_t t = pList[j];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    bestTriangle = (int)t;
+                }
+            }
+        }
+
+        // dead end, restart from the next triangle in the input order
+        if (bestTriangle < 0 && output + 1 < triangleCount)
+        {
+            while (emitted[inputCursor])
+                inputCursor++;
+
+            bestTriangle = (int)inputCursor;
+            pClusters->push_back((uint32_t)output + 1);
+        }
+
+        currentTriangle = bestTriangle;
+    }
+}
+
+//
+// Splits the hard clusters from OptimizeVertexCache where the running ACMR gets close enough to the ACMR of the cluster 
+// (threshold 1.05 means 5% worse), then sorts the clusters so the ones facing outwards from the center of the primitive go first. 
+// Those are the likely occluders, drawing them first lets the depth test reject more of the rest.
+//
+static void OptimizeOverdraw(const std::vector<uint32_t> &indices, const std::vector<float> &positions, XMFLOAT3 center, const std::vector<uint32_t> &hardClusters, float threshold, std::vector<uint32_t> *pOut)
+{
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = positions.size() / 3;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = VCACHE_SIZE + 1;
+
+    std::vector<uint32_t> clusters;
+    for (size_t c = 0; c < hardClusters.size(); c++)
+    {
+        uint32_t start = hardClusters[c];
+        uint32_t end = (c + 1 < hardClusters.size()) ? hardClusters[c + 1] : (uint32_t)triangleCount;
+
+        timestamp += VCACHE_SIZE + 1;
+        uint32_t clusterMisses = 0;
+        for (uint32_t t = start; t < end; t++)
+            clusterMisses += UpdateCache(&indices[t * 3], timestamps.data(), &timestamp);
+
+        float clusterThreshold = threshold * float(clusterMisses) / float(end - start);
+
+        clusters.push_back(start);
+
+        timestamp += VCACHE_SIZE + 1;
+        uint32_t runningMisses = 0;
+        uint32_t runningTriangles = 0;
+        for (uint32_t t = start; t < end; t++)
+        {
+            runningMisses += UpdateCache(&indices[t * 3], timestamps.data(), &timestamp);
+            runningTriangles++;
+
+            if (float(runningMisses) / float(runningTriangles) <= clusterThreshold)
+            {
+                clusters.push_back(t + 1);
+                timestamp += VCACHE_SIZE + 1;
+                runningMisses = 0;
+                runningTriangles = 0;
+            }
+        }
+
+        // the last split leaves a tail with a bad ACMR (or is empty), merge it with the previous cluster
+        if (clusters.back() != start)
+            clusters.pop_back();
+    }
+
+    // area weighted centroid and average normal of each cluster
+    std::vector<float> sortKeys(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        uint32_t start = clusters[c];
+        uint32_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : (uint32_t)triangleCount;
+
+        XMVECTOR centroid = XMVectorZero();
+        XMVECTOR normal = XMVectorZero();
+        float area = 0.0f;
+        for (uint32_t t = start; t < end; t++)
+        {
+            XMVECTOR p0 = XMLoadFloat3((const XMFLOAT3 *)&positions[indices[t * 3 + 0] * 3]);
+            XMVECTOR p1 = XMLoadFloat3((const XMFLOAT3 *)&positions[indices[t * 3 + 1] * 3]);
+            XMVECTOR p2 = XMLoadFloat3((const XMFLOAT3 *)&positions[indices[t * 3 + 2] * 3]);
+
+            XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+            float triangleArea = XMVectorGetX(XMVector3Length(n));
+
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+
+        centroid = (area > 0.0f) ? centroid / area : XMVectorZero();
+        normal = XMVector3Normalize(normal);
+
+        sortKeys[c] = XMVectorGetX(XMVector3Dot(centroid - XMLoadFloat3(&center), normal));
+    }
+
+    std::vector<uint32_t> order(clusters.size());
+    for (uint32_t c = 0; c < order.size(); c++)
+        order[c] = c;
+
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    pOut->clear();
+    pOut->reserve(indices.size());
+    for (uint32_t c : order)
+    {
+        uint32_t start = clusters[c];
+        uint32_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : (uint32_t)triangleCount;
+        pOut->insert(pOut->end(), indices.begin() + start * 3, indices.begin() + end * 3);
+    }
+}
+
+//
+// Renumbers the vertices in the order the indices first reference them, pRemap holds the old index of each new vertex.
+// Vertices not referenced by any triangle get dropped.
+//
+static void OptimizeVertexFetch(std::vector<uint32_t> *pIndices, size_t vertexCount, std::vector<uint32_t> *pRemap)
+{
+    std::vector<uint32_t> newIndex(vertexCount, UINT32_MAX);
+    pRemap->clear();
+
+    for (uint32_t &index : *pIndices)
+    {
+        if (newIndex[index] == UINT32_MAX)
+        {
+            newIndex[index] = (uint32_t)pRemap->size();
+            pRemap->push_back(index);
+        }
+        index = newIndex[index];
+    }
+}
+
+struct OptimizedPrimitive
+{
+    int meshIndex;
+    int primitiveIndex;
+    bool bRemapVertices;                // false when the vertex streams are shared with other primitives
+
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> remap;        // old index of each new vertex
+
+    uint32_t triangleCount = 0;
+    uint32_t uniqueVertices = 0;
+    uint32_t missesBefore = 0;
+    uint32_t missesAfter = 0;
+};
+
+static void OptimizePrimitive(const GLTFCommon *pGLTFCommon, const tfPrimitives &primitive, float overdrawThreshold, OptimizedPrimitive *pResult)
+{
+    tfAccessor indexAccessor;
+    pGLTFCommon->GetBufferDetails(primitive.m_indices, &indexAccessor);
+
+    const tfAccessorDesc &positionDesc = pGLTFCommon->m_accessors[primitive.FindAttribute("POSITION")];
+    size_t vertexCount = positionDesc.m_count;
+
+    std::vector<uint32_t> indices(indexAccessor.m_count - indexAccessor.m_count % 3);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        const void *pIndex = indexAccessor.Get((int)i);
+        uint32_t index = (indexAccessor.m_type == 4) ? *(const uint32_t *)pIndex : *(const uint16_t *)pIndex;
+
+        // an out of range index would corrupt the adjacency, leave such a primitive as it is
+        if (index >= vertexCount)
+            return;
+
+        indices[i] = index;
+    }
+
+    pResult->triangleCount = (uint32_t)indices.size() / 3;
+    AnalyzeVertexCache(indices, vertexCount, &pResult->missesBefore, &pResult->uniqueVertices);
+
+    std::vector<uint32_t> cacheOptimized;
+    std::vector<uint32_t> hardClusters;
+    OptimizeVertexCache(indices, vertexCount, &cacheOptimized, &hardClusters);
+
+    // positions as floats for the cluster sort, quantized ones are in the same space as the bounds
+    tfAccessor positionAccessor;
+    pGLTFCommon->GetBufferDetails(primitive.FindAttribute("POSITION"), &positionAccessor);
+
+    std::vector<float> positions(vertexCount * 3);
+    for (size_t v = 0; v < vertexCount; v++)
+        DequantizeToFloat(positionAccessor.Get((int)v), 1, 0, 3, positionDesc.m_componentType, positionDesc.m_normalized, &positions[v * 3]);
+
+    XMFLOAT3 center;
+    XMStoreFloat3(&center, primitive.m_center);
+    OptimizeOverdraw(cacheOptimized, positions, center, hardClusters, overdrawThreshold, &pResult->indices);
+
+    uint32_t uniqueVertices;
+    AnalyzeVertexCache(pResult->indices, vertexCount, &pResult->missesAfter, &uniqueVertices);
+
+    // the exporter already did a better job, keep its order
+    if (pResult->missesAfter > pResult->missesBefore)
+    {
+        pResult->indices = indices;
+        pResult->missesAfter = pResult->missesBefore;
+    }
+
+    if (pResult->bRemapVertices)
+        OptimizeVertexFetch(&pResult->indices, vertexCount, &pResult->remap);
+}
+
+//
+// Optional import stage, call it after Load() and before SaveCooked() and the GPU upload. Only indexed triangle lists get optimized.
+// Primitives sharing vertex streams (or with streams of different sizes, or with levels of detail already built) get their triangles 
+// reordered but not their vertices.
+//
+void GLTFCommon::OptimizeMeshes(float overdrawThreshold, AsyncPool *pAsyncPool)
+{
+    Profile p("GLTFCommon::OptimizeMeshes");
+
+    // count the users of each accessor, the vertices of shared streams can't be renumbered
+    std::vector<int> accessorUsers(m_accessors.size(), 0);
+    for (const tfMesh &mesh : m_meshes)
+    {
+        for (const tfPrimitives &primitive : mesh.m_pPrimitives)
+        {
+            if (primitive.m_indices >= 0)
+                accessorUsers[primitive.m_indices]++;
+
+            for (const tfAttribute &attribute : primitive.m_attributes)
+                accessorUsers[attribute.m_accessor]++;
+        }
+    }
+
+    std::vector<OptimizedPrimitive> results;
+    std::vector<bool> indicesOptimized(m_accessors.size(), false);
+    for (int m = 0; m < (int)m_meshes.size(); m++)
+    {
+        for (int i = 0; i < (int)m_meshes[m].m_pPrimitives.size(); i++)
+        {
+            const tfPrimitives &primitive = m_meshes[m].m_pPrimitives[i];
+
+            // shared index buffers get optimized only once
+            int positionAttr = primitive.FindAttribute("POSITION");
+            if (primitive.m_mode != 4 || primitive.m_indices < 0 || positionAttr < 0 || indicesOptimized[primitive.m_indices])
+                continue;
+
+            indicesOptimized[primitive.m_indices] = true;
+
+            OptimizedPrimitive result;
+            result.meshIndex = m;
+            result.primitiveIndex = i;
+            result.bRemapVertices = accessorUsers[primitive.m_indices] == 1 && primitive.m_lods.empty() && primitive.m_targets.empty(); // the targets index the vertices too
+            for (const tfAttribute &attribute : primitive.m_attributes)
+            {
+                if (accessorUsers[attribute.m_accessor] != 1 || m_accessors[attribute.m_accessor].m_count != m_accessors[positionAttr].m_count)
+                    result.bRemapVertices = false;
+            }
+
+            results.push_back(result);
+        }
+    }
+
+    // primitives are optimized concurrently, the tasks only read the scene
+    //
+    Sync primitivesOptimized;
+    for (OptimizedPrimitive &result : results)
+    {
+        ExecAsyncIfThereIsAPool(pAsyncPool, [this, &result, overdrawThreshold]()
+        {
+            OptimizePrimitive(this, m_meshes[result.meshIndex].m_pPrimitives[result.primitiveIndex], overdrawThreshold, &result);
+        }, &primitivesOptimized);
+    }
+
+    primitivesOptimized.Wait();
+
+    // new buffers for the optimized indices and vertex streams
+    //
+    uint32_t triangles = 0, vertices = 0, missesBefore = 0, missesAfter = 0;
+    for (const OptimizedPrimitive &result : results)
+    {
+        if (result.indices.empty())
+            continue;
+
+        const tfPrimitives &primitive = m_meshes[result.meshIndex].m_pPrimitives[result.primitiveIndex];
+
+        tfAccessorDesc *pIndices = &m_accessors[primitive.m_indices];
+        uint32_t indexSize = GetFormatSize(pIndices->m_componentType);
+
+        size_t size = result.indices.size() * indexSize;
+        char *pData = new char[size];
+        for (size_t i = 0; i < result.indices.size(); i++)
+        {
+            if (indexSize == 4)
+                ((uint32_t *)pData)[i] = result.indices[i];
+            else
+                ((uint16_t *)pData)[i] = (uint16_t)result.indices[i];
+        }
+
+        pIndices->m_bufferView = AddBuffer(pData, size);
+        pIndices->m_byteOffset = 0;
+        pIndices->m_count = (int)result.indices.size();
+        pIndices->m_sparseCount = 0;
+
+        if (!result.remap.empty())
+        {
+            for (const tfAttribute &attribute : primitive.m_attributes)
+            {
+                tfAccessor stream;
+                GetBufferDetails(attribute.m_accessor, &stream);
+
+                // vertex elements stay 4 byte aligned, as glTF requires
+                uint32_t elementSize = stream.m_dimension * stream.m_type;
+                uint32_t stride = (elementSize + 3) & ~3;
+
+                size = result.remap.size() * stride;
+                pData = new char[size];
+                memset(pData, 0, size);
+                for (size_t v = 0; v < result.remap.size(); v++)
+                    memcpy(pData + v * stride, stream.Get(result.remap[v]), elementSize);
+
+                tfAccessorDesc *pAccessor = &m_accessors[attribute.m_accessor];
+                pAccessor->m_bufferView = AddBuffer(pData, size);
+                pAccessor->m_byteOffset = 0;
+                pAccessor->m_count = (int)result.remap.size();
+                pAccessor->m_sparseCount = 0;
+                m_bufferViews[pAccessor->m_bufferView].m_byteStride = (stride != elementSize) ? stride : 0;
+            }
+        }
+
+        triangles += result.triangleCount;
+        vertices += result.uniqueVertices;
+        missesBefore += result.missesBefore;
+        missesAfter += result.missesAfter;
+    }
+
+    if (triangles > 0)
+    {
+        Trace(format("OptimizeMeshes: %s, %d primitives, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", m_filename.c_str(), (int)results.size(),
+            float(missesBefore) / triangles, float(missesAfter) / triangles,
+            float(missesBefore) / vertices, float(missesAfter) / vertices));
+    }
+}
@@ -0,0 +1,648 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfCommon.h"
+#include "GltfHelpers.h"
+#include "GltfSimplifier.h"
+#include "Misc/Misc.h"
+#include "Misc/Async.h"
+#include <cfloat>
+#include <unordered_set>
+#include <iterator>
+
+//
+// Sum of squared distances to planes, error(p) = p'Ap + 2b'p + c, A is symmetric. The weight is the sum of the weights of the 
+// planes, dividing by it makes the error an average squared distance
+//
+struct Quadric
+{
+    float a00, a11, a22, a10, a20, a21;
+    float b0, b1, b2;
+    float c;
+    float w;
+};
+
+static Quadric QuadricFromPlane(XMVECTOR normal, XMVECTOR point, float weight)
+{
+    XMFLOAT3 n;
+    XMStoreFloat3(&n, normal);
+    float d = -XMVectorGetX(XMVector3Dot(normal, point));
+
+    Quadric q;
+    q.a00 = n.x * n.x * weight;
+    q.a11 = n.y * n.y * weight;
+    q.a22 = n.z * n.z * weight;
+    q.a10 = n.y * n.x * weight;
+    q.a20 = n.z * n.x * weight;
+    q.a21 = n.z * n.y * weight;
+    q.b0 = n.x * d * weight;
+    q.b1 = n.y * d * weight;
+    q.b2 = n.z * d * weight;
+    q.c = d * d * weight;
+    q.w = weight;
+    return q;
+}
+
+static void QuadricAdd(Quadric *pQ, const Quadric &r)
+{
+    pQ->a00 += r.a00; pQ->a11 += r.a11; pQ->a22 += r.a22;
+    pQ->a10 += r.a10; pQ->a20 += r.a20; pQ->a21 += r.a21;
+    pQ->b0 += r.b0; pQ->b1 += r.b1; pQ->b2 += r.b2;
+    pQ->c += r.c;
+    pQ->w += r.w;
+}
+
+static float QuadricError(const Quadric &q, const XMFLOAT3 &p)
+{
+    float rx = q.b0 * 2.0f + q.a10 * p.y * 2.0f + q.a00 * p.x;
+    float ry = q.b1 * 2.0f + q.a21 * p.z * 2.0f + q.a11 * p.y;
+    float rz = q.b2 * 2.0f + q.a20 * p.x * 2.0f + q.a22 * p.z;
+    float r = q.c + rx * p.x + ry * p.y + rz * p.z;
+
+    return (q.w == 0.0f) ? 0.0f : fabsf(r) / q.w;
+}
+
+//
+// Manifold vertices can collapse onto any neighbour, border ones only onto their neighbours along the border so it doesn't shrink.
+// Seams (vertices sharing their position with others, like UV borders) and non manifold vertices are locked
+//
+enum VertexKind
+{
+    KIND_MANIFOLD,
+    KIND_BORDER,
+    KIND_LOCKED
+};
+
+#define BORDER_WEIGHT 10.0f         // borders are kept harder than the surface
+#define PASS_ERROR_BOUND 1.5f       // a pass takes collapses up to this much more expensive than the one reaching its goal
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return ((uint64_t)a << 32) | b;
+}
+
+class Simplifier
+{
+    std::vector<XMFLOAT3> m_positions;      // normalized to the unit cube so the quadrics stay in float range
+    float m_scale;                          // from the unit cube back to the space of the primitive
+
+    std::vector<uint32_t> m_wedge;          // first vertex with the same position
+    std::vector<uint8_t> m_kind;
+    std::vector<uint32_t> m_borderNext;     // wedge after and before along the open border
+    std::vector<uint32_t> m_borderPrev;
+    std::vector<Quadric> m_quadrics;
+
+    std::vector<uint32_t> m_indices;
+    float m_error = 0.0f;                   // largest collapse error so far, squared and in the unit cube
+
+    void ClassifyVertices();
+    void ComputeQuadrics();
+    bool CanCollapse(uint32_t u, uint32_t v) const;
+    bool HasFlips(uint32_t u, uint32_t v, const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &adjacency, const std::vector<uint32_t> &remap) const;
+    bool BreaksLink(uint32_t u, uint32_t v, const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &adjacency, const std::vector<uint32_t> &remap) const;
+    bool CollapsePass(size_t targetTriangles);
+
+public:
+    Simplifier(const std::vector<XMFLOAT3> &positions, const std::vector<uint32_t> &indices);
+
+    // simplifies until reaching targetTriangles or until no collapse is possible, it continues from the previous call
+    void Simplify(size_t targetTriangles);
+
+    const std::vector<uint32_t> &GetIndices() const { return m_indices; }
+    float GetError() const { return sqrtf(m_error) * m_scale; }
+};
+
+Simplifier::Simplifier(const std::vector<XMFLOAT3> &positions, const std::vector<uint32_t> &indices)
+{
+    XMVECTOR vmin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR vmax = XMVectorReplicate(-FLT_MAX);
+    for (const XMFLOAT3 &p : positions)
+    {
+        vmin = XMVectorMin(vmin, XMLoadFloat3(&p));
+        vmax = XMVectorMax(vmax, XMLoadFloat3(&p));
+    }
+
+    XMFLOAT3 extent;
+    XMStoreFloat3(&extent, vmax - vmin);
+    m_scale = std::max(std::max(extent.x, extent.y), std::max(extent.z, FLT_MIN));
+
+    m_positions.resize(positions.size());
+    for (size_t v = 0; v < positions.size(); v++)
+        XMStoreFloat3(&m_positions[v], (XMLoadFloat3(&positions[v]) - vmin) / m_scale);
+
+    // degenerate triangles would break the classification
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        if (indices[i] != indices[i + 1] && indices[i] != indices[i + 2] && indices[i + 1] != indices[i + 2])
+            m_indices.insert(m_indices.end(), indices.begin() + i, indices.begin() + i + 3);
+    }
+
+    ClassifyVertices();
+    ComputeQuadrics();
+}
+
+void Simplifier::ClassifyVertices()
+{
+    size_t vertexCount = m_positions.size();
+
+    // vertices with the same position share a wedge, the topology is evaluated on wedges
+    std::vector<uint32_t> order(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        order[v] = v;
+
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+    {
+        return memcmp(&m_positions[a], &m_positions[b], sizeof(XMFLOAT3)) < 0;
+    });
+
+    m_wedge.resize(vertexCount);
+    std::vector<uint32_t> wedgeSize(vertexCount, 0);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        bool bSame = i > 0 && memcmp(&m_positions[order[i]], &m_positions[order[i - 1]], sizeof(XMFLOAT3)) == 0;
+        m_wedge[order[i]] = bSame ? m_wedge[order[i - 1]] : order[i];
+        wedgeSize[m_wedge[order[i]]]++;
+    }
+
+    // an edge is open when its opposite doesn't exist, an edge used twice in the same direction is non manifold
+    std::unordered_set<uint64_t> edges;
+    std::vector<bool> bNonManifold(vertexCount, false);
+    for (size_t i = 0; i < m_indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = m_wedge[m_indices[i + k]];
+            uint32_t b = m_wedge[m_indices[i + (k + 1) % 3]];
+            if (!edges.insert(EdgeKey(a, b)).second)
+                bNonManifold[a] = bNonManifold[b] = true;
+        }
+    }
+
+    std::vector<uint32_t> openOut(vertexCount, 0), openIn(vertexCount, 0);
+    m_borderNext.assign(vertexCount, UINT32_MAX);
+    m_borderPrev.assign(vertexCount, UINT32_MAX);
+    for (uint64_t edge : edges)
+    {
+        uint32_t a = (uint32_t)(edge >> 32);
+        uint32_t b = (uint32_t)edge;
+        if (edges.find(EdgeKey(b, a)) == edges.end())
+        {
+            openOut[a]++;
+            openIn[b]++;
+            m_borderNext[a] = b;
+            m_borderPrev[b] = a;
+        }
+    }
+
+    m_kind.resize(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        uint32_t w = m_wedge[v];
+        if (wedgeSize[w] > 1 || bNonManifold[w])
+            m_kind[v] = KIND_LOCKED;
+        else if (openOut[w] == 0 && openIn[w] == 0)
+            m_kind[v] = KIND_MANIFOLD;
+        else if (openOut[w] == 1 && openIn[w] == 1)
+            m_kind[v] = KIND_BORDER;
+        else
+            m_kind[v] = KIND_LOCKED;
+    }
+}
+
+void Simplifier::ComputeQuadrics()
+{
+    Quadric zero = {};
+    m_quadrics.assign(m_positions.size(), zero);
+
+    std::unordered_set<uint64_t> edges;
+    for (size_t i = 0; i < m_indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+            edges.insert(EdgeKey(m_wedge[m_indices[i + k]], m_wedge[m_indices[i + (k + 1) % 3]]));
+    }
+
+    for (size_t i = 0; i < m_indices.size(); i += 3)
+    {
+        XMVECTOR p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = XMLoadFloat3(&m_positions[m_indices[i + k]]);
+
+        XMVECTOR normal = XMVector3Cross(p[1] - p[0], p[2] - p[0]);
+        float area = XMVectorGetX(XMVector3Length(normal));
+        if (area == 0.0f)
+            continue;
+
+        normal = normal / area;
+
+        Quadric q = QuadricFromPlane(normal, p[0], area);
+        for (int k = 0; k < 3; k++)
+            QuadricAdd(&m_quadrics[m_indices[i + k]], q);
+
+        // open edges get a plane perpendicular to the triangle that keeps the border vertices on the border line
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = m_indices[i + k];
+            uint32_t b = m_indices[i + (k + 1) % 3];
+            if (edges.find(EdgeKey(m_wedge[b], m_wedge[a])) != edges.end())
+                continue;
+
+            XMVECTOR edge = p[(k + 1) % 3] - p[k];
+            XMVECTOR edgeNormal = XMVector3Cross(edge, normal);
+            float length = XMVectorGetX(XMVector3Length(edgeNormal));
+            if (length == 0.0f)
+                continue;
+
+            Quadric qb = QuadricFromPlane(edgeNormal / length, p[k], XMVectorGetX(XMVector3LengthSq(edge)) * BORDER_WEIGHT);
+            QuadricAdd(&m_quadrics[a], qb);
+            QuadricAdd(&m_quadrics[b], qb);
+        }
+    }
+}
+
+bool Simplifier::CanCollapse(uint32_t u, uint32_t v) const
+{
+    if (m_kind[u] == KIND_MANIFOLD)
+        return true;
+
+    if (m_kind[u] == KIND_BORDER)
+        return m_borderNext[m_wedge[u]] == m_wedge[v] || m_borderPrev[m_wedge[u]] == m_wedge[v];
+
+    return false;
+}
+
+//
+// Moving u onto v must not flip any of the triangles around u that survive the collapse
+//
+bool Simplifier::HasFlips(uint32_t u, uint32_t v, const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &adjacency, const std::vector<uint32_t> &remap) const
+{
+    XMVECTOR pu = XMLoadFloat3(&m_positions[u]);
+    XMVECTOR pv = XMLoadFloat3(&m_positions[v]);
+
+    for (uint32_t j = offsets[u]; j < offsets[u + 1]; j++)
+    {
+        const uint32_t *pTriangle = &m_indices[adjacency[j] * 3];
+
+        int k = (pTriangle[0] == u) ? 0 : (pTriangle[1] == u) ? 1 : 2;
+        uint32_t b = remap[pTriangle[(k + 1) % 3]];
+        uint32_t c = remap[pTriangle[(k + 2) % 3]];
+
+        // these triangles go away with the collapse
+        if (b == v || c == v || b == c)
+            continue;
+
+        XMVECTOR pb = XMLoadFloat3(&m_positions[b]);
+        XMVECTOR pc = XMLoadFloat3(&m_positions[c]);
+        XMVECTOR before = XMVector3Cross(pb - pu, pc - pu);
+        XMVECTOR after = XMVector3Cross(pb - pv, pc - pv);
+
+        if (XMVectorGetX(XMVector3Dot(before, after)) <= 0.0f)
+            return true;
+    }
+
+    return false;
+}
+
+//
+// Link condition, u and v may only share the vertices opposite to their edge (two of them, one on a border). Otherwise the collapse 
+// pinches the surface and leaves folded triangles
+//
+bool Simplifier::BreaksLink(uint32_t u, uint32_t v, const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &adjacency, const std::vector<uint32_t> &remap) const
+{
+    std::vector<uint32_t> neighboursU, neighboursV;
+    for (uint32_t j = offsets[u]; j < offsets[u + 1]; j++)
+    {
+        for (int k = 0; k < 3; k++)
+            neighboursU.push_back(m_wedge[remap[m_indices[adjacency[j] * 3 + k]]]);
+    }
+
+    for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++)
+    {
+        for (int k = 0; k < 3; k++)
+            neighboursV.push_back(m_wedge[remap[m_indices[adjacency[j] * 3 + k]]]);
+    }
+
+    std::sort(neighboursU.begin(), neighboursU.end());
+    neighboursU.erase(std::unique(neighboursU.begin(), neighboursU.end()), neighboursU.end());
+    std::sort(neighboursV.begin(), neighboursV.end());
+    neighboursV.erase(std::unique(neighboursV.begin(), neighboursV.end()), neighboursV.end());
+
+    std::vector<uint32_t> shared;
+    std::set_intersection(neighboursU.begin(), neighboursU.end(), neighboursV.begin(), neighboursV.end(), std::back_inserter(shared));
+
+    // the intersection includes u and v themselves
+    size_t allowed = (m_kind[u] == KIND_BORDER) ? 3 : 4;
+    return shared.size() > allowed;
+}
+
+//
+// One round of collapses, the cheapest ones first. A vertex takes part in at most one collapse per pass so the costs stay valid.
+// Returns false when nothing could be collapsed
+//
+bool Simplifier::CollapsePass(size_t targetTriangles)
+{
+    size_t vertexCount = m_positions.size();
+    size_t triangleCount = m_indices.size() / 3;
+
+    // triangles around each vertex
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t index : m_indices)
+        offsets[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(m_indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < m_indices.size(); i++)
+        adjacency[fill[m_indices[i]]++] = (uint32_t)(i / 3);
+
+    std::unordered_set<uint64_t> edges;
+    for (size_t i = 0; i < m_indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+            edges.insert(EdgeKey(m_indices[i + k], m_indices[i + (k + 1) % 3]));
+    }
+
+    // every edge once, in the cheapest direction
+    struct Collapse
+    {
+        uint32_t u;
+        uint32_t v;
+        float error;
+    };
+
+    std::vector<Collapse> collapses;
+    for (uint64_t edge : edges)
+    {
+        uint32_t a = (uint32_t)(edge >> 32);
+        uint32_t b = (uint32_t)edge;
+        if (a > b && edges.find(EdgeKey(b, a)) != edges.end())
+            continue;
+
+        float errorAB = CanCollapse(a, b) ? QuadricError(m_quadrics[a], m_positions[b]) : FLT_MAX;
+        float errorBA = CanCollapse(b, a) ? QuadricError(m_quadrics[b], m_positions[a]) : FLT_MAX;
+
+        if (errorAB == FLT_MAX && errorBA == FLT_MAX)
+            continue;
+
+        Collapse collapse;
+        collapse.u = (errorAB <= errorBA) ? a : b;
+        collapse.v = (errorAB <= errorBA) ? b : a;
+        collapse.error = std::min(errorAB, errorBA);
+        collapses.push_back(collapse);
+    }
+
+    if (collapses.empty())
+        return false;
+
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+    // a manifold collapse removes two triangles
+    size_t trianglesToRemove = triangleCount - targetTriangles;
+    size_t goal = std::min(collapses.size() - 1, trianglesToRemove / 2);
+    float errorGoal = collapses[goal].error * PASS_ERROR_BOUND;
+
+    std::vector<uint32_t> remap(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        remap[v] = v;
+
+    std::vector<bool> bLocked(vertexCount, false);
+    size_t removed = 0;
+    for (const Collapse &collapse : collapses)
+    {
+        if (removed >= trianglesToRemove || collapse.error > errorGoal)
+            break;
+
+        if (bLocked[collapse.u] || bLocked[collapse.v])
+            continue;
+
+        if (HasFlips(collapse.u, collapse.v, offsets, adjacency, remap) || BreaksLink(collapse.u, collapse.v, offsets, adjacency, remap))
+            continue;
+
+        remap[collapse.u] = collapse.v;
+        QuadricAdd(&m_quadrics[collapse.v], m_quadrics[collapse.u]);
+        bLocked[collapse.u] = bLocked[collapse.v] = true;
+
+        removed += (m_kind[collapse.u] == KIND_BORDER) ? 1 : 2;
+        m_error = std::max(m_error, collapse.error);
+    }
+
+    if (removed == 0)
+        return false;
+
+    // apply the collapses and drop the triangles that became degenerate
+    size_t write = 0;
+    for (size_t i = 0; i < m_indices.size(); i += 3)
+    {
+        uint32_t a = remap[m_indices[i + 0]];
+        uint32_t b = remap[m_indices[i + 1]];
+        uint32_t c = remap[m_indices[i + 2]];
+        if (a == b || a == c || b == c)
+            continue;
+
+        m_indices[write++] = a;
+        m_indices[write++] = b;
+        m_indices[write++] = c;
+    }
+    m_indices.resize(write);
+
+    return true;
+}
+
+void Simplifier::Simplify(size_t targetTriangles)
+{
+    while (m_indices.size() / 3 > targetTriangles)
+    {
+        if (!CollapsePass(targetTriangles))
+            break;
+    }
+}
+
+struct PrimitiveLods
+{
+    tfPrimitives *pPrimitive;
+    std::vector<std::vector<uint32_t>> indices;
+    std::vector<float> errors;
+};
+
+static void BuildPrimitiveLods(const GLTFCommon *pGLTFCommon, int lodCount, float reduction, PrimitiveLods *pResult)
+{
+    const tfPrimitives &primitive = *pResult->pPrimitive;
+
+    int positionAttr = primitive.FindAttribute("POSITION");
+    const tfAccessorDesc &positionDesc = pGLTFCommon->m_accessors[positionAttr];
+
+    tfAccessor positionAccessor;
+    pGLTFCommon->GetBufferDetails(positionAttr, &positionAccessor);
+
+    std::vector<XMFLOAT3> positions(positionAccessor.m_count);
+    for (int v = 0; v < positionAccessor.m_count; v++)
+        DequantizeToFloat(positionAccessor.Get(v), 1, 0, 3, positionDesc.m_componentType, positionDesc.m_normalized, &positions[v].x);
+
+    tfAccessor indexAccessor;
+    pGLTFCommon->GetBufferDetails(primitive.m_indices, &indexAccessor);
+
+    std::vector<uint32_t> indices(indexAccessor.m_count - indexAccessor.m_count % 3);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        const void *pIndex = indexAccessor.Get((int)i);
+        indices[i] = (indexAccessor.m_type == 4) ? *(const uint32_t *)pIndex : *(const uint16_t *)pIndex;
+        if (indices[i] >= positions.size())
+            return;
+    }
+
+    // each level continues simplifying the previous one, the error only grows
+    Simplifier simplifier(positions, indices);
+    size_t previousTriangles = indices.size() / 3;
+    for (int lod = 1; lod <= lodCount; lod++)
+    {
+        size_t target = (size_t)(indices.size() / 3 * powf(reduction, (float)lod));
+        simplifier.Simplify(target);
+
+        // stop when the mesh doesn't get any simpler, the seams and borders are all that is left
+        size_t triangles = simplifier.GetIndices().size() / 3;
+        if (triangles == 0 || triangles > previousTriangles * 9 / 10)
+            break;
+
+        pResult->indices.push_back(simplifier.GetIndices());
+        pResult->errors.push_back(simplifier.GetError());
+        previousTriangles = triangles;
+    }
+}
+
+//
+// Builds up to lodCount levels of detail per indexed triangle list, each one with 'reduction' times the triangles of the previous one.
+// Call it after OptimizeMeshes() since that one renumbers the vertices, and before SaveCooked() so the levels get cached
+//
+void GLTFCommon::BuildLods(int lodCount, float reduction, AsyncPool *pAsyncPool)
+{
+    Profile p("GLTFCommon::BuildLods");
+
+    std::vector<PrimitiveLods> results;
+    for (tfMesh &mesh : m_meshes)
+    {
+        for (tfPrimitives &primitive : mesh.m_pPrimitives)
+        {
+            primitive.m_lods.clear();
+            if (primitive.m_mode != 4 || primitive.m_indices < 0 || primitive.FindAttribute("POSITION") < 0)
+                continue;
+
+            PrimitiveLods result;
+            result.pPrimitive = &primitive;
+            results.push_back(result);
+        }
+    }
+
+    Sync lodsBuilt;
+    for (PrimitiveLods &result : results)
+    {
+        ExecAsyncIfThereIsAPool(pAsyncPool, [this, &result, lodCount, reduction]()
+        {
+            BuildPrimitiveLods(this, lodCount, reduction, &result);
+        }, &lodsBuilt);
+    }
+
+    lodsBuilt.Wait();
+
+    // each level is a new index accessor like the one of the primitive
+    for (const PrimitiveLods &result : results)
+    {
+        for (size_t lod = 0; lod < result.indices.size(); lod++)
+        {
+            tfAccessorDesc accessor = m_accessors[result.pPrimitive->m_indices];
+            uint32_t indexSize = GetFormatSize(accessor.m_componentType);
+
+            const std::vector<uint32_t> &indices = result.indices[lod];
+            size_t size = indices.size() * indexSize;
+            char *pData = new char[size];
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                if (indexSize == 4)
+                    ((uint32_t *)pData)[i] = indices[i];
+                else
+                    ((uint16_t *)pData)[i] = (uint16_t)indices[i];
+            }
+
+            accessor.m_bufferView = AddBuffer(pData, size);
+            accessor.m_byteOffset = 0;
+            accessor.m_count = (int)indices.size();
+            accessor.m_hasMinMax = false;
+            accessor.m_sparseCount = 0;
+            m_accessors.push_back(accessor);
+
+            tfLod tflod;
+            tflod.m_indices = (int)m_accessors.size() - 1;
+            tflod.m_error = result.errors[lod];
+            result.pPrimitive->m_lods.push_back(tflod);
+        }
+    }
+}
+
+//
+// scale takes the error of the levels from the space of the primitive to the world, center and radius are the world space sphere
+//
+static int SelectLod(const tfPrimitives &primitive, XMVECTOR center, float radius, float scale, XMVECTOR cameraPos, float projectionScale, float maxScreenError)
+{
+    // distance to the bounding sphere of the primitive, inside of it the full detail is used
+    float distance = XMVectorGetX(XMVector3Length(XMVectorSetW(center - cameraPos, 0.0f))) - radius;
+    if (distance <= 0.0f)
+        return 0;
+
+    int lod = 0;
+    for (const tfLod &level : primitive.m_lods)
+    {
+        float screenError = level.m_error * scale * projectionScale / (2.0f * distance);
+        if (screenError > maxScreenError)
+            break;
+
+        lod++;
+    }
+
+    return lod;
+}
+
+int SelectLod(const tfPrimitives &primitive, const XMMATRIX &mWorld, XMVECTOR cameraPos, float projectionScale, float maxScreenError)
+{
+    if (primitive.m_lods.empty())
+        return 0;
+
+    // the largest scale of the world matrix so the error doesn't get underestimated
+    float scale = sqrtf(std::max(XMVectorGetX(XMVector3LengthSq(mWorld.r[0])), std::max(XMVectorGetX(XMVector3LengthSq(mWorld.r[1])), XMVectorGetX(XMVector3LengthSq(mWorld.r[2])))));
+
+    XMVECTOR center = XMVector3Transform(primitive.m_center, mWorld);
+    float radius = XMVectorGetX(XMVector3Length(primitive.m_radius)) * scale;
+    return SelectLod(primitive, center, radius, scale, cameraPos, projectionScale, maxScreenError);
+}
+
+int SelectLod(const tfPrimitives &primitive, const XMFLOAT4 &worldSphere, XMVECTOR cameraPos, float projectionScale, float maxScreenError)
+{
+    if (primitive.m_lods.empty())
+        return 0;
+
+    // the sphere holds the boxes of all the joints, so its ratio to the sphere of the primitive doesn't underestimate the scale either
+    float localRadius = XMVectorGetX(XMVector3Length(primitive.m_radius));
+    float scale = (localRadius > 0.0f) ? worldSphere.w / localRadius : 1.0f;
+
+    return SelectLod(primitive, XMLoadFloat4(&worldSphere), worldSphere.w, scale, cameraPos, projectionScale, maxScreenError);
+}
+
+float GetLodProjectionScale(const Camera &cam)
+{
+    return XMVectorGetY(cam.GetProjection().r[1]);
+}
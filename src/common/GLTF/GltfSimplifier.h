@@ -0,0 +1,43 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+//
+// Levels of detail built at import by GLTFCommon::BuildLods(), each one is an index buffer over the vertices of the primitive 
+// simplified with quadric error metrics (Garland & Heckbert). Vertices on attribute seams (UV borders, hard normals...) are kept 
+// and the open borders of the mesh only collapse along themselves, so the silhouette and the texturing hold.
+//
+// tfLod::m_error is the geometric error in the space of the primitive, SelectLod() projects it on the screen.
+//
+
+class Camera;
+struct tfPrimitives;
+
+//
+// Returns the coarsest level of detail (0 is the primitive itself, i is tfPrimitives::m_lods[i - 1]) whose error, once projected, 
+// is smaller than maxScreenError (a fraction of the screen height, 1.0f/1080 is a pixel at 1080p). 
+// mWorld places the primitive in the world, cameraPos is in world space and projectionScale comes from GetLodProjectionScale()
+//
+int SelectLod(const tfPrimitives &primitive, const XMMATRIX &mWorld, XMVECTOR cameraPos, float projectionScale, float maxScreenError);
+// same with the world space sphere of GLTFCommon::m_worldSpheres, for the skinned primitives (their joints place them, not the node)
+int SelectLod(const tfPrimitives &primitive, const XMFLOAT4 &worldSphere, XMVECTOR cameraPos, float projectionScale, float maxScreenError);
+
+// cotangent of half the vertical field of view, the factor that turns a distance into a fraction of the half screen height
+float GetLodProjectionScale(const Camera &cam);
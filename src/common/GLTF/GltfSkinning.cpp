@@ -0,0 +1,90 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "GltfSkinning.h"
+#include "Misc/Misc.h"
+#include <immintrin.h>
+
+static const bool s_hasAvx2 = CpuHasAvx2();
+
+//
+// Row vectors, each row of the result is the row of A times the 4 rows of B.
+// Two rows of A live in a YMM register, splatting their elements in place gives two rows of the result per instruction
+//
+static void ComputeSkinningMatricesAvx2(const float *pA, const float *pB, uint32_t count, float *pOut)
+{
+    for (uint32_t i = 0; i < count; i++, pA += 16, pB += 16, pOut += 32)
+    {
+        __m256 b0 = _mm256_broadcast_ps((const __m128 *)(pB + 0));
+        __m256 b1 = _mm256_broadcast_ps((const __m128 *)(pB + 4));
+        __m256 b2 = _mm256_broadcast_ps((const __m128 *)(pB + 8));
+        __m256 b3 = _mm256_broadcast_ps((const __m128 *)(pB + 12));
+
+        __m256 a01 = _mm256_loadu_ps(pA + 0);
+        __m256 a23 = _mm256_loadu_ps(pA + 8);
+
+        __m256 c01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+        c01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1, c01);
+        c01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xaa), b2, c01);
+        c01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xff), b3, c01);
+
+        __m256 c23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+        c23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1, c23);
+        c23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0xaa), b2, c23);
+        c23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0xff), b3, c23);
+
+        // the current matrix moves to the previous slot before getting overwritten
+        _mm256_storeu_ps(pOut + 16, _mm256_loadu_ps(pOut + 0));
+        _mm256_storeu_ps(pOut + 24, _mm256_loadu_ps(pOut + 8));
+        _mm256_storeu_ps(pOut + 0, c01);
+        _mm256_storeu_ps(pOut + 8, c23);
+    }
+}
+
+static void ComputeSkinningMatricesSse(const float *pA, const float *pB, uint32_t count, float *pOut)
+{
+    for (uint32_t i = 0; i < count; i++, pA += 16, pB += 16, pOut += 32)
+    {
+        __m128 b0 = _mm_loadu_ps(pB + 0);
+        __m128 b1 = _mm_loadu_ps(pB + 4);
+        __m128 b2 = _mm_loadu_ps(pB + 8);
+        __m128 b3 = _mm_loadu_ps(pB + 12);
+
+        for (int r = 0; r < 4; r++)
+        {
+            __m128 a = _mm_loadu_ps(pA + r * 4);
+            __m128 c = _mm_mul_ps(_mm_shuffle_ps(a, a, 0x00), b0);
+            c = _mm_add_ps(c, _mm_mul_ps(_mm_shuffle_ps(a, a, 0x55), b1));
+            c = _mm_add_ps(c, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xaa), b2));
+            c = _mm_add_ps(c, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xff), b3));
+
+            _mm_storeu_ps(pOut + 16 + r * 4, _mm_loadu_ps(pOut + r * 4));
+            _mm_storeu_ps(pOut + r * 4, c);
+        }
+    }
+}
+
+void ComputeSkinningMatrices(const XMMATRIX *pInverseBinds, const XMMATRIX *pJointMats, uint32_t count, XMMATRIX *pSkinningMats)
+{
+    if (s_hasAvx2)
+        ComputeSkinningMatricesAvx2((const float *)pInverseBinds, (const float *)pJointMats, count, (float *)pSkinningMats);
+    else
+        ComputeSkinningMatricesSse((const float *)pInverseBinds, (const float *)pJointMats, count, (float *)pSkinningMats);
+}
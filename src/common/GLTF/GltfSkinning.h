@@ -0,0 +1,33 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+//
+// Batched skinning matrices, used by GLTFCommon::TransformScene().
+// The joint matrices get gathered in a contiguous array first so the multiplies run over plain arrays, AVX2 (with FMA) is used 
+// when the CPU supports it and SSE otherwise.
+//
+
+//
+// For each of the count joints the current skinning matrix becomes the previous one and the new current one is 
+// pInverseBinds[i] * pJointMats[i]. pSkinningMats holds count pairs of (current, previous) matrices, the layout of Matrix2 
+// and of the skinning constant buffers.
+//
+void ComputeSkinningMatrices(const XMMATRIX *pInverseBinds, const XMMATRIX *pJointMats, uint32_t count, XMMATRIX *pSkinningMats);
@@ -26,7 +26,7 @@
 class tfAccessor
 {
 public:
-    const void *m_data = NULL;
+    const void *m_data = NULL;          // NULL for sparse accessors without a buffer view, the elements that are not overridden are zero
     int m_count = 0;
     int m_stride;
     int m_dimension;
@@ -35,14 +35,83 @@ public:
     XMVECTOR m_min;
     XMVECTOR m_max;
 
+    // sparse accessors, the elements listed in m_sparseIndices (sorted) come from m_sparseValues (tightly packed), the rest from m_data
+    int m_sparseCount = 0;
+    int m_sparseIndexSize = 0;          // 1, 2 or 4 bytes
+    const void *m_sparseIndices = NULL;
+    const void *m_sparseValues = NULL;
+
+    bool IsSparse() const { return m_sparseCount > 0; }
+
+    uint32_t GetSparseIndex(int s) const
+    {
+        switch (m_sparseIndexSize)
+        {
+        case 1: return ((const uint8_t *)m_sparseIndices)[s];
+        case 2: return ((const uint16_t *)m_sparseIndices)[s];
+        default: return ((const uint32_t *)m_sparseIndices)[s];
+        }
+    }
+
     const void *Get(int i) const
     {
         if (i >= m_count)
             i = m_count - 1;
 
+        if (m_sparseCount > 0)
+        {
+            int ini = 0;
+            int fin = m_sparseCount - 1;
+
+            while (ini <= fin)
+            {
+                int mid = (ini + fin) / 2;
+                uint32_t index = GetSparseIndex(mid);
+
+                if ((uint32_t)i < index)
+                    fin = mid - 1;
+                else if ((uint32_t)i > index)
+                    ini = mid + 1;
+                else
+                    return (const char*)m_sparseValues + m_dimension*m_type*mid;
+            }
+
+            // big enough for a MAT4 of floats
+            static const float zeros[16] = {};
+            if (m_data == NULL)
+                return zeros;
+        }
+
         return (const char*)m_data + m_stride*i;
     }
 
+    // writes the elements destinationStride bytes apart (tightly packed by default), the GPU uploads use this to materialize sparse accessors 
+    // and to pad the elements to the size of their vertex format
+    void CopyTo(void *pDestination, size_t destinationStride = 0) const
+    {
+        const size_t elementSize = m_dimension*m_type;
+        if (destinationStride == 0)
+            destinationStride = elementSize;
+        const size_t copySize = std::min(elementSize, destinationStride);
+
+        if (m_data == NULL)
+        {
+            memset(pDestination, 0, destinationStride * m_count);
+        }
+        else
+        {
+            for (int i = 0; i < m_count; i++)
+                memcpy((char*)pDestination + destinationStride*i, (const char*)m_data + m_stride*i, copySize);
+        }
+
+        for (int s = 0; s < m_sparseCount; s++)
+        {
+            uint32_t index = GetSparseIndex(s);
+            if (index < (uint32_t)m_count)
+                memcpy((char*)pDestination + destinationStride*index, (const char*)m_sparseValues + elementSize*s, copySize);
+        }
+    }
+
     int FindClosestFloatIndex(float val) const
     {
         int ini = 0;
@@ -65,15 +134,167 @@ public:
     }
 };
 
+//
+// Typed copies of the glTF tables, these get filled while parsing so the JSON DOM doesn't need to hold them
+//
+// EXT_meshopt_compression, the data of the buffer view is compressed in another buffer and gets decoded when loading
+//
+enum tfMeshoptMode { MESHOPT_MODE_ATTRIBUTES, MESHOPT_MODE_TRIANGLES, MESHOPT_MODE_INDICES };
+enum tfMeshoptFilter { MESHOPT_FILTER_NONE, MESHOPT_FILTER_OCTAHEDRAL, MESHOPT_FILTER_QUATERNION, MESHOPT_FILTER_EXPONENTIAL };
+
+struct tfMeshoptDesc
+{
+    int m_buffer = -1;              // -1 when the buffer view is not compressed
+    uint32_t m_byteOffset = 0;
+    uint32_t m_byteLength = 0;
+    uint32_t m_byteStride = 0;
+    uint32_t m_count = 0;
+    tfMeshoptMode m_mode = MESHOPT_MODE_ATTRIBUTES;
+    tfMeshoptFilter m_filter = MESHOPT_FILTER_NONE;
+};
+
+struct tfBufferViewDesc
+{
+    int m_buffer = -1;
+    uint32_t m_byteOffset = 0;
+    uint32_t m_byteLength = 0;
+    uint32_t m_byteStride = 0;      // 0 means the elements are tightly packed
+    tfMeshoptDesc m_meshopt;
+};
+
+struct tfAccessorDesc
+{
+    int m_bufferView = -1;
+    uint32_t m_byteOffset = 0;
+    int m_componentType = 0;        // 5120 (BYTE) .. 5126 (FLOAT)
+    int m_dimension = 0;            // 1 for SCALAR .. 16 for MAT4
+    int m_count = 0;
+    bool m_normalized = false;
+    bool m_hasMinMax = false;
+    float m_min[4] = { 0, 0, 0, 0 };
+    float m_max[4] = { 0, 0, 0, 0 };
+
+    // sparse accessors, m_sparseCount elements get overridden. The base data is all zeros when m_bufferView is -1
+    int m_sparseCount = 0;
+    int m_sparseIndicesBufferView = -1;
+    uint32_t m_sparseIndicesByteOffset = 0;
+    int m_sparseIndicesComponentType = 0;
+    int m_sparseValuesBufferView = -1;
+    uint32_t m_sparseValuesByteOffset = 0;
+};
+
+struct tfImageDesc
+{
+    std::string m_uri;
+};
+
+struct tfTextureDesc
+{
+    int m_source = -1;
+    int m_sampler = -1;
+};
+
+struct tfAttribute
+{
+    std::string m_name;             // POSITION, NORMAL, TEXCOORD_0...
+    int m_accessor;
+};
+
+//
+// A small cluster of triangles of a primitive with its bounds, built by GLTFCommon::BuildMeshlets(), see GltfMeshlets.h
+//
+struct tfMeshlet
+{
+    uint32_t m_vertexOffset;        // first entry in tfPrimitives::m_meshletVertices
+    uint32_t m_triangleOffset;      // first entry in tfPrimitives::m_meshletTriangles, 3 per triangle
+    uint32_t m_vertexCount;
+    uint32_t m_triangleCount;
+
+    XMFLOAT3 m_center;              // bounding sphere, in the space of the primitive
+    float m_radius;
+
+    // backface cone, all the triangles face away from a camera for which dot(center - camera, axis) >= cutoff * length(center - camera) + radius
+    XMFLOAT3 m_coneAxis;
+    float m_coneCutoff;             // 1 when the normals spread too much for the cluster to ever be backfacing
+};
+
+//
+// Morph targets, the deltas of each target are kept sparse, only the vertices it moves. Built by GLTFCommon::InitTransformedData() from
+// the accessors of the target, see GltfMorphTargets.h
+//
+enum tfMorphStream { MORPH_POSITION, MORPH_NORMAL, MORPH_STREAM_COUNT };
+
+struct tfMorphDeltas
+{
+    std::vector<uint32_t> m_vertices;       // sorted
+    std::vector<float> m_deltas;            // 3 floats per vertex
+};
+
+struct tfMorphTarget
+{
+    int m_accessors[MORPH_STREAM_COUNT] = { -1, -1 };  // POSITION and NORMAL, the TANGENT deltas are ignored
+    tfMorphDeltas m_deltas[MORPH_STREAM_COUNT];
+};
+
+//
+// Skinned primitives, the box of the vertices each joint moves in the space of the mesh (grown by the morph targets), the skinning
+// matrix of the joint takes it to world space. Built by GLTFCommon::InitTransformedData()
+//
+struct tfJointBounds
+{
+    uint32_t m_joint;               // in the joints of the skin
+    XMFLOAT3 m_center;
+    XMFLOAT3 m_extent;
+};
+
+struct tfLod
+{
+    int m_indices;                  // accessor of the index buffer of this level
+    float m_error;                  // geometric error in the space of the primitive
+};
+
 struct tfPrimitives
 {
     XMVECTOR m_center;
     XMVECTOR m_radius;
+
+    std::vector<tfAttribute> m_attributes;  // sorted by name
+    int m_indices = -1;
+    int m_material = -1;
+    int m_mode = 4;                 // TRIANGLES
+
+    // meshlets, empty unless GLTFCommon::BuildMeshlets() was called
+    std::vector<tfMeshlet> m_meshlets;
+    std::vector<uint32_t> m_meshletVertices;    // vertices of the primitive used by each meshlet
+    std::vector<uint8_t> m_meshletTriangles;    // indices into the vertices of the meshlet
+
+    // coarser levels of detail over the same vertices, empty unless GLTFCommon::BuildLods() was called, see GltfSimplifier.h
+    std::vector<tfLod> m_lods;
+
+    std::vector<tfMorphTarget> m_targets;
+    std::vector<float> m_morphBase[MORPH_STREAM_COUNT];  // the POSITION and NORMAL streams the targets move, 3 floats per vertex, empty otherwise
+
+    std::vector<tfJointBounds> m_jointBounds;   // empty unless the primitive has JOINTS_0 and WEIGHTS_0
+
+    // takes a C string so the literals don't build a std::string on every call
+    int FindAttribute(const char *pName) const
+    {
+        for (const tfAttribute &a : m_attributes)
+        {
+            if (strcmp(a.m_name.c_str(), pName) == 0)
+                return a.m_accessor;
+        }
+
+        return -1;
+    }
+
+    int FindAttribute(const std::string &name) const { return FindAttribute(name.c_str()); }
 };
 
 struct tfMesh
 {
     std::vector<tfPrimitives> m_pPrimitives;
+    std::vector<float> m_weights;           // default weights of the morph targets, one per target
 };
 
 struct Transform
@@ -100,6 +321,17 @@ struct tfNode
     std::string m_name;
 
     Transform m_tranform;
+
+    // EXT_mesh_gpu_instancing, range of the instances of the node in GLTFCommon's instance arrays, 0 instances means the node is drawn once
+    uint32_t m_firstInstance = 0;
+    uint32_t m_instanceCount = 0;
+
+    // morph targets, the weights of the node override the ones of the mesh. The range in GLTFCommon::m_morphWeights is set by InitTransformedData()
+    std::vector<float> m_weights;
+    uint32_t m_firstMorphWeight = 0;
+    uint32_t m_morphWeightCount = 0;
+
+    uint32_t m_firstBox = 0;            // world space bounds of its first primitive in GLTFCommon::m_worldBoxes and m_worldSpheres, the rest follow
 };
 
 struct NodeMatrixPostTransform
@@ -110,6 +342,11 @@ struct NodeMatrixPostTransform
 struct tfScene
 {
     std::vector<tfNodeIdx> m_nodes;
+
+    // the hierarchy flattened in level order so it gets transformed in a single linear pass, parents always come before their children
+    std::vector<tfNodeIdx> m_flatNodes;
+    std::vector<tfNodeIdx> m_flatParents;   // parent node of each entry of m_flatNodes, -1 for the roots
+    std::vector<uint32_t> m_levels;         // first entry of each depth level in m_flatNodes, followed by the total count
 };
 
 struct tfSkins
@@ -117,14 +354,149 @@ struct tfSkins
     tfAccessor m_InverseBindMatrices;
     tfNode *m_pSkeleton = NULL;
     std::vector<int> m_jointsNodeIdx;
+    uint32_t m_firstSkinningMat = 0;    // set by GLTFCommon::InitTransformedData()
+    std::vector<tfNodeIdx> m_skinnedNodes;  // the nodes with a mesh that use the skin, set by GLTFCommon::InitTransformedData() too
 };
 
+//
+// Keyframe times of an animation, the samplers with the same input accessor share one track. Playback mostly moves forward a little
+// every frame so the search starts from the key found the last time, the binary search is only used for seeks and loops
+//
+#define TIME_TRACK_MAX_STEPS 4
+
+class tfTimeTrack
+{
+public:
+    const float *m_pTimes = NULL;       // dense, points to the buffer or to m_denseTimes when the accessor is sparse
+    int m_count = 0;
+    std::vector<float> m_denseTimes;
+
+    // the keys to interpolate at the time of the last Seek()
+    int m_curr = 0;
+    int m_next = 0;
+    float m_frac = 0;
+
+    void Seek(float time)
+    {
+        if (m_bSought && time == m_time)
+            return;
+
+        int key = m_key;
+        if (!m_bSought || time < m_time)
+        {
+            key = FindKey(time);
+        }
+        else
+        {
+            for (int steps = 0; key + 1 < m_count && m_pTimes[key + 1] <= time; steps++)
+            {
+                if (steps == TIME_TRACK_MAX_STEPS)
+                {
+                    key = FindKey(time);
+                    break;
+                }
+                key++;
+            }
+        }
+
+        m_bSought = true;
+        m_time = time;
+        m_key = key;
+
+        if (key < 0)
+        {
+            m_curr = m_next = 0;
+            m_frac = 0;
+        }
+        else if (key >= m_count - 1)
+        {
+            m_curr = m_next = m_count - 1;
+            m_frac = 0;
+        }
+        else
+        {
+            m_curr = key;
+            m_next = key + 1;
+            m_frac = (time - m_pTimes[key]) / (m_pTimes[key + 1] - m_pTimes[key]);
+        }
+    }
+
+private:
+    bool m_bSought = false;
+    float m_time = 0;
+    int m_key = -1;                     // last key whose time is not after m_time, -1 when m_time is before the first key
+
+    int FindKey(float time) const
+    {
+        int ini = 0;
+        int fin = m_count - 1;
+
+        while (ini <= fin)
+        {
+            int mid = (ini + fin) / 2;
+            if (time < m_pTimes[mid])
+                fin = mid - 1;
+            else
+                ini = mid + 1;
+        }
+
+        return fin;
+    }
+};
+
+//
+// Keyframes compressed by GLTFCommon::CompressAnimations(), m_value holds 3 16 bit words per key:
+//  - KEYS_QUAT48, smallest three, the largest component is dropped (and made positive), the other three take 15 bits each 
+//    and the low bits of the first two words tell which one was dropped
+//  - KEYS_VECTOR48, each component normalized to the range of the channel, m_rangeMin + m_rangeExtent * word / 65535
+//
+enum tfKeyFormat { KEYS_FLOAT, KEYS_QUAT48, KEYS_VECTOR48 };
+
+// CUBICSPLINE samplers have 3 values per key, the in tangent, the value and the out tangent
+enum tfInterpolation { INTERPOLATION_LINEAR, INTERPOLATION_STEP, INTERPOLATION_CUBICSPLINE };
+
 class tfSampler
 {
 public:
     tfAccessor m_time;
     tfAccessor m_value;
+    int m_timeTrack = -1;               // in tfAnimation::m_timeTracks
+    tfInterpolation m_interpolation = INTERPOLATION_LINEAR;
 
+    tfKeyFormat m_keyFormat = KEYS_FLOAT;
+    float m_rangeMin[3] = {};
+    float m_rangeExtent[3] = {};
+
+    // writes the value of a key as floats, whatever the format
+    void GetKey(int key, float *pValue) const
+    {
+        const uint16_t *pWords = (const uint16_t *)m_value.Get(key);
+        if (m_keyFormat == KEYS_QUAT48)
+        {
+            const float scale = 1.41421356f / 32767.0f;
+            int dropped = (pWords[0] & 1) | ((pWords[1] & 1) << 1);
+            float sum = 0;
+            for (int c = 0, w = 0; c < 4; c++)
+            {
+                if (c == dropped)
+                    continue;
+                pValue[c] = (pWords[w++] >> 1) * scale - 0.70710678f;
+                sum += pValue[c] * pValue[c];
+            }
+            pValue[dropped] = sqrtf(std::max(0.0f, 1.0f - sum));
+        }
+        else if (m_keyFormat == KEYS_VECTOR48)
+        {
+            for (int c = 0; c < 3; c++)
+                pValue[c] = m_rangeMin[c] + m_rangeExtent[c] * (pWords[c] * (1.0f / 65535.0f));
+        }
+        else
+        {
+            memcpy(pValue, pWords, m_value.m_dimension * sizeof(float));
+        }
+    }
+
+    // binary search over all the keys, for one off lookups, only for KEYS_FLOAT and INTERPOLATION_LINEAR
     void SampleLinear(float time, float *frac, float **pCurr, float **pNext) const
     {
         int curr_index = m_time.FindClosestFloatIndex(time);
@@ -148,6 +520,17 @@ public:
         *frac = (time - curr_time) / (next_time - curr_time);
         assert(*frac >= 0 && *frac <= 1.0);
     }
+
+    // same as above but the keys come from the cursor of the time track, pTimeTracks is tfAnimation::m_timeTracks
+    void SampleLinear(float time, tfTimeTrack *pTimeTracks, float *frac, float **pCurr, float **pNext) const
+    {
+        tfTimeTrack &track = pTimeTracks[m_timeTrack];
+        track.Seek(time);
+
+        *frac = track.m_frac;
+        *pCurr = (float*)m_value.Get(track.m_curr);
+        *pNext = (float*)m_value.Get(track.m_next);
+    }
 };
 
 class tfChannel
@@ -158,17 +541,111 @@ public:
         delete m_pTranslation;
         delete m_pRotation;
         delete m_pScale;
+        delete m_pWeights;
     }
 
     tfSampler *m_pTranslation;
     tfSampler *m_pRotation;
     tfSampler *m_pScale;
+    tfSampler *m_pWeights;              // morph target weights, the values hold the weights of all the targets of each key
+};
+
+//
+// Animations compiled for evaluation, see GltfAnimation.h. The channels of each path are kept in plain arrays and the pose, the 
+// translation, rotation and scale of the animated nodes, in SoA streams of m_stride floats
+//
+enum tfPoseStream { POSE_TX, POSE_TY, POSE_TZ, POSE_RX, POSE_RY, POSE_RZ, POSE_RW, POSE_SX, POSE_SY, POSE_SZ, POSE_STREAM_COUNT };
+
+struct tfAnimationChannels
+{
+    std::vector<int> m_slots;               // the animated node the channel writes, an index in tfCompiledAnimation::m_nodes
+    std::vector<int> m_timeTracks;          // in tfAnimation::m_timeTracks
+    std::vector<const float *> m_values;    // keyframes, m_strides[i] floats apart
+    std::vector<int> m_strides;
+    std::vector<const tfSampler *> m_decoders;  // the sampler when its keyframes are compressed, NULL for floats
+    std::vector<uint8_t> m_steps;           // 1 for STEP interpolation, the key holds until the next one
+};
+
+struct tfWeightChannel
+{
+    uint32_t m_firstWeight;                 // where the weights of the node start in GLTFCommon::m_morphWeights
+    uint32_t m_count;                       // morph targets of the node
+    int m_timeTrack;
+    const float *m_pValues;                 // m_count floats per key, 3 times that for CUBICSPLINE (in tangents, values and out tangents)
+    tfInterpolation m_interpolation;
+};
+
+struct tfCompiledAnimation
+{
+    std::vector<int> m_nodes;               // the animated nodes, sorted
+    uint32_t m_stride = 0;                  // m_nodes.size() rounded up to a multiple of 4
+    std::vector<float> m_pose;              // the last evaluated pose, starts with the rest pose of the nodes for the paths without channels
+
+    tfAnimationChannels m_translations;
+    tfAnimationChannels m_rotations;
+    tfAnimationChannels m_scales;
+
+    // CUBICSPLINE channels, these interpolate the tangents too
+    tfAnimationChannels m_cubicTranslations;
+    tfAnimationChannels m_cubicRotations;
+    tfAnimationChannels m_cubicScales;
+
+    // morph target weights, one channel per node
+    std::vector<tfWeightChannel> m_weights;
+
+    std::vector<float> m_unpackedValues;    // keyframes of the sparse accessors
 };
 
 struct tfAnimation
 {
     float m_duration;
     std::map<int, tfChannel> m_channels;
+    std::vector<tfTimeTrack> m_timeTracks;  // built by GLTFCommon::CompileAnimations(), SetAnimationTime() moves their cursors
+    tfCompiledAnimation m_compiled;         // built by GLTFCommon::CompileAnimations() too
+};
+
+//
+// Crowds, the poses of many instances of the scene playing the same animation at their own times, see SampleAnimationInstances()
+//
+struct tfAnimationInstances
+{
+    std::vector<float> m_poses;             // the pose of each instance in the layout of tfCompiledAnimation::m_pose, m_poseSize floats apart
+    uint32_t m_poseSize = 0;
+
+    // scratch, kept so evaluating the crowd every frame doesn't allocate
+    std::vector<float> m_times;             // looped time of each instance
+    std::vector<uint32_t> m_order;          // the instances sorted by time
+    std::vector<tfTimeTrack> m_cursors;     // one per time track of the animation, walked once through the sorted times
+    std::vector<int> m_keys;                // curr and next keys of each time track for each entry of m_order
+    std::vector<float> m_fracs;
+    std::vector<XMVECTOR> m_loaded;         // keyframes loaded for each group of 4 linear channels, reused while the keys don't change
+    std::vector<int> m_loadedKeys;
+};
+
+//
+// Pose blending, see GLTFCommon::SetAnimationLayers(). Each layer samples an animation and blends it on the translation, rotation
+// and scale of the nodes it animates
+//
+struct tfAnimationLayer
+{
+    uint32_t m_animation = 0;
+    float m_time = 0.0f;
+    float m_weight = 1.0f;
+    bool m_bAdditive = false;               // adds the difference between the animation and the rest pose on top of the blended layers
+    const float *m_pJointWeights = NULL;    // mask, one weight per node that scales m_weight, NULL for all the nodes
+};
+
+enum tfPosePoolEntry { POOL_REST, POOL_BLENDED, POOL_ADDITIVE, POOL_RESULT, POOL_POSE_COUNT };
+
+struct tfPosePool
+{
+    uint32_t m_stride = 0;                  // the node count rounded up to a multiple of 4
+    std::vector<float> m_poses;             // POOL_POSE_COUNT poses of POSE_STREAM_COUNT streams indexed by node, POOL_RESULT follows m_nodes
+    std::vector<float> m_weights;           // weight the blended layers put on each node
+    std::vector<int> m_nodes;               // the nodes animated by the last blend, sorted
+    std::vector<uint8_t> m_bTouched;        // whether the node is in m_nodes
+
+    float *GetPose(tfPosePoolEntry entry) { return m_poses.data() + (size_t)entry * POSE_STREAM_COUNT * m_stride; }
 };
 
 struct tfLight
@@ -35,6 +35,47 @@ int GetFormatSize(int id)
     return -1;
 }
 
+//
+// KHR_mesh_quantization, normalized integers map to [0, 1] or [-1, 1], the rest are used as they are
+//
+float DequantizeValue(float value, int id, bool normalized)
+{
+    if (normalized)
+    {
+        switch (id)
+        {
+            case 5120: return std::max<float>(value / 127.0f, -1.0f); //(BYTE)
+            case 5121: return value / 255.0f; //(UNSIGNED_BYTE)
+            case 5122: return std::max<float>(value / 32767.0f, -1.0f); //(SHORT)
+            case 5123: return value / 65535.0f; //(UNSIGNED_SHORT)
+        }
+    }
+    return value;
+}
+
+void DequantizeToFloat(const void *pData, int count, int stride, int dimension, int id, bool normalized, float *pOut)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const char *pElement = (const char *)pData + (size_t)stride * i;
+        for (int c = 0; c < dimension; c++)
+        {
+            float value;
+            switch (id)
+            {
+                case 5120: value = ((const int8_t *)pElement)[c]; break;
+                case 5121: value = ((const uint8_t *)pElement)[c]; break;
+                case 5122: value = ((const int16_t *)pElement)[c]; break;
+                case 5123: value = ((const uint16_t *)pElement)[c]; break;
+                case 5124: value = (float)((const int32_t *)pElement)[c]; break;
+                case 5125: value = (float)((const uint32_t *)pElement)[c]; break;
+                default:   value = ((const float *)pElement)[c]; break;
+            }
+            *pOut++ = DequantizeValue(value, id, normalized);
+        }
+    }
+}
+
 int GetDimensions(const std::string &str)
 {
     if (str == "SCALAR")    return  1;
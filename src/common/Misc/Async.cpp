@@ -116,12 +116,12 @@ void AsyncPool::AddAsyncTask(std::function<void()> job, Sync *pSync)
 // ExecAsyncIfThereIsAPool, will use async if there is a pool, otherswise will run the taks synchronously
 //
 
-void ExecAsyncIfThereIsAPool(AsyncPool *pAsyncPool, std::function<void()> job)
+void ExecAsyncIfThereIsAPool(AsyncPool *pAsyncPool, std::function<void()> job, Sync *pSync)
 {
     // use MT if there is a pool
     if (pAsyncPool != NULL)
     {
-        pAsyncPool->AddAsyncTask(job);
+        pAsyncPool->AddAsyncTask(job, pSync);
     }
     else
     {
@@ -100,4 +100,4 @@ public:
     void AddAsyncTask(std::function<void()> job, Sync *pSync = NULL);
 };
 
-void ExecAsyncIfThereIsAPool(AsyncPool *pAsyncPool, std::function<void()> job);
+void ExecAsyncIfThereIsAPool(AsyncPool *pAsyncPool, std::function<void()> job, Sync *pSync = NULL);
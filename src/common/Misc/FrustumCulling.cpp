@@ -0,0 +1,178 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "stdafx.h"
+#include "FrustumCulling.h"
+#include "Misc.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+static const bool s_hasAvx2 = CpuHasAvx2();
+
+void ExtractFrustumPlanes(const XMMATRIX &mViewProj, FrustumPlanes *pPlanes)
+{
+    XMMATRIX m = XMMatrixTranspose(mViewProj);
+    XMVECTOR planes[6] = { m.r[3] + m.r[0], m.r[3] - m.r[0], m.r[3] + m.r[1], m.r[3] - m.r[1], m.r[2], m.r[3] - m.r[2] };
+    for (int i = 0; i < 6; i++)
+    {
+        float length = XMVectorGetX(XMVector3Length(planes[i]));
+        if (length > 1e-20f)
+            XMStoreFloat4(&pPlanes->m_planes[i], planes[i] / length);
+        else
+            pPlanes->m_planes[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+}
+
+void CullingBoxes::Resize(uint32_t count)
+{
+    m_count = count;
+    uint32_t padded = (count + 7) & ~7;
+    for (std::vector<float> *pArray : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ })
+        pArray->resize(padded, 0.0f);
+}
+
+void CullingBoxes::Set(uint32_t index, XMVECTOR center, XMVECTOR extent)
+{
+    m_centerX[index] = XMVectorGetX(center);
+    m_centerY[index] = XMVectorGetY(center);
+    m_centerZ[index] = XMVectorGetZ(center);
+    m_extentX[index] = XMVectorGetX(extent);
+    m_extentY[index] = XMVectorGetY(extent);
+    m_extentZ[index] = XMVectorGetZ(extent);
+}
+
+//
+// Arvo, the extent along each axis is the extent of the box projected on the absolute values of the rows
+//
+void TransformBox(const XMMATRIX &mWorld, XMVECTOR center, XMVECTOR extent, XMVECTOR *pCenter, XMVECTOR *pExtent)
+{
+    *pCenter = XMVector3Transform(center, mWorld);
+    *pExtent = XMVectorAbs(mWorld.r[0]) * XMVectorSplatX(extent) + XMVectorAbs(mWorld.r[1]) * XMVectorSplatY(extent) + XMVectorAbs(mWorld.r[2]) * XMVectorSplatZ(extent);
+}
+
+void CullingBoxes::SetTransformed(uint32_t index, const XMMATRIX &mWorld, XMVECTOR center, XMVECTOR extent)
+{
+    XMVECTOR worldCenter, worldExtent;
+    TransformBox(mWorld, center, extent, &worldCenter, &worldExtent);
+    Set(index, worldCenter, worldExtent);
+}
+
+//
+// A box is out when it is fully behind a plane, that is when the distance of its center is below minus the extent projected on the normal
+//
+static inline void AppendVisible(uint32_t mask, uint32_t first, uint32_t *pVisible, uint32_t *pVisibleCount)
+{
+    unsigned long lane;
+    while (_BitScanForward(&lane, mask))
+    {
+        pVisible[(*pVisibleCount)++] = first + lane;
+        mask &= mask - 1;
+    }
+}
+
+static uint32_t CullBoxesAvx2(const FrustumPlanes &planes, const CullingBoxes &boxes, uint32_t *pVisible)
+{
+    __m256 normalX[6], normalY[6], normalZ[6], distance[6], absX[6], absY[6], absZ[6];
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (int p = 0; p < 6; p++)
+    {
+        normalX[p] = _mm256_set1_ps(planes.m_planes[p].x);
+        normalY[p] = _mm256_set1_ps(planes.m_planes[p].y);
+        normalZ[p] = _mm256_set1_ps(planes.m_planes[p].z);
+        distance[p] = _mm256_set1_ps(planes.m_planes[p].w);
+        absX[p] = _mm256_andnot_ps(signMask, normalX[p]);
+        absY[p] = _mm256_andnot_ps(signMask, normalY[p]);
+        absZ[p] = _mm256_andnot_ps(signMask, normalZ[p]);
+    }
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < boxes.m_count; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&boxes.m_centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&boxes.m_centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&boxes.m_centerZ[i]);
+        __m256 ex = _mm256_loadu_ps(&boxes.m_extentX[i]);
+        __m256 ey = _mm256_loadu_ps(&boxes.m_extentY[i]);
+        __m256 ez = _mm256_loadu_ps(&boxes.m_extentZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 d = _mm256_fmadd_ps(cx, normalX[p], _mm256_fmadd_ps(cy, normalY[p], _mm256_fmadd_ps(cz, normalZ[p], distance[p])));
+            __m256 r = _mm256_fmadd_ps(ex, absX[p], _mm256_fmadd_ps(ey, absY[p], _mm256_mul_ps(ez, absZ[p])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        // the padding lanes are dropped
+        uint32_t lanes = boxes.m_count - i;
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(inside) & ((lanes >= 8) ? 0xff : ((1u << lanes) - 1));
+        AppendVisible(mask, i, pVisible, &visibleCount);
+    }
+
+    return visibleCount;
+}
+
+static uint32_t CullBoxesSse(const FrustumPlanes &planes, const CullingBoxes &boxes, uint32_t *pVisible)
+{
+    __m128 normalX[6], normalY[6], normalZ[6], distance[6], absX[6], absY[6], absZ[6];
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (int p = 0; p < 6; p++)
+    {
+        normalX[p] = _mm_set1_ps(planes.m_planes[p].x);
+        normalY[p] = _mm_set1_ps(planes.m_planes[p].y);
+        normalZ[p] = _mm_set1_ps(planes.m_planes[p].z);
+        distance[p] = _mm_set1_ps(planes.m_planes[p].w);
+        absX[p] = _mm_andnot_ps(signMask, normalX[p]);
+        absY[p] = _mm_andnot_ps(signMask, normalY[p]);
+        absZ[p] = _mm_andnot_ps(signMask, normalZ[p]);
+    }
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < boxes.m_count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&boxes.m_centerX[i]);
+        __m128 cy = _mm_loadu_ps(&boxes.m_centerY[i]);
+        __m128 cz = _mm_loadu_ps(&boxes.m_centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.m_extentX[i]);
+        __m128 ey = _mm_loadu_ps(&boxes.m_extentY[i]);
+        __m128 ez = _mm_loadu_ps(&boxes.m_extentZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, normalX[p]), _mm_mul_ps(cy, normalY[p])), _mm_add_ps(_mm_mul_ps(cz, normalZ[p]), distance[p]));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, absX[p]), _mm_mul_ps(ey, absY[p])), _mm_mul_ps(ez, absZ[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+
+        uint32_t lanes = boxes.m_count - i;
+        uint32_t mask = (uint32_t)_mm_movemask_ps(inside) & ((lanes >= 4) ? 0xf : ((1u << lanes) - 1));
+        AppendVisible(mask, i, pVisible, &visibleCount);
+    }
+
+    return visibleCount;
+}
+
+uint32_t CullBoxes(const FrustumPlanes &planes, const CullingBoxes &boxes, uint32_t *pVisible)
+{
+    if (s_hasAvx2)
+        return CullBoxesAvx2(planes, boxes, pVisible);
+    else
+        return CullBoxesSse(planes, boxes, pVisible);
+}
@@ -0,0 +1,58 @@
+// AMD Cauldron code
+// 
+// Copyright(c) 2020 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+using namespace DirectX;
+
+//
+// Frustum culling of many boxes at once. The planes get extracted once per view and the world space boxes are kept in SoA form,
+// AVX2 tests 8 boxes per iteration (SSE 4 when the CPU doesn't have it) and the visible ones come out as a compact list of indices.
+//
+
+struct FrustumPlanes
+{
+    XMFLOAT4 m_planes[6];                   // left, right, bottom, top, near and far, normalized with the normals pointing inside
+};
+
+// Gribb/Hartmann planes of a view projection (row vectors, D3D clip space), the far plane of an infinite projection never culls
+void ExtractFrustumPlanes(const XMMATRIX &mViewProj, FrustumPlanes *pPlanes);
+
+//
+// Axis aligned boxes as centers and half extents, the arrays are padded to a multiple of 8 entries
+//
+struct CullingBoxes
+{
+    uint32_t m_count = 0;
+    std::vector<float> m_centerX, m_centerY, m_centerZ;
+    std::vector<float> m_extentX, m_extentY, m_extentZ;
+
+    void Resize(uint32_t count);
+    void Set(uint32_t index, XMVECTOR center, XMVECTOR extent);
+    // the box around the transformed one, see TransformBox()
+    void SetTransformed(uint32_t index, const XMMATRIX &mWorld, XMVECTOR center, XMVECTOR extent);
+};
+
+// the box around the transformed box (Arvo), mWorld transforms row vectors
+void TransformBox(const XMMATRIX &mWorld, XMVECTOR center, XMVECTOR extent, XMVECTOR *pCenter, XMVECTOR *pExtent);
+
+// writes the indices of the boxes that are at least partially inside the frustum to pVisible, which holds boxes.m_count entries, and 
+// returns how many there are
+uint32_t CullBoxes(const FrustumPlanes &planes, const CullingBoxes &boxes, uint32_t *pVisible);
@@ -19,6 +19,7 @@
 
 #include "stdafx.h"
 #include "Misc.h"
+#include <intrin.h>
 
 //
 // Get current time in milliseconds
@@ -297,3 +298,16 @@ int countBits(uint32_t v)
     v = (v & 0x33333333) + ((v >> 2) & 0x33333333); // put count of each 4 bits into those 4 bits  
     return ((v + (v >> 4) & 0xF0F0F0F) * 0x1010101) >> 24;
 }
+
+bool CpuHasAvx2()
+{
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 1);
+    bool bOsxsave = (cpuInfo[2] & (1 << 27)) != 0;
+    bool bFma = (cpuInfo[2] & (1 << 12)) != 0;
+    if (!bOsxsave || !bFma || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(cpuInfo, 7, 0);
+    return (cpuInfo[1] & (1 << 5)) != 0;
+}
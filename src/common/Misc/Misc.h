@@ -64,4 +64,7 @@ public:
     }
 };
 
-int countBits(uint32_t v);
\ No newline at end of file
+int countBits(uint32_t v);
+
+// AVX2 and FMA, the CPU needs to support them and the OS to save the YMM registers
+bool CpuHasAvx2();
\ No newline at end of file
@@ -65,6 +65,84 @@ static void SaveTimestamps(float time, const std::vector<TimeStamp> &timeStamps)
     fprintf(bm.f, "\n");
 }
 
+//
+// Optional "animation" section, times the animation paths on the loaded scene before the benchmark starts and writes the 
+// microseconds per call to the results as comments, e.g. 
+//     "animation": { "iterations": 100, "crowdInstances": 256, "layers": [ { "animation": 0 }, { "animation": 1, "weight": 0.5, "additive": true } ] }
+//
+static void BenchmarkAnimation(const json &animation, GLTFCommon *pGltfLoader)
+{
+    if ((pGltfLoader == NULL) || (pGltfLoader->m_animations.size() == 0))
+    {
+        Trace("The animation benchmark needs a scene with animations\n");
+        return;
+    }
+
+    // these get restored at the end so the benchmark starts from the same pose
+    std::vector<XMMATRIX> animatedMats = pGltfLoader->m_animatedMats;
+    std::vector<float> morphWeights = pGltfLoader->m_morphWeights;
+
+    int iterations = std::max(animation.value("iterations", 100), 1);
+    float duration = pGltfLoader->m_animations[0].m_duration;
+
+    // one instance, what the apps do every frame
+    double start = MillisecondsNow();
+    for (int i = 0; i < iterations; i++)
+        pGltfLoader->SetAnimationTime(0, i / 60.0f);
+    fprintf(bm.f, "#SetAnimationTime, %f\n", (MillisecondsNow() - start) * 1000.0 / iterations);
+
+    // a crowd playing animation 0, the instances spread over the animation
+    uint32_t crowdInstances = animation.value("crowdInstances", 0);
+    if (crowdInstances > 0)
+    {
+        std::vector<float> times(crowdInstances);
+        tfAnimationInstances instances;
+        start = MillisecondsNow();
+        for (int i = 0; i < iterations; i++)
+        {
+            for (uint32_t c = 0; c < crowdInstances; c++)
+                times[c] = duration * c / crowdInstances + i / 60.0f;
+            pGltfLoader->SetAnimationTimes(0, times.data(), crowdInstances, &instances);
+        }
+        fprintf(bm.f, "#SetAnimationTimes %u instances, %f\n", crowdInstances, (MillisecondsNow() - start) * 1000.0 / iterations);
+    }
+
+    // blended layers, all of them at the same time
+    std::vector<tfAnimationLayer> layers;
+    auto layersIt = animation.find("layers");
+    if (layersIt != animation.end())
+    {
+        for (const json &layer : *layersIt)
+        {
+            tfAnimationLayer tflayer;
+            tflayer.m_animation = layer.value("animation", 0u);
+            tflayer.m_weight = layer.value("weight", 1.0f);
+            tflayer.m_bAdditive = layer.value("additive", false);
+            if (tflayer.m_animation >= pGltfLoader->m_animations.size())
+            {
+                Trace(format("The animation %u of a layer doesn't exist in the GLTF\n", tflayer.m_animation));
+                continue;
+            }
+            layers.push_back(tflayer);
+        }
+    }
+    if (layers.size() > 0)
+    {
+        start = MillisecondsNow();
+        for (int i = 0; i < iterations; i++)
+        {
+            for (tfAnimationLayer &layer : layers)
+                layer.m_time = i / 60.0f;
+            pGltfLoader->SetAnimationLayers(layers.data(), (uint32_t)layers.size());
+        }
+        fprintf(bm.f, "#SetAnimationLayers %u layers, %f\n", (uint32_t)layers.size(), (MillisecondsNow() - start) * 1000.0 / iterations);
+    }
+
+    pGltfLoader->m_animatedMats = animatedMats;
+    pGltfLoader->m_morphWeights = morphWeights;
+    std::fill(pGltfLoader->m_dirtyNodes.begin(), pGltfLoader->m_dirtyNodes.end(), 1);
+}
+
 //
 //
 //
@@ -94,6 +172,10 @@ void BenchmarkConfig(const json& benchmark, int cameraId, GLTFCommon *pGltfLoade
     fprintf(bm.f, "#deviceName %s\n", deviceName.c_str());
     fprintf(bm.f, "#driverVersion %s\n", driverVersion.c_str());
 
+    auto animation = benchmark.find("animation");
+    if (animation != benchmark.end())
+        BenchmarkAnimation(*animation, pGltfLoader);
+
     bm.timeStep = benchmark.value("timeStep", 1.0f);
 
     //set default timeStart/timEnd